@@ -0,0 +1,64 @@
+#!/bin/bash
+
+# Time yamscan with single random motifs of increasing width and print the
+# time spent per window (in nanoseconds, both strands) for each binary given
+# as an argument (default: bin/yamscan). Comparing a build from before and
+# after a change to the scoring code shows the gain for each width.
+#
+# By default the sequences are scanned with -x over their full lengths, which
+# scores every window with the full PWM. Set YAMSCAN_ARGS=" " to time the
+# default scan instead. Other settings (and their defaults):
+#
+#   WIDTHS="5 10 15 20 25 30 40 50"
+#   SEQ_COUNT=10     SEQ_SIZE=1000000     REPEATS=3
+#
+# bin/yamseed is used to generate the random sequences.
+
+WIDTHS=${WIDTHS:-"5 10 15 20 25 30 40 50"}
+SEQ_COUNT=${SEQ_COUNT:-10}
+SEQ_SIZE=${SEQ_SIZE:-1000000}
+REPEATS=${REPEATS:-3}
+BINS=${@:-bin/yamscan}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+printf ">m\nA [ 1 ]\nC [ 1 ]\nG [ 1 ]\nT [ 1 ]\n" > "$TMP/seed.jaspar"
+bin/yamseed -n "$SEQ_COUNT" -L "$SEQ_SIZE" -r 0 -m "$TMP/seed.jaspar" > "$TMP/seqs.fa" || exit 1
+awk -v size="$SEQ_SIZE" '/^>/ { print substr($1, 2) "\t0\t" size }' \
+  < "$TMP/seqs.fa" > "$TMP/seqs.bed"
+YAMSCAN_ARGS=${YAMSCAN_ARGS:-"-x $TMP/seqs.bed"}
+
+printf "width"
+for bin in $BINS; do printf "\t%s" "$bin"; done
+printf "\n"
+
+for w in $WIDTHS; do
+  awk -v w="$w" 'BEGIN {
+    srand(w)
+    print ">w" w
+    for (i = 1; i <= w; i++) {
+      for (j = 1; j <= 4; j++) c[i, j] = int(rand() * 50)
+      c[i, 4] = 200 - c[i, 1] - c[i, 2] - c[i, 3]
+    }
+    split("A C G T", let, " ")
+    for (j = 1; j <= 4; j++) {
+      printf "%s [", let[j]
+      for (i = 1; i <= w; i++) printf " %d", c[i, j]
+      printf " ]\n"
+    }
+  }' > "$TMP/w$w.jaspar"
+  printf "%s" "$w"
+  for bin in $BINS; do
+    best=
+    for r in $(seq "$REPEATS"); do
+      start=$(date +%s%N)
+      $bin -m "$TMP/w$w.jaspar" -s "$TMP/seqs.fa" $YAMSCAN_ARGS > /dev/null || exit 1
+      elapsed=$(( $(date +%s%N) - start ))
+      if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then best=$elapsed; fi
+    done
+    awk -v t="$best" -v n="$SEQ_COUNT" -v s="$SEQ_SIZE" -v w="$w" \
+      'BEGIN { printf "\t%.2f", t / (n * (s - w + 1)) }'
+  done
+  printf "\n"
+done
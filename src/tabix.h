@@ -0,0 +1,596 @@
+/*
+ *   tabix.h: Writing and querying tabix (.tbi) indexes of BGZF text files
+ *   Copyright (C) 2026  Benjamin Jean-Marie Tremblay
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The index follows the tabix format used by htslib: for each sequence, the
+ * file offsets of the lines are stored per bin of the UCSC binning scheme
+ * (as chunks of consecutive lines), along with a linear index of the first
+ * line overlapping each 16 kbp window. Offsets are BGZF virtual offsets: the
+ * offset of a block in the compressed file shifted left by 16 bits, plus the
+ * position within the uncompressed block.
+ *
+ * Indexes are built from lines pushed in sorted order (tbx_push), and
+ * written BGZF-compressed with zout.h. Reading one back (tbx_load) allows
+ * iterating over the lines of a BGZF file overlapping a region (tbx_query and
+ * tbx_next). Coordinates are 0-based and half-open throughout; the conf of
+ * the index says how to get them from the columns of a line.
+ *
+ * Only the .tbi format is supported, limiting positions to 2^29 (512 Mbp).
+ */
+
+#ifndef TABIX_H
+#define TABIX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <zlib.h>
+#include "kseq.h"
+#include "zout.h"
+
+#define TBX_MAX_POS       ((uint64_t) 1 << 29)
+#define TBX_MAX_BIN                     37450      /* Also the pseudo-bin */
+#define TBX_LIDX_SHIFT                     14
+#define TBX_UCSC                      0x10000      /* 0-based coordinates */
+
+#define TBX_MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define TBX_MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+typedef struct tbx_conf_t {
+  int32_t               preset;            /* 0, or TBX_UCSC for BED    */
+  int32_t               sc;                /* Columns, from 1           */
+  int32_t               bc;
+  int32_t               ec;
+  int32_t               meta;
+  int32_t               skip;
+} tbx_conf_t;
+
+typedef struct tbx_chunk_t {
+  uint64_t              beg;
+  uint64_t              end;
+} tbx_chunk_t;
+
+typedef struct tbx_bin_t {
+  uint32_t              bin;
+  uint64_t              n;
+  uint64_t              n_alloc;
+  tbx_chunk_t          *chunks;
+} tbx_bin_t;
+
+typedef struct tbx_ref_t {
+  char                 *name;
+  tbx_bin_t            *bins;              /* Indexed by bin number     */
+  uint32_t             *used;              /* Bins with chunks, in order */
+  uint64_t              n_used;
+  uint64_t             *lidx;
+  uint64_t              n_lidx;
+  uint64_t              off_beg;
+  uint64_t              off_end;
+  uint64_t              n_lines;
+} tbx_ref_t;
+
+typedef struct tbx_t {
+  tbx_conf_t            conf;
+  tbx_ref_t            *refs;
+  uint64_t              n;
+  uint64_t              n_alloc;
+  /* Iteration, see tbx_query */
+  FILE                 *f;
+  unsigned char        *cblock;
+  unsigned char        *block;
+  uint64_t              block_off;
+  uint64_t              next_off;
+  uint64_t              block_size;
+  uint64_t              block_pos;
+  tbx_chunk_t          *iter;
+  uint64_t              iter_n;
+  uint64_t              iter_i;
+  int64_t               iter_ref;
+  uint64_t              iter_beg;
+  uint64_t              iter_end;
+  int                   iter_header;
+  int                   iter_in_chunk;
+} tbx_t;
+
+/* Smallest bin containing [beg, end) */
+static inline uint32_t tbx_reg2bin(const uint64_t beg, uint64_t end) {
+  end--;
+  if (beg >> 14 == end >> 14) return ((1 << 15) - 1) / 7 + (beg >> 14);
+  if (beg >> 17 == end >> 17) return ((1 << 12) - 1) / 7 + (beg >> 17);
+  if (beg >> 20 == end >> 20) return ((1 <<  9) - 1) / 7 + (beg >> 20);
+  if (beg >> 23 == end >> 23) return ((1 <<  6) - 1) / 7 + (beg >> 23);
+  if (beg >> 26 == end >> 26) return ((1 <<  3) - 1) / 7 + (beg >> 26);
+  return 0;
+}
+
+/* All bins which may overlap [beg, end); list needs TBX_MAX_BIN entries */
+static inline uint64_t tbx_reg2bins(const uint64_t beg, uint64_t end, uint32_t *list) {
+  static const uint32_t offsets[5] = { 1, 9, 73, 585, 4681 };
+  uint64_t n = 0;
+  end--;
+  list[n++] = 0;
+  for (int l = 0; l < 5; l++) {
+    const int shift = 26 - 3 * l;
+    for (uint64_t k = offsets[l] + (beg >> shift); k <= offsets[l] + (end >> shift); k++) {
+      list[n++] = k;
+    }
+  }
+  return n;
+}
+
+static inline tbx_t *tbx_init(const tbx_conf_t conf) {
+  tbx_t *idx = calloc(1, sizeof(tbx_t));
+  if (idx != NULL) idx->conf = conf;
+  return idx;
+}
+
+static inline void tbx_destroy(tbx_t *idx) {
+  if (idx == NULL) return;
+  for (uint64_t i = 0; i < idx->n; i++) {
+    tbx_ref_t *ref = &idx->refs[i];
+    if (ref->bins != NULL) {
+      for (uint64_t j = 0; j < ref->n_used; j++) free(ref->bins[ref->used[j]].chunks);
+      free(ref->bins);
+    }
+    free(ref->used);
+    free(ref->lidx);
+    free(ref->name);
+  }
+  free(idx->refs);
+  if (idx->f != NULL) fclose(idx->f);
+  free(idx->cblock);
+  free(idx->block);
+  free(idx->iter);
+  free(idx);
+}
+
+static inline tbx_ref_t *tbx_add_ref(tbx_t *idx, const char *name, const uint64_t name_size) {
+  if (idx->n == idx->n_alloc) {
+    tbx_ref_t *refs = realloc(idx->refs, sizeof(tbx_ref_t) * (idx->n_alloc + 64));
+    if (refs == NULL) return NULL;
+    idx->refs = refs;
+    idx->n_alloc += 64;
+  }
+  tbx_ref_t *ref = &idx->refs[idx->n];
+  memset(ref, 0, sizeof(tbx_ref_t));
+  ref->name = malloc(name_size + 1);
+  ref->bins = calloc(TBX_MAX_BIN + 1, sizeof(tbx_bin_t));
+  if (ref->name == NULL || ref->bins == NULL) {
+    free(ref->name);
+    free(ref->bins);
+    return NULL;
+  }
+  memcpy(ref->name, name, name_size);
+  ref->name[name_size] = '\0';
+  idx->n++;
+  return ref;
+}
+
+static inline int tbx_push_chunk(tbx_ref_t *ref, const uint32_t bin, const uint64_t beg, const uint64_t end) {
+  tbx_bin_t *b = &ref->bins[bin];
+  if (b->n && b->chunks[b->n - 1].end == beg) {
+    b->chunks[b->n - 1].end = end;
+    return 0;
+  }
+  if (!b->n_alloc) {
+    uint32_t *used = realloc(ref->used, sizeof(uint32_t) * (ref->n_used + 1));
+    if (used == NULL) return 1;
+    ref->used = used;
+    ref->used[ref->n_used++] = bin;
+  }
+  if (b->n == b->n_alloc) {
+    tbx_chunk_t *chunks = realloc(b->chunks, sizeof(tbx_chunk_t) * (b->n_alloc + 16));
+    if (chunks == NULL) return 1;
+    b->chunks = chunks;
+    b->n_alloc += 16;
+  }
+  b->chunks[b->n].beg = beg;
+  b->chunks[b->n].end = end;
+  b->n++;
+  b->bin = bin;
+  return 0;
+}
+
+/* Add a line covering [beg, end) of sequence name, stored between the virtual
+ * offsets off_beg and off_end. Lines must come sorted by position, with all
+ * lines of a sequence together. Returns 1 if out of memory.
+ */
+static inline int tbx_push(tbx_t *idx, const char *name, const uint64_t name_size, const uint64_t beg, uint64_t end, const uint64_t off_beg, const uint64_t off_end) {
+  tbx_ref_t *ref = idx->n ? &idx->refs[idx->n - 1] : NULL;
+  if (ref == NULL || strlen(ref->name) != name_size || memcmp(ref->name, name, name_size)) {
+    if ((ref = tbx_add_ref(idx, name, name_size)) == NULL) return 1;
+    ref->off_beg = off_beg;
+  }
+  if (end <= beg) end = beg + 1;
+  const uint64_t w_end = (end - 1) >> TBX_LIDX_SHIFT;
+  if (w_end >= ref->n_lidx) {
+    uint64_t *lidx = realloc(ref->lidx, sizeof(uint64_t) * (w_end + 1));
+    if (lidx == NULL) return 1;
+    ref->lidx = lidx;
+    for (uint64_t w = ref->n_lidx; w <= w_end; w++) ref->lidx[w] = UINT64_MAX;
+    ref->n_lidx = w_end + 1;
+  }
+  for (uint64_t w = beg >> TBX_LIDX_SHIFT; w <= w_end; w++) {
+    if (ref->lidx[w] == UINT64_MAX) ref->lidx[w] = off_beg;
+  }
+  ref->off_end = off_end;
+  ref->n_lines++;
+  return tbx_push_chunk(ref, tbx_reg2bin(beg, end), off_beg, off_end);
+}
+
+static inline void tbx_put32(FILE *f, const uint32_t x) {
+  unsigned char b[4];
+  zout_put_u32(b, x);
+  fwrite(b, 1, 4, f);
+}
+
+static inline void tbx_put64(FILE *f, const uint64_t x) {
+  tbx_put32(f, x & 0xffffffff);
+  tbx_put32(f, x >> 32);
+}
+
+/* Write the index to path, BGZF-compressed. Returns 1 on failure. */
+static inline int tbx_write(const tbx_t *idx, const char *path, const char **err) {
+  FILE *dest = fopen(path, "wb");
+  if (dest == NULL) {
+    *err = "failed to create index file";
+    return 1;
+  }
+  FILE *f = zout_open(dest, ZOUT_BGZF, Z_DEFAULT_COMPRESSION, 1, 1, NULL, err);
+  if (f == NULL) {
+    fclose(dest);
+    return 1;
+  }
+  uint64_t names_size = 0;
+  for (uint64_t i = 0; i < idx->n; i++) names_size += strlen(idx->refs[i].name) + 1;
+  fwrite("TBI\1", 1, 4, f);
+  tbx_put32(f, idx->n);
+  tbx_put32(f, idx->conf.preset);
+  tbx_put32(f, idx->conf.sc);
+  tbx_put32(f, idx->conf.bc);
+  tbx_put32(f, idx->conf.ec);
+  tbx_put32(f, idx->conf.meta);
+  tbx_put32(f, idx->conf.skip);
+  tbx_put32(f, names_size);
+  for (uint64_t i = 0; i < idx->n; i++) {
+    fwrite(idx->refs[i].name, 1, strlen(idx->refs[i].name) + 1, f);
+  }
+  for (uint64_t i = 0; i < idx->n; i++) {
+    const tbx_ref_t *ref = &idx->refs[i];
+    tbx_put32(f, ref->n_used + 1);
+    for (uint64_t j = 0; j < ref->n_used; j++) {
+      const tbx_bin_t *b = &ref->bins[ref->used[j]];
+      tbx_put32(f, b->bin);
+      tbx_put32(f, b->n);
+      for (uint64_t k = 0; k < b->n; k++) {
+        tbx_put64(f, b->chunks[k].beg);
+        tbx_put64(f, b->chunks[k].end);
+      }
+    }
+    /* htslib's pseudo-bin: offsets of the sequence, then line counts */
+    tbx_put32(f, TBX_MAX_BIN);
+    tbx_put32(f, 2);
+    tbx_put64(f, ref->off_beg);
+    tbx_put64(f, ref->off_end);
+    tbx_put64(f, ref->n_lines);
+    tbx_put64(f, 0);
+    tbx_put32(f, ref->n_lidx);
+    uint64_t prev = ref->off_beg;
+    for (uint64_t w = 0; w < ref->n_lidx; w++) {
+      if (ref->lidx[w] != UINT64_MAX) prev = ref->lidx[w];
+      tbx_put64(f, prev);
+    }
+  }
+  tbx_put64(f, 0);
+  if (fclose(f)) {
+    *err = "failed to write index file";
+    return 1;
+  }
+  return 0;
+}
+
+/* Reading ---------------------------------------------------------------- */
+
+static inline int tbx_read32(gzFile gz, uint32_t *x) {
+  unsigned char b[4];
+  if (gzread(gz, b, 4) != 4) return 1;
+  *x = (uint32_t) b[0] | ((uint32_t) b[1] << 8) | ((uint32_t) b[2] << 16) | ((uint32_t) b[3] << 24);
+  return 0;
+}
+
+static inline int tbx_read64(gzFile gz, uint64_t *x) {
+  uint32_t lo, hi;
+  if (tbx_read32(gz, &lo) || tbx_read32(gz, &hi)) return 1;
+  *x = (uint64_t) lo | ((uint64_t) hi << 32);
+  return 0;
+}
+
+/* Load the index at path, for reading the BGZF file at data_path. */
+static inline tbx_t *tbx_load(const char *path, const char *data_path, const char **err) {
+  gzFile gz = gzopen(path, "rb");
+  if (gz == NULL) {
+    *err = "failed to open index file";
+    return NULL;
+  }
+  tbx_conf_t conf;
+  char magic[4];
+  uint32_t n_ref, x[7], names_size;
+  tbx_t *idx = NULL;
+  char *names = NULL;
+  if (gzread(gz, magic, 4) != 4 || memcmp(magic, "TBI\1", 4)) {
+    *err = "not a tabix index";
+    goto error;
+  }
+  if (tbx_read32(gz, &n_ref)) goto truncated;
+  for (int i = 0; i < 7; i++) {
+    if (tbx_read32(gz, &x[i])) goto truncated;
+  }
+  conf.preset = x[0]; conf.sc = x[1]; conf.bc = x[2]; conf.ec = x[3];
+  conf.meta = x[4]; conf.skip = x[5];
+  names_size = x[6];
+  if ((idx = tbx_init(conf)) == NULL || (names = malloc(names_size + 1)) == NULL) goto error_mem;
+  if (gzread(gz, names, names_size) != (int) names_size) goto truncated;
+  names[names_size] = '\0';
+  const char *name = names;
+  for (uint64_t i = 0; i < n_ref; i++) {
+    if (name >= names + names_size) goto truncated;
+    tbx_ref_t *ref = tbx_add_ref(idx, name, strlen(name));
+    if (ref == NULL) goto error_mem;
+    name += strlen(name) + 1;
+    uint32_t n_bin, bin, n_chunk, n_intv;
+    if (tbx_read32(gz, &n_bin)) goto truncated;
+    for (uint64_t j = 0; j < n_bin; j++) {
+      if (tbx_read32(gz, &bin) || tbx_read32(gz, &n_chunk) || bin > TBX_MAX_BIN) goto truncated;
+      for (uint64_t k = 0; k < n_chunk; k++) {
+        uint64_t beg, end;
+        if (tbx_read64(gz, &beg) || tbx_read64(gz, &end)) goto truncated;
+        if (bin == TBX_MAX_BIN) continue;
+        if (tbx_push_chunk(ref, bin, beg, end)) goto error_mem;
+      }
+    }
+    if (tbx_read32(gz, &n_intv)) goto truncated;
+    ref->lidx = malloc(sizeof(uint64_t) * (n_intv ? n_intv : 1));
+    if (ref->lidx == NULL) goto error_mem;
+    ref->n_lidx = n_intv;
+    for (uint64_t w = 0; w < n_intv; w++) {
+      if (tbx_read64(gz, &ref->lidx[w])) goto truncated;
+    }
+  }
+  free(names);
+  gzclose(gz);
+  idx->f = fopen(data_path, "rb");
+  idx->cblock = malloc(ZOUT_BGZF_MAX_BLOCK);
+  idx->block = malloc(ZOUT_BGZF_MAX_BLOCK);
+  if (idx->f == NULL) {
+    *err = "failed to open indexed file";
+    tbx_destroy(idx);
+    return NULL;
+  }
+  if (idx->cblock == NULL || idx->block == NULL) {
+    *err = "failed to allocate memory for reading the indexed file";
+    tbx_destroy(idx);
+    return NULL;
+  }
+  return idx;
+truncated:
+  *err = "index file is truncated or corrupted";
+  goto error;
+error_mem:
+  *err = "failed to allocate memory for index";
+error:
+  free(names);
+  tbx_destroy(idx);
+  gzclose(gz);
+  return NULL;
+}
+
+/* Read and inflate the BGZF block starting at offset. Returns 1 on failure;
+ * an empty block (the EOF marker) is not a failure.
+ */
+static inline int tbx_read_block(tbx_t *idx, const uint64_t offset) {
+  unsigned char *c = idx->cblock;
+  if (fseeko(idx->f, offset, SEEK_SET) || fread(c, 1, 18, idx->f) != 18) return 1;
+  if (c[0] != 0x1f || c[1] != 0x8b || c[12] != 'B' || c[13] != 'C') return 1;
+  const uint64_t size = ((uint64_t) c[16] | ((uint64_t) c[17] << 8)) + 1;
+  if (size < 26 || fread(c + 18, 1, size - 18, idx->f) != size - 18) return 1;
+  z_stream zs;
+  memset(&zs, 0, sizeof(z_stream));
+  if (inflateInit2(&zs, -15) != Z_OK) return 1;
+  zs.next_in = c + 18;
+  zs.avail_in = size - 26;
+  zs.next_out = idx->block;
+  zs.avail_out = ZOUT_BGZF_MAX_BLOCK;
+  const int ret = inflate(&zs, Z_FINISH);
+  const uint64_t block_size = zs.total_out;
+  inflateEnd(&zs);
+  if (ret != Z_STREAM_END) return 1;
+  idx->block_off = offset;
+  idx->next_off = offset + size;
+  idx->block_size = block_size;
+  idx->block_pos = 0;
+  return 0;
+}
+
+static inline int tbx_seek(tbx_t *idx, const uint64_t voff) {
+  if ((voff >> 16 != idx->block_off || !idx->next_off) && tbx_read_block(idx, voff >> 16)) return 1;
+  idx->block_pos = voff & 0xffff;
+  return 0;
+}
+
+/* Read the next line into line (without the newline). Returns the line
+ * size, -1 at the end of the file, or -2 on failure.
+ */
+static inline int64_t tbx_getline(tbx_t *idx, kstring_t *line) {
+  line->l = 0;
+  for (;;) {
+    while (idx->block_pos >= idx->block_size) {
+      if (tbx_read_block(idx, idx->next_off)) return -2;
+      if (!idx->block_size) return line->l ? (int64_t) line->l : -1;
+    }
+    const unsigned char *s = idx->block + idx->block_pos;
+    const unsigned char *nl = memchr(s, '\n', idx->block_size - idx->block_pos);
+    const uint64_t n = nl != NULL ? (uint64_t) (nl - s) : idx->block_size - idx->block_pos;
+    if (line->l + n + 1 > line->m) {
+      char *tmp = realloc(line->s, line->l + n + 1);
+      if (tmp == NULL) return -2;
+      line->s = tmp;
+      line->m = line->l + n + 1;
+    }
+    memcpy(line->s + line->l, s, n);
+    line->l += n;
+    line->s[line->l] = '\0';
+    idx->block_pos += n + (nl != NULL);
+    if (nl != NULL) return line->l;
+  }
+}
+
+static inline uint64_t tbx_tell(tbx_t *idx) {
+  return (idx->block_off << 16) | idx->block_pos;
+}
+
+/* Get the sequence name (pointer and size) and 0-based range of a line.
+ * Returns 1 if the columns are missing.
+ */
+static inline int tbx_parse(const tbx_conf_t *conf, const char *line, const char **name, uint64_t *name_size, uint64_t *beg, uint64_t *end) {
+  const int32_t last = TBX_MAX(conf->sc, TBX_MAX(conf->bc, conf->ec));
+  const char *field = line;
+  int got = 0;
+  *end = 0;
+  for (int32_t col = 1; col <= last; col++) {
+    const char *tab = strchr(field, '\t');
+    const uint64_t size = tab != NULL ? (uint64_t) (tab - field) : strlen(field);
+    if (col == conf->sc) {
+      *name = field;
+      *name_size = size;
+      got++;
+    }
+    if (col == conf->bc) {
+      *beg = strtoull(field, NULL, 10);
+      if (!(conf->preset & TBX_UCSC) && *beg) *beg -= 1;
+      got++;
+    }
+    if (col == conf->ec) *end = strtoull(field, NULL, 10);
+    if (tab == NULL && col < last) return 1;
+    field = tab + 1;
+  }
+  if (!conf->ec || *end <= *beg) *end = *beg + 1;
+  return got != 2;
+}
+
+/* Set up iterating over the lines overlapping [beg, end) of sequence name
+ * with tbx_next, after the header lines (those starting with the meta
+ * character) at the start of the file. Returns 1 if out of memory; a
+ * sequence missing from the index simply has no lines.
+ */
+static inline int tbx_query(tbx_t *idx, const char *name, const uint64_t beg, const uint64_t end) {
+  idx->iter_n = 0;
+  idx->iter_i = 0;
+  idx->iter_ref = -1;
+  idx->iter_beg = beg;
+  idx->iter_end = end;
+  idx->iter_header = 1;
+  idx->iter_in_chunk = 0;
+  idx->block_size = 0;
+  idx->block_pos = 0;
+  idx->next_off = 0;
+  for (uint64_t i = 0; i < idx->n; i++) {
+    if (!strcmp(idx->refs[i].name, name)) idx->iter_ref = i;
+  }
+  if (idx->iter_ref == -1 || beg >= end) return 0;
+  const tbx_ref_t *ref = &idx->refs[idx->iter_ref];
+  uint32_t *bins = malloc(sizeof(uint32_t) * TBX_MAX_BIN);
+  if (bins == NULL) return 1;
+  const uint64_t n_bins = tbx_reg2bins(beg, TBX_MIN(end, TBX_MAX_POS), bins);
+  const uint64_t w = beg >> TBX_LIDX_SHIFT;
+  const uint64_t min_off = ref->n_lidx ? ref->lidx[TBX_MIN(w, ref->n_lidx - 1)] : 0;
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < n_bins; i++) n += ref->bins[bins[i]].n;
+  free(idx->iter);
+  if ((idx->iter = malloc(sizeof(tbx_chunk_t) * (n ? n : 1))) == NULL) {
+    free(bins);
+    return 1;
+  }
+  for (uint64_t i = 0; i < n_bins; i++) {
+    const tbx_bin_t *b = &ref->bins[bins[i]];
+    for (uint64_t k = 0; k < b->n; k++) {
+      if (b->chunks[k].end > min_off) idx->iter[idx->iter_n++] = b->chunks[k];
+    }
+  }
+  free(bins);
+  /* Sort by start (insertion sort, there are few) and merge overlaps */
+  for (uint64_t i = 1; i < idx->iter_n; i++) {
+    const tbx_chunk_t c = idx->iter[i];
+    uint64_t j = i;
+    while (j > 0 && idx->iter[j - 1].beg > c.beg) {
+      idx->iter[j] = idx->iter[j - 1];
+      j--;
+    }
+    idx->iter[j] = c;
+  }
+  n = 0;
+  for (uint64_t i = 0; i < idx->iter_n; i++) {
+    if (n && idx->iter[i].beg <= idx->iter[n - 1].end) {
+      idx->iter[n - 1].end = TBX_MAX(idx->iter[n - 1].end, idx->iter[i].end);
+    } else {
+      idx->iter[n++] = idx->iter[i];
+    }
+  }
+  idx->iter_n = n;
+  return 0;
+}
+
+/* Next line from tbx_query: 1 for a line, 0 when done, -1 on failure. */
+static inline int tbx_next(tbx_t *idx, kstring_t *line) {
+  if (idx->iter_header) {
+    const int64_t ret = tbx_getline(idx, line);
+    if (ret >= 0 && line->s[0] == idx->conf.meta) return 1;
+    if (ret == -2) return -1;
+    idx->iter_header = 0;
+  }
+  while (idx->iter_i < idx->iter_n) {
+    const tbx_chunk_t *c = &idx->iter[idx->iter_i];
+    if (!idx->iter_in_chunk) {
+      if (tbx_seek(idx, c->beg)) return -1;
+      idx->iter_in_chunk = 1;
+    }
+    while (idx->block_pos >= idx->block_size && idx->block_size) {
+      if (tbx_read_block(idx, idx->next_off)) return -1;
+    }
+    if (!idx->block_size || tbx_tell(idx) >= c->end) {
+      idx->iter_i++;
+      idx->iter_in_chunk = 0;
+      continue;
+    }
+    const int64_t ret = tbx_getline(idx, line);
+    if (ret == -2) return -1;
+    if (ret == -1) break;
+    if (line->s[0] == idx->conf.meta) continue;
+    const char *name;
+    uint64_t name_size, beg, end;
+    if (tbx_parse(&idx->conf, line->s, &name, &name_size, &beg, &end)) continue;
+    const char *ref_name = idx->refs[idx->iter_ref].name;
+    if (strlen(ref_name) != name_size || memcmp(ref_name, name, name_size)) continue;
+    if (beg >= idx->iter_end) break;
+    if (end > idx->iter_beg) return 1;
+  }
+  idx->iter_i = idx->iter_n;
+  return 0;
+}
+
+#endif
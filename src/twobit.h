@@ -0,0 +1,280 @@
+/*
+ *   twobit.h: Read-only access to UCSC .2bit files via mmap
+ *   Copyright (C) 2026  Benjamin Jean-Marie Tremblay
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The whole file is mapped into memory, but only the record headers are read
+ * when opening it. Bases are decoded on request for any range of a sequence,
+ * so only the touched parts of the packed DNA (a quarter of the size of the
+ * equivalent FASTA) end up resident. N blocks are decoded as 'N' and soft
+ * mask blocks as lower case letters, the same as twoBitToFa.
+ *
+ * Both byte orders and version 1 files (64-bit offsets) are supported.
+ */
+
+#ifndef TWOBIT_H
+#define TWOBIT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TWOBIT_MAGIC              0x1A412743
+#define TWOBIT_MAGIC_SWAPPED      0x4327411A
+
+#define TWOBIT_MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define TWOBIT_MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+typedef struct twobit_seq_t {
+  char                 *name;
+  uint64_t              size;
+  uint64_t              n_blocks;          /* Runs of N                 */
+  const unsigned char  *n_starts;
+  const unsigned char  *n_sizes;
+  uint64_t              m_blocks;          /* Runs of lower case letters */
+  const unsigned char  *m_starts;
+  const unsigned char  *m_sizes;
+  const unsigned char  *dna;               /* 4 bases per byte          */
+} twobit_seq_t;
+
+typedef struct twobit_t {
+  unsigned char        *map;
+  uint64_t              map_size;
+  int                   swapped;
+  uint64_t              n;
+  twobit_seq_t         *seqs;
+  const char           *err;
+} twobit_t;
+
+/* Packed byte -> 4 letters (T, C, A, G = 0, 1, 2, 3, first base in the
+ * highest two bits), and packed byte -> counts of each letter.
+ */
+static char twobit_lut[256][4];
+static unsigned char twobit_count_lut[256][4];
+
+static inline uint32_t twobit_u32(const twobit_t *tb, const unsigned char *p) {
+  uint32_t x;
+  memcpy(&x, p, 4);
+  return tb->swapped ? __builtin_bswap32(x) : x;
+}
+
+static inline uint64_t twobit_u64(const twobit_t *tb, const unsigned char *p) {
+  uint64_t x;
+  memcpy(&x, p, 8);
+  return tb->swapped ? __builtin_bswap64(x) : x;
+}
+
+/* j-th value of an array of block starts/sizes */
+static inline uint64_t twobit_block(const twobit_t *tb, const unsigned char *arr, const uint64_t j) {
+  return twobit_u32(tb, arr + 4 * j);
+}
+
+static inline void twobit_close(twobit_t *tb) {
+  if (tb->seqs != NULL) {
+    for (uint64_t i = 0; i < tb->n; i++) free(tb->seqs[i].name);
+    free(tb->seqs);
+    tb->seqs = NULL;
+  }
+  if (tb->map != NULL) {
+    munmap(tb->map, tb->map_size);
+    tb->map = NULL;
+  }
+}
+
+/* Returns 0 on success. On failure tb->err describes the problem and errno
+ * may be set if it was a system error.
+ */
+static inline int twobit_open(twobit_t *tb, const char *path) {
+  static const char letters[4] = { 'T', 'C', 'A', 'G' };
+  memset(tb, 0, sizeof(twobit_t));
+  for (int b = 0; b < 256; b++) {
+    for (int k = 0; k < 4; k++) {
+      twobit_lut[b][k] = letters[(b >> (6 - 2 * k)) & 3];
+      twobit_count_lut[b][k] = ((b & 3) == k) + (((b >> 2) & 3) == k) +
+        (((b >> 4) & 3) == k) + (((b >> 6) & 3) == k);
+    }
+  }
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    tb->err = "failed to open file";
+    return 1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size < 16) {
+    close(fd);
+    tb->err = "file is too small to be a .2bit file";
+    return 1;
+  }
+  tb->map_size = st.st_size;
+  void *map = mmap(NULL, tb->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    tb->err = "failed to mmap file";
+    return 1;
+  }
+  tb->map = map;
+  uint32_t magic;
+  memcpy(&magic, tb->map, 4);
+  if (magic == TWOBIT_MAGIC_SWAPPED) {
+    tb->swapped = 1;
+  } else if (magic != TWOBIT_MAGIC) {
+    tb->err = "bad .2bit signature";
+    twobit_close(tb);
+    return 1;
+  }
+  const uint32_t version = twobit_u32(tb, tb->map + 4);
+  if (version > 1) {
+    tb->err = "unknown .2bit version";
+    twobit_close(tb);
+    return 1;
+  }
+  tb->n = twobit_u32(tb, tb->map + 8);
+  tb->seqs = calloc(tb->n ? tb->n : 1, sizeof(twobit_seq_t));
+  if (tb->seqs == NULL) {
+    tb->err = "failed to allocate memory for sequence index";
+    twobit_close(tb);
+    return 1;
+  }
+  const unsigned char *end = tb->map + tb->map_size;
+  const unsigned char *p = tb->map + 16;
+  for (uint64_t i = 0; i < tb->n; i++) {
+    if (p + 1 > end || p + 1 + *p + (version ? 8 : 4) > end) goto truncated;
+    const uint64_t name_size = *p++;
+    tb->seqs[i].name = malloc(name_size + 1);
+    if (tb->seqs[i].name == NULL) {
+      tb->err = "failed to allocate memory for sequence name";
+      twobit_close(tb);
+      return 1;
+    }
+    memcpy(tb->seqs[i].name, p, name_size);
+    tb->seqs[i].name[name_size] = '\0';
+    p += name_size;
+    uint64_t offset;
+    if (version) {
+      offset = twobit_u64(tb, p);
+      p += 8;
+    } else {
+      offset = twobit_u32(tb, p);
+      p += 4;
+    }
+    /* Record: dnaSize, nBlockCount, nBlockStarts, nBlockSizes, maskBlockCount,
+     * maskBlockStarts, maskBlockSizes, reserved, packedDna
+     */
+    const unsigned char *r = tb->map + offset;
+    if (offset + 8 > tb->map_size) goto truncated;
+    twobit_seq_t *s = &tb->seqs[i];
+    s->size = twobit_u32(tb, r);
+    s->n_blocks = twobit_u32(tb, r + 4);
+    r += 8;
+    if (r + 8 * s->n_blocks + 4 > end) goto truncated;
+    s->n_starts = r;
+    s->n_sizes = r + 4 * s->n_blocks;
+    r += 8 * s->n_blocks;
+    s->m_blocks = twobit_u32(tb, r);
+    r += 4;
+    if (r + 8 * s->m_blocks + 4 + (s->size + 3) / 4 > end) goto truncated;
+    s->m_starts = r;
+    s->m_sizes = r + 4 * s->m_blocks;
+    r += 8 * s->m_blocks + 4;
+    s->dna = r;
+  }
+  return 0;
+truncated:
+  tb->err = "file is truncated or corrupted";
+  twobit_close(tb);
+  return 1;
+}
+
+/* Index of the first block in a sorted starts/sizes array which ends after
+ * pos.
+ */
+static inline uint64_t twobit_first_block(const twobit_t *tb, const unsigned char *starts, const unsigned char *sizes, const uint64_t n, const uint64_t pos) {
+  uint64_t lo = 0, hi = n;
+  while (lo < hi) {
+    const uint64_t mid = lo + (hi - lo) / 2;
+    if (twobit_block(tb, starts, mid) + twobit_block(tb, sizes, mid) <= pos) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+/* Decode bases [start, end) of sequence i into dst (not NUL-terminated) */
+static inline void twobit_decode(const twobit_t *tb, const uint64_t i, const uint64_t start, const uint64_t end, unsigned char *dst) {
+  const twobit_seq_t *s = &tb->seqs[i];
+  uint64_t pos = start;
+  while (pos < end && (pos & 3)) {
+    *dst++ = twobit_lut[s->dna[pos >> 2]][pos & 3];
+    pos++;
+  }
+  for (; pos + 4 <= end; pos += 4, dst += 4) {
+    memcpy(dst, twobit_lut[s->dna[pos >> 2]], 4);
+  }
+  while (pos < end) {
+    *dst++ = twobit_lut[s->dna[pos >> 2]][pos & 3];
+    pos++;
+  }
+  dst -= end - start;
+  for (uint64_t j = twobit_first_block(tb, s->n_starts, s->n_sizes, s->n_blocks, start);
+      j < s->n_blocks; j++) {
+    const uint64_t b_start = twobit_block(tb, s->n_starts, j);
+    if (b_start >= end) break;
+    const uint64_t b_end = TWOBIT_MIN(end, b_start + twobit_block(tb, s->n_sizes, j));
+    for (uint64_t k = TWOBIT_MAX(b_start, start); k < b_end; k++) dst[k - start] = 'N';
+  }
+  for (uint64_t j = twobit_first_block(tb, s->m_starts, s->m_sizes, s->m_blocks, start);
+      j < s->m_blocks; j++) {
+    const uint64_t b_start = twobit_block(tb, s->m_starts, j);
+    if (b_start >= end) break;
+    const uint64_t b_end = TWOBIT_MIN(end, b_start + twobit_block(tb, s->m_sizes, j));
+    for (uint64_t k = TWOBIT_MAX(b_start, start); k < b_end; k++) dst[k - start] |= 0x20;
+  }
+}
+
+/* Count the A, C, G and T bases (in that order) of sequence i without
+ * decoding it. Everything else is N.
+ */
+static inline void twobit_count_bases(const twobit_t *tb, const uint64_t i, uint64_t *acgt) {
+  static const int code2acgt[4] = { 3, 1, 0, 2 };
+  const twobit_seq_t *s = &tb->seqs[i];
+  uint64_t counts[4] = { 0, 0, 0, 0 };
+  for (uint64_t b = 0; b < s->size / 4; b++) {
+    const unsigned char *c = twobit_count_lut[s->dna[b]];
+    counts[0] += c[0]; counts[1] += c[1]; counts[2] += c[2]; counts[3] += c[3];
+  }
+  for (uint64_t pos = s->size & ~((uint64_t) 3); pos < s->size; pos++) {
+    counts[(s->dna[pos >> 2] >> (6 - 2 * (pos & 3))) & 3]++;
+  }
+  for (uint64_t j = 0; j < s->n_blocks; j++) {
+    const uint64_t b_start = twobit_block(tb, s->n_starts, j);
+    const uint64_t b_end = TWOBIT_MIN(s->size, b_start + twobit_block(tb, s->n_sizes, j));
+    for (uint64_t pos = b_start; pos < b_end; pos++) {
+      counts[(s->dna[pos >> 2] >> (6 - 2 * (pos & 3))) & 3]--;
+    }
+  }
+  for (int k = 0; k < 4; k++) acgt[code2acgt[k]] = counts[k];
+}
+
+static inline int twobit_is_path(const char *path) {
+  const size_t len = strlen(path);
+  return len > 5 && !strcmp(path + len - 5, ".2bit");
+}
+
+#endif
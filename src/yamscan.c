@@ -17,6 +17,7 @@
  *
  */
 
+#define _GNU_SOURCE  /* fopencookie(), see zout.h */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,21 +26,72 @@
 #include <getopt.h>
 #include <math.h>
 #include <limits.h>
+#include <float.h>
 #include <time.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <zlib.h>
 #include "kseq.h"
 #include "khash.h"
+#include "twobit.h"
+#include "zout.h"
+#include "tabix.h"
 
 KSEQ_INIT(gzFile, gzread)
 KHASH_MAP_INIT_STR(seq_str_h, uint64_t);
 KHASH_SET_INIT_STR(motif_str_h);
 
-#define YAMSCAN_VERSION                    "1.7"
-#define YAMSCAN_YEAR                        2023
+#define YAMSCAN_VERSION                    "1.8"
+#define YAMSCAN_YEAR                        2026
 
 /* ChangeLog
+ *
+ * v1.8 (October 2026)
+ * - Output hits directly as BED6+4, GFF3 or GTF via -F
+ * - Print reverse complemented matches for hits on the reverse strand via -c
+ * - Write one indexed bigBed file per motif via -B
+ * - Only scan within runs of standard bases, using an index of such runs built
+ *   when reading sequences
+ * - Skip ranges listed in an exclusion BED via -X, by removing them from the
+ *   index of scannable runs
+ * - Read .2bit files directly via -s; these are memory-mapped and decoded one
+ *   chunk at a time during scanning instead of being loaded into memory
+ * - Score the reference and alternate alleles of the variants in a VCF via -V,
+ *   only looking at the windows overlapping each variant
+ * - Report hits which differ between the haplotypes of the samples in a VCF
+ *   via -H, scanning each distinct local haplotype only once
+ * - Stream large numbers of short reads via -R, scoring batches of reads with
+ *   all motifs across threads, and print per-read motif presence via -P
+ * - Scan sequences as they are read via -L, so that stdin does not need to be
+ *   loaded into memory first; the sequence stats are printed at the end
+ * - Print the summed affinity of every sequence or BED range for each motif via
+ *   -A, as the log2 of the sum of 2^score over all windows
+ * - Write the score of every window as one bigWig file per motif via -W,
+ *   including zoom levels, while the motifs are being scanned
+ * - Print histograms of hit positions relative to the sequence centres, with a
+ *   central enrichment test, via -C
+ * - Print histograms of the spacing between the hits of every pair of motifs
+ *   via -S, sweeping motif pairs across threads
+ * - Print clusters of hits from all motifs (cis-regulatory modules) via -K,
+ *   scanning each block of a sequence with every motif and sweeping windows
+ *   across the hits in a single pass
+ * - Set motif thresholds at an empirical FDR via -Q, using shuffled copies of
+ *   the sequences generated in memory (with the yamshuf Euler shuffle)
+ * - Compare observed and expected window counts at P-values from -E down,
+ *   counting windows by score during the scan
+ * - Skip windows which cannot pass the threshold using an int16 copy of each
+ *   PWM, scoring blocks of windows in vectorized loops with twice as many
+ *   lanes as int would allow; hits are still scored with the full PWM
+ * - Score windows with kernels specialized for each motif width, picked when
+ *   the motifs are loaded
+ * - Build portable binaries by default, with the vectorized kernels compiled
+ *   for AVX-512, AVX2 and baseline x86-64 and picked at runtime (-march=native
+ *   is now only used with make NATIVE=1)
+ * - Compress the output as BGZF (-z) or zstd (-Z) on dedicated threads (-T)
+ * - Write the hits of each motif to their own file via -O, or split them
+ *   between a set number of files via -N
+ * - Sort the hits by position and write them as BGZF with a tabix index via
+ *   -I, for fetching the hits in a region
  *
  * v1.7 (September 2023)
  * - Add option to mask lower case letters and skip scanning via -M
@@ -111,6 +163,14 @@ KHASH_SET_INIT_STR(motif_str_h);
 #define MAX_CDF_SIZE        ((uint64_t) 2097152)
 #define PWM_INT_MULTIPLIER                1000.0    /* Needs to be a double */
 
+/* Most motifs also get an int16 copy of their PWM, with the scores divided
+ * by the smallest integer (up to PWM16_MAX_DIV) which keeps every window sum
+ * within the int16 range. This is only used to find the windows worth
+ * scoring, PWM16_BLOCK_SIZE windows at a time (see pwm16_candidates).
+ */
+#define PWM16_MAX_DIV                          8
+#define PWM16_BLOCK_SIZE         ((uint64_t) 1024)
+
 /* Max size of the parsed -b char array.
  */
 #define USER_BKG_MAX_SIZE       ((uint64_t) 256)
@@ -142,11 +202,63 @@ KHASH_SET_INIT_STR(motif_str_h);
  */
 #define SEQ_REALLOC_SIZE                  524288
 
+/* Number of items per compressed data block, and number of children per
+ * index node, in bigBed files written with -B. These match the defaults used
+ * by the UCSC bedToBigBed tool.
+ */
+#define BBI_ITEMS_PER_SLOT      ((uint64_t) 512)
+#define BBI_BLOCK_SIZE          ((uint64_t) 256)
+
+/* Zoom levels in bigWig files written with -W. The first level summarizes
+ * bins of BW_ZOOM_REDUCTION bases and is kept in memory while scanning (32
+ * bytes per bin), and each further level is four times coarser.
+ */
+#define BW_ZOOM_REDUCTION       ((uint64_t) 1024)
+#define BW_MAX_ZOOM_LEVELS                    10
+
+/* Number of windows decoded at a time when scanning .2bit input. Each thread
+ * has its own buffer of this size.
+ */
+#define TWOBIT_CHUNK_SIZE       ((uint64_t) 1048576)
+
+/* Size limits of the batches of reads which are scored at once with -R. Each
+ * thread scores one batch while the next ones are being read, so the total
+ * memory used for reads is about twice this times the number of threads.
+ */
+#define READ_BATCH_BASES        ((uint64_t) 1048576)
+#define READ_BATCH_READS        ((uint64_t) 16384)
+
+/* Number of motif pairs handled at a time with -S, split between threads.
+ * Only the spacing histograms of these need to be kept in memory.
+ */
+#define SPACING_PAIR_CHUNK      ((uint64_t) 1024)
+
+/* Number of windows scanned at a time with -K. Every motif is scanned over
+ * one block before moving on to the next, so that only the hits of the
+ * current block (and those still within reach of a cluster window) need to
+ * be kept in memory. For .2bit input, the block is decoded once for all
+ * motifs.
+ */
+#define CRM_BLOCK_SIZE          ((uint64_t) 1048576)
+
+/* The shuffled controls of -Q keep the counts of k-mers of this size, as for
+ * yamshuf -k. Each copy of each sequence gets its own generator, seeded from
+ * CONTROL_SEED and its index, so the controls do not depend on -j.
+ */
+#define CONTROL_K                              3
+#define CONTROL_SEED                           4
+
+/* Number of tenfold P-value steps below -E that window counts are kept for.
+ */
+#define MAX_CALIB_LEVELS                      32
+
 /* Front-facing defaults.
  */
 #define DEFAULT_NSITES                      1000
 #define DEFAULT_PVALUE                    0.0001
 #define DEFAULT_PSEUDOCOUNT                    1
+#define DEFAULT_CRM_SCORE                     10
+#define DEFAULT_CONTROL_COPIES                 1
 
 #define VEC_ADD(VEC, X, VEC_LEN)                                \
   do {                                                          \
@@ -180,6 +292,24 @@ KHASH_SET_INIT_STR(motif_str_h);
 #define LIKELY(COND) __builtin_expect(COND, 1)
 #define UNLIKELY(COND) __builtin_expect(COND, 0)
 
+/* The few vectorized kernels are compiled once per instruction set and the
+ * best one for the CPU is picked when the program starts, so the same binary
+ * runs everywhere. Not needed when building with -march=native (NATIVE=1).
+ * The x86-64 level names only work in target_clones from GCC 12 onwards
+ * (v4 brings AVX512BW, which the int16 kernels need to be worth it); older
+ * GCC gets plain feature names instead.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12 \
+  && defined(__x86_64__) && defined(__linux__) && !defined(__AVX2__)
+#define TARGET_CLONES \
+  __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#elif defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6 \
+  && defined(__x86_64__) && defined(__linux__) && !defined(__AVX2__)
+#define TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define TARGET_CLONES
+#endif
+
 /* Size of progress bar.
  */
 #define PROGRESS_BAR_WIDTH                    60
@@ -270,7 +400,8 @@ static void usage(void) {
     "            Alternatively, solely providing -s and not -m/-1 will cause       \n"
     "            yamscan to return sequence stats. Non-standard characters (i.e.   \n"
     "            other than ACGTU) will be read but are treated as gaps during     \n"
-    "            scanning.                                                         \n"
+    "            scanning. Files ending in .2bit are read directly, without loading\n"
+    "            the sequences into memory.                                        \n"
     " -x <str>   Filename of a BED-formatted file containing ranges within         \n"
     "            sequences which scanning will be restricted to. Must have at least\n"
     "            three tab-separated columns. If a fourth column is present it will\n"
@@ -280,15 +411,142 @@ static void usage(void) {
     "            for speed. Overlapping ranges are allowed, but be warned that they\n"
     "            will be individually scanned thus potentially introducing         \n"
     "            duplicate hits. The file can be gzipped.                          \n"
+    " -X <str>   Filename of a BED-formatted file containing ranges to exclude from\n"
+    "            scanning. Only hits which do not overlap any of these ranges are  \n"
+    "            reported. Only the first three columns are used, and ranges on    \n"
+    "            sequences not in the input are ignored. Can be combined with -x.  \n"
+    "            The file can be gzipped.                                          \n"
+    " -V <str>   Filename of a VCF file of variants. Instead of scanning whole     \n"
+    "            sequences, only the windows overlapping each variant are scored,  \n"
+    "            for both the reference and alternate alleles. The best hit for    \n"
+    "            each allele is reported along with the score and P-value changes, \n"
+    "            if either passes the threshold. Records whose REF does not match  \n"
+    "            the sequence, and symbolic alleles, are skipped. Cannot be used   \n"
+    "            with -x, -X, -B or -F. The file can be gzipped.                   \n"
+    " -H         Use the sample genotypes (GT) of the VCF file passed to -V to scan\n"
+    "            each local haplotype. Variants closer than a motif width are      \n"
+    "            scanned together, and each distinct combination of alleles is     \n"
+    "            scanned only once. Hits found in some but not all haplotypes are  \n"
+    "            reported along with the samples carrying them and their copy      \n"
+    "            number. Unphased genotypes are read in the order written, and     \n"
+    "            missing alleles as the reference.                                 \n"
+    " -R         Stream the sequences as short reads (such as from FASTQ files or  \n"
+    "            stdin) instead of loading or peeking through them first. Reads are\n"
+    "            read in batches and scored with all motifs at once, one batch per \n"
+    "            thread, so memory usage does not depend on the input size. Read   \n"
+    "            names are not checked for duplicates, and the read count, size, GC\n"
+    "            and Ns are printed at the end of the output instead of the header.\n"
+    "            Cannot be used with -x, -X, -V, -B or .2bit files.                \n"
+    " -P         With -R, print one line per read with at least one hit instead of \n"
+    "            the hits: the read name and a hexadecimal string of motif         \n"
+    "            presence, where each digit covers four motifs in input order (8   \n"
+    "            for the first, 4 for the second, 2 for the third and 1 for the    \n"
+    "            fourth).                                                          \n"
+    " -A         Instead of printing hits, print one row per sequence (or -x range)\n"
+    "            and one column per motif with the log2 of the sum of 2^score over \n"
+    "            every window in the sequence (both strands unless -f is used), in \n"
+    "            the same units as the score column. This is the expected occupancy\n"
+    "            of the whole sequence for each motif, and sequences with no       \n"
+    "            windows get -inf. The -t and -0 flags are ignored. Cannot be used \n"
+    "            with -V, -R, -L, -B or -F.                                        \n"
+    " -C <str>   Instead of printing hits, print one row per motif with a histogram\n"
+    "            of where the hits fall relative to the centre of each sequence (or\n"
+    "            -x range), using the site centres. With 'best' only the best hit  \n"
+    "            of each sequence is counted (split between ties), and with 'all'  \n"
+    "            every hit is. Each row also has the central region with the most  \n"
+    "            significant enrichment of sites (binomial test, adjusted for the  \n"
+    "            number of widths tried). The sequences should all be the same     \n"
+    "            size. Cannot be used with -V, -R, -L, -A, -B, -W or -F.           \n"
+    " -S <int>   Instead of printing hits, print histograms of the spacing between \n"
+    "            the hits of every pair of motifs (including each motif with       \n"
+    "            itself) on the same sequence, for gaps of up to <int> bases       \n"
+    "            between non-overlapping hits. There is one row for each pair,     \n"
+    "            strand (same or opposite) and side (upstream or downstream of the \n"
+    "            hit of the first motif) with any hits, along with the most common \n"
+    "            gap and its binomial P-value. Hits are kept in memory until all   \n"
+    "            motifs have been scanned, and motif pairs are split between       \n"
+    "            threads. Cannot be used with -x, -V, -R, -L, -A, -B, -W, -C or -F.\n"
+    " -K <int,   Instead of printing hits, print clusters of hits from all motifs  \n"
+    "     dbl>   (cis-regulatory modules, as in Cluster-Buster). Each block of a   \n"
+    "            sequence is scanned with every motif before moving on to the next \n"
+    "            one. Windows of <int> bases are slid across the hits, and each is \n"
+    "            scored as the sum of -log10(P-value) of the hits starting within  \n"
+    "            it. Windows scoring at least <dbl> (default: %g) which share hits \n"
+    "            are merged into one cluster, which is reported with its range,    \n"
+    "            number of hits and motifs, summed score, best window score and the\n"
+    "            number of hits of each motif in order of appearance. Hits on both \n"
+    "            strands are counted separately. Cannot be used with -x, -V, -R,   \n"
+    "            -L, -A, -B, -W, -C, -S or -F.                                     \n"
     " -o <str>   Filename to output results. By default output goes to stdout.     \n"
+    " -z <int>   Compress the output as BGZF at this level (1-9), using dedicated  \n"
+    "            threads (see -T). The output can be read like any gzip file, and  \n"
+    "            is compatible with bgzip and tabix.                               \n"
+    " -Z <int>   Compress the output with zstd at this level (1-19). Only available\n"
+    "            if yamscan was built with make ZSTD=1.                            \n"
+    " -T <int>   Number of threads used to compress the output with -z or -Z.      \n"
+    "            Default: 1.                                                       \n"
+    " -F <str>   Output format: yamscan, bed, gff3 or gtf. Default: yamscan. The   \n"
+    "            BED6+4 score column is min(1000, -10*log10(P-value)), followed by \n"
+    "            the score, score_pct, pvalue and qvalue (always '.') columns. The \n"
+    "            GFF3/GTF score column uses the same formula with one decimal.     \n"
+    " -O <str>   Instead of printing hits, write the hits of each motif to their   \n"
+    "            own file named <str><motif>.txt (with any '/' in the motif name   \n"
+    "            replaced by '_'). The extension is .bed, .gff3 or .gtf with -F,   \n"
+    "            followed by .gz with -z or .zst with -Z. Every file starts with   \n"
+    "            the usual header, which is still printed to the output along with \n"
+    "            anything other than hits (such as from -Q or -E). A file is only  \n"
+    "            open while its motif is being scanned, by the thread scanning it. \n"
+    "            Cannot be used with -B, -W, -V, -R, -L, -A, -C, -S or -K.         \n"
+    " -N <int>   With -O, split the hits between <int> files named <str>0.txt to   \n"
+    "            <str><int-1>.txt instead, picking the file of each motif from a   \n"
+    "            hash of its name. These are shared by all threads and stay open   \n"
+    "            during scanning.                                                  \n"
+    " -I         Sort the hits by position and write them as BGZF (at the -z level,\n"
+    "            by default 6) to the -o file, along with a tabix index named      \n"
+    "            <file>.tbi for quickly fetching the hits in a region (such as with\n"
+    "            tabix or yamdedup -R). Hits are kept in memory until all motifs   \n"
+    "            have been scanned. Positions past 2^29 cannot be indexed. Requires\n"
+    "            -o, and cannot be used with -O, -Z, -B, -W, -V, -R, -L, -A, -C, -S\n"
+    "            or -K.                                                            \n"
+    " -B <str>   Instead of printing hits, write one bigBed file per motif named  \n"
+    "            <str><motif>.bb (with any '/' in the motif name replaced by '_'). \n"
+    "            The BED6+4 columns are the same as -F bed. Hits for each motif are\n"
+    "            kept in memory until it has been scanned. Cannot be used with -o  \n"
+    "            or -F.                                                            \n"
+    " -W <str>   Write one bigWig file per motif named <str><motif>.bw (with any   \n"
+    "            '/' in the motif name replaced by '_') instead of printing hits.  \n"
+    "            Every position where a window is scanned gets the score of the    \n"
+    "            window starting there, the best of both strands unless -f is used.\n"
+    "            Files are written while scanning, with zoom levels starting at    \n"
+    "            %llu bp bins. The -t and -0 flags are ignored. Cannot be used with\n"
+    "            -o, -F, -B, -x, -V, -R, -L or -A.                                 \n"
     " -b <dbl,   Comma-separated background probabilities for A,C,G,T|U. By default\n"
     "     dbl,   the background probability values from the motif file (MEME only) \n"
     "     dbl,   are used, or a uniform background is assumed. Used in PWM         \n"
     "     dbl>   generation.                                                       \n"
     " -f         Only scan the forward strand.                                     \n"
+    " -c         Print the reverse complement of matches on the reverse strand,    \n"
+    "            instead of always printing the forward strand sequence.           \n"
     " -t <dbl>   Threshold P-value. Default: %g.                          \n"
     " -0         Instead of using a threshold, simply report all hits with a score \n"
     "            of zero or greater. Useful for manual filtering.                  \n"
+    " -Q <dbl,   Set the threshold of each motif to the lowest score with an       \n"
+    "     int>   empirical false discovery rate of at most <dbl>, estimated from   \n"
+    "            <int> (default: %d) shuffled copies of the sequences which are    \n"
+    "            generated and kept in memory. Each run of standard bases is       \n"
+    "            shuffled separately, keeping its %d-mer counts (as yamshuf does). \n"
+    "            Only windows passing -t are counted, so it should be lenient      \n"
+    "            enough. Each motif scans the sequences twice, once to count hits  \n"
+    "            and once to print them, and the threshold, number of hits and     \n"
+    "            estimated FDR of each motif are printed at the end of the output. \n"
+    "            Cannot be used with -1, -x, -V, -R, -L, -A, -W or -K.             \n"
+    " -E <dbl>   Compare the observed and expected score distributions of each     \n"
+    "            motif. Windows with a P-value below <dbl> are counted as they are \n"
+    "            scanned, and for <dbl> and every tenfold smaller P-value the      \n"
+    "            number of windows passing it is printed at the end of the output  \n"
+    "            (or to stderr with -F or -B) next to the number expected from the \n"
+    "            background. Large ratios point to a background which does not fit \n"
+    "            the sequences. Cannot be used with -1, -V, -R, -L, -A, -W or -K.  \n"
     " -p <int>   Pseudocount for PWM generation. Default: %d. Must be a positive    \n"
     "            integer.                                                          \n"
     " -n <int>   Number of motif sites used in PPM->PCM conversion. Default: %d. \n"
@@ -297,12 +555,19 @@ static void usage(void) {
     "            have the motif/sequence numbers appended. Incompatible with -x.   \n"
     " -r         Do not trim motif (HOCOMOCO/JASPAR only, HOMER/MEME must already  \n"
     "            be one word) and sequence names to the first word.                \n"
+    " -L         Scan each sequence with all motifs as soon as it is read, instead \n"
+    "            of reading all of the input first. This allows large inputs from  \n"
+    "            stdin to be scanned without loading them into memory. Since the   \n"
+    "            sequence stats are not known until the end, they are printed as   \n"
+    "            the last line of the output instead of in the header. With -j, the\n"
+    "            motifs are split between threads for each sequence. Cannot be used\n"
+    "            with -x, -X, -V, -B, -R or .2bit files.                           \n"
     " -l         Deactivate low memory mode. Normally only a single sequence is    \n"
     "            stored in memory at a time. Setting this flag allows the program  \n"
     "            to instead store the entire input into memory, which can help with\n"
     "            performance in cases of slow disk access or gzipped files. Note   \n"
     "            that this flag is automatically set when reading sequences from   \n"
-    "            stdin, and when multithreading is enabled.                        \n"
+    "            stdin (unless -L is used), and when multithreading is enabled.    \n"
     " -j <int>   Number of threads yamscan can use to scan. Default: 1. Note that  \n"
     "            increasing this number will also increase memory usage slightly.  \n"
     "            The number of threads is limited by the number of input motifs.   \n"
@@ -313,7 +578,8 @@ static void usage(void) {
     " -w         Very verbose mode.                                                \n"
     " -h         Print this help message.                                          \n"
     , YAMSCAN_VERSION, YAMSCAN_YEAR, MAX_MOTIF_SIZE / 5, MAX_MOTIF_SIZE / 5,
-      DEFAULT_PVALUE, DEFAULT_PSEUDOCOUNT, DEFAULT_NSITES
+      (double) DEFAULT_CRM_SCORE, BW_ZOOM_REDUCTION,
+      DEFAULT_PVALUE, DEFAULT_CONTROL_COPIES, CONTROL_K, DEFAULT_PSEUDOCOUNT, DEFAULT_NSITES
   );
 }
 
@@ -357,6 +623,28 @@ static const unsigned char char2index[256] = {
   4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 
 };
 
+/* Complements of DNA/RNA letters (including ambiguity codes), used by -c.
+ * Anything else is left as is.
+ */
+static const unsigned char char2comp[256] = {
+    0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,
+   16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,
+   32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,
+   48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,
+   64, 'T', 'V', 'G', 'H',  69,  70, 'C', 'D',  73,  74, 'M',  76, 'K', 'N',  79,
+   80,  81, 'Y', 'S', 'A', 'A', 'B', 'W',  88, 'R',  90,  91,  92,  93,  94,  95,
+   96, 't', 'v', 'g', 'h', 101, 102, 'c', 'd', 105, 106, 'm', 108, 'k', 'n', 111,
+  112, 113, 'y', 's', 'a', 'a', 'b', 'w', 120, 'r', 122, 123, 124, 125, 126, 127,
+  128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143,
+  144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+  160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+  176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+  192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
+  208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
+  224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
+  240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+};
+
 static uint64_t char_counts[256];
 
 static const double consensus2probs[] = {
@@ -404,13 +692,43 @@ enum MOTIF_FMT {
   FMT_UNKNOWN  = 5
 };
 
+enum OUT_FMT {
+  OUT_YAMSCAN  = 1,
+  OUT_BED      = 2,
+  OUT_GFF3     = 3,
+  OUT_GTF      = 4
+};
+
+enum SITE_HIST {
+  HIST_NONE    = 0,
+  HIST_BEST    = 1,
+  HIST_ALL     = 2
+};
+
 typedef struct args_t {
   double   bkg[4];
   double   pvalue;
   int      nsites;
   int      pseudocount; 
   int      nthreads;
+  int      out_fmt;
+  int      site_hist;
+  int      max_gap;
+  int      crm_size;
+  double   crm_score;
+  double   fdr;
+  int      n_controls;
+  double   calib_pvalue;
+  int      compress;
+  int      compress_level;
+  int      compress_threads;
+  char    *bb_prefix;
+  char    *split_prefix;
+  int      n_shards;
+  char    *tabix_path;
+  char    *bw_prefix;
   int      scan_rc : 1;
+  int      rc_match : 1;
   int      dedup : 1;
   int      trim_names : 1;
   int      use_user_bkg : 1;
@@ -419,6 +737,13 @@ typedef struct args_t {
   int      progress : 1;
   int      use_bed : 1;
   int      mask : 1;
+  int      use_twobit : 1;
+  int      use_vcf : 1;
+  int      use_haps : 1;
+  int      use_reads : 1;
+  int      presence : 1;
+  int      stream : 1;
+  int      affinity : 1;
   int      v : 1;
   int      w : 1;
 } args_t;
@@ -429,15 +754,39 @@ static args_t args = {
   .nsites          = DEFAULT_NSITES,
   .pseudocount     = DEFAULT_PSEUDOCOUNT,
   .scan_rc         = 1,
+  .rc_match        = 0,
   .dedup           = 0,
   .trim_names      = 1,
   .use_user_bkg    = 0,
   .low_mem         = 1,
   .nthreads        = 1,
+  .out_fmt         = OUT_YAMSCAN,
+  .site_hist       = HIST_NONE,
+  .max_gap         = -1,
+  .crm_size        = 0,
+  .crm_score       = DEFAULT_CRM_SCORE,
+  .fdr             = 0.0,
+  .n_controls      = DEFAULT_CONTROL_COPIES,
+  .calib_pvalue    = 0.0,
+  .compress        = 0,
+  .compress_level  = 0,
+  .compress_threads = 1,
+  .bb_prefix       = NULL,
+  .split_prefix    = NULL,
+  .n_shards        = 0,
+  .tabix_path      = NULL,
+  .bw_prefix       = NULL,
   .thresh0         = 0,
   .progress        = 0,
   .use_bed         = 0,
   .mask            = 0,
+  .use_twobit      = 0,
+  .use_vcf         = 0,
+  .use_haps        = 0,
+  .use_reads       = 0,
+  .presence        = 0,
+  .stream          = 0,
+  .affinity        = 0,
   .v               = 0,
   .w               = 0
 };
@@ -487,9 +836,83 @@ static void free_bed(void) {
   }
 }
 
+/* Hits buffered in memory (for -B and -S). The chrom field is the rank of the
+ * sequence name (see seq_ranks), so that sorting gives the order expected by
+ * genome browsers.
+ */
+typedef struct hit_t {
+  uint64_t    chrom;
+  uint64_t    start;
+  double      pvalue;
+  double      score;
+  double      score_pct;
+  char        strand;
+} hit_t;
+
+typedef struct hits_t {
+  hit_t      *h;
+  uint64_t    n;
+  uint64_t    n_alloc;
+} hits_t;
+
+/* Histogram of hit positions (for -C), relative to the centre of each
+ * sequence or BED range. Positions are site centres, so that bin i is the
+ * site centre i - (n_bins - 1) / 2 bases from the middle. For -C best, the
+ * sites of the current row are kept until the next one starts, so that the
+ * weight can be split between ties.
+ */
+typedef struct sites_t {
+  double     *hist;
+  uint64_t    n_bins;
+  uint64_t    mot_size;
+  uint64_t    row;                         /* Current sequence or BED range */
+  uint64_t    row_start;
+  uint64_t    row_size;
+  char        row_strand;
+  double      best;
+  uint64_t   *ties;
+  uint64_t    n_ties;
+  uint64_t    ties_alloc;
+} sites_t;
+
+/* Threshold picked by -Q. While counting, every window at or above the -t
+ * threshold adds to counting[score - threshold].
+ */
+typedef struct fdr_t {
+  uint64_t   *counting;
+  int         score;                       /* INT_MAX if none was found */
+  double      pvalue;
+  uint64_t    hits;
+  double      control_hits;                /* Average per copy */
+} fdr_t;
+
+/* Window counts for -E. Windows scoring at least scores[k] but less than
+ * scores[k + 1] add to counts[k], where scores[0] is the score for the -E
+ * P-value and every level after it is for a tenfold smaller one. Levels
+ * which share a score are only kept once, and scores[n_levels] is INT_MAX.
+ * Since every motif is only scanned by one thread at a time, the counts need
+ * no locking.
+ */
+typedef struct calib_t {
+  int         scores[MAX_CALIB_LEVELS + 1];
+  double      pvalues[MAX_CALIB_LEVELS];
+  uint64_t    counts[MAX_CALIB_LEVELS];
+  int         n_levels;
+  uint64_t    windows;
+} calib_t;
+
+typedef void (*score_fn_t)(const int *, const unsigned char *, int *, const unsigned char *);
+typedef void (*score_rc_fn_t)(const int *, const int *, const unsigned char *, int *, int *,
+  const unsigned char *);
+
 typedef struct motif_t {
   int         pwm[MAX_MOTIF_SIZE];         /* Slight perf boost by putting the pwms first */
   int         pwm_rc[MAX_MOTIF_SIZE];
+  score_fn_t  score_fn;                    /* Kernels for this width, see SCORE_KERNELS */
+  score_rc_fn_t score_rc_fn;
+  int16_t     pwm16[MAX_MOTIF_SIZE / 5 * 4];    /* A,C,G,T only, see set_pwm16 */
+  int16_t     pwm16_rc[MAX_MOTIF_SIZE / 5 * 4];
+  int         pwm16_div;                   /* 0 if the int16 PWM is not used */
   double     *cdf;
   int         threshold;
   uint64_t    size;
@@ -504,6 +927,16 @@ typedef struct motif_t {
   int         cdf_offset;
   char        name[MAX_NAME_SIZE];
   double     *tmp_pdf;
+  hits_t     *hits;                        /* Only used by -B, -S and -K */
+  struct track_t *track;                   /* Only used by -W */
+  sites_t    *sites;                       /* Only used by -C */
+  fdr_t      *fdr;                         /* Only used by -Q */
+  calib_t    *calib;                       /* Only used by -E */
+  FILE       *out;                         /* files.o, or the -O file   */
+  char       *out_buf;                     /* Only used by -I */
+  size_t      out_size;
+  double     *affinity;                    /* Only used by -A, per row  */
+  double     *affinity_tab;                /* 2^score, indexed like cdf */
 } motif_t;
 
 static motif_t **motifs;
@@ -579,6 +1012,20 @@ static seq_info_t seq_info = {
 static char            **seq_names;
 static unsigned char   **seqs;
 static uint64_t         *seq_sizes;
+static uint64_t         *seq_ranks;        /* Only used by -B, -W and -S */
+static twobit_t          twobit;           /* Only used for .2bit input */
+static uint64_t         *ranked_seqs;
+
+/* Runs of scannable letters (ACGTU, and also lower case unless -M is set)
+ * for each sequence, stored as start/end pairs. Any window overlapping
+ * another letter can never pass the threshold because of AMBIGUITY_SCORE, so
+ * the scanning loops only need to visit these. Runs shorter than the
+ * smallest motif are not stored.
+ */
+static uint64_t        **seq_segs;
+static uint64_t         *seq_n_segs;
+static uint64_t          seq_segs_alloc = 0;
+static uint64_t          seq_segs_min_size = 1;
 
 static void free_seqs(void) {
   for (uint64_t i = 0; i < seq_info.n; i++) {
@@ -588,10 +1035,30 @@ static void free_seqs(void) {
   free(seq_names);
   free(seq_sizes);
   free(seqs);
+  free(seq_ranks);
+  free(ranked_seqs);
+  for (uint64_t i = 0; i < seq_segs_alloc; i++) {
+    free(seq_segs[i]);
+  }
+  free(seq_segs);
+  free(seq_n_segs);
 }
 
 static void free_motifs(void) {
   for (uint64_t i = 0; i < motif_info.n; i++) {
+    if (motifs[i]->hits != NULL) {
+      free(motifs[i]->hits->h);
+      free(motifs[i]->hits);
+    }
+    if (motifs[i]->sites != NULL) {
+      free(motifs[i]->sites->hist);
+      free(motifs[i]->sites->ties);
+      free(motifs[i]->sites);
+    }
+    free(motifs[i]->affinity);
+    free(motifs[i]->out_buf);
+    free(motifs[i]->fdr);
+    free(motifs[i]->calib);
     free(motifs[i]);
   }
   free(motifs);
@@ -611,29 +1078,66 @@ static pthread_t         *threads;
 static pthread_mutex_t    pb_lock = PTHREAD_MUTEX_INITIALIZER;
 static uint64_t           pb_counter = 0;
 
+/* -O: the header printed at the start of every file, and the -N files */
+static char              *split_header = NULL;
+static FILE             **split_files = NULL;
+
+/* -I: the sorted hits, and the blocks of the BGZF output */
+typedef struct tabix_line_t {
+  uint64_t  seq_i;
+  uint64_t  start;
+  uint64_t  end;
+  uint64_t  order;
+  uint64_t  pos;                          /* In the uncompressed output */
+  char     *line;
+  uint64_t  size;
+} tabix_line_t;
+
+static tabix_line_t      *tabix_lines = NULL;
+static uint64_t           n_tabix_lines = 0;
+static zout_blocks_t      tabix_blocks = { NULL, 0, 0, 0, 0 };
+
 typedef struct files_t {
   int       m_open : 1;
   int       s_open : 1;
   int       o_open : 1;
   int       b_open : 1;
+  int       e_open : 1;
+  int       vcf_open : 1;
   FILE     *m;
   gzFile    s;
   FILE     *o;
   gzFile    b;
+  gzFile    e;
+  gzFile    vcf;
 } files_t;
 
 static files_t files = {
   .m_open = 0,
   .s_open = 0,
   .o_open = 0,
-  .b_open = 0
+  .b_open = 0,
+  .e_open = 0,
+  .vcf_open = 0
 };
 
 static void close_files(void) {
   if (files.m_open) fclose(files.m);
   if (files.s_open) gzclose(files.s);
   if (files.o_open) fclose(files.o);
+  if (split_files != NULL) {
+    for (uint64_t i = 0; i < args.n_shards; i++) {
+      if (split_files[i] != NULL) fclose(split_files[i]);
+    }
+    free(split_files);
+    split_files = NULL;
+  }
+  free(split_header);
+  split_header = NULL;
   if (files.b_open) gzclose(files.b);
+  if (files.e_open) gzclose(files.e);
+  if (files.vcf_open) gzclose(files.vcf);
+  if (args.use_twobit) twobit_close(&twobit);
 }
 
 static void init_motif(motif_t *motif) {
@@ -654,6 +1158,19 @@ static void init_motif(motif_t *motif) {
   motif->min_score = 0;
   motif->cdf_max = 0;
   motif->thread = 0;
+  motif->hits = NULL;
+  motif->track = NULL;
+  motif->sites = NULL;
+  motif->fdr = NULL;
+  motif->calib = NULL;
+  motif->out = NULL;
+  motif->out_buf = NULL;
+  motif->out_size = 0;
+  motif->pwm16_div = 0;
+  motif->score_fn = NULL;
+  motif->score_rc_fn = NULL;
+  motif->affinity = NULL;
+  motif->affinity_tab = NULL;
   for (uint64_t i = 0; i < MAX_MOTIF_SIZE; i++) {
     motif->pwm[i] = 0;
     motif->pwm_rc[i] = 0;
@@ -686,12 +1203,61 @@ static inline int get_score_i(const motif_t *motif, const int i, const uint64_t
   return motif->pwm[i + pos * 5];
 }
 
+/* Window scoring kernels for every motif width. With the width known at
+ * compile time the loops are fully unrolled, so the PWM offsets become
+ * constants and the loop counter and size checks go away. The reverse strand
+ * alone is scored with the forward kernel and the reverse complement PWM.
+ */
+#define SCORE_KERNELS(W) \
+  static void score_subseq_##W(const int *pwm, const unsigned char *seq, int *score, \
+      const unsigned char *char2Xindex) { \
+    int score_ = 0; \
+    _Pragma("GCC unroll 50") \
+    for (uint64_t i = 0; i < W; i++) score_ += pwm[char2Xindex[seq[i]] + i * 5]; \
+    *score = score_; \
+  } \
+  static void score_subseq_rc_##W(const int *pwm, const int *pwm_rc, const unsigned char *seq, \
+      int *score, int *score_rc, const unsigned char *char2Xindex) { \
+    int score_ = 0, score_rc_ = 0; \
+    _Pragma("GCC unroll 50") \
+    for (uint64_t i = 0; i < W; i++) { \
+      const unsigned char let_ = char2Xindex[seq[i]]; \
+      score_ += pwm[let_ + i * 5]; \
+      score_rc_ += pwm_rc[let_ + i * 5]; \
+    } \
+    *score = score_; \
+    *score_rc = score_rc_; \
+  }
+
+#define MOTIF_WIDTHS(X) \
+  X(1)  X(2)  X(3)  X(4)  X(5)  X(6)  X(7)  X(8)  X(9)  X(10) \
+  X(11) X(12) X(13) X(14) X(15) X(16) X(17) X(18) X(19) X(20) \
+  X(21) X(22) X(23) X(24) X(25) X(26) X(27) X(28) X(29) X(30) \
+  X(31) X(32) X(33) X(34) X(35) X(36) X(37) X(38) X(39) X(40) \
+  X(41) X(42) X(43) X(44) X(45) X(46) X(47) X(48) X(49) X(50)
+
+MOTIF_WIDTHS(SCORE_KERNELS)
+
+#define SCORE_FN_ENTRY(W) score_subseq_##W,
+#define SCORE_RC_FN_ENTRY(W) score_subseq_rc_##W,
+
+static const score_fn_t score_fns[MAX_MOTIF_SIZE / 5 + 1] = {
+  NULL, MOTIF_WIDTHS(SCORE_FN_ENTRY)
+};
+
+static const score_rc_fn_t score_rc_fns[MAX_MOTIF_SIZE / 5 + 1] = {
+  NULL, MOTIF_WIDTHS(SCORE_RC_FN_ENTRY)
+};
+
 static void free_ht(void) {
-  /* khash.h doesn't own the memory, it's (de)allocated in seq_names
-  for (khint_t k = 0; k < kh_end(seq_hash_tab); k++) {
-    if (kh_exist(seq_hash_tab, k)) free((char *) kh_key(seq_hash_tab, k));
+  /* khash.h doesn't own the memory, it's (de)allocated in seq_names, except
+   * with -L where the names are copied (see check_stream_seq_name)
+   */
+  if (args.stream) {
+    for (khint_t k = 0; k < kh_end(seq_hash_tab); k++) {
+      if (kh_exist(seq_hash_tab, k)) free((char *) kh_key(seq_hash_tab, k));
+    }
   }
-  */
   kh_destroy(seq_str_h, seq_hash_tab);
 }
 
@@ -744,7 +1310,7 @@ static inline int str_to_uint64_t(char *str, uint64_t *res) {
 /* For the motif half of yamscan, this function is (by far) where it spends
  * most of its time.
  */
-static void fill_cdf(motif_t *motif) {
+TARGET_CLONES static void fill_cdf(motif_t *motif) {
   uint64_t max_step, s; //s0, s1, s2, s3;
   double pdf_sum = 0.0;
   if (args.w && args.nthreads == 1 && !args.progress) {
@@ -819,6 +1385,17 @@ static inline double score2pval(const motif_t *motif, const int score) {
   return motif->cdf[score - motif->cdf_offset];
 }
 
+/* For -A, instead of the CDF: 2^score for every possible score */
+static void fill_affinity_tab(motif_t *motif) {
+  motif->affinity_tab = malloc(sizeof(double) * motif->cdf_size);
+  if (motif->affinity_tab == NULL) {
+    badexit("Error: Failed to allocate memory for affinity table.");
+  }
+  for (uint64_t i = 0; i < motif->cdf_size; i++) {
+    motif->affinity_tab[i] = exp2(((int) i + motif->cdf_offset) / PWM_INT_MULTIPLIER);
+  }
+}
+
 static void set_threshold(motif_t *motif) {
   uint64_t threshold_i = motif->cdf_size;
   for (uint64_t i = 0; i < motif->cdf_size; i++) {
@@ -859,6 +1436,23 @@ static void set_threshold(motif_t *motif) {
   }
 }
 
+static void set_calib_levels(motif_t *motif) {
+  calib_t *calib = motif->calib;
+  uint64_t i = 0;
+  int n = 0;
+  for (double pvalue = args.calib_pvalue; n < MAX_CALIB_LEVELS; pvalue /= 10.0) {
+    while (i < motif->cdf_size && motif->cdf[i] >= pvalue) i++;
+    const int score = i + motif->cdf_offset;
+    if (i == motif->cdf_size || score > motif->max_score) break;
+    if (n && score == calib->scores[n - 1]) continue;
+    calib->scores[n] = score;
+    calib->pvalues[n] = motif->cdf[i];
+    n++;
+  }
+  calib->scores[n] = INT_MAX;
+  calib->n_levels = n;
+}
+
 static int check_and_load_bkg(double *bkg) {
   if (bkg[0] == -1.0 || bkg[1] == -1.0 || bkg[2] == -1.0 || bkg[3] == -1.0) {
     fprintf(stderr, "Error: Too few background values found (need 4)."); return 1;
@@ -1533,12 +2127,50 @@ static void trim_motif_name(motif_t *motif) {
   }
 }
 
+/* Division rounding towards +inf, for either sign */
+static inline int ceil_div(const int x, const int d) {
+  return x / d + (x % d > 0);
+}
+
+/* The int16 scores are rounded up, and raised to at least INT16_MIN / size,
+ * so that (multiplied back by the divisor) the int16 score of a window is
+ * never less than its real score, and no partial sum can overflow. If the
+ * scores cannot be made to fit with a small enough divisor, the int16 PWM
+ * is not used.
+ */
+static void set_pwm16(motif_t *motif) {
+  const int lowest = INT16_MIN / (int) motif->size;
+  motif->pwm16_div = 0;
+  for (int div = 1; div <= PWM16_MAX_DIV; div++) {
+    int64_t max_sum = 0;
+    for (uint64_t i = 0; i < motif->size; i++) {
+      int max_pos = 0;
+      for (int j = 0; j < 4; j++) {
+        max_pos = MAX(max_pos, ceil_div(motif->pwm[j + i * 5], div));
+      }
+      max_sum += max_pos;
+    }
+    if (max_sum > INT16_MAX) continue;
+    for (uint64_t i = 0; i < motif->size; i++) {
+      for (int j = 0; j < 4; j++) {
+        motif->pwm16[j + i * 4] = MAX(lowest, ceil_div(motif->pwm[j + i * 5], div));
+        motif->pwm16_rc[j + i * 4] = MAX(lowest, ceil_div(motif->pwm_rc[j + i * 5], div));
+      }
+    }
+    motif->pwm16_div = div;
+    return;
+  }
+}
+
 static void complete_motifs(void) {
   for (uint64_t i = 0; i < motif_info.n; i++) {
     motifs[i]->min = get_pwm_min(motifs[i]);
     motifs[i]->max = get_pwm_max(motifs[i]);
     motifs[i]->cdf_offset = motifs[i]->min * motifs[i]->size;
     fill_pwm_rc(motifs[i]);
+    set_pwm16(motifs[i]);
+    motifs[i]->score_fn = score_fns[motifs[i]->size];
+    motifs[i]->score_rc_fn = score_rc_fns[motifs[i]->size];
     motifs[i]->cdf_max = motifs[i]->max - motifs[i]->min;
     motifs[i]->cdf_size = motifs[i]->size * motifs[i]->cdf_max + 1;
     if (args.trim_names) trim_motif_name(motifs[i]);
@@ -1946,6 +2578,91 @@ static void add_seq_name(char *name, kseq_t *kseq) {
   }
 }
 
+static void alloc_seq_segs(const uint64_t seq_i) {
+  if (seq_i >= seq_segs_alloc) {
+    uint64_t **tmp_ptr1 = realloc(seq_segs,
+      sizeof(*seq_segs) * seq_segs_alloc + sizeof(*seq_segs) * ALLOC_CHUNK_SIZE);
+    if (tmp_ptr1 == NULL) {
+      badexit("Error: Failed to allocate memory for sequence segments.");
+    }
+    seq_segs = tmp_ptr1;
+    uint64_t *tmp_ptr2 = realloc(seq_n_segs,
+      sizeof(*seq_n_segs) * seq_segs_alloc + sizeof(*seq_n_segs) * ALLOC_CHUNK_SIZE);
+    if (tmp_ptr2 == NULL) {
+      badexit("Error: Failed to allocate memory for sequence segments.");
+    }
+    seq_n_segs = tmp_ptr2;
+    for (uint64_t i = seq_segs_alloc; i < seq_segs_alloc + ALLOC_CHUNK_SIZE; i++) {
+      seq_segs[i] = NULL;
+      seq_n_segs[i] = 0;
+    }
+    seq_segs_alloc += ALLOC_CHUNK_SIZE;
+  }
+}
+
+static uint64_t *push_seq_seg(uint64_t *segs, uint64_t *n, uint64_t *n_alloc, const uint64_t start, const uint64_t end) {
+  if (*n == *n_alloc) {
+    *n_alloc = *n_alloc ? *n_alloc * 2 : 8;
+    uint64_t *tmp_ptr = realloc(segs, sizeof(uint64_t) * 2 * *n_alloc);
+    if (tmp_ptr == NULL) {
+      free(segs);
+      badexit("Error: Failed to allocate memory for sequence segments.");
+    }
+    segs = tmp_ptr;
+  }
+  segs[2 * *n] = start;
+  segs[2 * *n + 1] = end;
+  (*n)++;
+  return segs;
+}
+
+static void add_seq_segs(const uint64_t seq_i, const unsigned char *seq, const uint64_t len) {
+  const unsigned char *char2Xindex = args.mask ? char2maskindex : char2index;
+  alloc_seq_segs(seq_i);
+  uint64_t n = 0, n_alloc = 0, *segs = NULL;
+  for (uint64_t i = 0; i < len; ) {
+    while (i < len && char2Xindex[seq[i]] == 4) i++;
+    const uint64_t start = i;
+    while (i < len && char2Xindex[seq[i]] != 4) i++;
+    if (i - start < seq_segs_min_size || i == start) continue;
+    segs = push_seq_seg(segs, &n, &n_alloc, start, i);
+  }
+  seq_segs[seq_i] = segs;
+  seq_n_segs[seq_i] = n;
+}
+
+/* Same as add_seq_segs, but the runs are found from the N (and with -M, the
+ * soft mask) blocks of a .2bit record without decoding it.
+ */
+static void add_seq_segs_twobit(const uint64_t seq_i) {
+  const twobit_seq_t *tb_seq = &twobit.seqs[seq_i];
+  const uint64_t m_blocks = args.mask ? tb_seq->m_blocks : 0;
+  alloc_seq_segs(seq_i);
+  uint64_t n = 0, n_alloc = 0, *segs = NULL, cur = 0;
+  for (uint64_t jn = 0, jm = 0; jn < tb_seq->n_blocks || jm < m_blocks; ) {
+    uint64_t b_start, b_end;
+    if (jm == m_blocks || (jn < tb_seq->n_blocks &&
+          twobit_block(&twobit, tb_seq->n_starts, jn) < twobit_block(&twobit, tb_seq->m_starts, jm))) {
+      b_start = twobit_block(&twobit, tb_seq->n_starts, jn);
+      b_end = b_start + twobit_block(&twobit, tb_seq->n_sizes, jn);
+      jn++;
+    } else {
+      b_start = twobit_block(&twobit, tb_seq->m_starts, jm);
+      b_end = b_start + twobit_block(&twobit, tb_seq->m_sizes, jm);
+      jm++;
+    }
+    if (b_start >= cur + seq_segs_min_size) {
+      segs = push_seq_seg(segs, &n, &n_alloc, cur, b_start);
+    }
+    cur = MAX(cur, b_end);
+  }
+  if (tb_seq->size >= cur + seq_segs_min_size) {
+    segs = push_seq_seg(segs, &n, &n_alloc, cur, tb_seq->size);
+  }
+  seq_segs[seq_i] = segs;
+  seq_n_segs[seq_i] = n;
+}
+
 static uint64_t peek_through_seqs(kseq_t *kseq) {
   uint64_t name_sizes = 0, max_kseq_mem = 0;
   int ret_val;
@@ -1984,6 +2701,7 @@ static uint64_t peek_through_seqs(kseq_t *kseq) {
     for (uint64_t i = 0; i < kseq->seq.l; i++) {
       char_counts[seq_tmp[i]]++;
     }
+    if (motif_info.n) add_seq_segs(seq_info.n - 1, seq_tmp, kseq->seq.l);
   }
   if (ret_val == -2) {
     kseq_destroy(kseq);
@@ -2087,6 +2805,9 @@ static void load_seqs(kseq_t *kseq) {
       badexit("Error: Failed to allocate memory for sequence name.");
     }
     add_seq_name(seq_names[seq_info.n - 1], kseq);
+    if (motif_info.n) {
+      add_seq_segs(seq_info.n - 1, seqs[seq_info.n - 1], seq_sizes[seq_info.n - 1]);
+    }
   }
   if (ret_val == -2) {
     kseq_destroy(kseq);
@@ -2144,6 +2865,88 @@ static void load_seqs(kseq_t *kseq) {
   }
 }
 
+/* Sequences in .2bit files are never fully loaded: only the names, sizes and
+ * index of scannable runs are kept, and the bases are decoded from the mapped
+ * file as needed.
+ */
+static void load_twobit(void) {
+  uint64_t name_sizes = 0;
+  seq_info.n = twobit.n;
+  seq_info.n_alloc = twobit.n;
+  if (!seq_info.n) {
+    badexit("Error: Failed to read any sequences from input.");
+  }
+  char **tmp_ptr1 = realloc(seq_names, sizeof(*seq_names) * seq_info.n);
+  unsigned char **tmp_ptr2 = realloc(seqs, sizeof(*seqs) * seq_info.n);
+  uint64_t *tmp_ptr3 = realloc(seq_sizes, sizeof(*seq_sizes) * seq_info.n);
+  if (tmp_ptr1 == NULL || tmp_ptr2 == NULL || tmp_ptr3 == NULL) {
+    badexit("Error: Failed to allocate memory for sequences.");
+  }
+  seq_names = tmp_ptr1;
+  seqs = tmp_ptr2;
+  seq_sizes = tmp_ptr3;
+  ERASE_ARRAY(char_counts, 256);
+  for (uint64_t i = 0; i < seq_info.n; i++) {
+    const uint64_t name_size = strlen(twobit.seqs[i].name);
+    if (name_size > SEQ_NAME_MAX_CHAR) {
+      fprintf(stderr, "Error: Sequence name is too large (%llu>%llu).",
+        name_size, SEQ_NAME_MAX_CHAR);
+      badexit("");
+    }
+    seq_names[i] = malloc(name_size + 1);
+    if (seq_names[i] == NULL) {
+      badexit("Error: Failed to allocate memory for sequence name.");
+    }
+    memcpy(seq_names[i], twobit.seqs[i].name, name_size + 1);
+    name_sizes += name_size + 1;
+    seqs[i] = NULL;
+    seq_sizes[i] = twobit.seqs[i].size;
+    uint64_t acgt[4];
+    twobit_count_bases(&twobit, i, acgt);
+    char_counts['A'] += acgt[0];
+    char_counts['C'] += acgt[1];
+    char_counts['G'] += acgt[2];
+    char_counts['T'] += acgt[3];
+    char_counts['N'] += seq_sizes[i] - acgt[0] - acgt[1] - acgt[2] - acgt[3];
+    if (motif_info.n) add_seq_segs_twobit(i);
+  }
+  uint64_t seq_len_total = 0;
+  for (uint64_t i = 0; i < seq_info.n; i++) seq_len_total += seq_sizes[i];
+  if (!seq_len_total) {
+    badexit("Error: Only encountered empty sequences.");
+  }
+  seq_info.total_bases = seq_len_total;
+  seq_info.unknowns = seq_len_total - standard_base_count();
+  seq_info.gc_pct = calc_gc() * 100.0;
+  double unknowns_pct = 100.0 * seq_info.unknowns / seq_len_total;
+  if (seq_info.unknowns == seq_len_total) {
+    badexit("Error: Failed to read any standard DNA/RNA bases.");
+  } else if (unknowns_pct >= 90.0) {
+    fprintf(stderr,
+      "!!! Warning: Non-standard base count is extremely high!!! (%.2f%%)\n",
+      unknowns_pct);
+  } else if (unknowns_pct >= 50.0 && args.v) {
+    fprintf(stderr, "Warning: Non-standard base count is very high! (%.2f%%)\n",
+      unknowns_pct);
+  } else if (unknowns_pct >= 10.0 && args.v) {
+    fprintf(stderr, "Warning: Non-standard base count seems high. (%.2f%%)\n",
+      unknowns_pct);
+  }
+  if (args.v) {
+    fprintf(stderr, "Indexed %'llu base(s) across %'llu sequence(s) (GC=%.2f%%).\n",
+      seq_len_total, seq_info.n, seq_info.gc_pct);
+    if (seq_info.unknowns) {
+      fprintf(stderr, "Found %'llu (%.2f%%) non-standard bases.\n",
+        seq_info.unknowns, unknowns_pct);
+    }
+    print_seq_mem(
+      seq_info.n_alloc * sizeof(*seq_names) +
+      name_sizes +
+      seq_info.n_alloc * sizeof(*seq_sizes)
+    );
+  }
+}
+
 /*
 static int char_arrays_are_equal(const char *arr1, const char *arr2, const uint64_t len) {
   int are_equal = 1;
@@ -2251,6 +3054,54 @@ static void find_motif_dupes(void) {
   free(is_dup);
 }
 
+/* -O, -B and -W name their files after the motifs with any '/' replaced by
+ * '_', so two motifs such as "a/b" and "a_b" would share one file.
+ */
+static void find_motif_file_dupes(void) {
+  char **file_names = malloc(sizeof(char *) * motif_info.n);
+  if (file_names == NULL) {
+    badexit("Error: Failed to allocate memory for motif file name check.");
+  }
+  khash_t(seq_str_h) *file_hash_tab = kh_init(seq_str_h);
+  khint64_t k;
+  int absent, hash_err = 0;
+  uint64_t n_names = 0, dup_i = 0, dup_j = 0;
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    file_names[i] = strdup(motifs[i]->name);
+    if (file_names[i] == NULL) {
+      hash_err = 1;
+      break;
+    }
+    n_names++;
+    for (char *c = file_names[i]; *c != '\0'; c++) {
+      if (*c == '/') *c = '_';
+    }
+    k = kh_put(seq_str_h, file_hash_tab, file_names[i], &absent);
+    if (absent == -1) {
+      hash_err = 1;
+      break;
+    } else if (absent == 0) {
+      dup_i = kh_val(file_hash_tab, k);
+      dup_j = i;
+      break;
+    }
+    kh_val(file_hash_tab, k) = i;
+  }
+  kh_destroy(seq_str_h, file_hash_tab);
+  for (uint64_t i = 0; i < n_names; i++) free(file_names[i]);
+  free(file_names);
+  if (hash_err) {
+    badexit("Error: Failed to hash motif file names.");
+  } else if (dup_j) {
+    fprintf(stderr,
+      "Error: Motif names would give the same file name once '/' is replaced by '_'."
+      "\n    L%llu #%llu: %s\n    L%llu #%llu: %s",
+      motifs[dup_i]->file_line_num, dup_i + 1, motifs[dup_i]->name,
+      motifs[dup_j]->file_line_num, dup_j + 1, motifs[dup_j]->name);
+    badexit("");
+  }
+}
+
 static void find_seq_dupes(void) {
   uint64_t *is_dup = malloc(sizeof(uint64_t) * seq_info.n);
   ERASE_ARRAY(is_dup, seq_info.n);
@@ -2666,275 +3517,3738 @@ static void check_bed_ranges(void) {
   }
 }
 
-static void print_bed_stats(void) {
-  if (args.w) {
-    fprintf(stderr, "%'llu line(s) total, with %'llu comment/header and %'llu empty line(s).\n",
-      bed.n_lines, bed.n_comments, bed.n_empty);
+typedef struct excl_range_t {
+  uint64_t  seq_i;
+  uint64_t  start;
+  uint64_t  end;
+} excl_range_t;
+
+static int cmp_excl_ranges(const void *a, const void *b) {
+  const excl_range_t *r1 = a, *r2 = b;
+  if (r1->seq_i != r2->seq_i) return r1->seq_i < r2->seq_i ? -1 : 1;
+  if (r1->start != r2->start) return r1->start < r2->start ? -1 : 1;
+  return (r1->end > r2->end) - (r1->end < r2->end);
+}
+
+/* Read the -X BED and subtract its (merged) ranges from the scannable runs
+ * of each sequence. Pieces left smaller than the smallest motif are dropped.
+ */
+static void apply_excl_bed(void) {
+  uint64_t n = 0, n_alloc = ALLOC_CHUNK_SIZE, n_skipped = 0, line_num = 0;
+  uint64_t start, end;
+  char tmp_field[MOTIF_VALUE_MAX_CHAR];
+  excl_range_t *ranges = malloc(sizeof(excl_range_t) * n_alloc);
+  if (ranges == NULL) {
+    badexit("Error: Failed to allocate memory for exclusion ranges.");
   }
-  uint64_t n_seqs = 0, n_bases = 0;
-  uint64_t *covered_seqs = malloc(sizeof(uint64_t) * seq_info.n);
-  if (covered_seqs == NULL) {
-    badexit("Error: Failed to allocate memory for bed stats.");
+  int ret_val;
+  kstream_t *kbed = ks_init(files.e);
+  kstring_t line = { 0, 0, 0 };
+  while ((ret_val = ks_getuntil(kbed, '\n', &line, 0)) >= 0) {
+    line_num++;
+    if (count_nonempty_chars(line.s) == 0 || line.s[0] == '#' ||
+        !strncmp(line.s, "browser", 7) || !strncmp(line.s, "track", 5)) {
+      continue;
+    } else if (count_fields(line.s) < 3) {
+      ks_destroy(kbed);
+      fprintf(stderr, "Error: Line %'llu in exclusion bed has fewer than 3 tab-separated fields.",
+        line_num);
+      badexit("");
+    }
+    if (parse_bed_field(line.s, 2, tmp_field) == 0 || str_to_uint64_t(tmp_field, &start)) {
+      ks_destroy(kbed);
+      fprintf(stderr, "Error: Failed to parse exclusion bed start value on line %'llu.", line_num);
+      badexit("");
+    }
+    if (parse_bed_field(line.s, 3, tmp_field) == 0 || str_to_uint64_t(tmp_field, &end)) {
+      ks_destroy(kbed);
+      fprintf(stderr, "Error: Failed to parse exclusion bed end value on line %'llu.", line_num);
+      badexit("");
+    }
+    if (start >= end) {
+      ks_destroy(kbed);
+      fprintf(stderr, "Error: Line %'llu in exclusion bed has a start >= end value.", line_num);
+      badexit("");
+    }
+    if (count_field_size(line.s, 1) >= MOTIF_VALUE_MAX_CHAR) {
+      ks_destroy(kbed);
+      fprintf(stderr, "Error: Sequence name in exclusion bed on line %'llu is too large.", line_num);
+      badexit("");
+    }
+    parse_bed_field(line.s, 1, tmp_field);
+    if (args.trim_names) {
+      for (uint64_t i = 0; tmp_field[i] != '\0'; i++) {
+        if (tmp_field[i] == ' ') {
+          tmp_field[i] = '\0';
+          break;
+        }
+      }
+    }
+    khint64_t k = kh_get(seq_str_h, seq_hash_tab, tmp_field);
+    if (k == kh_end(seq_hash_tab)) {
+      n_skipped++;
+      continue;
+    }
+    if (n == n_alloc) {
+      excl_range_t *tmp_ptr = realloc(ranges, sizeof(excl_range_t) * (n_alloc + ALLOC_CHUNK_SIZE));
+      if (tmp_ptr == NULL) {
+        ks_destroy(kbed);
+        free(ranges);
+        badexit("Error: Failed to allocate more memory for exclusion ranges.");
+      }
+      ranges = tmp_ptr;
+      n_alloc += ALLOC_CHUNK_SIZE;
+    }
+    ranges[n].seq_i = kh_val(seq_hash_tab, k);
+    ranges[n].start = start;
+    ranges[n].end = end;
+    n++;
   }
-  ERASE_ARRAY(covered_seqs, seq_info.n);
-  for (uint64_t i = 0; i < bed.n_regions; i++) {
-    covered_seqs[bed.seq_indices[i]] = 1;
-    n_bases += bed.ends[i] - bed.starts[i];
+  ks_destroy(kbed);
+  free(line.s);
+  if (ret_val == -3) {
+    free(ranges);
+    badexit("Error: Failed to read exclusion bed file stream.");
+  }
+  qsort(ranges, n, sizeof(excl_range_t), cmp_excl_ranges);
+  uint64_t n_merged = 0;
+  for (uint64_t i = 0; i < n; i++) {
+    if (n_merged && ranges[n_merged - 1].seq_i == ranges[i].seq_i &&
+        ranges[i].start <= ranges[n_merged - 1].end) {
+      ranges[n_merged - 1].end = MAX(ranges[n_merged - 1].end, ranges[i].end);
+    } else {
+      ranges[n_merged++] = ranges[i];
+    }
   }
-  for (uint64_t i = 0; i < seq_info.n; i++) {
-    n_seqs += covered_seqs[i];
+  uint64_t excl_bases = 0;
+  for (uint64_t i = 0; i < n_merged; i++) {
+    excl_bases += MIN(ranges[i].end, seq_sizes[ranges[i].seq_i]) -
+      MIN(ranges[i].start, seq_sizes[ranges[i].seq_i]);
+  }
+  for (uint64_t r = 0; r < n_merged; ) {
+    const uint64_t seq_i = ranges[r].seq_i;
+    uint64_t r_end = r;
+    while (r_end < n_merged && ranges[r_end].seq_i == seq_i) r_end++;
+    const uint64_t *segs = seq_segs[seq_i];
+    uint64_t n_new = 0, n_new_alloc = seq_n_segs[seq_i] + r_end - r;
+    uint64_t *new_segs = malloc(sizeof(uint64_t) * 2 * MAX(1, n_new_alloc));
+    if (new_segs == NULL) {
+      free(ranges);
+      badexit("Error: Failed to allocate memory for sequence segments.");
+    }
+    for (uint64_t s = 0, j = r; s < seq_n_segs[seq_i]; s++) {
+      uint64_t cur = segs[2 * s];
+      const uint64_t seg_end = segs[2 * s + 1];
+      while (j < r_end && ranges[j].end <= cur) j++;
+      for (uint64_t k = j; k < r_end && ranges[k].start < seg_end; k++) {
+        if (ranges[k].start >= cur + seq_segs_min_size) {
+          new_segs[2 * n_new] = cur;
+          new_segs[2 * n_new + 1] = ranges[k].start;
+          n_new++;
+        }
+        cur = MAX(cur, ranges[k].end);
+      }
+      if (seg_end >= cur + seq_segs_min_size) {
+        new_segs[2 * n_new] = cur;
+        new_segs[2 * n_new + 1] = seg_end;
+        n_new++;
+      }
+    }
+    free(seq_segs[seq_i]);
+    seq_segs[seq_i] = new_segs;
+    seq_n_segs[seq_i] = n_new;
+    r = r_end;
   }
-  fprintf(stderr, "Found %'llu range(s) covering %'llu base(s) across %'llu sequence(s).\n",
-    bed.n_regions, n_bases, n_seqs);
-  free(covered_seqs);
-}
-
-static void count_bases_single_in_bed(const unsigned char *seq, const uint64_t start, const uint64_t end) {
-  for (uint64_t i = start; i < end; i++) char_counts[seq[i]]++;
-}
-
-static void print_seq_stats_single_in_bed(FILE *whereto, const uint64_t seq_i, const uint64_t seq_j) {
-  for (uint64_t i = 0; i < bed.n_regions; i++) {
-    if (bed.seq_indices[i] == seq_j) {
-      ERASE_ARRAY(char_counts, 256);
-      count_bases_single_in_bed(seqs[seq_i], bed.starts[i], bed.ends[i]);
-      fprintf(whereto, "%s:%llu-%llu(%c)\t%s\t%llu\t%s\t%llu\t%.2f\t%llu\n",
-        seq_names[bed.seq_indices[i]], bed.starts[i] + 1, bed.ends[i], bed.strands[i],
-        bed.range_names[i], seq_j + 1, seq_names[seq_j], bed.ends[i] - bed.starts[i],
-        calc_gc() * 100.0, (bed.ends[i] - bed.starts[i]) - standard_base_count());
+  if (args.v) {
+    fprintf(stderr, "Excluding %'llu base(s) in %'llu merged range(s) from scanning.\n",
+      excl_bases, n_merged);
+    if (n_skipped) {
+      fprintf(stderr, "Ignored %'llu exclusion range(s) on sequences not in the input.\n",
+        n_skipped);
     }
   }
+  free(ranges);
 }
 
-static void print_seq_stats_in_bed(FILE *whereto) {
-  for (uint64_t i = 0; i < bed.n_regions; i++) {
-    ERASE_ARRAY(char_counts, 256);
-    count_bases_single_in_bed(seqs[bed.seq_indices[i]], bed.starts[i], bed.ends[i]);
-    fprintf(whereto, "%s:%llu-%llu(%c)\t%s\t%llu\t%s\t%llu\t%.2f\t%llu\n",
-      seq_names[bed.seq_indices[i]], bed.starts[i] + 1, bed.ends[i], bed.strands[i],
-      bed.range_names[i], bed.seq_indices[i] + 1, seq_names[bed.seq_indices[i]],
-      bed.ends[i] - bed.starts[i], calc_gc() * 100.0,
-      (bed.ends[i] - bed.starts[i]) - standard_base_count());
-  }
+/* One ALT allele of a VCF record (-V). The ID, REF and ALT strings share a
+ * single allocation owned by id. Alleles of a multi-allelic record share the
+ * same record number, which is used to avoid re-scoring the reference.
+ */
+typedef struct variant_t {
+  uint64_t  seq_i;
+  uint64_t  pos;                  /* 0-based position of the first REF base */
+  uint64_t  record;
+  char     *id;
+  char     *ref;
+  char     *alt;
+  uint64_t  ref_size;
+  uint64_t  alt_size;
+  uint64_t  carriers_off;         /* -H: haplotypes carrying this allele */
+  uint64_t  n_carriers;
+} variant_t;
+
+typedef struct variants_t {
+  variant_t  *v;
+  uint64_t    n;
+  uint64_t    n_alloc;
+  uint64_t    n_records;
+} variants_t;
+
+static variants_t variants = {
+  .v         = NULL,
+  .n         = 0,
+  .n_alloc   = 0,
+  .n_records = 0
+};
+
+static void free_variants(void) {
+  for (uint64_t i = 0; i < variants.n; i++) free(variants.v[i].id);
+  free(variants.v);
 }
 
-static inline void score_subseq(const motif_t *motif, const unsigned char *seq, const uint64_t offset, int *score, const unsigned char *char2Xindex) {
-  *score = 0;
-  for (uint64_t i = 0; i < motif->size; i++) {
-    *score += get_score(motif, seq[i + offset], i, char2Xindex);
+/* Copy bases [start, end) of a sequence, whether it was loaded or is in a
+ * .2bit file.
+ */
+static void copy_seq_range(const uint64_t seq_i, const uint64_t start, const uint64_t end, unsigned char *dst) {
+  if (args.use_twobit) {
+    twobit_decode(&twobit, seq_i, start, end, dst);
+  } else {
+    memcpy(dst, seqs[seq_i] + start, end - start);
   }
 }
 
-static inline void score_subseq_rev(const motif_t *motif, const unsigned char *seq, const uint64_t offset, int *score, const unsigned char *char2Xindex) {
-  *score = 0;
-  for (uint64_t i = 0; i < motif->size; i++) {
-    *score += get_score_rc(motif, seq[i + offset], i, char2Xindex);
-  }
+static void push_variant(const uint64_t seq_i, const uint64_t pos, const uint64_t record, const char *id, const uint64_t id_size, const char *ref, const uint64_t ref_size, const char *alt, const uint64_t alt_size) {
+  if (variants.n == variants.n_alloc) {
+    variant_t *tmp_ptr = realloc(variants.v, sizeof(variant_t) * (variants.n_alloc + ALLOC_CHUNK_SIZE));
+    if (tmp_ptr == NULL) {
+      badexit("Error: Failed to allocate memory for variants.");
+    }
+    variants.v = tmp_ptr;
+    variants.n_alloc += ALLOC_CHUNK_SIZE;
+  }
+  variant_t *var = &variants.v[variants.n];
+  var->id = malloc(id_size + ref_size + alt_size + 3);
+  if (var->id == NULL) {
+    badexit("Error: Failed to allocate memory for variant.");
+  }
+  var->ref = var->id + id_size + 1;
+  var->alt = var->ref + ref_size + 1;
+  memcpy(var->id, id, id_size);
+  var->id[id_size] = '\0';
+  memcpy(var->ref, ref, ref_size);
+  var->ref[ref_size] = '\0';
+  memcpy(var->alt, alt, alt_size);
+  var->alt[alt_size] = '\0';
+  var->seq_i = seq_i;
+  var->pos = pos;
+  var->record = record;
+  var->ref_size = ref_size;
+  var->alt_size = alt_size;
+  var->carriers_off = 0;
+  var->n_carriers = 0;
+  variants.n++;
 }
 
-static inline void score_subseq_rc(const motif_t *motif, const unsigned char *seq, const uint64_t offset, int *score, int *score_rc, const unsigned char *char2Xindex) {
-  *score = 0; *score_rc = 0;
-  for (uint64_t i = 0; i < motif->size; i++) {
-    *score += get_score(motif, seq[i + offset], i, char2Xindex);
-    *score_rc += get_score_rc(motif, seq[i + offset], i, char2Xindex);
+/* Sample genotypes (-H). Every sample has two haplotypes, numbered
+ * 2*sample and 2*sample+1, and each ALT allele stores the list of
+ * haplotypes carrying it in carriers. Most genotypes are homozygous for the
+ * reference, so this is much smaller than a full genotype matrix.
+ */
+typedef struct haps_t {
+  char      **samples;
+  uint64_t    n_samples;
+  uint32_t   *carriers;
+  uint64_t    n_carriers;
+  uint64_t    n_alloc;
+  uint64_t   *order;                /* Variants sorted by position       */
+  uint64_t   *clusters;             /* Offsets into order, n_clusters+1  */
+  uint64_t    n_clusters;
+} haps_t;
+
+static haps_t haps = {
+  .samples    = NULL,
+  .n_samples  = 0,
+  .carriers   = NULL,
+  .n_carriers = 0,
+  .n_alloc    = 0,
+  .order      = NULL,
+  .clusters   = NULL,
+  .n_clusters = 0
+};
+
+static void free_haps(void) {
+  for (uint64_t i = 0; i < haps.n_samples; i++) free(haps.samples[i]);
+  free(haps.samples);
+  free(haps.carriers);
+  free(haps.order);
+  free(haps.clusters);
+}
+
+static void read_vcf_samples(const char *line) {
+  const uint64_t n_fields = count_fields(line);
+  if (n_fields < 10) {
+    badexit("Error: The VCF does not have any sample columns, which -H requires.");
+  }
+  haps.n_samples = n_fields - 9;
+  if (haps.n_samples > UINT32_MAX / 2) {
+    badexit("Error: Too many samples in VCF.");
+  }
+  haps.samples = malloc(sizeof(char *) * haps.n_samples);
+  if (haps.samples == NULL) {
+    badexit("Error: Failed to allocate memory for VCF samples.");
+  }
+  for (uint64_t i = 0; i < haps.n_samples; i++) {
+    const char *name = line + field_start(line, i + 10);
+    const uint64_t name_size = count_field_size(line, i + 10);
+    haps.samples[i] = malloc(name_size + 1);
+    if (haps.samples[i] == NULL) {
+      badexit("Error: Failed to allocate memory for VCF sample name.");
+    }
+    memcpy(haps.samples[i], name, name_size);
+    haps.samples[i][name_size] = '\0';
+  }
+}
+
+static inline void push_carrier(const uint32_t hap) {
+  if (haps.n_carriers == haps.n_alloc) {
+    uint32_t *tmp_ptr = realloc(haps.carriers,
+      sizeof(uint32_t) * (haps.n_alloc + ALLOC_CHUNK_SIZE * 64));
+    if (tmp_ptr == NULL) {
+      badexit("Error: Failed to allocate memory for VCF genotypes.");
+    }
+    haps.carriers = tmp_ptr;
+    haps.n_alloc += ALLOC_CHUNK_SIZE * 64;
+  }
+  haps.carriers[haps.n_carriers++] = hap;
+}
+
+/* Parse the GT of every sample of a record, and add the haplotypes carrying
+ * each ALT allele to its variant (alt_vars[a-1] for allele a, UINT64_MAX if it
+ * was skipped). Missing alleles are treated as the reference, haploid calls
+ * as homozygous, and any alleles past the second are ignored. Unphased
+ * genotypes are used in the order they are written.
+ */
+static void read_vcf_genotypes(const char *line, const uint64_t line_num, const uint64_t *alt_vars, const uint64_t n_alts, uint32_t *hap_alleles) {
+  if (count_fields(line) < 9 + haps.n_samples) {
+    fprintf(stderr, "Error: Line %'llu in VCF has fewer sample columns than the header.",
+      line_num);
+    badexit("");
+  }
+  const uint64_t format_start = field_start(line, 9);
+  const uint64_t format_size = count_field_size(line, 9);
+  const char *format = line + format_start;
+  uint64_t gt_i = 0, key_start = 0;
+  int has_gt = 0;
+  for (uint64_t f = 0; f <= format_size; f++) {
+    if (f == format_size || format[f] == ':') {
+      if (f - key_start == 2 && format[key_start] == 'G' && format[key_start + 1] == 'T') {
+        has_gt = 1;
+        break;
+      }
+      gt_i++;
+      key_start = f + 1;
+    }
+  }
+  if (!has_gt) {
+    fprintf(stderr, "Error: No GT in the VCF FORMAT column on line %'llu.", line_num);
+    badexit("");
+  }
+  uint64_t i = format_start + format_size;
+  for (uint64_t smp = 0; smp < haps.n_samples; smp++) {
+    if (line[i] != '\t') {
+      fprintf(stderr, "Error: Line %'llu in VCF has fewer sample columns than the header.",
+        line_num);
+      badexit("");
+    }
+    i++;
+    for (uint64_t sub = 0; sub < gt_i && line[i] != '\t' && line[i] != '\0'; i++) {
+      if (line[i] == ':') sub++;
+    }
+    uint32_t alleles[2] = { 0, 0 };
+    uint64_t n_alleles = 0;
+    while (line[i] != '\t' && line[i] != '\0' && line[i] != ':') {
+      uint32_t allele = 0;
+      if (line[i] >= '0' && line[i] <= '9') {
+        while (line[i] >= '0' && line[i] <= '9') {
+          allele = allele * 10 + (line[i] - '0');
+          i++;
+        }
+      } else {
+        i++;
+      }
+      if (n_alleles < 2) alleles[n_alleles] = allele;
+      n_alleles++;
+      if (line[i] == '|' || line[i] == '/') i++;
+    }
+    if (n_alleles == 1) alleles[1] = alleles[0];
+    while (line[i] != '\t' && line[i] != '\0') i++;
+    hap_alleles[2 * smp] = alleles[0];
+    hap_alleles[2 * smp + 1] = alleles[1];
+  }
+  for (uint64_t a = 0; a < n_alts; a++) {
+    if (alt_vars[a] == UINT64_MAX) continue;
+    variant_t *var = &variants.v[alt_vars[a]];
+    var->carriers_off = haps.n_carriers;
+    for (uint64_t h = 0; h < 2 * haps.n_samples; h++) {
+      if (hap_alleles[h] == a + 1) push_carrier(h);
+    }
+    var->n_carriers = haps.n_carriers - var->carriers_off;
+  }
+}
+
+
+static inline int is_plain_allele(const char *allele, const uint64_t size) {
+  if (!size) return 0;
+  for (uint64_t i = 0; i < size; i++) {
+    if ((allele[i] < 'A' || allele[i] > 'Z') && (allele[i] < 'a' || allele[i] > 'z')) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Read the -V VCF. Only the first five columns are used. Records on
+ * sequences not in the input or with a REF not matching the sequence are
+ * skipped, as are symbolic, missing and spanning deletion ALT alleles.
+ */
+static void read_vcf(void) {
+  uint64_t line_num = 0, n_skipped_seqs = 0, n_mismatches = 0, n_skipped_alleles = 0;
+  uint64_t pos, ref_buf_size = 0, n_alts = 0, alt_vars_size = 0;
+  unsigned char *ref_buf = NULL;
+  uint64_t *alt_vars = NULL;
+  uint32_t *hap_alleles = NULL;
+  char tmp_field[MOTIF_VALUE_MAX_CHAR];
+  int ret_val;
+  kstream_t *kvcf = ks_init(files.vcf);
+  kstring_t line = { 0, 0, 0 };
+  while ((ret_val = ks_getuntil(kvcf, '\n', &line, 0)) >= 0) {
+    line_num++;
+    if (args.use_haps && !strncmp(line.s, "#CHROM", 6) && haps.samples == NULL) {
+      read_vcf_samples(line.s);
+      hap_alleles = malloc(sizeof(uint32_t) * 2 * haps.n_samples);
+      if (hap_alleles == NULL) {
+        badexit("Error: Failed to allocate memory for VCF genotypes.");
+      }
+      continue;
+    } else if (count_nonempty_chars(line.s) == 0 || line.s[0] == '#') {
+      continue;
+    } else if (args.use_haps && haps.samples == NULL) {
+      badexit("Error: The VCF is missing its #CHROM header line, which -H requires.");
+    } else if (count_fields(line.s) < 5) {
+      ks_destroy(kvcf);
+      fprintf(stderr, "Error: Line %'llu in VCF has fewer than 5 tab-separated fields.",
+        line_num);
+      badexit("");
+    }
+    if (count_field_size(line.s, 1) >= MOTIF_VALUE_MAX_CHAR) {
+      ks_destroy(kvcf);
+      fprintf(stderr, "Error: Sequence name in VCF on line %'llu is too large.", line_num);
+      badexit("");
+    }
+    parse_bed_field(line.s, 1, tmp_field);
+    if (args.trim_names) {
+      for (uint64_t i = 0; tmp_field[i] != '\0'; i++) {
+        if (tmp_field[i] == ' ') {
+          tmp_field[i] = '\0';
+          break;
+        }
+      }
+    }
+    khint64_t k = kh_get(seq_str_h, seq_hash_tab, tmp_field);
+    if (k == kh_end(seq_hash_tab)) {
+      n_skipped_seqs++;
+      continue;
+    }
+    const uint64_t seq_i = kh_val(seq_hash_tab, k);
+    if (count_field_size(line.s, 2) >= MOTIF_VALUE_MAX_CHAR ||
+        parse_bed_field(line.s, 2, tmp_field) == 0 ||
+        str_to_uint64_t(tmp_field, &pos) || pos == 0) {
+      ks_destroy(kvcf);
+      fprintf(stderr, "Error: Failed to parse VCF position on line %'llu.", line_num);
+      badexit("");
+    }
+    pos--;
+    const char *id = line.s + field_start(line.s, 3);
+    const uint64_t id_size = count_field_size(line.s, 3);
+    const char *ref = line.s + field_start(line.s, 4);
+    const uint64_t ref_size = count_field_size(line.s, 4);
+    const char *alts = line.s + field_start(line.s, 5);
+    const uint64_t alts_size = count_field_size(line.s, 5);
+    if (!is_plain_allele(ref, ref_size)) {
+      ks_destroy(kvcf);
+      fprintf(stderr, "Error: Failed to parse VCF REF allele on line %'llu.", line_num);
+      badexit("");
+    }
+    if (pos + ref_size > seq_sizes[seq_i]) {
+      n_mismatches++;
+      continue;
+    }
+    if (ref_size > ref_buf_size) {
+      unsigned char *tmp_ptr = realloc(ref_buf, ref_size);
+      if (tmp_ptr == NULL) {
+        ks_destroy(kvcf);
+        free(ref_buf);
+        badexit("Error: Failed to allocate memory for VCF REF allele.");
+      }
+      ref_buf = tmp_ptr;
+      ref_buf_size = ref_size;
+    }
+    copy_seq_range(seq_i, pos, pos + ref_size, ref_buf);
+    int ref_matches = 1;
+    for (uint64_t i = 0; i < ref_size; i++) {
+      if (char2index[ref_buf[i]] != char2index[(unsigned char) ref[i]]) {
+        ref_matches = 0;
+        break;
+      }
+    }
+    if (!ref_matches) {
+      n_mismatches++;
+      continue;
+    }
+    n_alts = 0;
+    for (uint64_t a = 0; a < alts_size; ) {
+      uint64_t alt_size = 0;
+      while (a + alt_size < alts_size && alts[a + alt_size] != ',') alt_size++;
+      if (n_alts == alt_vars_size) {
+        alt_vars_size += 16;
+        uint64_t *tmp_ptr = realloc(alt_vars, sizeof(uint64_t) * alt_vars_size);
+        if (tmp_ptr == NULL) {
+          badexit("Error: Failed to allocate memory for VCF ALT alleles.");
+        }
+        alt_vars = tmp_ptr;
+      }
+      if (is_plain_allele(alts + a, alt_size) &&
+          (alt_size != ref_size || strncasecmp(alts + a, ref, ref_size))) {
+        alt_vars[n_alts++] = variants.n;
+        push_variant(seq_i, pos, variants.n_records, id, id_size, ref, ref_size,
+          alts + a, alt_size);
+      } else {
+        alt_vars[n_alts++] = UINT64_MAX;
+        n_skipped_alleles++;
+      }
+      a += alt_size + 1;
+    }
+    if (args.use_haps) {
+      read_vcf_genotypes(line.s, line_num, alt_vars, n_alts, hap_alleles);
+    }
+    variants.n_records++;
+  }
+  ks_destroy(kvcf);
+  free(line.s);
+  free(ref_buf);
+  free(alt_vars);
+  free(hap_alleles);
+  if (ret_val == -3) {
+    badexit("Error: Failed to read VCF file stream.");
+  }
+  if (args.use_haps && haps.samples == NULL) {
+    badexit("Error: The VCF is missing its #CHROM header line, which -H requires.");
+  }
+  if (n_mismatches) {
+    fprintf(stderr, "Warning: Skipped %'llu VCF record(s) not matching the sequences.\n",
+      n_mismatches);
+  }
+  if (args.v) {
+    fprintf(stderr, "Found %'llu allele(s) across %'llu VCF record(s).\n",
+      variants.n, variants.n_records);
+    if (n_skipped_seqs) {
+      fprintf(stderr, "Ignored %'llu VCF record(s) on sequences not in the input.\n",
+        n_skipped_seqs);
+    }
+    if (n_skipped_alleles) {
+      fprintf(stderr, "Ignored %'llu symbolic, missing or unchanged ALT allele(s).\n",
+        n_skipped_alleles);
+    }
+    if (args.use_haps) {
+      fprintf(stderr, "Found %'llu sample(s) with %'llu non-reference haplotype allele(s).\n",
+        haps.n_samples, haps.n_carriers);
+    }
+  }
+}
+
+static void print_bed_stats(void) {
+  if (args.w) {
+    fprintf(stderr, "%'llu line(s) total, with %'llu comment/header and %'llu empty line(s).\n",
+      bed.n_lines, bed.n_comments, bed.n_empty);
+  }
+  uint64_t n_seqs = 0, n_bases = 0;
+  uint64_t *covered_seqs = malloc(sizeof(uint64_t) * seq_info.n);
+  if (covered_seqs == NULL) {
+    badexit("Error: Failed to allocate memory for bed stats.");
+  }
+  ERASE_ARRAY(covered_seqs, seq_info.n);
+  for (uint64_t i = 0; i < bed.n_regions; i++) {
+    covered_seqs[bed.seq_indices[i]] = 1;
+    n_bases += bed.ends[i] - bed.starts[i];
+  }
+  for (uint64_t i = 0; i < seq_info.n; i++) {
+    n_seqs += covered_seqs[i];
+  }
+  fprintf(stderr, "Found %'llu range(s) covering %'llu base(s) across %'llu sequence(s).\n",
+    bed.n_regions, n_bases, n_seqs);
+  free(covered_seqs);
+}
+
+static void count_bases_single_in_bed(const unsigned char *seq, const uint64_t start, const uint64_t end) {
+  for (uint64_t i = start; i < end; i++) char_counts[seq[i]]++;
+}
+
+static void print_seq_stats_single_in_bed(FILE *whereto, const uint64_t seq_i, const uint64_t seq_j) {
+  for (uint64_t i = 0; i < bed.n_regions; i++) {
+    if (bed.seq_indices[i] == seq_j) {
+      ERASE_ARRAY(char_counts, 256);
+      count_bases_single_in_bed(seqs[seq_i], bed.starts[i], bed.ends[i]);
+      fprintf(whereto, "%s:%llu-%llu(%c)\t%s\t%llu\t%s\t%llu\t%.2f\t%llu\n",
+        seq_names[bed.seq_indices[i]], bed.starts[i] + 1, bed.ends[i], bed.strands[i],
+        bed.range_names[i], seq_j + 1, seq_names[seq_j], bed.ends[i] - bed.starts[i],
+        calc_gc() * 100.0, (bed.ends[i] - bed.starts[i]) - standard_base_count());
+    }
+  }
+}
+
+static void print_seq_stats_in_bed(FILE *whereto) {
+  for (uint64_t i = 0; i < bed.n_regions; i++) {
+    ERASE_ARRAY(char_counts, 256);
+    count_bases_single_in_bed(seqs[bed.seq_indices[i]], bed.starts[i], bed.ends[i]);
+    fprintf(whereto, "%s:%llu-%llu(%c)\t%s\t%llu\t%s\t%llu\t%.2f\t%llu\n",
+      seq_names[bed.seq_indices[i]], bed.starts[i] + 1, bed.ends[i], bed.strands[i],
+      bed.range_names[i], bed.seq_indices[i] + 1, seq_names[bed.seq_indices[i]],
+      bed.ends[i] - bed.starts[i], calc_gc() * 100.0,
+      (bed.ends[i] - bed.starts[i]) - standard_base_count());
+  }
+}
+
+static inline void score_subseq(const motif_t *motif, const unsigned char *seq, const uint64_t offset, int *score, const unsigned char *char2Xindex) {
+  motif->score_fn(motif->pwm, seq + offset, score, char2Xindex);
+}
+
+static inline void score_subseq_rev(const motif_t *motif, const unsigned char *seq, const uint64_t offset, int *score, const unsigned char *char2Xindex) {
+  motif->score_fn(motif->pwm_rc, seq + offset, score, char2Xindex);
+}
+
+static inline void score_subseq_rc(const motif_t *motif, const unsigned char *seq, const uint64_t offset, int *score, int *score_rc, const unsigned char *char2Xindex) {
+  motif->score_rc_fn(motif->pwm, motif->pwm_rc, seq + offset, score, score_rc, char2Xindex);
+}
+
+/* A plain table lookup over the (at most 50) match bytes; gcc vectorizes this
+ * as a reversed gather, which is cheaper than the fprintf that follows.
+ */
+static inline void rev_comp_match(unsigned char *dst, const unsigned char *src, const int size) {
+  for (int i = 0; i < size; i++) {
+    dst[i] = char2comp[src[size - 1 - i]];
+  }
+}
+
+/* bigBed output (-B). Each motif gets its own file, written by the thread
+ * which scanned it as soon as it is done. The layout follows the UCSC BBI
+ * format: a fixed header, an autoSql description of the columns, a B+ tree
+ * mapping sequence names to IDs, the zlib-compressed data blocks, and an
+ * R-tree indexing those blocks by position. No zoom levels or summary are
+ * written, which are optional.
+ */
+
+#define BB_MAGIC               0x8789F2EB
+#define BB_VERSION                      4
+#define BB_HEADER_SIZE                 64
+#define BPT_MAGIC              0x78CA8C91
+#define CIR_MAGIC              0x2468ACE0
+#define CIR_HEADER_SIZE                48
+
+static const char *bb_autosql =
+  "table yamscan\n"
+  "\"yamscan motif hits\"\n"
+  "    (\n"
+  "    string chrom;      \"Sequence name\"\n"
+  "    uint   chromStart; \"Start position (0-based)\"\n"
+  "    uint   chromEnd;   \"End position\"\n"
+  "    string name;       \"Motif name\"\n"
+  "    uint   score;      \"min(1000, -10*log10(P-value))\"\n"
+  "    char[1] strand;    \"Strand\"\n"
+  "    float  logOdds;    \"PWM score\"\n"
+  "    float  scorePct;   \"Score as a percentage of the max possible score\"\n"
+  "    double pValue;     \"P-value\"\n"
+  "    string qValue;     \"Q-value (always '.')\"\n"
+  "    )\n";
+
+typedef struct bbi_block_t {
+  uint32_t    chrom;
+  uint32_t    start;
+  uint32_t    end;
+  uint64_t    offset;
+  uint64_t    size;
+} bbi_block_t;
+
+typedef struct rtree_node_t {
+  uint32_t    start_chrom;
+  uint32_t    start;
+  uint32_t    end_chrom;
+  uint32_t    end;
+  uint64_t    first;                       /* First child in the level below */
+  uint64_t    n;
+} rtree_node_t;
+
+static int cmp_seq_ranks(const void *a, const void *b) {
+  return strcmp(seq_names[*((const uint64_t *) a)], seq_names[*((const uint64_t *) b)]);
+}
+
+static void rank_seq_names(void) {
+  ranked_seqs = malloc(sizeof(uint64_t) * seq_info.n);
+  seq_ranks = malloc(sizeof(uint64_t) * seq_info.n);
+  if (ranked_seqs == NULL || seq_ranks == NULL) {
+    badexit("Error: Failed to allocate memory for sequence ranks.");
+  }
+  for (uint64_t i = 0; i < seq_info.n; i++) {
+    ranked_seqs[i] = i;
+    if (seq_sizes[i] > UINT32_MAX) {
+      fprintf(stderr, "Error: Sequence \"%s\" is too large for -B/-W/-S/-K (%llu>max=%u).",
+        seq_names[i], seq_sizes[i], UINT32_MAX);
+      badexit("");
+    }
+  }
+  qsort(ranked_seqs, seq_info.n, sizeof(uint64_t), cmp_seq_ranks);
+  for (uint64_t i = 0; i < seq_info.n; i++) {
+    seq_ranks[ranked_seqs[i]] = i;
+  }
+}
+
+static void init_hits(motif_t *motif) {
+  motif->hits = malloc(sizeof(hits_t));
+  if (motif->hits == NULL) {
+    badexit("Error: Failed to allocate memory for hits.");
+  }
+  motif->hits->h = NULL;
+  motif->hits->n = 0;
+  motif->hits->n_alloc = 0;
+}
+
+static inline void push_hit(hits_t *hits, const uint64_t seq_i, const uint64_t start, const char strand, const double pvalue, const double score, const double score_pct) {
+  if (hits->n == hits->n_alloc) {
+    const uint64_t n_alloc = hits->n_alloc ? hits->n_alloc * 2 : ALLOC_CHUNK_SIZE;
+    hit_t *tmp_ptr = realloc(hits->h, sizeof(hit_t) * n_alloc);
+    if (tmp_ptr == NULL) {
+      badexit("Error: Failed to allocate memory for hits.");
+    }
+    hits->h = tmp_ptr;
+    hits->n_alloc = n_alloc;
+  }
+  hit_t *hit = &hits->h[hits->n++];
+  hit->chrom = seq_ranks[seq_i];
+  hit->start = start;
+  hit->strand = strand;
+  hit->pvalue = pvalue;
+  hit->score = score;
+  hit->score_pct = score_pct;
+}
+
+static int cmp_hits(const void *a, const void *b) {
+  const hit_t *h1 = a, *h2 = b;
+  if (h1->chrom != h2->chrom) return h1->chrom < h2->chrom ? -1 : 1;
+  if (h1->start != h2->start) return h1->start < h2->start ? -1 : 1;
+  return (h1->strand > h2->strand) - (h1->strand < h2->strand);
+}
+
+static inline void write_u8(FILE *f, const uint8_t x) { fwrite(&x, 1, 1, f); }
+static inline void write_u16(FILE *f, const uint16_t x) { fwrite(&x, 2, 1, f); }
+static inline void write_u32(FILE *f, const uint32_t x) { fwrite(&x, 4, 1, f); }
+static inline void write_u64(FILE *f, const uint64_t x) { fwrite(&x, 8, 1, f); }
+
+static inline void write_zeros(FILE *f, uint64_t n) {
+  while (n--) fputc(0, f);
+}
+
+/* Bulk B+ tree of sequence names (padded to key_size) and their ID/size,
+ * in the same layout as written by bPlusTree.c. The names must be sorted.
+ */
+static void write_chrom_tree(FILE *f, const uint64_t *chrom_seqs, const uint64_t n) {
+  uint64_t key_size = 1;
+  for (uint64_t i = 0; i < n; i++) {
+    key_size = MAX(key_size, strlen(seq_names[chrom_seqs[i]]));
+  }
+  const uint64_t block_size = MAX(1, MIN(BBI_BLOCK_SIZE, n));
+  const uint64_t node_size = 4 + block_size * (key_size + 8);
+  write_u32(f, BPT_MAGIC);
+  write_u32(f, block_size);
+  write_u32(f, key_size);
+  write_u32(f, 8);
+  write_u64(f, n);
+  write_u64(f, 0);
+  if (!n) return;
+  uint64_t levels = 1;
+  for (uint64_t x = n; x > block_size; x = (x + block_size - 1) / block_size) {
+    levels++;
+  }
+  uint64_t offset = ftello(f);
+  for (uint64_t level = levels - 1; level > 0; level--) {
+    uint64_t slot_size = 1;
+    for (uint64_t i = 0; i < level; i++) slot_size *= block_size;
+    const uint64_t node_items = slot_size * block_size;
+    const uint64_t n_nodes = (n + node_items - 1) / node_items;
+    uint64_t next_child = offset + n_nodes * node_size;
+    for (uint64_t i = 0; i < n; i += node_items) {
+      const uint64_t count = MIN(block_size, (n - i + slot_size - 1) / slot_size);
+      write_u8(f, 0);
+      write_u8(f, 0);
+      write_u16(f, count);
+      for (uint64_t j = 0; j < count; j++) {
+        const char *key = seq_names[chrom_seqs[i + j * slot_size]];
+        const uint64_t key_len = strlen(key);
+        fwrite(key, 1, key_len, f);
+        write_zeros(f, key_size - key_len);
+        write_u64(f, next_child);
+        next_child += node_size;
+      }
+      write_zeros(f, (block_size - count) * (key_size + 8));
+    }
+    offset += n_nodes * node_size;
+  }
+  for (uint64_t i = 0; i < n; i += block_size) {
+    const uint64_t count = MIN(block_size, n - i);
+    write_u8(f, 1);
+    write_u8(f, 0);
+    write_u16(f, count);
+    for (uint64_t j = i; j < i + count; j++) {
+      const char *key = seq_names[chrom_seqs[j]];
+      const uint64_t key_len = strlen(key);
+      fwrite(key, 1, key_len, f);
+      write_zeros(f, key_size - key_len);
+      write_u32(f, j);
+      write_u32(f, seq_sizes[chrom_seqs[j]]);
+    }
+    write_zeros(f, (block_size - count) * (key_size + 8));
+  }
+}
+
+/* Bulk R-tree over the data blocks, in the same layout as written by
+ * cirTree.c. Level 0 nodes (the leaves) each hold up to BBI_BLOCK_SIZE data
+ * blocks, level 1 nodes hold up to BBI_BLOCK_SIZE leaves, and so on until a
+ * single root node is left. Levels are written starting from the root.
+ */
+static void write_rtree(FILE *f, const bbi_block_t *blocks, const uint64_t n, const uint64_t data_end) {
+  const uint64_t block_size = BBI_BLOCK_SIZE;
+  const uint64_t leaf_size = 4 + block_size * 32;
+  const uint64_t node_size = 4 + block_size * 24;
+  rtree_node_t *levels[64];
+  uint64_t level_n[64], level_offset[64], n_levels = 0, n_children = n;
+  do {
+    const uint64_t n_nodes = MAX(1, (n_children + block_size - 1) / block_size);
+    rtree_node_t *nodes = calloc(n_nodes, sizeof(rtree_node_t));
+    if (nodes == NULL) {
+      badexit("Error: Failed to allocate memory for bigBed index.");
+    }
+    for (uint64_t i = 0; i < n_nodes; i++) {
+      nodes[i].first = i * block_size;
+      nodes[i].n = MIN(n_children, nodes[i].first + block_size) - nodes[i].first;
+      for (uint64_t j = nodes[i].first; j < nodes[i].first + nodes[i].n; j++) {
+        rtree_node_t child;
+        if (n_levels) {
+          child = levels[n_levels - 1][j];
+        } else {
+          child.start_chrom = blocks[j].chrom;
+          child.start = blocks[j].start;
+          child.end_chrom = blocks[j].chrom;
+          child.end = blocks[j].end;
+        }
+        if (j == nodes[i].first) {
+          nodes[i].start_chrom = child.start_chrom;
+          nodes[i].start = child.start;
+          nodes[i].end_chrom = child.end_chrom;
+          nodes[i].end = child.end;
+        } else if (child.end_chrom > nodes[i].end_chrom ||
+            (child.end_chrom == nodes[i].end_chrom && child.end > nodes[i].end)) {
+          nodes[i].end_chrom = child.end_chrom;
+          nodes[i].end = child.end;
+        }
+      }
+    }
+    levels[n_levels] = nodes;
+    level_n[n_levels++] = n_nodes;
+    n_children = n_nodes;
+  } while (n_children > 1);
+  level_offset[n_levels - 1] = ftello(f) + CIR_HEADER_SIZE;
+  for (uint64_t l = n_levels - 1; l > 0; l--) {
+    level_offset[l - 1] = level_offset[l] + level_n[l] * node_size;
+  }
+  const rtree_node_t *root = levels[n_levels - 1];
+  write_u32(f, CIR_MAGIC);
+  write_u32(f, block_size);
+  write_u64(f, n);
+  write_u32(f, root->start_chrom);
+  write_u32(f, root->start);
+  write_u32(f, root->end_chrom);
+  write_u32(f, root->end);
+  write_u64(f, data_end);
+  write_u32(f, BBI_ITEMS_PER_SLOT);
+  write_u32(f, 0);
+  for (uint64_t l = n_levels; l-- > 0; ) {
+    for (uint64_t i = 0; i < level_n[l]; i++) {
+      const rtree_node_t *node = &levels[l][i];
+      write_u8(f, l ? 0 : 1);
+      write_u8(f, 0);
+      write_u16(f, node->n);
+      for (uint64_t j = node->first; j < node->first + node->n; j++) {
+        if (l) {
+          const rtree_node_t *child = &levels[l - 1][j];
+          write_u32(f, child->start_chrom);
+          write_u32(f, child->start);
+          write_u32(f, child->end_chrom);
+          write_u32(f, child->end);
+          write_u64(f, level_offset[l - 1] + j * (l > 1 ? node_size : leaf_size));
+        } else {
+          write_u32(f, blocks[j].chrom);
+          write_u32(f, blocks[j].start);
+          write_u32(f, blocks[j].chrom);
+          write_u32(f, blocks[j].end);
+          write_u64(f, blocks[j].offset);
+          write_u64(f, blocks[j].size);
+        }
+      }
+      write_zeros(f, (block_size - node->n) * (l ? 24 : 32));
+    }
+  }
+  for (uint64_t l = 0; l < n_levels; l++) {
+    free(levels[l]);
+  }
+}
+
+static inline double track_score(const double pvalue) {
+  return MIN(1000.0, pvalue > 0.0 ? -10.0 * log10(pvalue) : 1000.0);
+}
+
+/* Create <prefix><name><ext>, with any '/' in the motif name replaced */
+static FILE *create_motif_file(const char *name, const char *prefix, const char *ext, const char *what, char *fname) {
+  int fname_len = snprintf(fname, PATH_MAX, "%s%s%s", prefix, name, ext);
+  if (fname_len >= PATH_MAX) {
+    fprintf(stderr, "Error: %s filename for motif \"%s\" is too long.", what, name);
+    badexit("");
+  }
+  for (char *c = fname + strlen(prefix); *c != '\0'; c++) {
+    if (*c == '/') *c = '_';
+  }
+  FILE *f = fopen(fname, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "Error: Failed to create %s file \"%s\" [%s]", what, fname, strerror(errno));
+    badexit("");
+  }
+  return f;
+}
+
+/* -O: create <prefix><name><ext> and print the header to it. The extension
+ * follows -F and -z/-Z.
+ */
+static FILE *open_split_file(const char *name) {
+  static const char *fmt_exts[] = { "", ".txt", ".bed", ".gff3", ".gtf" };
+  char ext[16], fname[PATH_MAX];
+  snprintf(ext, sizeof(ext), "%s%s", fmt_exts[args.out_fmt],
+    args.compress == ZOUT_BGZF ? ".gz" : args.compress == ZOUT_ZSTD ? ".zst" : "");
+  FILE *f = create_motif_file(name, args.split_prefix, ext, "Output", fname);
+  if (args.compress) {
+    const char *zout_err = NULL;
+    FILE *zout = zout_open(f, args.compress, args.compress_level, args.compress_threads, 1,
+      NULL, &zout_err);
+    if (zout == NULL) {
+      fprintf(stderr, "Error: Failed to set up compression for \"%s\" [%s].", fname, zout_err);
+      badexit("");
+    }
+    f = zout;
+  }
+  fputs(split_header, f);
+  return f;
+}
+
+/* With -O (but not -N), each motif gets its own file while it is scanned.
+ * With -I, hits are kept in memory to be sorted by write_tabix_lines.
+ */
+static void open_motif_out(motif_t *motif) {
+  if (args.split_prefix != NULL && !args.n_shards) {
+    motif->out = open_split_file(motif->name);
+  } else if (args.tabix_path != NULL) {
+    motif->out = open_memstream(&motif->out_buf, &motif->out_size);
+    if (motif->out == NULL) {
+      badexit("Error: Failed to allocate memory for -I hits.");
+    }
+  }
+}
+
+static void close_motif_out(motif_t *motif) {
+  if ((args.split_prefix != NULL && !args.n_shards) || args.tabix_path != NULL) {
+    if (fclose(motif->out)) {
+      badexit("Error: Failed to write hits.");
+    }
+    motif->out = NULL;
+  }
+}
+
+static int cmp_tabix_lines(const void *a, const void *b) {
+  const tabix_line_t *x = (const tabix_line_t *) a, *y = (const tabix_line_t *) b;
+  if (x->seq_i != y->seq_i) return x->seq_i < y->seq_i ? -1 : 1;
+  if (x->start != y->start) return x->start < y->start ? -1 : 1;
+  if (x->end != y->end) return x->end < y->end ? -1 : 1;
+  return x->order < y->order ? -1 : x->order > y->order;
+}
+
+/* Columns holding the sequence name and range of the hits for -I */
+static tbx_conf_t tabix_conf(void) {
+  tbx_conf_t conf = { 0, 1, 2, 3, '#', 0 };
+  switch (args.out_fmt) {
+    case OUT_YAMSCAN:
+      if (args.use_bed) {
+        conf.sc = 3; conf.bc = 4; conf.ec = 5;
+      }
+      break;
+    case OUT_BED:
+      conf.preset = TBX_UCSC;
+      break;
+    case OUT_GFF3:
+    case OUT_GTF:
+      conf.bc = 4; conf.ec = 5;
+      break;
+  }
+  return conf;
+}
+
+/* -I: print the hits kept in memory sorted by sequence (in the order they
+ * were read) and position, remembering where each line starts in the output.
+ */
+static void write_tabix_lines(void) {
+  const tbx_conf_t conf = tabix_conf();
+  uint64_t n_alloc = 0;
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    char *buf = motifs[i]->out_buf;
+    if (buf == NULL) continue;
+    for (char *line = buf, *nl; line < buf + motifs[i]->out_size; line = nl + 1) {
+      nl = strchr(line, '\n');
+      if (n_tabix_lines == n_alloc) {
+        n_alloc = MAX(1024, n_alloc * 2);
+        tabix_line_t *tmp_ptr = realloc(tabix_lines, sizeof(tabix_line_t) * n_alloc);
+        if (tmp_ptr == NULL) {
+          badexit("Error: Failed to allocate memory for sorting -I hits.");
+        }
+        tabix_lines = tmp_ptr;
+      }
+      tabix_line_t *t = &tabix_lines[n_tabix_lines];
+      const char *name;
+      uint64_t name_size;
+      if (tbx_parse(&conf, line, &name, &name_size, &t->start, &t->end)) {
+        badexit("Error: Failed to parse hit for -I.");
+      }
+      char *name_end = line + (name - line) + name_size;
+      const char tmp_char = *name_end;
+      *name_end = '\0';
+      khint_t k = kh_get(seq_str_h, seq_hash_tab, name);
+      if (k == kh_end(seq_hash_tab)) {
+        fprintf(stderr, "Error: Unknown sequence \"%s\" in -I hits.", name);
+        badexit("");
+      }
+      *name_end = tmp_char;
+      if (t->end > TBX_MAX_POS) {
+        fprintf(stderr, "Error: Hit at %.*s:%llu is past the 2^29 limit of -I.",
+          (int) name_size, name, t->end);
+        badexit("");
+      }
+      t->seq_i = kh_val(seq_hash_tab, k);
+      t->order = n_tabix_lines++;
+      t->line = line;
+      t->size = nl - line + 1;
+    }
+  }
+  if (n_tabix_lines) qsort(tabix_lines, n_tabix_lines, sizeof(tabix_line_t), cmp_tabix_lines);
+  if (fflush(files.o)) {
+    badexit("Error: Failed to write output.");
+  }
+  uint64_t pos = tabix_blocks.in_bytes;
+  for (uint64_t i = 0; i < n_tabix_lines; i++) {
+    tabix_lines[i].pos = pos;
+    fwrite(tabix_lines[i].line, 1, tabix_lines[i].size, files.o);
+    pos += tabix_lines[i].size;
+  }
+}
+
+static inline uint64_t tabix_voffset(const uint64_t pos) {
+  return (tabix_blocks.offsets[pos / ZOUT_BGZF_BLOCK_SIZE] << 16) | (pos % ZOUT_BGZF_BLOCK_SIZE);
+}
+
+/* -I: once the output is closed and the offsets of its blocks are known,
+ * index the lines printed by write_tabix_lines.
+ */
+static void write_tabix_index(void) {
+  tbx_t *idx = tbx_init(tabix_conf());
+  if (idx == NULL) {
+    badexit("Error: Failed to allocate memory for tabix index.");
+  }
+  const tbx_conf_t conf = idx->conf;
+  for (uint64_t i = 0; i < n_tabix_lines; i++) {
+    const tabix_line_t *t = &tabix_lines[i];
+    const char *name;
+    uint64_t name_size, start, end;
+    tbx_parse(&conf, t->line, &name, &name_size, &start, &end);
+    if (tbx_push(idx, name, name_size, t->start, t->end,
+          tabix_voffset(t->pos), tabix_voffset(t->pos + t->size))) {
+      badexit("Error: Failed to allocate memory for tabix index.");
+    }
+  }
+  char fname[PATH_MAX];
+  if (snprintf(fname, PATH_MAX, "%s.tbi", args.tabix_path) >= PATH_MAX) {
+    badexit("Error: Tabix index filename is too long.");
+  }
+  const char *tbx_err = NULL;
+  if (tbx_write(idx, fname, &tbx_err)) {
+    fprintf(stderr, "Error: Failed to write tabix index \"%s\" [%s].", fname, tbx_err);
+    badexit("");
+  }
+  tbx_destroy(idx);
+  free(tabix_lines);
+  free(tabix_blocks.offsets);
+}
+
+/* Sort the buffered hits for a motif and write them as <prefix><motif>.bb.
+ * Data blocks never span more than one sequence.
+ */
+static void write_bigbed(const motif_t *motif) {
+  hits_t *hits = motif->hits;
+  char fname[PATH_MAX];
+  FILE *f = create_motif_file(motif->name, args.bb_prefix, ".bb", "bigBed", fname);
+  if (hits->n) qsort(hits->h, hits->n, sizeof(hit_t), cmp_hits);
+  uint64_t *chrom_seqs = malloc(sizeof(uint64_t) * (hits->n + 1));
+  bbi_block_t *blocks = malloc(sizeof(bbi_block_t) * (hits->n / BBI_ITEMS_PER_SLOT + seq_info.n + 1));
+  char *item = malloc(MAX_NAME_SIZE + 128);
+  uint64_t buf_size = 4096, n_chroms = 0, n_blocks = 0, max_block_size = 0;
+  unsigned char *buf = malloc(buf_size), *zbuf = NULL;
+  if (chrom_seqs == NULL || blocks == NULL || item == NULL || buf == NULL) {
+    badexit("Error: Failed to allocate memory for bigBed output.");
+  }
+  write_zeros(f, BB_HEADER_SIZE);
+  const uint64_t autosql_offset = ftello(f);
+  fwrite(bb_autosql, 1, strlen(bb_autosql) + 1, f);
+  for (uint64_t i = 0; i < hits->n; i++) {
+    if (!n_chroms || ranked_seqs[hits->h[i].chrom] != chrom_seqs[n_chroms - 1]) {
+      chrom_seqs[n_chroms++] = ranked_seqs[hits->h[i].chrom];
+    }
+  }
+  const uint64_t chrom_tree_offset = ftello(f);
+  write_chrom_tree(f, chrom_seqs, n_chroms);
+  const uint64_t data_offset = ftello(f);
+  write_u64(f, hits->n);
+  for (uint64_t i = 0, chrom_i = 0; i < hits->n; ) {
+    const uint64_t chrom = hits->h[i].chrom;
+    if (ranked_seqs[chrom] != chrom_seqs[chrom_i]) chrom_i++;
+    bbi_block_t *block = &blocks[n_blocks++];
+    block->chrom = chrom_i;
+    block->start = hits->h[i].start;
+    block->end = 0;
+    uint64_t block_len = 0;
+    for (uint64_t j = 0; j < BBI_ITEMS_PER_SLOT && i < hits->n && hits->h[i].chrom == chrom; j++, i++) {
+      const hit_t *hit = &hits->h[i];
+      const uint32_t start = hit->start, end = hit->start + motif->size;
+      const int item_len = snprintf(item, MAX_NAME_SIZE + 128,
+        "%s\t%d\t%c\t%.3f\t%.1f\t%.9g\t.", motif->name,
+        (int) track_score(hit->pvalue), hit->strand, hit->score,
+        hit->score_pct, hit->pvalue) + 1;
+      if (block_len + 12 + item_len > buf_size) {
+        buf_size = (block_len + 12 + item_len) * 2;
+        unsigned char *tmp_ptr = realloc(buf, buf_size);
+        if (tmp_ptr == NULL) {
+          badexit("Error: Failed to allocate memory for bigBed output.");
+        }
+        buf = tmp_ptr;
+      }
+      memcpy(buf + block_len, &block->chrom, 4);
+      memcpy(buf + block_len + 4, &start, 4);
+      memcpy(buf + block_len + 8, &end, 4);
+      memcpy(buf + block_len + 12, item, item_len);
+      block_len += 12 + item_len;
+      block->end = MAX(block->end, end);
+    }
+    uLongf zbuf_len = compressBound(block_len);
+    unsigned char *tmp_ptr = realloc(zbuf, zbuf_len);
+    if (tmp_ptr == NULL) {
+      badexit("Error: Failed to allocate memory for bigBed output.");
+    }
+    zbuf = tmp_ptr;
+    if (compress(zbuf, &zbuf_len, buf, block_len) != Z_OK) {
+      badexit("Error: Failed to compress bigBed data block.");
+    }
+    block->offset = ftello(f);
+    block->size = zbuf_len;
+    fwrite(zbuf, 1, zbuf_len, f);
+    max_block_size = MAX(max_block_size, block_len);
+  }
+  const uint64_t index_offset = ftello(f);
+  write_rtree(f, blocks, n_blocks, index_offset);
+  write_u32(f, BB_MAGIC);
+  if (fseeko(f, 0, SEEK_SET)) {
+    fprintf(stderr, "Error: Failed to write bigBed file \"%s\" [%s]", fname, strerror(errno));
+    badexit("");
+  }
+  write_u32(f, BB_MAGIC);
+  write_u16(f, BB_VERSION);
+  write_u16(f, 0);                  /* zoomLevels         */
+  write_u64(f, chrom_tree_offset);
+  write_u64(f, data_offset);
+  write_u64(f, index_offset);
+  write_u16(f, 10);                 /* fieldCount         */
+  write_u16(f, 6);                  /* definedFieldCount  */
+  write_u64(f, autosql_offset);
+  write_u64(f, 0);                  /* totalSummaryOffset */
+  write_u32(f, max_block_size);     /* uncompressBufSize  */
+  write_u64(f, 0);                  /* extensionOffset    */
+  if (ferror(f) || fclose(f)) {
+    fprintf(stderr, "Error: Failed to write bigBed file \"%s\".", fname);
+    badexit("");
+  }
+  free(chrom_seqs);
+  free(blocks);
+  free(item);
+  free(buf);
+  free(zbuf);
+  free(hits->h);
+  hits->h = NULL;
+  hits->n = 0;
+  hits->n_alloc = 0;
+}
+
+/* bigWig output (-W). Each motif gets its own file, written while the motif
+ * is being scanned: the value at each position is the score of the window
+ * starting there (the best of both strands unless -f is used), and each run of
+ * scanned windows is split into fixedStep sections of up to BBI_ITEMS_PER_SLOT
+ * values, one per compressed block. Since the sequences are scanned in input
+ * order and not in the order of their IDs (the name ranks), the index is built
+ * from the sorted list of blocks once the motif is done. The first zoom level
+ * is filled in while scanning, and the others are built from it at the end.
+ * Up to BW_MAX_ZOOM_LEVELS zoom headers are reserved after the header.
+ */
+
+#define BW_MAGIC               0x888FFC26
+#define BW_SECTION_HEADER_SIZE         24
+#define BW_ZOOM_HEADER_SIZE            24
+#define BW_SUMMARY_OFFSET       (BB_HEADER_SIZE + BW_MAX_ZOOM_LEVELS * BW_ZOOM_HEADER_SIZE)
+#define BW_SUMMARY_SIZE                40
+
+/* Same layout as the zoom records on disk */
+typedef struct zoom_rec_t {
+  uint32_t    chrom;
+  uint32_t    start;
+  uint32_t    end;
+  uint32_t    n;
+  float       min;
+  float       max;
+  float       sum;
+  float       sum_sq;
+} zoom_rec_t;
+
+typedef struct track_t {
+  FILE          *f;
+  char           fname[PATH_MAX];
+  uint64_t       data_offset;
+  uint32_t       chrom;                    /* Current section */
+  uint32_t       start;
+  uint64_t       n;
+  float          values[BBI_ITEMS_PER_SLOT];
+  unsigned char  buf[BW_SECTION_HEADER_SIZE + sizeof(float) * BBI_ITEMS_PER_SLOT];
+  unsigned char *zbuf;
+  bbi_block_t   *blocks;
+  uint64_t       n_blocks;
+  uint64_t       blocks_alloc;
+  zoom_rec_t    *zooms;
+  uint64_t       n_zooms;
+  uint64_t       zooms_alloc;
+  uint64_t       max_block_size;
+  uint64_t       bases;                    /* Total summary */
+  double         min;
+  double         max;
+  double         sum;
+  double         sum_sq;
+} track_t;
+
+/* Make room for at least n items, doubling the allocated size as needed */
+static void *grow_buf(void *ptr, uint64_t *n_alloc, const uint64_t n, const size_t size, const char *what) {
+  if (n <= *n_alloc) return ptr;
+  *n_alloc = MAX(n, *n_alloc * 2);
+  void *tmp_ptr = realloc(ptr, *n_alloc * size);
+  if (tmp_ptr == NULL) {
+    fprintf(stderr, "Error: Failed to allocate memory for %s.", what);
+    badexit("");
+  }
+  return tmp_ptr;
+}
+
+static inline void write_f64(FILE *f, const double x) { fwrite(&x, 8, 1, f); }
+
+static int cmp_bbi_blocks(const void *a, const void *b) {
+  const bbi_block_t *b1 = a, *b2 = b;
+  if (b1->chrom != b2->chrom) return b1->chrom < b2->chrom ? -1 : 1;
+  return (b1->start > b2->start) - (b1->start < b2->start);
+}
+
+static int cmp_zoom_recs(const void *a, const void *b) {
+  const zoom_rec_t *z1 = a, *z2 = b;
+  if (z1->chrom != z2->chrom) return z1->chrom < z2->chrom ? -1 : 1;
+  return (z1->start > z2->start) - (z1->start < z2->start);
+}
+
+static void open_track(motif_t *motif) {
+  track_t *track = calloc(1, sizeof(track_t));
+  if (track == NULL) {
+    badexit("Error: Failed to allocate memory for bigWig output.");
+  }
+  track->zbuf = malloc(compressBound(sizeof(zoom_rec_t) * BBI_ITEMS_PER_SLOT));
+  if (track->zbuf == NULL) {
+    badexit("Error: Failed to allocate memory for bigWig output.");
+  }
+  track->f = create_motif_file(motif->name, args.bw_prefix, ".bw", "bigWig", track->fname);
+  write_zeros(track->f, BW_SUMMARY_OFFSET + BW_SUMMARY_SIZE);
+  write_chrom_tree(track->f, ranked_seqs, seq_info.n);
+  track->data_offset = ftello(track->f);
+  write_u64(track->f, 0);
+  motif->track = track;
+}
+
+static void write_track_block(track_t *track, bbi_block_t *block, const unsigned char *buf, const uint64_t size) {
+  uLongf zbuf_len = compressBound(sizeof(zoom_rec_t) * BBI_ITEMS_PER_SLOT);
+  if (compress(track->zbuf, &zbuf_len, buf, size) != Z_OK) {
+    badexit("Error: Failed to compress bigWig data block.");
+  }
+  block->offset = ftello(track->f);
+  block->size = zbuf_len;
+  fwrite(track->zbuf, 1, zbuf_len, track->f);
+  track->max_block_size = MAX(track->max_block_size, size);
+}
+
+static void flush_track_section(track_t *track) {
+  if (!track->n) return;
+  const uint32_t end = track->start + track->n, step = 1, span = 1;
+  const uint16_t n = track->n;
+  unsigned char *buf = track->buf;
+  memcpy(buf, &track->chrom, 4);
+  memcpy(buf + 4, &track->start, 4);
+  memcpy(buf + 8, &end, 4);
+  memcpy(buf + 12, &step, 4);
+  memcpy(buf + 16, &span, 4);
+  buf[20] = 3;                      /* fixedStep          */
+  buf[21] = 0;
+  memcpy(buf + 22, &n, 2);
+  memcpy(buf + BW_SECTION_HEADER_SIZE, track->values, sizeof(float) * n);
+  track->blocks = grow_buf(track->blocks, &track->blocks_alloc, track->n_blocks + 1,
+    sizeof(bbi_block_t), "bigWig output");
+  bbi_block_t *block = &track->blocks[track->n_blocks++];
+  block->chrom = track->chrom;
+  block->start = track->start;
+  block->end = end;
+  write_track_block(track, block, buf, BW_SECTION_HEADER_SIZE + sizeof(float) * n);
+  track->n = 0;
+}
+
+static inline void push_track_value(track_t *track, const uint32_t chrom, const uint32_t pos, const float value) {
+  if (track->n == BBI_ITEMS_PER_SLOT ||
+      (track->n && (chrom != track->chrom || pos != track->start + track->n))) {
+    flush_track_section(track);
+  }
+  if (!track->n) {
+    track->chrom = chrom;
+    track->start = pos;
+  }
+  track->values[track->n++] = value;
+  zoom_rec_t *z = track->n_zooms ? &track->zooms[track->n_zooms - 1] : NULL;
+  if (z == NULL || z->chrom != chrom || z->start / BW_ZOOM_REDUCTION != pos / BW_ZOOM_REDUCTION) {
+    track->zooms = grow_buf(track->zooms, &track->zooms_alloc, track->n_zooms + 1,
+      sizeof(zoom_rec_t), "bigWig zoom levels");
+    z = &track->zooms[track->n_zooms++];
+    z->chrom = chrom;
+    z->start = pos;
+    z->n = 0;
+    z->min = value;
+    z->max = value;
+    z->sum = 0.0f;
+    z->sum_sq = 0.0f;
+  }
+  z->end = pos + 1;
+  z->n++;
+  z->min = MIN(z->min, value);
+  z->max = MAX(z->max, value);
+  z->sum += value;
+  z->sum_sq += value * value;
+  const double x = value;
+  if (!track->bases) {
+    track->min = x;
+    track->max = x;
+  }
+  track->bases++;
+  track->min = MIN(track->min, x);
+  track->max = MAX(track->max, x);
+  track->sum += x;
+  track->sum_sq += x * x;
+}
+
+/* Score the windows starting in [lo, hi), which must be within a scannable
+ * run. As in score_seq, seq[0] is the base at position seq_offset.
+ */
+static void push_track(const motif_t *motif, const uint64_t seq_i, const unsigned char *seq, const uint64_t seq_offset, const uint64_t lo, const uint64_t hi) {
+  const unsigned char *char2Xindex = args.mask ? char2maskindex : char2index;
+  const uint32_t chrom = seq_ranks[seq_i];
+  int score, score_rc;
+  for (uint64_t i = lo; i < hi; i++) {
+    if (args.scan_rc) {
+      score_subseq_rc(motif, seq, i - seq_offset, &score, &score_rc, char2Xindex);
+      score = MAX(score, score_rc);
+    } else {
+      score_subseq(motif, seq, i - seq_offset, &score, char2Xindex);
+    }
+    push_track_value(motif->track, chrom, i, score / PWM_INT_MULTIPLIER);
+  }
+}
+
+/* Merge sorted zoom records into bins of the next reduction, in place */
+static uint64_t merge_zoom_recs(zoom_rec_t *z, const uint64_t n, const uint64_t reduction) {
+  uint64_t m = 0;
+  for (uint64_t i = 0; i < n; i++) {
+    if (m && z[m - 1].chrom == z[i].chrom && z[m - 1].start / reduction == z[i].start / reduction) {
+      zoom_rec_t *prev = &z[m - 1];
+      prev->end = z[i].end;
+      prev->n += z[i].n;
+      prev->min = MIN(prev->min, z[i].min);
+      prev->max = MAX(prev->max, z[i].max);
+      prev->sum += z[i].sum;
+      prev->sum_sq += z[i].sum_sq;
+    } else {
+      z[m++] = z[i];
+    }
+  }
+  return m;
+}
+
+/* Finish <prefix><motif>.bw: the index, the zoom levels, and the header */
+static void close_track(motif_t *motif) {
+  track_t *track = motif->track;
+  FILE *f = track->f;
+  flush_track_section(track);
+  const uint64_t index_offset = ftello(f), n_sections = track->n_blocks;
+  qsort(track->blocks, track->n_blocks, sizeof(bbi_block_t), cmp_bbi_blocks);
+  write_rtree(f, track->blocks, track->n_blocks, index_offset);
+  uint64_t zoom_data[BW_MAX_ZOOM_LEVELS], zoom_index[BW_MAX_ZOOM_LEVELS];
+  uint64_t n_levels = 0, reduction = BW_ZOOM_REDUCTION, n_zooms = track->n_zooms;
+  qsort(track->zooms, n_zooms, sizeof(zoom_rec_t), cmp_zoom_recs);
+  while (n_zooms && n_levels < BW_MAX_ZOOM_LEVELS) {
+    zoom_data[n_levels] = ftello(f);
+    write_u32(f, n_zooms);
+    track->n_blocks = 0;
+    for (uint64_t i = 0; i < n_zooms; ) {
+      uint64_t j = i + 1;
+      while (j < n_zooms && j - i < BBI_ITEMS_PER_SLOT && track->zooms[j].chrom == track->zooms[i].chrom) {
+        j++;
+      }
+      track->blocks = grow_buf(track->blocks, &track->blocks_alloc, track->n_blocks + 1,
+        sizeof(bbi_block_t), "bigWig output");
+      bbi_block_t *block = &track->blocks[track->n_blocks++];
+      block->chrom = track->zooms[i].chrom;
+      block->start = track->zooms[i].start;
+      block->end = track->zooms[j - 1].end;
+      write_track_block(track, block, (const unsigned char *) &track->zooms[i], sizeof(zoom_rec_t) * (j - i));
+      i = j;
+    }
+    zoom_index[n_levels] = ftello(f);
+    write_rtree(f, track->blocks, track->n_blocks, zoom_index[n_levels]);
+    n_levels++;
+    const uint64_t n_prev = n_zooms;
+    n_zooms = merge_zoom_recs(track->zooms, n_zooms, reduction * 4);
+    if (n_zooms == n_prev) break;
+    reduction *= 4;
+  }
+  write_u32(f, BW_MAGIC);
+  if (fseeko(f, track->data_offset, SEEK_SET)) {
+    fprintf(stderr, "Error: Failed to write bigWig file \"%s\" [%s]", track->fname, strerror(errno));
+    badexit("");
+  }
+  write_u64(f, n_sections);
+  fseeko(f, 0, SEEK_SET);
+  write_u32(f, BW_MAGIC);
+  write_u16(f, BB_VERSION);
+  write_u16(f, n_levels);           /* zoomLevels         */
+  write_u64(f, BW_SUMMARY_OFFSET + BW_SUMMARY_SIZE);
+  write_u64(f, track->data_offset);
+  write_u64(f, index_offset);
+  write_u16(f, 0);                  /* fieldCount         */
+  write_u16(f, 0);                  /* definedFieldCount  */
+  write_u64(f, 0);                  /* autoSqlOffset      */
+  write_u64(f, BW_SUMMARY_OFFSET);  /* totalSummaryOffset */
+  write_u32(f, track->max_block_size);
+  write_u64(f, 0);                  /* extensionOffset    */
+  for (uint64_t i = 0, r = BW_ZOOM_REDUCTION; i < n_levels; i++, r *= 4) {
+    write_u32(f, r);
+    write_u32(f, 0);
+    write_u64(f, zoom_data[i]);
+    write_u64(f, zoom_index[i]);
+  }
+  fseeko(f, BW_SUMMARY_OFFSET, SEEK_SET);
+  write_u64(f, track->bases);
+  write_f64(f, track->min);
+  write_f64(f, track->max);
+  write_f64(f, track->sum);
+  write_f64(f, track->sum_sq);
+  if (ferror(f) || fclose(f)) {
+    fprintf(stderr, "Error: Failed to write bigWig file \"%s\".", track->fname);
+    badexit("");
+  }
+  free(track->zbuf);
+  free(track->blocks);
+  free(track->zooms);
+  free(track);
+  motif->track = NULL;
+}
+
+static inline void add_site(sites_t *sites, const uint64_t start, const double weight) {
+  const uint64_t span = sites->n_bins - 1;
+  int64_t d2 = 2 * (int64_t) (start - sites->row_start) + sites->mot_size - sites->row_size;
+  if (sites->row_strand == '-') d2 = -d2;
+  sites->hist[(d2 + (int64_t) span) / 2] += weight;
+}
+
+static void finish_sites_row(sites_t *sites) {
+  for (uint64_t i = 0; i < sites->n_ties; i++) {
+    add_site(sites, sites->ties[i], 1.0 / sites->n_ties);
+  }
+  sites->n_ties = 0;
+}
+
+static inline void begin_sites_row(sites_t *sites, const uint64_t row, const uint64_t start, const uint64_t size, const char strand) {
+  if (row == sites->row) return;
+  finish_sites_row(sites);
+  sites->row = row;
+  sites->row_start = start;
+  sites->row_size = size;
+  sites->row_strand = strand;
+}
+
+static inline void push_site(sites_t *sites, const uint64_t start, const double score) {
+  if (args.site_hist == HIST_ALL) {
+    add_site(sites, start, 1.0);
+    return;
+  }
+  if (sites->n_ties && score < sites->best) return;
+  if (sites->n_ties && score > sites->best) sites->n_ties = 0;
+  sites->best = score;
+  sites->ties = grow_buf(sites->ties, &sites->ties_alloc, sites->n_ties + 1,
+    sizeof(uint64_t), "site positions");
+  sites->ties[sites->n_ties++] = start;
+}
+
+/* Track formats share a min(1000, -10*log10(P-value)) score column; BED
+ * truncates it to an integer and GFF3/GTF keep one decimal. When scanning
+ * within BED ranges, bed_chrom is set and the range is added as attributes.
+ */
+static void print_track_res(FILE *out, const char *bed_chrom, const uint64_t bed_start, const uint64_t bed_end, const char bed_strand, const char *bed_name, const char *seq_name, const uint64_t start, const uint64_t end, const char strand, const char *motif_name, const double pvalue, const double score, const double score_pct, const int match_size, const unsigned char *match) {
+  const double track_score_ = track_score(pvalue);
+  switch (args.out_fmt) {
+    case OUT_BED:
+      fprintf(out, "%s\t%llu\t%llu\t%s\t%d\t%c\t%.3f\t%.1f\t%.9g\t.\n",
+        seq_name, start - 1, end, motif_name, (int) track_score_, strand,
+        score, score_pct, pvalue);
+      break;
+    case OUT_GFF3:
+      fprintf(out,
+        "%s\tyamscan\tnucleotide_motif\t%llu\t%llu\t%g\t%c\t.\tID=%s_%s%c;Name=%s;P_Value=%.9g;Score=%.3f;Match=%.*s;",
+        seq_name, start, end, floor(track_score_ * 10.0) / 10.0, strand,
+        motif_name, seq_name, strand, motif_name, pvalue, score, match_size, match);
+      if (bed_chrom != NULL) {
+        fprintf(out, "Bed_Range=%s:%llu-%llu(%c);Bed_ID=%s;",
+          bed_chrom, bed_start, bed_end, bed_strand, bed_name);
+      }
+      fputc('\n', out);
+      break;
+    case OUT_GTF:
+      fprintf(out,
+        "%s\tyamscan\tnucleotide_motif\t%llu\t%llu\t%g\t%c\t.\tname \"%s_%s%c\"; motif_id \"%s\"; p_value \"%.9g\"; score \"%.3f\"; match \"%.*s\";",
+        seq_name, start, end, floor(track_score_ * 10.0) / 10.0, strand,
+        motif_name, seq_name, strand, motif_name, pvalue, score, match_size, match);
+      if (bed_chrom != NULL) {
+        fprintf(out, " bed_range \"%s:%llu-%llu(%c)\"; bed_id \"%s\";",
+          bed_chrom, bed_start, bed_end, bed_strand, bed_name);
+      }
+      fputc('\n', out);
+      break;
+  }
+}
+
+#define PRINT_RES_BED(MOTIF0, SEQ_I0, BED_RANGE1_CHROM, BED_RANGE1_START, \
+  BED_RANGE1_END, BED_RANGE1_STRAND, BED_NAME2, SEQ_NAME3, START4, END5, \
+  STRAND6, MOTIF7, PVALUE8, SCORE9, SCORE_PCT10, MATCH11_SIZE, MATCH11) \
+    do { \
+      if (MOTIF0->hits != NULL) { \
+        push_hit(MOTIF0->hits, SEQ_I0, START4 - 1, STRAND6, PVALUE8, SCORE9, \
+          SCORE_PCT10); \
+        break; \
+      } \
+      if (MOTIF0->sites != NULL) { \
+        push_site(MOTIF0->sites, START4 - 1, SCORE9); \
+        break; \
+      } \
+      const unsigned char *match_ = MATCH11; \
+      unsigned char match_rc_[MAX_MOTIF_SIZE / 5]; \
+      if (args.rc_match && STRAND6 == '-') { \
+        rev_comp_match(match_rc_, match_, MATCH11_SIZE); \
+        match_ = match_rc_; \
+      } \
+      if (args.out_fmt == OUT_YAMSCAN) { \
+        fprintf(MOTIF0->out, "%s:%llu-%llu(%c)\t%s\t%s\t%llu\t%llu\t%c\t%s\t%.9g\t%.3f\t%.1f\t%.*s\n", \
+          BED_RANGE1_CHROM, BED_RANGE1_START, BED_RANGE1_END, BED_RANGE1_STRAND, \
+          BED_NAME2, SEQ_NAME3, START4, END5, STRAND6, MOTIF7, PVALUE8, SCORE9, \
+          SCORE_PCT10, MATCH11_SIZE, match_); \
+      } else { \
+        print_track_res(MOTIF0->out, BED_RANGE1_CHROM, BED_RANGE1_START, BED_RANGE1_END, \
+          BED_RANGE1_STRAND, BED_NAME2, SEQ_NAME3, START4, END5, STRAND6, MOTIF7, \
+          PVALUE8, SCORE9, SCORE_PCT10, MATCH11_SIZE, match_); \
+      } \
+    } while (0)
+
+/* Index of the first scannable run of a sequence ending after pos */
+static inline uint64_t first_seg(const uint64_t seq_i, const uint64_t pos) {
+  const uint64_t *segs = seq_segs[seq_i];
+  uint64_t lo = 0, hi = seq_n_segs[seq_i];
+  while (lo < hi) {
+    const uint64_t mid = lo + (hi - lo) / 2;
+    if (segs[2 * mid + 1] <= pos) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+/* The scoring functions only look at windows starting within [from, to).
+ * The sequence does not need to be complete: seq[0] is the base at position
+ * seq_offset, and only needs to cover the windows being scanned.
+ */
+/* -A: the sum of 2^score over the windows starting in [lo, hi) of seq, on
+ * both strands for '.'. All windows must be within a scannable run, so that
+ * every score has an entry in affinity_tab.
+ */
+static double sum_affinity(const motif_t *motif, const unsigned char *seq, const uint64_t lo, const uint64_t hi, const char strand) {
+  const unsigned char *char2Xindex = args.mask ? char2maskindex : char2index;
+  const double *tab = motif->affinity_tab;
+  const int offset = motif->cdf_offset;
+  double sum = 0.0;
+  int score, score_rc;
+  if (strand == '.') {
+    for (uint64_t i = lo; i < hi; i++) {
+      score_subseq_rc(motif, seq, i, &score, &score_rc, char2Xindex);
+      sum += tab[score - offset] + tab[score_rc - offset];
+    }
+  } else if (strand == '+') {
+    for (uint64_t i = lo; i < hi; i++) {
+      score_subseq(motif, seq, i, &score, char2Xindex);
+      sum += tab[score - offset];
+    }
+  } else if (strand == '-') {
+    for (uint64_t i = lo; i < hi; i++) {
+      score_subseq_rev(motif, seq, i, &score, char2Xindex);
+      sum += tab[score - offset];
+    }
+  }
+  return sum;
+}
+
+/* -Q: count the windows starting in [lo, hi) of seq by score, for those at
+ * or above the threshold.
+ */
+static void count_scores(const motif_t *motif, const unsigned char *seq, const uint64_t lo, const uint64_t hi) {
+  const unsigned char *char2Xindex = args.mask ? char2maskindex : char2index;
+  const int threshold = motif->threshold;
+  uint64_t *counts = motif->fdr->counting;
+  int score, score_rc;
+  if (args.scan_rc) {
+    for (uint64_t i = lo; i < hi; i++) {
+      score_subseq_rc(motif, seq, i, &score, &score_rc, char2Xindex);
+      if (UNLIKELY(score >= threshold)) counts[score - threshold]++;
+      if (UNLIKELY(score_rc >= threshold)) counts[score_rc - threshold]++;
+    }
+  } else {
+    for (uint64_t i = lo; i < hi; i++) {
+      score_subseq(motif, seq, i, &score, char2Xindex);
+      if (UNLIKELY(score >= threshold)) counts[score - threshold]++;
+    }
+  }
+}
+
+static inline void count_calib(calib_t *calib, const int score) {
+  int k = 0;
+  while (score >= calib->scores[k + 1]) k++;
+  calib->counts[k]++;
+}
+
+/* Only called for windows above the lower of the -t and -E scores */
+#define CALIB_COUNT(MOTIF0, SCORE1) \
+  do { \
+    if (MOTIF0->calib != NULL && SCORE1 >= MOTIF0->calib->scores[0]) { \
+      count_calib(MOTIF0->calib, SCORE1); \
+    } \
+  } while (0)
+
+static void score_seq_in_bed(const motif_t *motif, const unsigned char *seq, const uint64_t seq_offset, const uint64_t bed_i, const uint64_t from, const uint64_t to) {
+  const unsigned char *char2Xindex = args.mask ? char2maskindex : char2index;
+  const uint64_t bed_seq_i = bed.seq_indices[bed_i];
+  const char *seq_name = seq_names[bed_seq_i];
+  const uint64_t bed_size = bed.ends[bed_i] - bed.starts[bed_i];
+  const uint64_t bed_start_i = bed.starts[bed_i] + 1;
+  const uint64_t bed_end_i = bed.ends[bed_i];
+  const char bed_strand_i = bed.strands[bed_i];
+  const char *bed_name = bed.range_names[bed_i];
+  const int mot_size = motif->size;
+  if (bed_size < mot_size || (motif->threshold == INT_MAX && motif->calib == NULL)) return;
+  const int threshold = motif->threshold - 1;
+  const int floor_score = motif->calib != NULL ? MIN(threshold, motif->calib->scores[0] - 1) : threshold;
+  if (motif->sites != NULL) {
+    begin_sites_row(motif->sites, bed_i, bed.starts[bed_i], bed_size, bed_strand_i);
+  }
+  const uint64_t *segs = seq_segs[bed_seq_i];
+  const uint64_t n_segs = seq_n_segs[bed_seq_i];
+  const uint64_t scan_start = MAX(bed_start_i - 1, from);
+  const uint64_t scan_end = MIN(bed_end_i - mot_size, to);
+  int score = INT_MIN, score_rc = INT_MIN;
+  for (uint64_t s = first_seg(bed_seq_i, scan_start); s < n_segs && segs[2 * s] < scan_end; s++) {
+    if (segs[2 * s + 1] - segs[2 * s] < mot_size) continue;
+    const uint64_t lo = MAX(segs[2 * s], scan_start);
+    const uint64_t hi = MIN(segs[2 * s + 1] - mot_size + 1, scan_end);
+    if (args.affinity) {
+      if (lo < hi) {
+        motif->affinity[bed_i] += sum_affinity(motif, seq, lo - seq_offset, hi - seq_offset,
+          bed_strand_i);
+      }
+      continue;
+    }
+    if (motif->calib != NULL && lo < hi) {
+      motif->calib->windows += bed_strand_i == '.' ? 2 * (hi - lo) : hi - lo;
+    }
+    if (bed_strand_i == '.') {
+      for (uint64_t i = lo; i < hi; i++) {
+        score_subseq_rc(motif, seq, i - seq_offset, &score, &score_rc, char2Xindex);
+        if (UNLIKELY(score > floor_score)) {
+          CALIB_COUNT(motif, score);
+          if (score > threshold) {
+            PRINT_RES_BED(motif, bed_seq_i, seq_name, bed_start_i, bed_end_i, bed_strand_i, bed_name, seq_name,
+              i + 1, i + mot_size, '+', motif->name, score2pval(motif, score),
+              score / PWM_INT_MULTIPLIER, 100.0 * score / motif->max_score, mot_size, seq + i - seq_offset);
+          }
+        }
+        if (UNLIKELY(score_rc > floor_score)) {
+          CALIB_COUNT(motif, score_rc);
+          if (score_rc > threshold) {
+            PRINT_RES_BED(motif, bed_seq_i, seq_name, bed_start_i, bed_end_i, bed_strand_i, bed_name, seq_name,
+              i + 1, i + mot_size, '-', motif->name, score2pval(motif, score_rc),
+              score_rc / PWM_INT_MULTIPLIER, 100.0 * score_rc / motif->max_score, mot_size, seq + i - seq_offset);
+          }
+        }
+      }
+    } else if (bed_strand_i == '+') {
+      for (uint64_t i = lo; i < hi; i++) {
+        score_subseq(motif, seq, i - seq_offset, &score, char2Xindex);
+        if (UNLIKELY(score > floor_score)) {
+          CALIB_COUNT(motif, score);
+          if (score > threshold) {
+            PRINT_RES_BED(motif, bed_seq_i, seq_name, bed_start_i, bed_end_i, bed_strand_i, bed_name, seq_name,
+              i + 1, i + mot_size, '+', motif->name, score2pval(motif, score),
+              score / PWM_INT_MULTIPLIER, 100.0 * score / motif->max_score, mot_size, seq + i - seq_offset);
+          }
+        }
+      }
+    } else if (bed_strand_i == '-') {
+      for (uint64_t i = lo; i < hi; i++) {
+        score_subseq_rev(motif, seq, i - seq_offset, &score, char2Xindex);
+        if (UNLIKELY(score > floor_score)) {
+          CALIB_COUNT(motif, score);
+          if (score > threshold) {
+            PRINT_RES_BED(motif, bed_seq_i, seq_name, bed_start_i, bed_end_i, bed_strand_i, bed_name, seq_name,
+              i + 1, i + mot_size, '-', motif->name, score2pval(motif, score),
+              score / PWM_INT_MULTIPLIER, 100.0 * score / motif->max_score, mot_size, seq + i - seq_offset);
+          }
+        }
+      }
+    }
+  }
+}
+
+#define PRINT_RES(MOTIF0, SEQ_I0, SEQ_NAME1, START2, END3, STRAND4, MOTIF5, \
+  PVALUE6, SCORE7, SCORE_PCT8, MATCH9_SIZE, MATCH9) \
+    do { \
+      if (MOTIF0->hits != NULL) { \
+        push_hit(MOTIF0->hits, SEQ_I0, START2 - 1, STRAND4, PVALUE6, SCORE7, \
+          SCORE_PCT8); \
+        break; \
+      } \
+      if (MOTIF0->sites != NULL) { \
+        push_site(MOTIF0->sites, START2 - 1, SCORE7); \
+        break; \
+      } \
+      const unsigned char *match_ = MATCH9; \
+      unsigned char match_rc_[MAX_MOTIF_SIZE / 5]; \
+      if (args.rc_match && STRAND4 == '-') { \
+        rev_comp_match(match_rc_, match_, MATCH9_SIZE); \
+        match_ = match_rc_; \
+      } \
+      if (args.out_fmt == OUT_YAMSCAN) { \
+        fprintf(MOTIF0->out, "%s\t%llu\t%llu\t%c\t%s\t%.9g\t%.3f\t%.1f\t%.*s\n", \
+          SEQ_NAME1, START2, END3, STRAND4, MOTIF5, PVALUE6, SCORE7, SCORE_PCT8, \
+          MATCH9_SIZE, match_); \
+      } else { \
+        print_track_res(MOTIF0->out, NULL, 0, 0, '.', NULL, SEQ_NAME1, START2, END3, STRAND4, \
+          MOTIF5, PVALUE6, SCORE7, SCORE_PCT8, MATCH9_SIZE, match_); \
+      } \
+    } while (0)
+
+static inline void score_window(const motif_t *motif, const uint64_t seq_i, const unsigned char *seq, const uint64_t seq_offset, const uint64_t i, const int threshold, const int floor_score, const unsigned char *char2Xindex) {
+  const int mot_size = motif->size;
+  int score;
+  score_subseq(motif, seq, i - seq_offset, &score, char2Xindex);
+  if (UNLIKELY(score > floor_score)) {
+    CALIB_COUNT(motif, score);
+    if (score > threshold) {
+      PRINT_RES(motif, seq_i, seq_names[seq_i], i + 1, i + mot_size, '+', motif->name, score2pval(motif, score),
+        score / PWM_INT_MULTIPLIER, 100.0 * score / motif->max_score, mot_size, seq + i - seq_offset);
+    }
+  }
+}
+
+static inline void score_window_rc(const motif_t *motif, const uint64_t seq_i, const unsigned char *seq, const uint64_t seq_offset, const uint64_t i, const int threshold, const int floor_score, const unsigned char *char2Xindex) {
+  const int mot_size = motif->size;
+  int score, score_rc;
+  score_subseq_rc(motif, seq, i - seq_offset, &score, &score_rc, char2Xindex);
+  if (UNLIKELY(score > floor_score)) {
+    CALIB_COUNT(motif, score);
+    if (score > threshold) {
+      PRINT_RES(motif, seq_i, seq_names[seq_i], i + 1, i + mot_size, '+', motif->name, score2pval(motif, score),
+        score / PWM_INT_MULTIPLIER, 100.0 * score / motif->max_score, mot_size, seq + i - seq_offset);
+    }
+  }
+  if (UNLIKELY(score_rc > floor_score)) {
+    CALIB_COUNT(motif, score_rc);
+    if (score_rc > threshold) {
+      PRINT_RES(motif, seq_i, seq_names[seq_i], i + 1, i + mot_size, '-', motif->name, score2pval(motif, score_rc),
+        score_rc / PWM_INT_MULTIPLIER, 100.0 * score_rc / motif->max_score, mot_size, seq + i - seq_offset);
+    }
+  }
+}
+
+/* Scores n windows starting from seq with the int16 PWM (and its reverse
+ * complement, unless -f), and fills cand with the offsets of the windows
+ * whose int16 score reaches floor16. Since the int16 scores are upper bounds,
+ * every other window can be skipped. Only used within runs of standard
+ * letters. The inner loops use a chain of selects instead of a table lookup,
+ * which gcc turns into vector compares and blends.
+ */
+TARGET_CLONES static uint64_t pwm16_candidates(const motif_t *motif, const unsigned char *seq, const uint64_t n, const int floor16, uint16_t *cand, const unsigned char *char2Xindex) {
+  unsigned char x[PWM16_BLOCK_SIZE + MAX_MOTIF_SIZE / 5];
+  int16_t acc[PWM16_BLOCK_SIZE], acc_rc[PWM16_BLOCK_SIZE];
+  const uint64_t mot_size = motif->size;
+  for (uint64_t i = 0; i < n + mot_size - 1; i++) x[i] = char2Xindex[seq[i]];
+  for (uint64_t i = 0; i < n; i++) acc[i] = 0;
+  for (uint64_t j = 0; j < mot_size; j++) {
+    const int16_t a = motif->pwm16[j * 4], c = motif->pwm16[j * 4 + 1];
+    const int16_t g = motif->pwm16[j * 4 + 2], t = motif->pwm16[j * 4 + 3];
+    const unsigned char *xj = x + j;
+    for (uint64_t i = 0; i < n; i++) {
+      acc[i] += xj[i] == 0 ? a : xj[i] == 1 ? c : xj[i] == 2 ? g : t;
+    }
+  }
+  if (args.scan_rc) {
+    for (uint64_t i = 0; i < n; i++) acc_rc[i] = 0;
+    for (uint64_t j = 0; j < mot_size; j++) {
+      const int16_t a = motif->pwm16_rc[j * 4], c = motif->pwm16_rc[j * 4 + 1];
+      const int16_t g = motif->pwm16_rc[j * 4 + 2], t = motif->pwm16_rc[j * 4 + 3];
+      const unsigned char *xj = x + j;
+      for (uint64_t i = 0; i < n; i++) {
+        acc_rc[i] += xj[i] == 0 ? a : xj[i] == 1 ? c : xj[i] == 2 ? g : t;
+      }
+    }
+    for (uint64_t i = 0; i < n; i++) acc[i] = MAX(acc[i], acc_rc[i]);
+  }
+  uint64_t n_cand = 0;
+  for (uint64_t i = 0; i < n; i++) {
+    cand[n_cand] = i;
+    n_cand += acc[i] >= floor16;
+  }
+  return n_cand;
+}
+
+static void score_seq(const motif_t *motif, const uint64_t seq_i, const unsigned char *seq, const uint64_t seq_offset, const uint64_t from, const uint64_t to) {
+  const unsigned char *char2Xindex = args.mask ? char2maskindex : char2index;
+  const uint64_t seq_size = seq_sizes[seq_i];
+  const int mot_size = motif->size;
+  if (seq_size < mot_size || (motif->threshold == INT_MAX && motif->calib == NULL)) return;
+  const int threshold = motif->threshold - 1;
+  const int floor_score = motif->calib != NULL ? MIN(threshold, motif->calib->scores[0] - 1) : threshold;
+  if (motif->sites != NULL) begin_sites_row(motif->sites, seq_i, 0, seq_size, '+');
+  const uint64_t *segs = seq_segs[seq_i];
+  const uint64_t n_segs = seq_n_segs[seq_i];
+  uint16_t cand[PWM16_BLOCK_SIZE];
+  for (uint64_t s = first_seg(seq_i, from); s < n_segs && segs[2 * s] < to; s++) {
+    if (segs[2 * s + 1] - segs[2 * s] < mot_size) continue;
+    const uint64_t lo = MAX(segs[2 * s], from);
+    const uint64_t hi = MIN(segs[2 * s + 1] - mot_size + 1, to);
+    if (args.affinity) {
+      if (lo < hi) {
+        motif->affinity[seq_i] += sum_affinity(motif, seq, lo - seq_offset, hi - seq_offset,
+          args.scan_rc ? '.' : '+');
+      }
+      continue;
+    }
+    if (motif->track != NULL) {
+      if (lo < hi) push_track(motif, seq_i, seq, seq_offset, lo, hi);
+      continue;
+    }
+    if (motif->fdr != NULL && motif->fdr->counting != NULL) {
+      if (lo < hi) count_scores(motif, seq, lo - seq_offset, hi - seq_offset);
+      continue;
+    }
+    if (motif->calib != NULL && lo < hi) {
+      motif->calib->windows += args.scan_rc ? 2 * (hi - lo) : hi - lo;
+    }
+    if (motif->pwm16_div) {
+      const int floor16 = ceil_div(floor_score + 1, motif->pwm16_div);
+      if (floor16 > INT16_MAX) continue;
+      for (uint64_t b = lo; b < hi; b += PWM16_BLOCK_SIZE) {
+        const uint64_t n_cand = pwm16_candidates(motif, seq + b - seq_offset,
+          MIN(PWM16_BLOCK_SIZE, hi - b), floor16, cand, char2Xindex);
+        for (uint64_t c = 0; c < n_cand; c++) {
+          if (args.scan_rc) {
+            score_window_rc(motif, seq_i, seq, seq_offset, b + cand[c], threshold, floor_score, char2Xindex);
+          } else {
+            score_window(motif, seq_i, seq, seq_offset, b + cand[c], threshold, floor_score, char2Xindex);
+          }
+        }
+      }
+    } else if (args.scan_rc) {
+      for (uint64_t i = lo; i < hi; i++) {
+        score_window_rc(motif, seq_i, seq, seq_offset, i, threshold, floor_score, char2Xindex);
+      }
+    } else {
+      for (uint64_t i = lo; i < hi; i++) {
+        score_window(motif, seq_i, seq, seq_offset, i, threshold, floor_score, char2Xindex);
+      }
+    }
+  }
+}
+
+/* For .2bit input: decode and scan TWOBIT_CHUNK_SIZE windows at a time,
+ * skipping chunks which do not overlap any scannable run. For -x, only the
+ * BED range is decoded.
+ */
+static void score_seq_twobit(const motif_t *motif, const uint64_t seq_i, const uint64_t bed_i, unsigned char *buf) {
+  const uint64_t mot_size = motif->size;
+  uint64_t from, to;
+  if (args.use_bed) {
+    if (bed.ends[bed_i] - bed.starts[bed_i] < mot_size) return;
+    from = bed.starts[bed_i];
+    to = bed.ends[bed_i] - mot_size;
+  } else {
+    if (seq_sizes[seq_i] < mot_size) return;
+    from = 0;
+    to = seq_sizes[seq_i] - mot_size + 1;
+  }
+  for (uint64_t chunk = from; chunk < to; chunk += TWOBIT_CHUNK_SIZE) {
+    const uint64_t chunk_end = MIN(to, chunk + TWOBIT_CHUNK_SIZE);
+    const uint64_t s = first_seg(seq_i, chunk);
+    if (s == seq_n_segs[seq_i] || seq_segs[seq_i][2 * s] >= chunk_end) continue;
+    twobit_decode(&twobit, seq_i, chunk, chunk_end + mot_size - 1, buf);
+    if (args.use_bed) {
+      score_seq_in_bed(motif, buf, chunk, bed_i, chunk, chunk_end);
+    } else {
+      score_seq(motif, seq_i, buf, chunk, chunk, chunk_end);
+    }
+  }
+}
+
+static void print_seq_stats_single(FILE *whereto, const uint64_t seq_i, const uint64_t seq_j) {
+  ERASE_ARRAY(char_counts, 256);
+  count_bases_single(seqs[seq_i], seq_sizes[seq_j]);
+  fprintf(whereto, "%llu\t%s\t", seq_j + 1, seq_names[seq_j]);
+  fprintf(whereto, "%llu\t", seq_sizes[seq_j]);
+  if (!seq_sizes[seq_j]) {
+    fprintf(whereto, "nan\t");
+  } else {
+    fprintf(whereto, "%.2f\t", calc_gc() * 100.0);
+  }
+  fprintf(whereto, "%llu\n", seq_sizes[seq_j] - standard_base_count());
+}
+
+static void print_seq_stats(FILE *whereto) {
+  for (uint64_t i = 0; i < seq_info.n; i++) {
+    ERASE_ARRAY(char_counts, 256);
+    count_bases_single(seqs[i], seq_sizes[i]);
+    fprintf(whereto, "%llu\t%s\t", i + 1, seq_names[i]);
+    fprintf(whereto, "%llu\t", seq_sizes[i]);
+    if (!seq_sizes[i]) {
+      fprintf(whereto, "nan\t");
+    } else {
+      fprintf(whereto, "%.2f\t", calc_gc() * 100.0);
+    }
+    fprintf(whereto, "%llu\n", seq_sizes[i] - standard_base_count());
+  }
+}
+
+static void add_consensus_motif(const char *consensus) {
+  if (add_motif()) badexit("");
+  ERASE_ARRAY(motifs[0]->name, MAX_NAME_SIZE);
+  uint64_t i = 0;
+  for (;;) {
+    motifs[0]->name[i] = consensus[i];
+    if (consensus[i] == '\0') {
+      motifs[0]->size = i;
+      break;
+    }
+    i++;
+  }
+  motifs[0]->name[i] = '\0';
+  if (motifs[0]->size > MAX_MOTIF_SIZE / 5) {
+    fprintf(stderr, "Error: Consensus sequence is too large (%llu>max=%llu).",
+      motifs[0]->size, MAX_MOTIF_SIZE / 5);
+  }
+  uint64_t let_i;
+  for (uint64_t pos = 0; pos < motifs[0]->size; pos++) {
+    let_i = consensus2index[(unsigned char) consensus[pos]];
+    if (let_i == -1) {
+      fprintf(stderr, "Error: Encountered unknown letter in consensus (%c).",
+        consensus[pos]);
+      badexit("");
+    }
+    set_score(motifs[0], 'A', pos,
+      calc_score(consensus2probs[let_i * 4 + 0], args.bkg[0]));
+    set_score(motifs[0], 'C', pos,
+      calc_score(consensus2probs[let_i * 4 + 1], args.bkg[1]));
+    set_score(motifs[0], 'G', pos,
+      calc_score(consensus2probs[let_i * 4 + 2], args.bkg[2]));
+    set_score(motifs[0], 'T', pos,
+      calc_score(consensus2probs[let_i * 4 + 3], args.bkg[3]));
+  }
+  complete_motifs();
+}
+
+static void print_pb(const double prog) {
+  const int left = prog * PROGRESS_BAR_WIDTH;
+  const int right = PROGRESS_BAR_WIDTH - left;
+  fprintf(stderr, "\r[%.*s%*s] %3d%%", left, PROGRESS_BAR_STRING, right, "",
+      (int) (prog * 100.0));
+  fflush(stderr);
+}
+
+/* -Q: empirical FDR from shuffled controls. Every copy of every sequence is
+ * made up front (split between threads by sequence) by shuffling each of its
+ * scannable runs on its own, so the controls share the runs, sizes and names
+ * of the real sequences. Then for each motif, the windows at or above the -t
+ * threshold are counted by score in the controls and in the real sequences.
+ * Going down from the best score, the estimated FDR of a threshold is the
+ * average number of control hits per copy over the number of real hits, and
+ * the lowest score of a real hit with an FDR of at most args.fdr is used as
+ * the new threshold for the actual scan.
+ */
+
+// Modified krng.h code from Heng Li to use xoroshiro128++ 1.0 instead
+
+typedef struct {
+  uint64_t s[2];
+} xrng_t;
+
+static inline uint64_t splitmix64(uint64_t x) {
+  uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+#define ROTL(X, K) (((X) << (K)) | ((X) >> (64 - (K))))
+
+static inline uint64_t xrand_r(xrng_t *r) {
+  const uint64_t s0 = r->s[0];
+  uint64_t s1 = r->s[1];
+  const uint64_t result = ROTL(s0 + s1, 17) + s0;
+  s1 ^= s0;
+  r->s[0] = ROTL(s0, 49) ^ s1 ^ (s1 << 21);
+  r->s[1] = ROTL(s1, 28);
+  return result;
+}
+
+static inline void sxrand_r(xrng_t *r, uint64_t seed) {
+  r->s[0] = splitmix64(seed);
+  r->s[1] = splitmix64(r->s[0]);
+}
+
+// rng code end
+
+/* Shuffling code from yamshuf, with the generator passed in. The runs being
+ * shuffled only contain standard bases.
+ */
+
+static const uint64_t pow5[CONTROL_K + 1] = { 1, 5, 25, 125 };
+
+static const char index2dna[6] = "ACGTN";
+
+typedef struct shuf_tabs_t {
+  uint64_t       *kmer_tab;
+  uint64_t       *euler_path;
+  uint64_t       *next_index;
+  unsigned char  *invalid_vertex;
+} shuf_tabs_t;
+
+static inline void swap(unsigned char *seq, const uint64_t i, const uint64_t j) {
+  const unsigned char tmp = seq[i]; seq[i] = seq[j]; seq[j] = tmp;
+}
+
+static void shuffle_fisher_yates(unsigned char *seq, const uint64_t len, xrng_t *xrng) {
+  for (uint64_t i = 0, l = len - 1; i < l; i++) {
+    swap(seq, i, i + xrand_r(xrng) % (l - i));
+  }
+}
+
+static inline uint64_t chars2kmer(const unsigned char *seq, const uint64_t k, const uint64_t offset) {
+  uint64_t kmer = 0;
+  for (uint64_t j = 0, i = k - 1; i < -1; j++, i--) {
+    kmer += pow5[i] * char2index[seq[offset + j]];
+  }
+  return kmer;
+}
+
+static inline void count_kmers(const unsigned char *seq, const uint64_t size, uint64_t *kmer_tab, const uint64_t k) {
+  for (uint64_t i = 0; i < size - k + 1; i++) {
+    kmer_tab[chars2kmer(seq, k, i)]++;
+  }
+}
+
+static inline uint64_t cumsum_and_pick_next_letter(const uint64_t *kmers, xrng_t *xrng) {
+  const uint64_t k0 = kmers[0];
+  const uint64_t k1 = kmers[0] + kmers[1];
+  const uint64_t k2 = kmers[0] + kmers[1] + kmers[2];
+  const uint64_t k3 = kmers[0] + kmers[1] + kmers[2] + kmers[3];
+  const uint64_t k4 = kmers[0] + kmers[1] + kmers[2] + kmers[3] + kmers[4];
+  const uint64_t r = xrand_r(xrng) % k4;
+  return 4 - ((r < k0) + (r < k1) + (r < k2) + (r < k3));
+}
+
+#define COUNT_EDGES(OFFSET, TABLE) (TABLE[OFFSET]+TABLE[OFFSET+1]+TABLE[OFFSET+2]+TABLE[OFFSET+3]+TABLE[OFFSET+4])
+
+static void shuffle_euler(unsigned char *seq, const uint64_t size, const uint64_t k, shuf_tabs_t *tabs, xrng_t *xrng) {
+
+  uint64_t *kmer_tab = tabs->kmer_tab;
+  uint64_t *euler_path = tabs->euler_path;
+  uint64_t *next_index = tabs->next_index;
+  unsigned char *invalid_vertex = tabs->invalid_vertex;
+
+  ERASE_ARRAY(invalid_vertex, pow5[k - 1]);
+  ERASE_ARRAY(euler_path, pow5[k - 1]);
+  ERASE_ARRAY(next_index, pow5[k - 1]);
+  ERASE_ARRAY(kmer_tab, pow5[k]);
+  count_kmers(seq, size, kmer_tab, k);
+
+  for (uint64_t i = 0; i < k - 1; i++) {
+    seq[i] = index2dna[char2index[seq[i]]];
+  }
+
+  for (uint64_t i = 0, j = 0; i < pow5[k - 1]; i++, j+= 5) {
+    if (!(COUNT_EDGES(j, kmer_tab))) invalid_vertex[i] = 1;
+  }
+
+  const uint64_t last_vertex = chars2kmer(seq, k - 1, size - k + 1);
+  invalid_vertex[last_vertex] = 1;
+
+  if (k > 2) {
+    for (uint64_t i = 0, j = 0, j_max = pow5[k - 2]; i < pow5[k - 1]; i++, j++) {
+      if (j == j_max) j = 0;
+      next_index[i] = j * 5;
+    }
+  }
+
+  for (uint64_t u, i = 0; i < pow5[k - 1]; i++) {
+    u = i;
+    while (!invalid_vertex[u]) {
+      euler_path[u] = cumsum_and_pick_next_letter(kmer_tab + u * 5, xrng);
+      u = euler_path[u] + next_index[u];
+    }
+    u = i;
+    while (!invalid_vertex[u]) {
+      invalid_vertex[u] = 1;
+      u = euler_path[u] + next_index[u];
+    }
+  }
+
+  for (uint64_t i = 0, j = 0; i < pow5[k - 1]; i++, j += 5) {
+    if (i != last_vertex && COUNT_EDGES(j, kmer_tab)) kmer_tab[j + euler_path[i]]--;
+  }
+
+  for (uint64_t current_vertex, next_edge, kmer_index, i = k - 2; i < size - 1; i++) {
+    current_vertex = chars2kmer(seq, k - 1, (i + 2) - k);
+    kmer_index = current_vertex * 5;
+    if (LIKELY(COUNT_EDGES(kmer_index, kmer_tab))) {
+      next_edge = cumsum_and_pick_next_letter(kmer_tab + kmer_index, xrng);
+      kmer_tab[next_edge + kmer_index]--;
+    } else {
+      next_edge = euler_path[current_vertex];
+    }
+    seq[i + 1] = index2dna[next_edge];
+  }
+
+}
+
+/* Shuffling code end */
+
+static unsigned char **controls;           /* Copy c of sequence j at c * n + j */
+
+static void *controls_sub_process(void *thread_i) {
+  const uint64_t k = CONTROL_K;
+  shuf_tabs_t tabs;
+  tabs.kmer_tab = malloc(sizeof(uint64_t) * pow5[k]);
+  tabs.euler_path = malloc(sizeof(uint64_t) * pow5[k - 1]);
+  tabs.next_index = malloc(sizeof(uint64_t) * pow5[k - 1]);
+  tabs.invalid_vertex = malloc(sizeof(unsigned char) * pow5[k - 1]);
+  if (tabs.kmer_tab == NULL || tabs.euler_path == NULL ||
+      tabs.next_index == NULL || tabs.invalid_vertex == NULL) {
+    badexit("Error: Failed to allocate memory for shuffling.");
+  }
+  for (uint64_t j = *((uint64_t *) thread_i); j < seq_info.n; j += args.nthreads) {
+    for (uint64_t c = 0; c < args.n_controls; c++) {
+      unsigned char *seq = malloc(MAX(1, seq_sizes[j]));
+      if (seq == NULL) {
+        badexit("Error: Failed to allocate memory for shuffled controls.");
+      }
+      if (args.use_twobit) {
+        twobit_decode(&twobit, j, 0, seq_sizes[j], seq);
+      } else {
+        memcpy(seq, seqs[j], seq_sizes[j]);
+      }
+      xrng_t xrng;
+      sxrand_r(&xrng, CONTROL_SEED ^ splitmix64(c * seq_info.n + j));
+      for (uint64_t s = 0; s < seq_n_segs[j]; s++) {
+        const uint64_t start = seq_segs[j][2 * s], size = seq_segs[j][2 * s + 1] - start;
+        if (size >= 2 * k) {
+          shuffle_euler(seq + start, size, k, &tabs, &xrng);
+        } else if (size > 1) {
+          shuffle_fisher_yates(seq + start, size, &xrng);
+        }
+      }
+      controls[c * seq_info.n + j] = seq;
+    }
+  }
+  free(tabs.kmer_tab);
+  free(tabs.euler_path);
+  free(tabs.next_index);
+  free(tabs.invalid_vertex);
+  free(thread_i);
+  return NULL;
+}
+
+static void make_controls(void) {
+  controls = malloc(sizeof(unsigned char *) * MAX(1, args.n_controls * seq_info.n));
+  if (controls == NULL) {
+    badexit("Error: Failed to allocate memory for shuffled controls.");
+  }
+  for (uint64_t t = 0; t < args.nthreads; t++) {
+    uint64_t *thread_i = malloc(sizeof(uint64_t));
+    if (thread_i == NULL) {
+      badexit("Error: Failed to allocate memory for thread index.");
+    }
+    *thread_i = t;
+    pthread_create(&threads[t], NULL, controls_sub_process, thread_i);
+  }
+  for (uint64_t t = 0; t < args.nthreads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+}
+
+static void free_controls(void) {
+  for (uint64_t i = 0; i < args.n_controls * seq_info.n; i++) {
+    free(controls[i]);
+  }
+  free(controls);
+}
+
+static void set_fdr_threshold(motif_t *motif, unsigned char *twobit_buf) {
+  fdr_t *fdr = motif->fdr;
+  fdr->score = INT_MAX;
+  fdr->hits = 0;
+  if (motif->threshold == INT_MAX) return;
+  const uint64_t n_scores = motif->max_score - motif->threshold + 1;
+  uint64_t *real = calloc(2 * n_scores, sizeof(uint64_t));
+  if (real == NULL) {
+    badexit("Error: Failed to allocate memory for score counts.");
+  }
+  uint64_t *ctrl = real + n_scores;
+  fdr->counting = ctrl;
+  for (uint64_t i = 0; i < args.n_controls * seq_info.n; i++) {
+    const uint64_t j = i % seq_info.n;
+    score_seq(motif, j, controls[i], 0, 0, seq_sizes[j]);
+  }
+  fdr->counting = real;
+  for (uint64_t j = 0; j < seq_info.n; j++) {
+    if (args.use_twobit) {
+      score_seq_twobit(motif, j, 0, twobit_buf);
+    } else {
+      score_seq(motif, j, seqs[j], 0, 0, seq_sizes[j]);
+    }
+  }
+  fdr->counting = NULL;
+  uint64_t n_real = 0, n_ctrl = 0, best = UINT64_MAX;
+  for (uint64_t i = n_scores - 1; i < -1; i--) {
+    n_real += real[i];
+    n_ctrl += ctrl[i];
+    if (real[i] && n_ctrl <= args.fdr * args.n_controls * n_real) {
+      best = i;
+      fdr->hits = n_real;
+      fdr->control_hits = (double) n_ctrl / args.n_controls;
+    }
+  }
+  free(real);
+  if (best == UINT64_MAX) {
+    motif->threshold = INT_MAX;
+  } else {
+    motif->threshold += best;
+    fdr->score = motif->threshold;
+    fdr->pvalue = score2pval(motif, motif->threshold);
+  }
+}
+
+static void *scan_sub_process(void *thread_i) {
+  unsigned char *twobit_buf = NULL;
+  if (args.use_twobit) {
+    twobit_buf = malloc(TWOBIT_CHUNK_SIZE + MAX_MOTIF_SIZE / 5);
+    if (twobit_buf == NULL) {
+      badexit("Error: Failed to allocate memory for .2bit decoding buffer.");
+    }
+  }
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    motif_t *motif = motifs[i];
+    if (*((int *) thread_i) == motif->thread) {
+      if (args.w && !args.progress) {
+        fprintf(stderr, "    Scanning motif: %s\n", motif->name);
+      }
+      if (args.affinity) {
+        fill_affinity_tab(motif);
+      } else if (args.bw_prefix != NULL) {
+        open_track(motif);
+      } else {
+        fill_cdf(motif);
+        set_threshold(motif);
+        if (motif->calib != NULL) set_calib_levels(motif);
+        if (motif->fdr != NULL) set_fdr_threshold(motif, twobit_buf);
+      }
+      open_motif_out(motif);
+      if (args.use_twobit) {
+        if (!args.use_bed) {
+          for (uint64_t j = 0; j < seq_info.n; j++) {
+            score_seq_twobit(motif, j, 0, twobit_buf);
+          }
+        } else {
+          for (uint64_t j = 0; j < bed.n_regions; j++) {
+            score_seq_twobit(motif, bed.seq_indices[j], j, twobit_buf);
+          }
+        }
+      } else if (!args.use_bed) {
+        for (uint64_t j = 0; j < seq_info.n; j++) {
+          score_seq(motif, j, seqs[j], 0, 0, seq_sizes[j]);
+        }
+      } else {
+        for (uint64_t j = 0; j < bed.n_regions; j++) {
+          score_seq_in_bed(motif, seqs[bed.seq_indices[j]], 0, j, 0, UINT64_MAX);
+        }
+      }
+      close_motif_out(motif);
+      if (args.bb_prefix != NULL) write_bigbed(motif);
+      if (motif->track != NULL) close_track(motif);
+      if (motif->affinity_tab != NULL) {
+        free(motif->affinity_tab);
+        motif->affinity_tab = NULL;
+      }
+      if (args.progress) {
+        pthread_mutex_lock(&pb_lock);
+        pb_counter++;
+        print_pb((double) pb_counter / motif_info.n);
+        pthread_mutex_unlock(&pb_lock);
+      }
+    }
+  }
+  free(twobit_buf);
+  free(thread_i);
+  return NULL;
+}
+
+/* Variant scoring (-V). For each allele, REF and ALT are first trimmed of
+ * any shared prefix and suffix, leaving the changed bases (which may be empty
+ * on one side for indels). The reference and alternate haplotypes are then
+ * built from the changed bases with motif_size-1 flanking bases on either
+ * side, so that every window within them overlaps the change (or for
+ * insertions/deletions, spans the junction). Only the best window of each
+ * haplotype is reported. The reference result is reused for the other ALT
+ * alleles of a record when the changed range is the same.
+ */
+
+typedef struct var_hit_t {
+  int       score;
+  uint64_t  start;                /* Offset into the haplotype */
+  char      strand;
+} var_hit_t;
+
+typedef struct var_buf_t {
+  unsigned char  *ref;
+  unsigned char  *alt;
+  uint64_t        size;
+  uint64_t        cached_record;  /* Reference result cache */
+  uint64_t        cached_start;
+  uint64_t        cached_end;
+  var_hit_t       cached_hit;
+} var_buf_t;
+
+static const motif_t *vcf_motif;  /* Motif being scored by the -V threads */
+
+static void best_window(const motif_t *motif, const unsigned char *seq, const uint64_t size, var_hit_t *hit) {
+  const unsigned char *char2Xindex = args.mask ? char2maskindex : char2index;
+  int score = INT_MIN, score_rc = INT_MIN;
+  hit->score = INT_MIN;
+  hit->start = 0;
+  hit->strand = '+';
+  for (uint64_t i = 0; i + motif->size <= size; i++) {
+    if (args.scan_rc) {
+      score_subseq_rc(motif, seq, i, &score, &score_rc, char2Xindex);
+    } else {
+      score_subseq(motif, seq, i, &score, char2Xindex);
+    }
+    if (score < motif->min_score) continue;   /* Overlaps a gap */
+    if (score > hit->score) {
+      hit->score = score;
+      hit->start = i;
+      hit->strand = '+';
+    }
+    if (score_rc > hit->score) {
+      hit->score = score_rc;
+      hit->start = i;
+      hit->strand = '-';
+    }
+  }
+}
+
+/* A haplotype without any window free of gaps gets a P-value of 1, and '.'
+ * for the other columns.
+ */
+static inline double var_score2pval(const motif_t *motif, const int score) {
+  return score == INT_MIN ? 1.0 : score2pval(motif, score);
+}
+
+static void print_var_hit(const motif_t *motif, const var_hit_t *hit, const uint64_t hap_start, const unsigned char *hap) {
+  if (hit->score == INT_MIN) {
+    fprintf(files.o, "\t.\t.\t1\t.\t.");
+    return;
+  }
+  const unsigned char *match = hap + hit->start;
+  unsigned char match_rc[MAX_MOTIF_SIZE / 5];
+  if (args.rc_match && hit->strand == '-') {
+    rev_comp_match(match_rc, match, motif->size);
+    match = match_rc;
+  }
+  fprintf(files.o, "\t%llu\t%c\t%.9g\t%.3f\t%.*s", hap_start + hit->start + 1, hit->strand,
+    score2pval(motif, hit->score), hit->score / PWM_INT_MULTIPLIER, (int) motif->size, match);
+}
+
+static void score_variant(const motif_t *motif, const variant_t *var, var_buf_t *buf) {
+  const uint64_t mot_size = motif->size;
+  uint64_t prefix = 0, suffix = 0;
+  while (prefix < var->ref_size && prefix < var->alt_size &&
+      char2index[(unsigned char) var->ref[prefix]] == char2index[(unsigned char) var->alt[prefix]]) {
+    prefix++;
+  }
+  while (suffix < var->ref_size - prefix && suffix < var->alt_size - prefix &&
+      char2index[(unsigned char) var->ref[var->ref_size - 1 - suffix]] ==
+      char2index[(unsigned char) var->alt[var->alt_size - 1 - suffix]]) {
+    suffix++;
+  }
+  const uint64_t start = var->pos + prefix;
+  const uint64_t ref_end = var->pos + var->ref_size - suffix;
+  const uint64_t alt_size = var->alt_size - prefix - suffix;
+  if (ref_end == start && !alt_size) return;
+  const uint64_t left = MIN(start, mot_size - 1);
+  const uint64_t hap_start = start - left;
+  const uint64_t hap_end = MIN(seq_sizes[var->seq_i], ref_end + mot_size - 1);
+  const uint64_t right = hap_end - ref_end;
+  const uint64_t ref_hap_size = hap_end - hap_start;
+  const uint64_t alt_hap_size = left + alt_size + right;
+  if (MAX(ref_hap_size, alt_hap_size) > buf->size) {
+    buf->size = MAX(ref_hap_size, alt_hap_size);
+    unsigned char *tmp_ptr1 = realloc(buf->ref, buf->size);
+    unsigned char *tmp_ptr2 = realloc(buf->alt, buf->size);
+    if (tmp_ptr1 == NULL || tmp_ptr2 == NULL) {
+      badexit("Error: Failed to allocate memory for variant haplotypes.");
+    }
+    buf->ref = tmp_ptr1;
+    buf->alt = tmp_ptr2;
+    buf->cached_record = UINT64_MAX;
+  }
+  var_hit_t ref_hit, alt_hit;
+  if (buf->cached_record == var->record && buf->cached_start == start &&
+      buf->cached_end == ref_end) {
+    ref_hit = buf->cached_hit;
+  } else {
+    copy_seq_range(var->seq_i, hap_start, hap_end, buf->ref);
+    best_window(motif, buf->ref, ref_hap_size, &ref_hit);
+    buf->cached_record = var->record;
+    buf->cached_start = start;
+    buf->cached_end = ref_end;
+    buf->cached_hit = ref_hit;
+  }
+  memcpy(buf->alt, buf->ref, left);
+  memcpy(buf->alt + left, var->alt + prefix, alt_size);
+  memcpy(buf->alt + left + alt_size, buf->ref + left + (ref_end - start), right);
+  best_window(motif, buf->alt, alt_hap_size, &alt_hit);
+  const int threshold = motif->threshold - 1;
+  if (ref_hit.score <= threshold && alt_hit.score <= threshold) return;
+  flockfile(files.o);   /* Keep lines from different threads whole */
+  fprintf(files.o, "%s\t%llu\t%s\t%s\t%s\t%s", seq_names[var->seq_i], var->pos + 1,
+    var->id, var->ref, var->alt, motif->name);
+  print_var_hit(motif, &ref_hit, hap_start, buf->ref);
+  print_var_hit(motif, &alt_hit, hap_start, buf->alt);
+  if (ref_hit.score == INT_MIN || alt_hit.score == INT_MIN) {
+    fprintf(files.o, "\t.");
+  } else {
+    fprintf(files.o, "\t%.3f", (alt_hit.score - ref_hit.score) / PWM_INT_MULTIPLIER);
+  }
+  fprintf(files.o, "\t%.3f\n",
+    log10(var_score2pval(motif, ref_hit.score)) - log10(var_score2pval(motif, alt_hit.score)));
+  funlockfile(files.o);
+}
+
+/* Each thread takes a contiguous slice of the variants for vcf_motif */
+static void *score_variants_sub_process(void *thread_i) {
+  const uint64_t t = *((uint64_t *) thread_i);
+  const uint64_t from = (variants.n * t) / args.nthreads;
+  const uint64_t to = (variants.n * (t + 1)) / args.nthreads;
+  var_buf_t buf = { NULL, NULL, 0, UINT64_MAX, 0, 0, { INT_MIN, 0, '+' } };
+  for (uint64_t i = from; i < to; i++) {
+    score_variant(vcf_motif, &variants.v[i], &buf);
+  }
+  free(buf.ref);
+  free(buf.alt);
+  free(thread_i);
+  return NULL;
+}
+
+/* Haplotype scoring (-H). Variants close enough for a window to overlap more
+ * than one of them are grouped into clusters. Within a cluster, haplotypes
+ * carrying the same set of ALT alleles share the same local sequence, so
+ * only the reference and each distinct combination of alleles are scanned.
+ * Hits are then matched up between the distinct haplotypes by position,
+ * strand and sequence, and those not carried by every haplotype are printed
+ * with the samples carrying them (and how many copies). Positions are along
+ * the reference; hits starting or ending within an insertion use the
+ * position of the last reference base before it.
+ */
+
+static int cmp_var_order(const void *a, const void *b) {
+  const uint64_t i1 = *((const uint64_t *) a), i2 = *((const uint64_t *) b);
+  const variant_t *v1 = &variants.v[i1], *v2 = &variants.v[i2];
+  if (v1->seq_i != v2->seq_i) return v1->seq_i < v2->seq_i ? -1 : 1;
+  if (v1->pos != v2->pos) return v1->pos < v2->pos ? -1 : 1;
+  return (i1 > i2) - (i1 < i2);
+}
+
+static void build_hap_clusters(const uint64_t max_mot_size) {
+  haps.order = malloc(sizeof(uint64_t) * MAX(1, variants.n));
+  haps.clusters = malloc(sizeof(uint64_t) * (variants.n + 1));
+  if (haps.order == NULL || haps.clusters == NULL) {
+    badexit("Error: Failed to allocate memory for variant clusters.");
+  }
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < variants.n; i++) {
+    if (variants.v[i].n_carriers) haps.order[n++] = i;
+  }
+  qsort(haps.order, n, sizeof(uint64_t), cmp_var_order);
+  uint64_t cluster_end = 0;
+  for (uint64_t i = 0; i < n; i++) {
+    const variant_t *var = &variants.v[haps.order[i]];
+    if (i == 0 || var->seq_i != variants.v[haps.order[i - 1]].seq_i ||
+        var->pos >= cluster_end + max_mot_size - 1) {
+      haps.clusters[haps.n_clusters++] = i;
+      cluster_end = var->pos + var->ref_size;
+    } else {
+      cluster_end = MAX(cluster_end, var->pos + var->ref_size);
+    }
+  }
+  haps.clusters[haps.n_clusters] = n;
+  if (args.v) {
+    fprintf(stderr, "Grouped %'llu carried allele(s) into %'llu cluster(s).\n",
+      n, haps.n_clusters);
+  }
+}
+
+typedef struct hap_pair_t {
+  uint32_t  hap;
+  uint32_t  k;                      /* Variant index within the cluster */
+} hap_pair_t;
+
+typedef struct hap_group_t {        /* A non-reference haplotype */
+  const hap_pair_t  *pairs;
+  uint32_t           n;
+  uint32_t           hap;
+} hap_group_t;
+
+typedef struct hap_hit_t {
+  uint64_t       start;
+  uint64_t       end;
+  int            score;
+  char           strand;
+  uint32_t       uniq;              /* Distinct haplotype, 0 = reference */
+  unsigned char  match[MAX_MOTIF_SIZE / 5];
+} hap_hit_t;
+
+typedef struct hap_buf_t {
+  hap_pair_t     *pairs;
+  hap_group_t    *groups;
+  uint64_t       *uniq_starts;      /* Offsets into groups for each uniq */
+  unsigned char  *ref;
+  unsigned char  *seq;
+  uint64_t       *map;              /* Reference position of each base  */
+  hap_hit_t      *hits;
+  unsigned char  *listed;           /* Per haplotype                    */
+  unsigned char  *dosage;           /* Per sample                       */
+  uint64_t        pairs_alloc;
+  uint64_t        groups_alloc;
+  uint64_t        uniq_alloc;
+  uint64_t        ref_alloc;
+  uint64_t        seq_alloc;
+  uint64_t        map_alloc;
+  uint64_t        hits_alloc;
+  uint64_t        n_hits;
+  uint64_t        n_groups;
+} hap_buf_t;
+
+static int cmp_hap_pairs(const void *a, const void *b) {
+  const hap_pair_t *p1 = a, *p2 = b;
+  if (p1->hap != p2->hap) return p1->hap < p2->hap ? -1 : 1;
+  return (p1->k > p2->k) - (p1->k < p2->k);
+}
+
+static int cmp_hap_groups(const void *a, const void *b) {
+  const hap_group_t *g1 = a, *g2 = b;
+  for (uint32_t i = 0; i < g1->n && i < g2->n; i++) {
+    if (g1->pairs[i].k != g2->pairs[i].k) return g1->pairs[i].k < g2->pairs[i].k ? -1 : 1;
+  }
+  if (g1->n != g2->n) return g1->n < g2->n ? -1 : 1;
+  return (g1->hap > g2->hap) - (g1->hap < g2->hap);
+}
+
+static int cmp_hap_hits(const void *a, const void *b) {
+  const hap_hit_t *h1 = a, *h2 = b;
+  if (h1->start != h2->start) return h1->start < h2->start ? -1 : 1;
+  if (h1->end != h2->end) return h1->end < h2->end ? -1 : 1;
+  if (h1->strand != h2->strand) return h1->strand < h2->strand ? -1 : 1;
+  const int res = memcmp(h1->match, h2->match, sizeof(h1->match));
+  if (res) return res;
+  return (h1->uniq > h2->uniq) - (h1->uniq < h2->uniq);
+}
+
+static inline void push_hap_hit(hap_buf_t *buf, const motif_t *motif, const uint64_t i, const int score, const char strand, const uint32_t uniq) {
+  buf->hits = grow_buf(buf->hits, &buf->hits_alloc, buf->n_hits + 1, sizeof(hap_hit_t),
+    "haplotype scoring");
+  hap_hit_t *hit = &buf->hits[buf->n_hits++];
+  hit->start = buf->map[i];
+  hit->end = buf->map[i + motif->size - 1];
+  hit->score = score;
+  hit->strand = strand;
+  hit->uniq = uniq;
+  memset(hit->match, 0, sizeof(hit->match));
+  memcpy(hit->match, buf->seq + i, motif->size);
+}
+
+static void scan_haplotype(const motif_t *motif, hap_buf_t *buf, const uint64_t size, const uint32_t uniq) {
+  const unsigned char *char2Xindex = args.mask ? char2maskindex : char2index;
+  const int threshold = motif->threshold - 1;
+  int score = INT_MIN, score_rc = INT_MIN;
+  for (uint64_t i = 0; i + motif->size <= size; i++) {
+    if (args.scan_rc) {
+      score_subseq_rc(motif, buf->seq, i, &score, &score_rc, char2Xindex);
+      if (UNLIKELY(score_rc > threshold)) push_hap_hit(buf, motif, i, score_rc, '-', uniq);
+    } else {
+      score_subseq(motif, buf->seq, i, &score, char2Xindex);
+    }
+    if (UNLIKELY(score > threshold)) push_hap_hit(buf, motif, i, score, '+', uniq);
+  }
+}
+
+static void print_hap_hit(const motif_t *motif, const variant_t *first_var, hap_buf_t *buf, const uint64_t from, const uint64_t to) {
+  const uint64_t n_haps = 2 * haps.n_samples;
+  uint64_t n_carriers = 0;
+  for (uint64_t i = from; i < to; i++) {
+    const uint32_t uniq = buf->hits[i].uniq;
+    if (i > from && uniq == buf->hits[i - 1].uniq) continue;
+    if (uniq == 0) {
+      n_carriers += n_haps - buf->n_groups;
+    } else {
+      n_carriers += buf->uniq_starts[uniq + 1] - buf->uniq_starts[uniq];
+    }
+  }
+  if (n_carriers == n_haps) return;
+  for (uint64_t i = from; i < to; i++) {
+    const uint32_t uniq = buf->hits[i].uniq;
+    if (i > from && uniq == buf->hits[i - 1].uniq) continue;
+    if (uniq == 0) {
+      for (uint64_t h = 0; h < n_haps; h++) {
+        if (!buf->listed[h]) buf->dosage[h / 2]++;
+      }
+    } else {
+      for (uint64_t g = buf->uniq_starts[uniq]; g < buf->uniq_starts[uniq + 1]; g++) {
+        buf->dosage[buf->groups[g].hap / 2]++;
+      }
+    }
+  }
+  const hap_hit_t *hit = &buf->hits[from];
+  const unsigned char *match = hit->match;
+  unsigned char match_rc[MAX_MOTIF_SIZE / 5];
+  if (args.rc_match && hit->strand == '-') {
+    rev_comp_match(match_rc, match, motif->size);
+    match = match_rc;
+  }
+  flockfile(files.o);
+  fprintf(files.o, "%s\t%llu\t%llu\t%c\t%s\t%.9g\t%.3f\t%.1f\t%.*s\t%llu\t",
+    seq_names[first_var->seq_i], hit->start + 1, hit->end + 1, hit->strand, motif->name,
+    score2pval(motif, hit->score), hit->score / PWM_INT_MULTIPLIER,
+    100.0 * hit->score / motif->max_score, (int) motif->size, match, n_carriers);
+  int is_first = 1;
+  for (uint64_t smp = 0; smp < haps.n_samples; smp++) {
+    if (buf->dosage[smp]) {
+      fprintf(files.o, is_first ? "%s:%d" : ",%s:%d", haps.samples[smp], buf->dosage[smp]);
+      is_first = 0;
+      buf->dosage[smp] = 0;
+    }
+  }
+  if (is_first) fputc('.', files.o);
+  fputc('\n', files.o);
+  funlockfile(files.o);
+}
+
+static void score_hap_cluster(const motif_t *motif, const uint64_t c, hap_buf_t *buf) {
+  const uint64_t *order = haps.order + haps.clusters[c];
+  const uint64_t n_vars = haps.clusters[c + 1] - haps.clusters[c];
+  const variant_t *first_var = &variants.v[order[0]];
+  const uint64_t mot_size = motif->size;
+  uint64_t n_pairs = 0, cluster_end = 0, alt_sizes = 0;
+  for (uint64_t k = 0; k < n_vars; k++) {
+    const variant_t *var = &variants.v[order[k]];
+    cluster_end = MAX(cluster_end, var->pos + var->ref_size);
+    alt_sizes += var->alt_size;
+    buf->pairs = grow_buf(buf->pairs, &buf->pairs_alloc, n_pairs + var->n_carriers,
+      sizeof(hap_pair_t), "haplotype scoring");
+    for (uint64_t j = 0; j < var->n_carriers; j++) {
+      buf->pairs[n_pairs].hap = haps.carriers[var->carriers_off + j];
+      buf->pairs[n_pairs].k = k;
+      n_pairs++;
+    }
+  }
+  if (n_pairs) qsort(buf->pairs, n_pairs, sizeof(hap_pair_t), cmp_hap_pairs);
+  uint64_t n_groups = 0;
+  for (uint64_t i = 0; i < n_pairs; ) {
+    uint64_t j = i + 1;
+    while (j < n_pairs && buf->pairs[j].hap == buf->pairs[i].hap) j++;
+    buf->groups = grow_buf(buf->groups, &buf->groups_alloc, n_groups + 1, sizeof(hap_group_t),
+      "haplotype scoring");
+    buf->groups[n_groups].pairs = buf->pairs + i;
+    buf->groups[n_groups].n = j - i;
+    buf->groups[n_groups].hap = buf->pairs[i].hap;
+    buf->listed[buf->pairs[i].hap] = 1;
+    n_groups++;
+    i = j;
+  }
+  if (n_groups) qsort(buf->groups, n_groups, sizeof(hap_group_t), cmp_hap_groups);
+  /* Groups with the same alleles are now next to each other. uniq_starts[u]
+   * is the first group of distinct haplotype u (u > 0), so uniq_starts[1] is
+   * always 0 and uniq_starts[n_uniq] is n_groups.
+   */
+  buf->uniq_starts = grow_buf(buf->uniq_starts, &buf->uniq_alloc, n_groups + 2,
+    sizeof(uint64_t), "haplotype scoring");
+  uint64_t n_uniq = 1;
+  for (uint64_t g = 0; g < n_groups; g++) {
+    const hap_group_t *g1 = &buf->groups[g], *g2 = &buf->groups[g - (g > 0)];
+    int is_new = g == 0 || g1->n != g2->n;
+    for (uint32_t i = 0; !is_new && i < g1->n; i++) {
+      is_new = g1->pairs[i].k != g2->pairs[i].k;
+    }
+    if (is_new) buf->uniq_starts[n_uniq++] = g;
+  }
+  buf->uniq_starts[0] = 0;
+  buf->uniq_starts[n_uniq] = n_groups;
+  buf->n_groups = n_groups;
+  const uint64_t lo = first_var->pos - MIN(first_var->pos, mot_size - 1);
+  const uint64_t hi = MIN(seq_sizes[first_var->seq_i], cluster_end + mot_size - 1);
+  buf->ref = grow_buf(buf->ref, &buf->ref_alloc, hi - lo, 1, "haplotype scoring");
+  buf->seq = grow_buf(buf->seq, &buf->seq_alloc, hi - lo + alt_sizes, 1, "haplotype scoring");
+  buf->map = grow_buf(buf->map, &buf->map_alloc, hi - lo + alt_sizes, sizeof(uint64_t),
+    "haplotype scoring");
+  copy_seq_range(first_var->seq_i, lo, hi, buf->ref);
+  buf->n_hits = 0;
+  if (n_groups < 2 * haps.n_samples) {
+    memcpy(buf->seq, buf->ref, hi - lo);
+    for (uint64_t i = 0; i < hi - lo; i++) buf->map[i] = lo + i;
+    scan_haplotype(motif, buf, hi - lo, 0);
+  }
+  for (uint64_t u = 1; u < n_uniq; u++) {
+    const hap_group_t *group = &buf->groups[buf->uniq_starts[u]];
+    uint64_t cur = lo, n = 0;
+    for (uint32_t i = 0; i < group->n; i++) {
+      const variant_t *var = &variants.v[order[group->pairs[i].k]];
+      if (var->pos < cur) continue;   /* Overlaps an allele already applied */
+      for (; cur < var->pos; cur++, n++) {
+        buf->seq[n] = buf->ref[cur - lo];
+        buf->map[n] = cur;
+      }
+      for (uint64_t j = 0; j < var->alt_size; j++, n++) {
+        buf->seq[n] = var->alt[j];
+        buf->map[n] = var->pos + MIN(j, var->ref_size - 1);
+      }
+      cur += var->ref_size;
+    }
+    for (; cur < hi; cur++, n++) {
+      buf->seq[n] = buf->ref[cur - lo];
+      buf->map[n] = cur;
+    }
+    scan_haplotype(motif, buf, n, u);
+  }
+  if (buf->n_hits) qsort(buf->hits, buf->n_hits, sizeof(hap_hit_t), cmp_hap_hits);
+  for (uint64_t i = 0; i < buf->n_hits; ) {
+    uint64_t j = i + 1;
+    while (j < buf->n_hits && buf->hits[j].start == buf->hits[i].start &&
+        buf->hits[j].end == buf->hits[i].end && buf->hits[j].strand == buf->hits[i].strand &&
+        !memcmp(buf->hits[j].match, buf->hits[i].match, sizeof(buf->hits[i].match))) {
+      j++;
+    }
+    print_hap_hit(motif, first_var, buf, i, j);
+    i = j;
+  }
+  for (uint64_t g = 0; g < n_groups; g++) buf->listed[buf->groups[g].hap] = 0;
+}
+
+/* Each thread takes a contiguous slice of the clusters for vcf_motif */
+static void *score_haps_sub_process(void *thread_i) {
+  const uint64_t t = *((uint64_t *) thread_i);
+  const uint64_t from = (haps.n_clusters * t) / args.nthreads;
+  const uint64_t to = (haps.n_clusters * (t + 1)) / args.nthreads;
+  hap_buf_t buf;
+  memset(&buf, 0, sizeof(hap_buf_t));
+  buf.listed = calloc(2 * haps.n_samples + 1, 1);
+  buf.dosage = calloc(haps.n_samples + 1, 1);
+  if (buf.listed == NULL || buf.dosage == NULL) {
+    badexit("Error: Failed to allocate memory for haplotype scoring.");
+  }
+  for (uint64_t c = from; c < to; c++) {
+    score_hap_cluster(vcf_motif, c, &buf);
+  }
+  free(buf.pairs);
+  free(buf.groups);
+  free(buf.uniq_starts);
+  free(buf.ref);
+  free(buf.seq);
+  free(buf.map);
+  free(buf.hits);
+  free(buf.listed);
+  free(buf.dosage);
+  free(thread_i);
+  return NULL;
+}
+
+/* Short read streaming (-R). Reads are only kept in memory for as long as the
+ * batch they belong to is being scored: while each thread scores one batch
+ * with all motifs, the main thread reads the next set of batches. Hits (or
+ * the motif presence strings for -P) are printed as soon as they are found,
+ * so with -j the output from different batches can be interleaved.
+ */
+
+typedef struct read_batch_t {
+  unsigned char  *seqs;             /* All reads back to back            */
+  char           *names;
+  uint64_t       *seq_offs;         /* n+1, start of each read in seqs   */
+  uint64_t       *name_offs;
+  unsigned char  *presence;         /* -P only                           */
+  uint64_t        n;
+  uint64_t        seqs_alloc;
+  uint64_t        names_alloc;
+  uint64_t        seq_offs_alloc;
+  uint64_t        name_offs_alloc;
+  uint64_t        presence_alloc;
+  uint64_t        char_counts[256];
+} read_batch_t;
+
+/* Totals for -R and -L, printed at the end of the output */
+typedef struct stream_info_t {
+  uint64_t  n;
+  uint64_t  total_bases;
+  uint64_t  max_possible_hits;
+} stream_info_t;
+
+static stream_info_t stream_info = {
+  .n                 = 0,
+  .total_bases       = 0,
+  .max_possible_hits = 0
+};
+
+/* Since all motifs are scored at the same time, each needs its own CDF. Only
+ * the part at or above the threshold is ever looked at, so only that is kept.
+ */
+static void keep_cdf_tail(motif_t *motif) {
+  if (motif->threshold == INT_MAX) {
+    motif->cdf = NULL;
+    return;
+  }
+  const uint64_t first = MAX(0, motif->threshold - motif->cdf_offset);
+  double *tail = malloc(sizeof(double) * (motif->cdf_size - first));
+  if (tail == NULL) {
+    badexit("Error: Failed to allocate memory for motif CDF.");
   }
+  memcpy(tail, motif->cdf + first, sizeof(double) * (motif->cdf_size - first));
+  motif->cdf = tail;
+  motif->cdf_offset += first;
 }
 
-#define PRINT_RES_BED(BED_RANGE1_CHROM, BED_RANGE1_START, BED_RANGE1_END, \
-  BED_RANGE1_STRAND, BED_NAME2, SEQ_NAME3, START4, END5, STRAND6, MOTIF7, \
-  PVALUE8, SCORE9, SCORE_PCT10, MATCH11_SIZE, MATCH11) \
-    fprintf(files.o, "%s:%llu-%llu(%c)\t%s\t%s\t%llu\t%llu\t%c\t%s\t%.9g\t%.3f\t%.1f\t%.*s\n", \
-      BED_RANGE1_CHROM, BED_RANGE1_START, BED_RANGE1_END, BED_RANGE1_STRAND, \
-      BED_NAME2, SEQ_NAME3, START4, END5, STRAND6, MOTIF7, PVALUE8, SCORE9, \
-      SCORE_PCT10, MATCH11_SIZE, MATCH11)
+static uint64_t fill_read_batch(kseq_t *kseq, read_batch_t *batch) {
+  uint64_t n_bases = 0, n_name = 0;
+  int ret_val = 0;
+  batch->n = 0;
+  batch->seq_offs = grow_buf(batch->seq_offs, &batch->seq_offs_alloc, 1,
+    sizeof(uint64_t), "read batches");
+  while (n_bases < READ_BATCH_BASES && batch->n < READ_BATCH_READS &&
+      (ret_val = kseq_read(kseq)) >= 0) {
+    batch->seqs = grow_buf(batch->seqs, &batch->seqs_alloc, n_bases + kseq->seq.l, 1,
+      "read batches");
+    batch->names = grow_buf(batch->names, &batch->names_alloc,
+      n_name + kseq->name.l + kseq->comment.l + 2, 1, "read batches");
+    batch->seq_offs = grow_buf(batch->seq_offs, &batch->seq_offs_alloc, batch->n + 2,
+      sizeof(uint64_t), "read batches");
+    batch->name_offs = grow_buf(batch->name_offs, &batch->name_offs_alloc, batch->n + 1,
+      sizeof(uint64_t), "read batches");
+    if (kseq->seq.l) memcpy(batch->seqs + n_bases, kseq->seq.s, kseq->seq.l);
+    add_seq_name(batch->names + n_name, kseq);
+    batch->seq_offs[batch->n] = n_bases;
+    batch->name_offs[batch->n] = n_name;
+    n_bases += kseq->seq.l;
+    n_name += strlen(batch->names + n_name) + 1;
+    batch->n++;
+  }
+  batch->seq_offs[batch->n] = n_bases;
+  if (ret_val == -2) {
+    badexit("Error: Failed to parse FASTQ qualities.");
+  } else if (ret_val < -2) {
+    badexit("Error: Failed to read input.");
+  }
+  stream_info.n += batch->n;
+  stream_info.total_bases += n_bases;
+  return batch->n;
+}
 
-static void score_seq_in_bed(const motif_t *motif, const uint64_t seq_loc, const uint64_t bed_i) {
+static void score_read(const motif_t *motif, const char *name, const unsigned char *seq, const uint64_t size) {
   const unsigned char *char2Xindex = args.mask ? char2maskindex : char2index;
-  const unsigned char *seq = seqs[seq_loc];
-  const char *seq_name = seq_names[bed.seq_indices[bed_i]];
-  const uint64_t bed_size = bed.ends[bed_i] - bed.starts[bed_i];
-  const uint64_t bed_start_i = bed.starts[bed_i] + 1;
-  const uint64_t bed_end_i = bed.ends[bed_i];
-  const char bed_strand_i = bed.strands[bed_i];
-  const char *bed_name = bed.range_names[bed_i];
   const int mot_size = motif->size;
-  if (bed_size < mot_size || motif->threshold == INT_MAX) return;
   const int threshold = motif->threshold - 1;
   int score = INT_MIN, score_rc = INT_MIN;
-  if (bed_strand_i == '.') {
-    for (uint64_t i = bed_start_i - 1; i < bed_end_i - mot_size; i++) {
+  if (args.scan_rc) {
+    for (uint64_t i = 0; i + mot_size <= size; i++) {
       score_subseq_rc(motif, seq, i, &score, &score_rc, char2Xindex);
       if (UNLIKELY(score > threshold)) {
-        PRINT_RES_BED(seq_name, bed_start_i, bed_end_i, bed_strand_i, bed_name, seq_name,
-          i + 1, i + mot_size, '+', motif->name, score2pval(motif, score),
+        flockfile(files.o);
+        PRINT_RES(motif, 0, name, i + 1, i + mot_size, '+', motif->name, score2pval(motif, score),
           score / PWM_INT_MULTIPLIER, 100.0 * score / motif->max_score, mot_size, seq + i);
+        funlockfile(files.o);
       }
       if (UNLIKELY(score_rc > threshold)) {
-        PRINT_RES_BED(seq_name, bed_start_i, bed_end_i, bed_strand_i, bed_name, seq_name,
-          i + 1, i + mot_size, '-', motif->name, score2pval(motif, score_rc),
+        flockfile(files.o);
+        PRINT_RES(motif, 0, name, i + 1, i + mot_size, '-', motif->name, score2pval(motif, score_rc),
           score_rc / PWM_INT_MULTIPLIER, 100.0 * score_rc / motif->max_score, mot_size, seq + i);
+        funlockfile(files.o);
       }
     }
-  } else if (bed_strand_i == '+') {
-    for (uint64_t i = bed_start_i - 1; i < bed_end_i - mot_size; i++) {
+  } else {
+    for (uint64_t i = 0; i + mot_size <= size; i++) {
       score_subseq(motif, seq, i, &score, char2Xindex);
       if (UNLIKELY(score > threshold)) {
-        PRINT_RES_BED(seq_name, bed_start_i, bed_end_i, bed_strand_i, bed_name, seq_name,
-          i + 1, i + mot_size, '+', motif->name, score2pval(motif, score),
-          score / PWM_INT_MULTIPLIER, 100.0 * score / motif->max_score, mot_size, seq + i);
-      }
-    }
-  } else if (bed_strand_i == '-') {
-    for (uint64_t i = bed_start_i - 1; i < bed_end_i - mot_size; i++) {
-      score_subseq_rev(motif, seq, i, &score, char2Xindex);
-      if (UNLIKELY(score > threshold)) {
-        PRINT_RES_BED(seq_name, bed_start_i, bed_end_i, bed_strand_i, bed_name, seq_name,
-          i + 1, i + mot_size, '-', motif->name, score2pval(motif, score),
+        flockfile(files.o);
+        PRINT_RES(motif, 0, name, i + 1, i + mot_size, '+', motif->name, score2pval(motif, score),
           score / PWM_INT_MULTIPLIER, 100.0 * score / motif->max_score, mot_size, seq + i);
+        funlockfile(files.o);
       }
     }
   }
 }
 
-#define PRINT_RES(SEQ_NAME1, START2, END3, STRAND4, MOTIF5, PVALUE6, SCORE7, \
-  SCORE_PCT8, MATCH9_SIZE, MATCH9) \
-    fprintf(files.o, "%s\t%llu\t%llu\t%c\t%s\t%.9g\t%.3f\t%.1f\t%.*s\n", \
-      SEQ_NAME1, START2, END3, STRAND4, MOTIF5, PVALUE6, SCORE7, SCORE_PCT8, \
-      MATCH9_SIZE, MATCH9)
-
-static void score_seq(const motif_t *motif, const uint64_t seq_i, const uint64_t seq_loc) {
+/* For -P: stop at the first hit */
+static int read_has_hit(const motif_t *motif, const unsigned char *seq, const uint64_t size) {
   const unsigned char *char2Xindex = args.mask ? char2maskindex : char2index;
-  const unsigned char *seq = seqs[seq_loc];
-  const char *seq_name = seq_names[seq_i];
-  const uint64_t seq_size = seq_sizes[seq_i];
-  const int mot_size = motif->size;
-  if (seq_size < mot_size || motif->threshold == INT_MAX) return;
+  const uint64_t mot_size = motif->size;
   const int threshold = motif->threshold - 1;
   int score = INT_MIN, score_rc = INT_MIN;
   if (args.scan_rc) {
-    for (uint64_t i = 0; i < seq_size - mot_size + 1; i++) {
+    for (uint64_t i = 0; i + mot_size <= size; i++) {
       score_subseq_rc(motif, seq, i, &score, &score_rc, char2Xindex);
-      if (UNLIKELY(score > threshold)) {
-        PRINT_RES(seq_name, i + 1, i + mot_size, '+', motif->name, score2pval(motif, score),
-          score / PWM_INT_MULTIPLIER, 100.0 * score / motif->max_score, mot_size, seq + i);
-      }
-      if (UNLIKELY(score_rc > threshold)) {
-        PRINT_RES(seq_name, i + 1, i + mot_size, '-', motif->name, score2pval(motif, score_rc),
-          score_rc / PWM_INT_MULTIPLIER, 100.0 * score_rc / motif->max_score, mot_size, seq + i);
-      }
+      if (UNLIKELY(score > threshold || score_rc > threshold)) return 1;
     }
   } else {
-    for (uint64_t i = 0; i < seq_size - mot_size + 1; i++) {
+    for (uint64_t i = 0; i + mot_size <= size; i++) {
       score_subseq(motif, seq, i, &score, char2Xindex);
-      if (UNLIKELY(score > threshold)) {
-        PRINT_RES(seq_name, i + 1, i + mot_size, '+', motif->name, score2pval(motif, score),
-          score / PWM_INT_MULTIPLIER, 100.0 * score / motif->max_score, mot_size, seq + i);
+      if (UNLIKELY(score > threshold)) return 1;
+    }
+  }
+  return 0;
+}
+
+/* Motifs are looped over first since this is faster than scoring each read
+ * with every motif in turn. For -P, presence is first filled in for the whole
+ * batch (one hex digit per four motifs per read) and then printed.
+ */
+static void *score_reads_sub_process(void *batch_ptr) {
+  static const char hex_digits[16] = "0123456789abcdef";
+  read_batch_t *batch = batch_ptr;
+  const uint64_t n_hex = (motif_info.n + 3) / 4;
+  ERASE_ARRAY(batch->char_counts, 256);
+  for (uint64_t i = 0; i < batch->seq_offs[batch->n]; i++) {
+    batch->char_counts[batch->seqs[i]]++;
+  }
+  if (args.presence) {
+    batch->presence = grow_buf(batch->presence, &batch->presence_alloc,
+      batch->n * n_hex + 1, 1, "motif presence");
+    memset(batch->presence, 0, batch->n * n_hex);
+  }
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    const motif_t *motif = motifs[i];
+    if (motif->threshold == INT_MAX) continue;
+    for (uint64_t r = 0; r < batch->n; r++) {
+      const unsigned char *seq = batch->seqs + batch->seq_offs[r];
+      const uint64_t size = batch->seq_offs[r + 1] - batch->seq_offs[r];
+      if (size < motif->size) continue;
+      if (!args.presence) {
+        score_read(motif, batch->names + batch->name_offs[r], seq, size);
+      } else if (read_has_hit(motif, seq, size)) {
+        batch->presence[r * n_hex + i / 4] |= 8 >> (i % 4);
       }
     }
   }
+  if (!args.presence) return NULL;
+  char *line = malloc(n_hex + 1);
+  if (line == NULL) {
+    badexit("Error: Failed to allocate memory for motif presence.");
+  }
+  line[n_hex] = '\0';
+  for (uint64_t r = 0; r < batch->n; r++) {
+    const unsigned char *presence = batch->presence + r * n_hex;
+    int has_hits = 0;
+    for (uint64_t i = 0; i < n_hex; i++) {
+      line[i] = hex_digits[presence[i]];
+      has_hits |= presence[i];
+    }
+    if (has_hits) fprintf(files.o, "%s\t%s\n", batch->names + batch->name_offs[r], line);
+  }
+  free(line);
+  return NULL;
 }
 
-static void print_seq_stats_single(FILE *whereto, const uint64_t seq_i, const uint64_t seq_j) {
+static void scan_reads(kseq_t *kseq) {
+  read_batch_t *batches = calloc(2 * args.nthreads, sizeof(read_batch_t));
+  if (batches == NULL) {
+    badexit("Error: Failed to allocate memory for read batches.");
+  }
+  read_batch_t *cur = batches, *next = batches + args.nthreads;
+  uint64_t n_cur = 0, n_next = 0;
+  while (n_cur < args.nthreads && fill_read_batch(kseq, &cur[n_cur])) n_cur++;
   ERASE_ARRAY(char_counts, 256);
-  count_bases_single(seqs[seq_i], seq_sizes[seq_j]);
-  fprintf(whereto, "%llu\t%s\t", seq_j + 1, seq_names[seq_j]);
-  fprintf(whereto, "%llu\t", seq_sizes[seq_j]);
-  if (!seq_sizes[seq_j]) {
-    fprintf(whereto, "nan\t");
+  while (n_cur) {
+    for (uint64_t t = 0; t < n_cur; t++) {
+      pthread_create(&threads[t], NULL, score_reads_sub_process, &cur[t]);
+    }
+    n_next = 0;
+    while (n_next < args.nthreads && fill_read_batch(kseq, &next[n_next])) n_next++;
+    for (uint64_t t = 0; t < n_cur; t++) {
+      pthread_join(threads[t], NULL);
+      for (int c = 0; c < 256; c++) char_counts[c] += cur[t].char_counts[c];
+    }
+    read_batch_t *tmp_ptr = cur;
+    cur = next;
+    next = tmp_ptr;
+    n_cur = n_next;
+  }
+  for (uint64_t i = 0; i < 2 * args.nthreads; i++) {
+    free(batches[i].seqs);
+    free(batches[i].names);
+    free(batches[i].seq_offs);
+    free(batches[i].name_offs);
+    free(batches[i].presence);
+  }
+  free(batches);
+  if (!stream_info.n) {
+    badexit("Error: Failed to read any sequences from input.");
+  }
+  if (args.v) {
+    fprintf(stderr, "Scanned %'llu base(s) across %'llu read(s).\n",
+      stream_info.total_bases, stream_info.n);
+  }
+}
+
+/* Sequence streaming (-L). Unlike low-mem mode the input is only read once,
+ * so it can come from stdin: each sequence is scanned with every motif as soon
+ * as it has been read (with the motifs split between threads), and then
+ * discarded. Only the current sequence is ever kept in memory.
+ */
+
+static void *stream_sub_process(void *thread_i) {
+  const uint64_t t = *((uint64_t *) thread_i);
+  const uint64_t from = (motif_info.n * t) / args.nthreads;
+  const uint64_t to = (motif_info.n * (t + 1)) / args.nthreads;
+  for (uint64_t i = from; i < to; i++) {
+    score_seq(motifs[i], 0, seqs[0], 0, 0, seq_sizes[0]);
+  }
+  free(thread_i);
+  return NULL;
+}
+
+/* -L: the names of the sequences already scanned are kept, so that
+ * duplicates are caught (or renamed with -d) like with find_seq_dupes.
+ */
+static void check_stream_seq_name(uint64_t *name_alloc) {
+  int absent;
+  khint_t k = kh_get(seq_str_h, seq_hash_tab, seq_names[0]);
+  if (k != kh_end(seq_hash_tab)) {
+    if (!args.dedup) {
+      fprintf(stderr,
+        "Error: Encountered duplicate sequence name (use -d to deduplicate).\n    #%llu: %s",
+        stream_info.n + 1, seq_names[0]);
+      badexit("");
+    }
+    seq_names[0] = grow_buf(seq_names[0], name_alloc, strlen(seq_names[0]) + 32, 1,
+      "sequence name");
+    dedup_char_array(seq_names[0], *name_alloc, stream_info.n + 1);
+  }
+  char *name = strdup(seq_names[0]);
+  if (name == NULL) {
+    badexit("Error: Failed to hash sequence names");
+  }
+  k = kh_put(seq_str_h, seq_hash_tab, name, &absent);
+  if (absent == -1) {
+    free(name);
+    badexit("Error: Failed to hash sequence names");
+  } else if (absent == 0) {
+    free(name);
   } else {
-    fprintf(whereto, "%.2f\t", calc_gc() * 100.0);
+    kh_val(seq_hash_tab, k) = stream_info.n;
   }
-  fprintf(whereto, "%llu\n", seq_sizes[seq_j] - standard_base_count());
 }
 
-static void print_seq_stats(FILE *whereto) {
-  for (uint64_t i = 0; i < seq_info.n; i++) {
-    ERASE_ARRAY(char_counts, 256);
-    count_bases_single(seqs[i], seq_sizes[i]);
-    fprintf(whereto, "%llu\t%s\t", i + 1, seq_names[i]);
-    fprintf(whereto, "%llu\t", seq_sizes[i]);
-    if (!seq_sizes[i]) {
-      fprintf(whereto, "nan\t");
+static void stream_seqs(kseq_t *kseq) {
+  uint64_t name_alloc = 0;
+  int ret_val;
+  ERASE_ARRAY(char_counts, 256);
+  seq_info.n = 1;
+  seq_names[0] = NULL;
+  while ((ret_val = kseq_read(kseq)) >= 0) {
+    seq_names[0] = grow_buf(seq_names[0], &name_alloc,
+      kseq->name.l + kseq->comment.l + 2, 1, "sequence name");
+    add_seq_name(seq_names[0], kseq);
+    check_stream_seq_name(&name_alloc);
+    seqs[0] = (unsigned char *) kseq->seq.s;
+    seq_sizes[0] = kseq->seq.l;
+    if (args.w) {
+      fprintf(stderr, "    Scanning sequence: %s\n", seq_names[0]);
+    }
+    count_bases_single(seqs[0], seq_sizes[0]);
+    add_seq_segs(0, seqs[0], seq_sizes[0]);
+    for (uint64_t t = 0; t < args.nthreads; t++) {
+      uint64_t *thread_i = malloc(sizeof(uint64_t));
+      if (thread_i == NULL) {
+        badexit("Error: Failed to allocate memory for thread index.");
+      }
+      *thread_i = t;
+      pthread_create(&threads[t], NULL, stream_sub_process, thread_i);
+    }
+    for (uint64_t t = 0; t < args.nthreads; t++) {
+      pthread_join(threads[t], NULL);
+    }
+    free(seq_segs[0]);
+    seq_segs[0] = NULL;
+    for (uint64_t i = 0; i < motif_info.n; i++) {
+      if (seq_sizes[0] >= motifs[i]->size) {
+        stream_info.max_possible_hits += 1 + seq_sizes[0] - motifs[i]->size;
+      }
+    }
+    stream_info.n++;
+    stream_info.total_bases += seq_sizes[0];
+  }
+  if (args.scan_rc) stream_info.max_possible_hits *= 2;
+  if (ret_val == -2) {
+    badexit("Error: Failed to parse FASTQ qualities.");
+  } else if (ret_val < -2) {
+    badexit("Error: Failed to read input.");
+  } else if (!stream_info.n) {
+    badexit("Error: Failed to read any sequences from input.");
+  }
+  if (args.v) {
+    fprintf(stderr, "Scanned %'llu base(s) across %'llu sequence(s).\n",
+      stream_info.total_bases, stream_info.n);
+  }
+}
+
+/* -A: one row per sequence (or BED range) and one column per motif, with the
+ * log2 of the summed 2^score of every window (-inf if there were none). In
+ * other words this is the log-sum-exp of the scores, in the same units.
+ */
+static void print_affinity_columns(FILE *out, const char *first_cols) {
+  fputs(first_cols, out);
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    fprintf(out, "\t%s", motifs[i]->name);
+  }
+  fputc('\n', out);
+}
+
+static void print_affinity(void) {
+  const uint64_t n_rows = args.use_bed ? bed.n_regions : seq_info.n;
+  for (uint64_t r = 0; r < n_rows; r++) {
+    if (args.use_bed) {
+      fprintf(files.o, "%s:%llu-%llu(%c)\t%s", seq_names[bed.seq_indices[r]],
+        bed.starts[r] + 1, bed.ends[r], bed.strands[r], bed.range_names[r]);
     } else {
-      fprintf(whereto, "%.2f\t", calc_gc() * 100.0);
+      fputs(seq_names[r], files.o);
     }
-    fprintf(whereto, "%llu\n", seq_sizes[i] - standard_base_count());
+    for (uint64_t i = 0; i < motif_info.n; i++) {
+      fprintf(files.o, "\t%.3f", log2(motifs[i]->affinity[r]));
+    }
+    fputc('\n', files.o);
   }
 }
 
-static void add_consensus_motif(const char *consensus) {
-  if (add_motif()) badexit("");
-  ERASE_ARRAY(motifs[0]->name, MAX_NAME_SIZE);
-  uint64_t i = 0;
-  for (;;) {
-    motifs[0]->name[i] = consensus[i];
-    if (consensus[i] == '\0') {
-      motifs[0]->size = i;
-      break;
+/* -C: the continued fraction for the regularized incomplete beta function
+ * I_x(a, b), from Numerical Recipes (modified Lentz's method).
+ */
+static double betacf(const double a, const double b, const double x) {
+  const double qab = a + b, qap = a + 1.0, qam = a - 1.0;
+  double c = 1.0, d = 1.0 - qab * x / qap;
+  if (fabs(d) < DBL_MIN) d = DBL_MIN;
+  d = 1.0 / d;
+  double h = d;
+  for (int m = 1; m <= 10000; m++) {
+    const int m2 = 2 * m;
+    double aa = m * (b - m) * x / ((qam + m2) * (a + m2));
+    d = 1.0 + aa * d;
+    if (fabs(d) < DBL_MIN) d = DBL_MIN;
+    c = 1.0 + aa / c;
+    if (fabs(c) < DBL_MIN) c = DBL_MIN;
+    d = 1.0 / d;
+    h *= d * c;
+    aa = -(a + m) * (qab + m) * x / ((a + m2) * (qap + m2));
+    d = 1.0 + aa * d;
+    if (fabs(d) < DBL_MIN) d = DBL_MIN;
+    c = 1.0 + aa / c;
+    if (fabs(c) < DBL_MIN) c = DBL_MIN;
+    d = 1.0 / d;
+    const double del = d * c;
+    h *= del;
+    if (fabs(del - 1.0) < 1e-15) break;
+  }
+  return h;
+}
+
+/* log(I_x(a, b)), which for a binomial(n, p) is log(P(X >= k)) with x = p,
+ * a = k and b = n - k + 1. Kept in log space since central enrichment
+ * P-values can easily be too small for a double.
+ */
+static double log_ibeta(const double x, const double a, const double b) {
+  if (x <= 0.0) return -INFINITY;
+  if (x >= 1.0) return 0.0;
+  const double log_front = lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log1p(-x);
+  if (x < (a + 1.0) / (a + b + 2.0)) {
+    return log_front + log(betacf(a, b, x)) - log(a);
+  }
+  return log1p(-exp(log_front + log(betacf(b, a, 1.0 - x)) - log(b)));
+}
+
+/* -C: one row per motif with the number of sites (split between ties for -C
+ * best), the central region with the smallest binomial P-value for holding
+ * that many of the sites if they were spread evenly, and the histogram. The
+ * P-value is multiplied by the number of region widths tried.
+ */
+static void print_site_hists(void) {
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    sites_t *sites = motifs[i]->sites;
+    finish_sites_row(sites);
+    const uint64_t n_bins = sites->n_bins;
+    double total = 0.0, central = 0.0, best_central = 0.0, best_log_p = 0.0;
+    uint64_t best_width = 0, n_widths = 0;
+    for (uint64_t b = 0; b < n_bins; b++) {
+      total += sites->hist[b];
     }
-    i++;
+    for (uint64_t w = 2 - n_bins % 2; w < n_bins; w += 2, n_widths++) {
+      const uint64_t from = (n_bins - w) / 2;
+      central += sites->hist[from] + (w > 1 ? sites->hist[from + w - 1] : 0.0);
+      const double log_p = central > 0.0 ?
+        log_ibeta((double) w / n_bins, central, total - central + 1.0) : 0.0;
+      if (!best_width || log_p < best_log_p) {
+        best_width = w;
+        best_central = central;
+        best_log_p = log_p;
+      }
+    }
+    const double log10_p = n_widths ? MIN(0.0, (best_log_p + log(n_widths)) / log(10.0)) : 0.0;
+    fprintf(files.o, "%s\t%.9g\t%llu\t%.9g\t%.3f\t", motifs[i]->name, total, best_width,
+      best_central, log10_p);
+    for (uint64_t b = 0; b < n_bins; b++) {
+      fprintf(files.o, b ? ",%.9g" : "%.9g", sites->hist[b]);
+    }
+    fputs(n_bins ? "\n" : ".\n", files.o);
   }
-  motifs[0]->name[i] = '\0';
-  if (motifs[0]->size > MAX_MOTIF_SIZE / 5) {
-    fprintf(stderr, "Error: Consensus sequence is too large (%llu>max=%llu).",
-      motifs[0]->size, MAX_MOTIF_SIZE / 5);
+}
+
+/* -S: spacing between the hits of each pair of motifs (SpaMo-style). The
+ * hits of every motif are kept as for -B and sorted by position, then each
+ * pair of motifs (including each motif with itself) is swept with a window of
+ * max_gap bases around every hit of the first motif, the primary. Pairs of
+ * hits which overlap are skipped. The gap is the number of bases between the
+ * two, and the secondary hit is counted as being on the same or opposite
+ * strand, and upstream or downstream, relative to the primary. For a motif
+ * with itself, each pair of hits is only counted once, with the left hit as
+ * the primary.
+ */
+
+typedef struct spacing_t {
+  uint64_t   *pair_i;
+  uint64_t   *pair_j;
+  uint64_t    n_pairs;
+  uint64_t    chunk_start;
+  uint64_t   *counts;              /* 4 histograms per pair in the chunk */
+} spacing_t;
+
+static spacing_t spacing;
+
+static void count_spacing(uint64_t *counts, const motif_t *motif1, const motif_t *motif2) {
+  const hits_t *hits1 = motif1->hits, *hits2 = motif2->hits;
+  const uint64_t max_gap = args.max_gap, n_gaps = max_gap + 1;
+  const uint64_t size1 = motif1->size, size2 = motif2->size;
+  const int self = motif1 == motif2;
+  uint64_t lo = 0;
+  for (uint64_t x = 0; x < hits1->n; x++) {
+    const hit_t *p = &hits1->h[x];
+    while (lo < hits2->n && (hits2->h[lo].chrom < p->chrom ||
+        (hits2->h[lo].chrom == p->chrom && hits2->h[lo].start + size2 + max_gap < p->start))) {
+      lo++;
+    }
+    for (uint64_t y = self ? x + 1 : lo; y < hits2->n; y++) {
+      const hit_t *h = &hits2->h[y];
+      if (h->chrom != p->chrom || h->start > p->start + size1 + max_gap) break;
+      uint64_t gap;
+      int right;
+      if (h->start >= p->start + size1) {
+        gap = h->start - p->start - size1;
+        right = 1;
+      } else if (p->start >= h->start + size2) {
+        gap = p->start - h->start - size2;
+        right = 0;
+      } else {
+        continue;
+      }
+      if (gap > max_gap) continue;
+      const int downstream = right == (p->strand == '+');
+      counts[(2 * (h->strand != p->strand) + downstream) * n_gaps + gap]++;
+    }
   }
-  uint64_t let_i;
-  for (uint64_t pos = 0; pos < motifs[0]->size; pos++) {
-    let_i = consensus2index[(unsigned char) consensus[pos]];
-    if (let_i == -1) {
-      fprintf(stderr, "Error: Encountered unknown letter in consensus (%c).",
-        consensus[pos]);
-      badexit("");
+}
+
+static void *spacing_sub_process(void *thread_i) {
+  const uint64_t n_counts = 4 * (args.max_gap + 1);
+  const uint64_t chunk_end = MIN(spacing.n_pairs, spacing.chunk_start + SPACING_PAIR_CHUNK);
+  for (uint64_t p = spacing.chunk_start + *((uint64_t *) thread_i); p < chunk_end; p += args.nthreads) {
+    count_spacing(spacing.counts + (p - spacing.chunk_start) * n_counts,
+      motifs[spacing.pair_i[p]], motifs[spacing.pair_j[p]]);
+  }
+  free(thread_i);
+  return NULL;
+}
+
+/* One row per motif pair and arrangement with at least one pair of hits: the
+ * number of pairs, the most common gap, its binomial P-value if the gaps were
+ * uniform (multiplied by the number of gaps and arrangements), and the
+ * histogram of gaps from 0 to max_gap.
+ */
+static void print_spacing(void) {
+  static const char *strands[2] = { "same", "opposite" };
+  static const char *sides[2] = { "upstream", "downstream" };
+  const uint64_t n_gaps = args.max_gap + 1, n_counts = 4 * n_gaps;
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    if (motifs[i]->hits->n) {
+      qsort(motifs[i]->hits->h, motifs[i]->hits->n, sizeof(hit_t), cmp_hits);
+    }
+  }
+  spacing.n_pairs = motif_info.n * (motif_info.n + 1) / 2;
+  spacing.pair_i = malloc(sizeof(uint64_t) * spacing.n_pairs);
+  spacing.pair_j = malloc(sizeof(uint64_t) * spacing.n_pairs);
+  spacing.counts = malloc(sizeof(uint64_t) * SPACING_PAIR_CHUNK * n_counts);
+  if (spacing.pair_i == NULL || spacing.pair_j == NULL || spacing.counts == NULL) {
+    badexit("Error: Failed to allocate memory for spacing histograms.");
+  }
+  for (uint64_t i = 0, p = 0; i < motif_info.n; i++) {
+    for (uint64_t j = i; j < motif_info.n; j++, p++) {
+      spacing.pair_i[p] = i;
+      spacing.pair_j[p] = j;
+    }
+  }
+  for (spacing.chunk_start = 0; spacing.chunk_start < spacing.n_pairs;
+      spacing.chunk_start += SPACING_PAIR_CHUNK) {
+    ERASE_ARRAY(spacing.counts, SPACING_PAIR_CHUNK * n_counts);
+    for (uint64_t t = 0; t < args.nthreads; t++) {
+      uint64_t *thread_i = malloc(sizeof(uint64_t));
+      if (thread_i == NULL) {
+        badexit("Error: Failed to allocate memory for thread index.");
+      }
+      *thread_i = t;
+      pthread_create(&threads[t], NULL, spacing_sub_process, thread_i);
+    }
+    for (uint64_t t = 0; t < args.nthreads; t++) {
+      pthread_join(threads[t], NULL);
+    }
+    const uint64_t chunk_end = MIN(spacing.n_pairs, spacing.chunk_start + SPACING_PAIR_CHUNK);
+    for (uint64_t p = spacing.chunk_start; p < chunk_end; p++) {
+      for (uint64_t a = 0; a < 4; a++) {
+        const uint64_t *counts = spacing.counts + (p - spacing.chunk_start) * n_counts + a * n_gaps;
+        uint64_t total = 0, top_gap = 0;
+        for (uint64_t g = 0; g < n_gaps; g++) {
+          total += counts[g];
+          if (counts[g] > counts[top_gap]) top_gap = g;
+        }
+        if (!total) continue;
+        const double log_p = log_ibeta(1.0 / n_gaps, counts[top_gap], total - counts[top_gap] + 1.0);
+        fprintf(files.o, "%s\t%s\t%s\t%s\t%llu\t%llu\t%llu\t%.3f\t",
+          motifs[spacing.pair_i[p]]->name, motifs[spacing.pair_j[p]]->name,
+          strands[a / 2], sides[a % 2], total, top_gap, counts[top_gap],
+          MIN(0.0, (log_p + log(n_counts)) / log(10.0)));
+        for (uint64_t g = 0; g < n_gaps; g++) {
+          fprintf(files.o, g ? ",%llu" : "%llu", counts[g]);
+        }
+        fputc('\n', files.o);
+      }
+    }
+  }
+  free(spacing.pair_i);
+  free(spacing.pair_j);
+  free(spacing.counts);
+}
+
+/* -K: clusters of hits from all motifs (cis-regulatory modules), loosely in
+ * the style of Cluster-Buster. Each sequence is scanned one block at a time,
+ * with the motifs split between threads, and the hits of every motif for
+ * the block are merged into a single list sorted by position. A window of
+ * crm_size bases is then started at each hit, and scored as the sum of the
+ * -log10(P-value) of all hits starting within it. Windows scoring at least
+ * crm_score which share hits with the previous one are merged into the same
+ * cluster. A window can only be scored once all hits starting within it are
+ * known, so the sweep stops crm_size bases before the end of the block and
+ * the hits it still needs are carried over to the next one.
+ */
+
+typedef struct crm_hit_t {
+  uint64_t    start;
+  uint64_t    end;
+  uint64_t    motif;
+  double      weight;              /* -log10(P-value) */
+} crm_hit_t;
+
+typedef struct crm_t {
+  crm_hit_t  *h;                   /* Hits of the current sequence */
+  uint64_t    n;
+  uint64_t    n_alloc;
+  uint64_t    next;                /* First window not yet scored */
+  uint64_t    right;               /* First hit after that window */
+  double      sum;                 /* Score of that window so far */
+  int         open;                /* Whether a cluster is being extended */
+  uint64_t    first;               /* Hits [first, last) are in the cluster */
+  uint64_t    last;
+  double      best;                /* Best window score of the cluster */
+  uint64_t   *counts;              /* Hits per motif while printing */
+  uint64_t   *order;               /* Motifs in order of appearance */
+  uint64_t    seq_i;               /* The block being scanned */
+  const unsigned char *seq;
+  uint64_t    seq_offset;
+  uint64_t    from;
+  uint64_t    to;
+} crm_t;
+
+static crm_t crm;
+
+static int cmp_crm_hits(const void *a, const void *b) {
+  const crm_hit_t *h1 = a, *h2 = b;
+  if (h1->start != h2->start) return h1->start < h2->start ? -1 : 1;
+  return (h1->motif > h2->motif) - (h1->motif < h2->motif);
+}
+
+static void print_crm(void) {
+  const crm_hit_t *h = crm.h;
+  uint64_t end = 0, n_motifs = 0;
+  double score = 0.0;
+  for (uint64_t k = crm.first; k < crm.last; k++) {
+    end = MAX(end, h[k].end);
+    score += h[k].weight;
+    if (!crm.counts[h[k].motif]++) crm.order[n_motifs++] = h[k].motif;
+  }
+  fprintf(files.o, "%s\t%llu\t%llu\t%llu\t%llu\t%.3f\t%.3f\t",
+    seq_names[crm.seq_i], h[crm.first].start + 1, end, crm.last - crm.first, n_motifs,
+    score, crm.best);
+  for (uint64_t m = 0; m < n_motifs; m++) {
+    fprintf(files.o, m ? ",%s:%llu" : "%s:%llu", motifs[crm.order[m]]->name,
+      crm.counts[crm.order[m]]);
+    crm.counts[crm.order[m]] = 0;
+  }
+  fputc('\n', files.o);
+}
+
+/* Score the windows whose hits are all known, i.e. which end at or before
+ * known (UINT64_MAX at the end of the sequence), then drop the hits which
+ * are no longer needed.
+ */
+static void sweep_crms(const uint64_t known) {
+  const uint64_t size = args.crm_size;
+  crm_hit_t *h = crm.h;
+  while (crm.next < crm.n && (known == UINT64_MAX || h[crm.next].start + size <= known)) {
+    const uint64_t window_end = h[crm.next].start + size;
+    while (crm.right < crm.n && h[crm.right].start < window_end) {
+      crm.sum += h[crm.right++].weight;
+    }
+    if (crm.sum >= args.crm_score) {
+      if (crm.open && crm.next < crm.last) {
+        crm.last = crm.right;
+        crm.best = MAX(crm.best, crm.sum);
+      } else {
+        if (crm.open) print_crm();
+        crm.open = 1;
+        crm.first = crm.next;
+        crm.last = crm.right;
+        crm.best = crm.sum;
+      }
+    }
+    crm.sum -= h[crm.next++].weight;
+    if (crm.next == crm.right) crm.sum = 0.0;
+  }
+  if (crm.open && (known == UINT64_MAX || crm.next >= crm.last)) {
+    print_crm();
+    crm.open = 0;
+  }
+  const uint64_t keep = crm.open ? crm.first : crm.next;
+  if (keep) {
+    memmove(h, h + keep, sizeof(crm_hit_t) * (crm.n - keep));
+    crm.n -= keep;
+    crm.next -= keep;
+    crm.right -= keep;
+    if (crm.open) {
+      crm.first -= keep;
+      crm.last -= keep;
+    }
+  }
+}
+
+static void *crm_sub_process(void *thread_i) {
+  const uint64_t t = *((uint64_t *) thread_i);
+  const uint64_t from = (motif_info.n * t) / args.nthreads;
+  const uint64_t to = (motif_info.n * (t + 1)) / args.nthreads;
+  for (uint64_t i = from; i < to; i++) {
+    score_seq(motifs[i], crm.seq_i, crm.seq, crm.seq_offset, crm.from, crm.to);
+  }
+  free(thread_i);
+  return NULL;
+}
+
+static void scan_crms(void) {
+  uint64_t max_mot_size = 1;
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    max_mot_size = MAX(max_mot_size, motifs[i]->size);
+  }
+  unsigned char *twobit_buf = NULL;
+  if (args.use_twobit) {
+    twobit_buf = malloc(CRM_BLOCK_SIZE + max_mot_size);
+    if (twobit_buf == NULL) {
+      badexit("Error: Failed to allocate memory for .2bit decoding buffer.");
+    }
+  }
+  crm.counts = calloc(motif_info.n, sizeof(uint64_t));
+  crm.order = malloc(sizeof(uint64_t) * motif_info.n);
+  if (crm.counts == NULL || crm.order == NULL) {
+    badexit("Error: Failed to allocate memory for clusters.");
+  }
+  for (uint64_t j = 0; j < seq_info.n; j++) {
+    if (args.w && !args.progress) {
+      fprintf(stderr, "    Scanning sequence: %s\n", seq_names[j]);
+    }
+    crm.seq_i = j;
+    crm.n = 0;
+    crm.next = 0;
+    crm.right = 0;
+    crm.sum = 0.0;
+    crm.open = 0;
+    for (uint64_t b = 0; b < seq_sizes[j]; b += CRM_BLOCK_SIZE) {
+      const uint64_t b_end = MIN(seq_sizes[j], b + CRM_BLOCK_SIZE);
+      const uint64_t s = first_seg(j, b);
+      if (s < seq_n_segs[j] && seq_segs[j][2 * s] < b_end) {
+        if (args.use_twobit) {
+          twobit_decode(&twobit, j, b, MIN(seq_sizes[j], b_end + max_mot_size - 1), twobit_buf);
+          crm.seq = twobit_buf;
+          crm.seq_offset = b;
+        } else {
+          crm.seq = seqs[j];
+          crm.seq_offset = 0;
+        }
+        crm.from = b;
+        crm.to = b_end;
+        for (uint64_t t = 0; t < args.nthreads; t++) {
+          uint64_t *thread_i = malloc(sizeof(uint64_t));
+          if (thread_i == NULL) {
+            badexit("Error: Failed to allocate memory for thread index.");
+          }
+          *thread_i = t;
+          pthread_create(&threads[t], NULL, crm_sub_process, thread_i);
+        }
+        for (uint64_t t = 0; t < args.nthreads; t++) {
+          pthread_join(threads[t], NULL);
+        }
+        const uint64_t n_old = crm.n;
+        for (uint64_t i = 0; i < motif_info.n; i++) {
+          hits_t *hits = motifs[i]->hits;
+          crm.h = grow_buf(crm.h, &crm.n_alloc, crm.n + hits->n, sizeof(crm_hit_t), "clusters");
+          for (uint64_t k = 0; k < hits->n; k++) {
+            crm_hit_t *hit = &crm.h[crm.n++];
+            hit->start = hits->h[k].start;
+            hit->end = hits->h[k].start + motifs[i]->size;
+            hit->motif = i;
+            hit->weight = -log10(hits->h[k].pvalue);
+          }
+          hits->n = 0;
+        }
+        if (crm.n > n_old) {
+          qsort(crm.h + n_old, crm.n - n_old, sizeof(crm_hit_t), cmp_crm_hits);
+        }
+      }
+      sweep_crms(b_end);
+    }
+    sweep_crms(UINT64_MAX);
+    if (args.progress) print_pb((j + 1.0) / seq_info.n);
+  }
+  free(crm.h);
+  free(crm.counts);
+  free(crm.order);
+  free(twobit_buf);
+}
+
+/* -Q: the threshold picked for each motif */
+static void print_fdr_thresholds(void) {
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    const fdr_t *fdr = motifs[i]->fdr;
+    if (fdr->score == INT_MAX) {
+      fprintf(files.o, "##Motif=%s Threshold=none Hits=0\n", motifs[i]->name);
+    } else {
+      fprintf(files.o, "##Motif=%s Threshold=%.3f PValue=%.9g Hits=%llu ControlHits=%.2f FDR=%.4f\n",
+        motifs[i]->name, fdr->score / PWM_INT_MULTIPLIER, fdr->pvalue, fdr->hits,
+        fdr->control_hits, fdr->control_hits / fdr->hits);
+    }
+  }
+}
+
+static void print_calibration(FILE *whereto) {
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    const calib_t *calib = motifs[i]->calib;
+    if (!calib->n_levels) {
+      fprintf(whereto, "##Calibration Motif=%s Windows=%llu PValue=none\n",
+        motifs[i]->name, calib->windows);
+      continue;
+    }
+    uint64_t observed = 0;
+    for (int k = 0; k < calib->n_levels; k++) observed += calib->counts[k];
+    for (int k = 0; k < calib->n_levels; k++) {
+      const double expected = calib->windows * calib->pvalues[k];
+      fprintf(whereto,
+        "##Calibration Motif=%s Windows=%llu Score=%.3f PValue=%.3g Expected=%.1f Observed=%llu Ratio=%.3f\n",
+        motifs[i]->name, calib->windows, calib->scores[k] / PWM_INT_MULTIPLIER,
+        calib->pvalues[k], expected, observed, observed / expected);
+      observed -= calib->counts[k];
     }
-    set_score(motifs[0], 'A', pos,
-      calc_score(consensus2probs[let_i * 4 + 0], args.bkg[0]));
-    set_score(motifs[0], 'C', pos,
-      calc_score(consensus2probs[let_i * 4 + 1], args.bkg[1]));
-    set_score(motifs[0], 'G', pos,
-      calc_score(consensus2probs[let_i * 4 + 2], args.bkg[2]));
-    set_score(motifs[0], 'T', pos,
-      calc_score(consensus2probs[let_i * 4 + 3], args.bkg[3]));
   }
-  complete_motifs();
 }
 
-static void print_pb(const double prog) {
-  const int left = prog * PROGRESS_BAR_WIDTH;
-  const int right = PROGRESS_BAR_WIDTH - left;
-  fprintf(stderr, "\r[%.*s%*s] %3d%%", left, PROGRESS_BAR_STRING, right, "",
-      (int) (prog * 100.0));
-  fflush(stderr);
+/* For -R and -L the sequence stats are only known at the end */
+static void print_trailer(void) {
+  if (args.out_fmt != OUT_YAMSCAN) return;
+  const uint64_t unknowns = stream_info.total_bases - standard_base_count();
+  if (args.use_reads) {
+    fprintf(files.o, "##ReadCount=%llu ReadSize=%llu GC=%.2f%% Ns=%llu\n",
+      stream_info.n, stream_info.total_bases, calc_gc() * 100.0, unknowns);
+  } else {
+    fprintf(files.o, "##SeqCount=%llu SeqSize=%llu GC=%.2f%% Ns=%llu MaxPossibleHits=%llu\n",
+      stream_info.n, stream_info.total_bases, calc_gc() * 100.0, unknowns,
+      stream_info.max_possible_hits);
+  }
 }
 
-static void *scan_sub_process(void *thread_i) {
+static void print_header(FILE *out, const int argc, char **argv) {
+  if (args.out_fmt == OUT_GFF3) {
+    fprintf(out, "##gff-version 3\n");
+    return;
+  } else if (args.out_fmt != OUT_YAMSCAN) {
+    return;
+  }
+  fprintf(out, "##yamscan v%s [ ", YAMSCAN_VERSION);
+  for (uint64_t i = 1; i < argc; i++) {
+    fprintf(out, "%s ", argv[i]);
+  }
+  fprintf(out, "]\n");
+  uint64_t motif_size = 0;
+  uint64_t max_possible_hits = 0;
   for (uint64_t i = 0; i < motif_info.n; i++) {
-    motif_t *motif = motifs[i];
-    if (*((int *) thread_i) == motif->thread) {
-      if (args.w && !args.progress) {
-        fprintf(stderr, "    Scanning motif: %s\n", motif->name);
-      }
-      fill_cdf(motif);
-      set_threshold(motif);
-      if (!args.use_bed) {
-        for (uint64_t j = 0; j < seq_info.n; j++) {
-          score_seq(motif, j, j);
-        }
-      } else {
-        for (uint64_t j = 0; j < bed.n_regions; j++) {
-          score_seq_in_bed(motif, bed.seq_indices[j], j);
-        }
-      }
-      if (args.progress) {
-        pthread_mutex_lock(&pb_lock);
-        pb_counter++;
-        print_pb((double) pb_counter / motif_info.n);
-        pthread_mutex_unlock(&pb_lock);
-      }
+    for (uint64_t j = 0; j < seq_info.n; j++) {
+      max_possible_hits += MAX(0, 1 + seq_sizes[j] - motifs[i]->size);
+    }
+  }
+  if (args.scan_rc) max_possible_hits *= 2;
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    motif_size += motifs[i]->size;
+  }
+  if (args.use_reads || args.stream) {
+    fprintf(out, "##MotifCount=%llu MotifSize=%llu\n", motif_info.n, motif_size);
+    if (args.presence) {
+      fprintf(out, "##read_name\tmotifs\n");
+    } else {
+      fprintf(out, "##seq_name\tstart\tend\tstrand\tmotif\tpvalue\tscore\tscore_pct\tmatch\n");
+    }
+  } else if (args.use_haps) {
+    fprintf(out,
+      "##MotifCount=%llu MotifSize=%llu VariantCount=%llu AlleleCount=%llu SampleCount=%llu ClusterCount=%llu SeqCount=%llu SeqSize=%llu GC=%.2f%% Ns=%llu\n",
+      motif_info.n, motif_size, variants.n_records, variants.n, haps.n_samples,
+      haps.n_clusters, seq_info.n, seq_info.total_bases, seq_info.gc_pct, seq_info.unknowns);
+    fprintf(out,
+      "##seq_name\tstart\tend\tstrand\tmotif\tpvalue\tscore\tscore_pct\tmatch\thaplotypes\tsamples\n");
+  } else if (args.use_vcf) {
+    fprintf(out,
+      "##MotifCount=%llu MotifSize=%llu VariantCount=%llu AlleleCount=%llu SeqCount=%llu SeqSize=%llu GC=%.2f%% Ns=%llu\n",
+      motif_info.n, motif_size, variants.n_records, variants.n, seq_info.n,
+      seq_info.total_bases, seq_info.gc_pct, seq_info.unknowns);
+    fprintf(out,
+      "##seq_name\tpos\tid\tref\talt\tmotif\tref_start\tref_strand\tref_pvalue\tref_score\tref_match\talt_start\talt_strand\talt_pvalue\talt_score\talt_match\tscore_delta\tlog10_pvalue_ratio\n");
+  } else if (args.use_bed) {
+    uint64_t bed_sum = 0;
+    for (uint64_t k = 0; k < bed.n_regions; k++) {
+      bed_sum += bed.ends[k] - bed.starts[k];
+    }
+    fprintf(out,
+      "##MotifCount=%llu MotifSize=%llu BedCount=%llu BedSize=%llu SeqCount=%llu SeqSize=%llu GC=%.2f%% Ns=%llu\n",
+      motif_info.n, motif_size, bed.n_regions, bed_sum, seq_info.n,
+      seq_info.total_bases, seq_info.gc_pct, seq_info.unknowns);
+    if (args.affinity) {
+      print_affinity_columns(out, "##bed_range\tbed_name");
+    } else if (args.site_hist) {
+      fprintf(out, "##motif\tsites\tcentral_width\tcentral_sites\tlog10_adj_pvalue\thistogram\n");
+    } else {
+      fprintf(out, 
+        "##bed_range\tbed_name\tseq_name\tstart\tend\tstrand\tmotif\tpvalue\tscore\tscore_pct\tmatch\n");
+    }
+  } else {
+    fprintf(out,
+      "##MotifCount=%llu MotifSize=%llu SeqCount=%llu SeqSize=%llu GC=%.2f%% Ns=%llu MaxPossibleHits=%llu\n",
+      motif_info.n, motif_size, seq_info.n, seq_info.total_bases, seq_info.gc_pct,
+      seq_info.unknowns, max_possible_hits);
+    if (args.affinity) {
+      print_affinity_columns(out, "##seq_name");
+    } else if (args.site_hist) {
+      fprintf(out, "##motif\tsites\tcentral_width\tcentral_sites\tlog10_adj_pvalue\thistogram\n");
+    } else if (args.max_gap >= 0) {
+      fprintf(out,
+        "##motif1\tmotif2\tstrand\tside\tpairs\ttop_gap\ttop_pairs\tlog10_adj_pvalue\thistogram\n");
+    } else if (args.crm_size) {
+      fprintf(out,
+        "##seq_name\tstart\tend\thits\tmotifs\tscore\tbest_window_score\tmotif_hits\n");
+    } else {
+      fprintf(out, 
+        "##seq_name\tstart\tend\tstrand\tmotif\tpvalue\tscore\tscore_pct\tmatch\n");
     }
   }
-  free(thread_i);
-  return NULL;
 }
 
 int main(int argc, char **argv) {
@@ -2963,15 +7277,15 @@ int main(int argc, char **argv) {
     badexit("Error: Failed to allocate memory for threads.");
   }
 
-  kseq_t *kseq;
-  char *user_bkg, *consensus;
+  kseq_t *kseq = NULL;
+  char *user_bkg, *consensus, *out_path = NULL;
   int has_motifs = 0, has_seqs = 0, has_consensus = 0;
-  int use_stdout = 1, use_stdin = 0, use_manual_thresh = 0;
+  int use_stdout = 1, use_stdin = 0, use_manual_thresh = 0, use_tabix = 0;
   uint64_t max_seq_size;
 
   int opt;
 
-  while ((opt = getopt(argc, argv, "m:1:s:o:b:flt:p:n:j:x:dgrMvwh0")) != -1) {
+  while ((opt = getopt(argc, argv, "m:1:s:o:z:Z:T:O:N:IF:B:W:C:S:K:Q:E:b:fclt:p:n:j:x:X:V:HRPLAdgrMvwh0")) != -1) {
     switch (opt) {
       case 'm':
         if (has_consensus) {
@@ -3001,11 +7315,37 @@ int main(int argc, char **argv) {
         }
         files.b_open = 1;
         break;
+      case 'X':
+        files.e = gzopen(optarg, "r");
+        if (files.e == NULL) {
+          fprintf(stderr, "Error: Failed to open exclusion bed file \"%s\" [%s]", optarg, strerror(errno));
+          badexit("");
+        }
+        files.e_open = 1;
+        break;
+      case 'V':
+        files.vcf = gzopen(optarg, "r");
+        if (files.vcf == NULL) {
+          fprintf(stderr, "Error: Failed to open VCF file \"%s\" [%s]", optarg, strerror(errno));
+          badexit("");
+        }
+        files.vcf_open = 1;
+        args.use_vcf = 1;
+        break;
       case 's':
         has_seqs = 1;
         if (optarg[0] == '-' && optarg[1] == '\0') {
           files.s = gzdopen(fileno(stdin), "r");
           use_stdin = 1;
+        } else if (twobit_is_path(optarg)) {
+          errno = 0;
+          if (twobit_open(&twobit, optarg)) {
+            fprintf(stderr, "Error: Failed to open sequence file \"%s\" [%s]", optarg,
+              errno ? strerror(errno) : twobit.err);
+            badexit("");
+          }
+          args.use_twobit = 1;
+          break;
         } else {
           files.s = gzopen(optarg, "r");
           if (files.s == NULL) {
@@ -3017,6 +7357,7 @@ int main(int argc, char **argv) {
         break;
       case 'o':
         use_stdout = 0;
+        out_path = optarg;
         files.o = fopen(optarg, "w");
         if (files.o == NULL) {
           fprintf(stderr, "Error: Failed to create output file \"%s\" [%s]", optarg, strerror(errno));
@@ -3024,6 +7365,127 @@ int main(int argc, char **argv) {
         }
         files.o_open = 1;
         break;
+      case 'z':
+      case 'Z':
+        args.compress = opt == 'z' ? ZOUT_BGZF : ZOUT_ZSTD;
+        if (str_to_int(optarg, &args.compress_level)) {
+          fprintf(stderr, "Error: Failed to parse -%c value.", opt);
+          badexit("");
+        }
+        if (args.compress_level < 1 || args.compress_level > (opt == 'z' ? 9 : 19)) {
+          fprintf(stderr, "Error: -%c must be between 1 and %d.", opt, opt == 'z' ? 9 : 19);
+          badexit("");
+        }
+        break;
+      case 'T':
+        if (str_to_int(optarg, &args.compress_threads)) {
+          badexit("Error: Failed to parse -T value.");
+        }
+        if (args.compress_threads < 1 || args.compress_threads > ZOUT_MAX_THREADS) {
+          fprintf(stderr, "Error: -T must be between 1 and %d.", ZOUT_MAX_THREADS);
+          badexit("");
+        }
+        break;
+      case 'O':
+        args.split_prefix = optarg;
+        break;
+      case 'N':
+        if (str_to_int(optarg, &args.n_shards)) {
+          badexit("Error: Failed to parse -N value.");
+        }
+        if (args.n_shards < 1) {
+          badexit("Error: -N must be a positive integer.");
+        }
+        break;
+      case 'I':
+        use_tabix = 1;
+        break;
+      case 'F':
+        if (!strcmp(optarg, "yamscan")) {
+          args.out_fmt = OUT_YAMSCAN;
+        } else if (!strcmp(optarg, "bed")) {
+          args.out_fmt = OUT_BED;
+        } else if (!strcmp(optarg, "gff3")) {
+          args.out_fmt = OUT_GFF3;
+        } else if (!strcmp(optarg, "gtf")) {
+          args.out_fmt = OUT_GTF;
+        } else {
+          fprintf(stderr, "Error: Unknown -F value \"%s\" (need yamscan/bed/gff3/gtf).", optarg);
+          badexit("");
+        }
+        break;
+      case 'B':
+        args.bb_prefix = optarg;
+        break;
+      case 'W':
+        args.bw_prefix = optarg;
+        break;
+      case 'S':
+        if (str_to_int(optarg, &args.max_gap)) {
+          badexit("Error: Failed to parse -S value.");
+        }
+        if (args.max_gap < 0) {
+          badexit("Error: -S must be zero or a positive integer.");
+        }
+        break;
+      case 'K': {
+        /* The comma is put back so that the header shows the full value */
+        char *comma = strchr(optarg, ',');
+        if (comma != NULL) {
+          if (str_to_double(comma + 1, &args.crm_score)) {
+            badexit("Error: Failed to parse -K score.");
+          }
+          *comma = '\0';
+        }
+        const int bad_size = str_to_int(optarg, &args.crm_size);
+        if (comma != NULL) *comma = ',';
+        if (bad_size) {
+          badexit("Error: Failed to parse -K value.");
+        }
+        if (args.crm_size < 1) {
+          badexit("Error: -K must be a positive integer.");
+        }
+        break;
+      }
+      case 'Q': {
+        char *comma = strchr(optarg, ',');
+        if (comma != NULL) {
+          if (str_to_int(comma + 1, &args.n_controls)) {
+            badexit("Error: Failed to parse -Q copies.");
+          }
+          if (args.n_controls < 1) {
+            badexit("Error: -Q copies must be a positive integer.");
+          }
+          *comma = '\0';
+        }
+        const int bad_fdr = str_to_double(optarg, &args.fdr);
+        if (comma != NULL) *comma = ',';
+        if (bad_fdr) {
+          badexit("Error: Failed to parse -Q value.");
+        }
+        if (args.fdr <= 0.0 || args.fdr > 1.0) {
+          badexit("Error: -Q must be more than 0 and at most 1.");
+        }
+        break;
+      }
+      case 'E':
+        if (str_to_double(optarg, &args.calib_pvalue)) {
+          badexit("Error: Failed to parse -E value.");
+        }
+        if (args.calib_pvalue <= 0.0 || args.calib_pvalue > 1.0) {
+          badexit("Error: -E must be more than 0 and at most 1.");
+        }
+        break;
+      case 'C':
+        if (!strcmp(optarg, "best")) {
+          args.site_hist = HIST_BEST;
+        } else if (!strcmp(optarg, "all")) {
+          args.site_hist = HIST_ALL;
+        } else {
+          fprintf(stderr, "Error: Unknown -C value \"%s\" (need best/all).", optarg);
+          badexit("");
+        }
+        break;
       case 'b':
         args.use_user_bkg = 1;
         user_bkg = optarg;
@@ -3031,6 +7493,9 @@ int main(int argc, char **argv) {
       case 'f':
         args.scan_rc = 0;
         break;
+      case 'c':
+        args.rc_match = 1;
+        break;
       case 't':
         if (str_to_double(optarg, &args.pvalue)) {
           badexit("Error: Failed to parse -t value.");
@@ -3067,6 +7532,21 @@ int main(int argc, char **argv) {
       case 'M':
         args.mask = 1;
         break;
+      case 'H':
+        args.use_haps = 1;
+        break;
+      case 'R':
+        args.use_reads = 1;
+        break;
+      case 'P':
+        args.presence = 1;
+        break;
+      case 'L':
+        args.stream = 1;
+        break;
+      case 'A':
+        args.affinity = 1;
+        break;
       case 'd':
         args.dedup = 1;
         break;
@@ -3103,6 +7583,131 @@ int main(int argc, char **argv) {
     badexit("Error: Cannot use both -x and -d.");
   }
 
+  if (args.bb_prefix != NULL && (!use_stdout || args.out_fmt != OUT_YAMSCAN)) {
+    badexit("Error: Cannot use -B with -o or -F.");
+  }
+
+  if (args.split_prefix != NULL) {
+    if (args.bb_prefix != NULL || args.bw_prefix != NULL || args.use_vcf || args.use_reads ||
+        args.stream || args.affinity || args.site_hist || args.max_gap >= 0 || args.crm_size) {
+      badexit("Error: Cannot use -O with -B, -W, -V, -R, -L, -A, -C, -S or -K.");
+    }
+  } else if (args.n_shards) {
+    badexit("Error: -N requires -O.");
+  }
+
+  if (use_tabix) {
+    if (use_stdout) {
+      badexit("Error: -I requires -o.");
+    }
+    if (args.split_prefix != NULL || args.compress == ZOUT_ZSTD || args.bb_prefix != NULL ||
+        args.bw_prefix != NULL || args.use_vcf || args.use_reads || args.stream ||
+        args.affinity || args.site_hist || args.max_gap >= 0 || args.crm_size) {
+      badexit("Error: Cannot use -I with -O, -Z, -B, -W, -V, -R, -L, -A, -C, -S or -K.");
+    }
+    if (!args.compress) {
+      args.compress = ZOUT_BGZF;
+      args.compress_level = 6;
+    }
+    args.tabix_path = out_path;
+  }
+
+  if (args.use_vcf) {
+    if (args.use_bed || files.e_open || args.bb_prefix != NULL || args.out_fmt != OUT_YAMSCAN) {
+      badexit("Error: Cannot use -V with -x, -X, -B or -F.");
+    } else if (!has_seqs || (!has_motifs && !has_consensus)) {
+      badexit("Error: -V requires -s and one of -m, -1.");
+    }
+  } else if (args.use_haps) {
+    badexit("Error: -H requires -V.");
+  }
+
+  if (args.use_reads) {
+    if (args.use_bed || files.e_open || args.use_vcf || args.bb_prefix != NULL || args.use_twobit) {
+      badexit("Error: Cannot use -R with -x, -X, -V, -B or .2bit files.");
+    } else if (!has_seqs || (!has_motifs && !has_consensus)) {
+      badexit("Error: -R requires -s and one of -m, -1.");
+    } else if (args.presence && args.out_fmt != OUT_YAMSCAN) {
+      badexit("Error: Cannot use -P with -F.");
+    }
+  } else if (args.presence) {
+    badexit("Error: -P requires -R.");
+  }
+
+  if (args.affinity) {
+    if (args.use_vcf || args.use_reads || args.stream || args.bb_prefix != NULL ||
+        args.out_fmt != OUT_YAMSCAN) {
+      badexit("Error: Cannot use -A with -V, -R, -L, -B or -F.");
+    } else if (!has_seqs || (!has_motifs && !has_consensus)) {
+      badexit("Error: -A requires -s and one of -m, -1.");
+    }
+  }
+
+  if (args.bw_prefix != NULL) {
+    if (!use_stdout || args.out_fmt != OUT_YAMSCAN || args.bb_prefix != NULL || args.use_bed ||
+        args.use_vcf || args.use_reads || args.stream || args.affinity) {
+      badexit("Error: Cannot use -W with -o, -F, -B, -x, -V, -R, -L or -A.");
+    } else if (!has_seqs || (!has_motifs && !has_consensus)) {
+      badexit("Error: -W requires -s and one of -m, -1.");
+    }
+  }
+
+  if (args.site_hist) {
+    if (args.use_vcf || args.use_reads || args.stream || args.affinity || args.bb_prefix != NULL ||
+        args.bw_prefix != NULL || args.out_fmt != OUT_YAMSCAN) {
+      badexit("Error: Cannot use -C with -V, -R, -L, -A, -B, -W or -F.");
+    } else if (!has_seqs || (!has_motifs && !has_consensus)) {
+      badexit("Error: -C requires -s and one of -m, -1.");
+    }
+  }
+
+  if (args.max_gap >= 0) {
+    if (args.use_bed || args.use_vcf || args.use_reads || args.stream || args.affinity ||
+        args.bb_prefix != NULL || args.bw_prefix != NULL || args.site_hist ||
+        args.out_fmt != OUT_YAMSCAN) {
+      badexit("Error: Cannot use -S with -x, -V, -R, -L, -A, -B, -W, -C or -F.");
+    } else if (!has_seqs || (!has_motifs && !has_consensus)) {
+      badexit("Error: -S requires -s and one of -m, -1.");
+    }
+  }
+
+  if (args.crm_size) {
+    if (args.use_bed || args.use_vcf || args.use_reads || args.stream || args.affinity ||
+        args.bb_prefix != NULL || args.bw_prefix != NULL || args.site_hist ||
+        args.max_gap >= 0 || args.out_fmt != OUT_YAMSCAN) {
+      badexit("Error: Cannot use -K with -x, -V, -R, -L, -A, -B, -W, -C, -S or -F.");
+    } else if (!has_seqs || (!has_motifs && !has_consensus)) {
+      badexit("Error: -K requires -s and one of -m, -1.");
+    }
+  }
+
+  if (args.fdr > 0.0) {
+    if (has_consensus || args.use_bed || args.use_vcf || args.use_reads || args.stream ||
+        args.affinity || args.bw_prefix != NULL || args.crm_size) {
+      badexit("Error: Cannot use -Q with -1, -x, -V, -R, -L, -A, -W or -K.");
+    } else if (!has_seqs || !has_motifs) {
+      badexit("Error: -Q requires -s and -m.");
+    }
+  }
+
+  if (args.calib_pvalue > 0.0) {
+    if (has_consensus || args.use_vcf || args.use_reads || args.stream || args.affinity ||
+        args.bw_prefix != NULL || args.crm_size) {
+      badexit("Error: Cannot use -E with -1, -V, -R, -L, -A, -W or -K.");
+    } else if (!has_seqs || !has_motifs) {
+      badexit("Error: -E requires -s and -m.");
+    }
+  }
+
+  if (args.stream) {
+    if (args.use_bed || files.e_open || args.use_vcf || args.bb_prefix != NULL ||
+        args.use_reads || args.use_twobit) {
+      badexit("Error: Cannot use -L with -x, -X, -V, -B, -R or .2bit files.");
+    } else if (!has_seqs || (!has_motifs && !has_consensus)) {
+      badexit("Error: -L requires -s and one of -m, -1.");
+    }
+  }
+
   if (use_manual_thresh && args.thresh0) {
     badexit("Error: Cannot use both -t and -0.");
   } else if (use_manual_thresh && has_consensus) {
@@ -3114,6 +7719,18 @@ int main(int argc, char **argv) {
     files.o_open = 1;
   }
 
+  if (args.compress) {
+    const char *zout_err = NULL;
+    FILE *zout = zout_open(files.o, args.compress, args.compress_level,
+      args.compress_threads, files.o != stdout,
+      args.tabix_path != NULL ? &tabix_blocks : NULL, &zout_err);
+    if (zout == NULL) {
+      fprintf(stderr, "Error: Failed to set up output compression [%s].", zout_err);
+      badexit("");
+    }
+    files.o = zout;
+  }
+
   if (args.scan_rc == 0 && args.use_bed && args.v) {
     fprintf(stderr, "Warning: The -f arg is ignored when -x is used.\n");
   }
@@ -3135,16 +7752,26 @@ int main(int argc, char **argv) {
   } else if (has_motifs) {
     load_motifs();
     find_motif_dupes();
+    if ((args.split_prefix != NULL && !args.n_shards) || args.bb_prefix != NULL ||
+        args.bw_prefix != NULL) {
+      find_motif_file_dupes();
+    }
   }
 
-  if (has_consensus || !has_seqs || !has_motifs || motif_info.n == 1) {
+  if (!has_seqs || !has_motifs ||
+      (!args.use_vcf && !args.use_reads && (has_consensus || motif_info.n == 1))) {
     if (args.nthreads > 1) {
       fprintf(stderr, "Note: Multi-threading not available for current inputs.\n");
     }
     args.nthreads = 1;
   }
 
-  if (use_stdin || args.nthreads > 1) {
+  if (args.use_reads) {
+    args.low_mem = 0;
+  } else if (args.stream) {
+    args.low_mem = 1;
+  } else if (use_stdin || args.nthreads > 1 || args.use_twobit || args.use_vcf || args.crm_size ||
+      args.fdr > 0.0) {
     if (args.low_mem) {
       if (args.v) {
         fprintf(stderr, "Deactivating low-mem mode.\n");
@@ -3164,7 +7791,8 @@ int main(int argc, char **argv) {
     }
     threads = tmp_threads;
     for (uint64_t i = 0; i < motif_info.n; i++) {
-      motifs[i]->thread = ((double) i / motif_info.n) * args.nthreads;
+      motifs[i]->thread = args.use_vcf || args.use_reads ? 0 :
+        ((double) i / motif_info.n) * args.nthreads;
     }
   }
 
@@ -3190,16 +7818,29 @@ int main(int argc, char **argv) {
     }
   }
 
-  if (has_seqs) {
+  if (has_motifs) {
+    seq_segs_min_size = motifs[0]->size;
+    for (uint64_t i = 1; i < motif_info.n; i++) {
+      seq_segs_min_size = MIN(seq_segs_min_size, motifs[i]->size);
+    }
+    seq_segs_min_size = MAX(1, seq_segs_min_size);
+  }
+
+  if (has_seqs && (args.use_reads || args.stream)) {
     kseq = kseq_init(files.s);
+  } else if (has_seqs) {
     time_t time1 = time(NULL);
     if (args.v) {
       if (args.low_mem) fprintf(stderr, "Peeking through sequences ...\n");
       else fprintf(stderr, "Reading sequences ...\n");
     }
-    if (args.low_mem) {
+    if (args.use_twobit) {
+      load_twobit();
+    } else if (args.low_mem) {
+      kseq = kseq_init(files.s);
       max_seq_size = peek_through_seqs(kseq);
     } else {
+      kseq = kseq_init(files.s);
       load_seqs(kseq);
     }
     find_seq_dupes();
@@ -3212,6 +7853,27 @@ int main(int argc, char **argv) {
         print_time((uint64_t) time3, "load sequences");
       }
     }
+    if (files.e_open && has_motifs) {
+      if (args.v) fprintf(stderr, "Reading exclusion bed file ...\n");
+      apply_excl_bed();
+    }
+    if (args.use_vcf) {
+      time_t time1 = time(NULL);
+      if (args.v) fprintf(stderr, "Reading VCF file ...\n");
+      read_vcf();
+      if (args.use_haps) {
+        uint64_t max_mot_size = 1;
+        for (uint64_t i = 0; i < motif_info.n; i++) {
+          max_mot_size = MAX(max_mot_size, motifs[i]->size);
+        }
+        build_hap_clusters(max_mot_size);
+      }
+      time_t time2 = time(NULL);
+      if (args.v) {
+        time_t time3 = difftime(time2, time1);
+        print_time((uint64_t) time3, "parse VCF file");
+      }
+    }
     if (args.use_bed) {
       time_t time1 = time(NULL);
       if (args.v) fprintf(stderr, "Reading bed file ...\n");
@@ -3238,7 +7900,24 @@ int main(int argc, char **argv) {
 
       time_t time1 = time(NULL);
 
-      if (args.low_mem) {
+      if (args.use_twobit) {
+        uint64_t max_size = 1;
+        for (uint64_t j = 0; j < seq_info.n; j++) {
+          max_size = MAX(max_size, seq_sizes[j]);
+        }
+        seqs[0] = malloc(max_size);
+        if (seqs[0] == NULL) {
+          badexit("Error: Failed to allocate memory for .2bit decoding buffer.");
+        }
+        for (uint64_t j = 0; j < seq_info.n; j++) {
+          twobit_decode(&twobit, j, 0, seq_sizes[j], seqs[0]);
+          if (args.use_bed) {
+            print_seq_stats_single_in_bed(files.o, 0, j);
+          } else {
+            print_seq_stats_single(files.o, 0, j);
+          }
+        }
+      } else if (args.low_mem) {
         for (uint64_t j = 0; j < seq_info.n; j++) {
           if (kseq_read(kseq) < 0) {
             badexit("Error: Failed to re-read input file.");
@@ -3271,53 +7950,168 @@ int main(int argc, char **argv) {
 
   if (has_seqs && has_motifs) {
 
-    fprintf(files.o, "##yamscan v%s [ ", YAMSCAN_VERSION);
-    for (uint64_t i = 1; i < argc; i++) {
-      fprintf(files.o, "%s ", argv[i]);
+    if (args.bb_prefix == NULL && args.bw_prefix == NULL) {
+      print_header(files.o, argc, argv);
     }
-    fprintf(files.o, "]\n");
-    uint64_t motif_size = 0;
-    uint64_t max_possible_hits = 0;
     for (uint64_t i = 0; i < motif_info.n; i++) {
-      for (uint64_t j = 0; j < seq_info.n; j++) {
-        max_possible_hits += MAX(0, 1 + seq_sizes[j] - motifs[i]->size);
+      motifs[i]->out = files.o;
+    }
+    if (args.split_prefix != NULL) {
+      size_t header_size;
+      FILE *header = open_memstream(&split_header, &header_size);
+      if (header == NULL) {
+        badexit("Error: Failed to allocate memory for the -O header.");
       }
+      print_header(header, argc, argv);
+      fclose(header);
     }
-    if (args.scan_rc) max_possible_hits *= 2;
-    for (uint64_t i = 0; i < motif_info.n; i++) {
-      motif_size += motifs[i]->size;
+    if (args.n_shards) {
+      split_files = calloc(args.n_shards, sizeof(FILE *));
+      if (split_files == NULL) {
+        badexit("Error: Failed to allocate memory for -N files.");
+      }
+      for (uint64_t i = 0; i < args.n_shards; i++) {
+        char shard_name[32];
+        snprintf(shard_name, sizeof(shard_name), "%llu", i);
+        split_files[i] = open_split_file(shard_name);
+      }
+      for (uint64_t i = 0; i < motif_info.n; i++) {
+        motifs[i]->out = split_files[kh_str_hash_func(motifs[i]->name) % args.n_shards];
+      }
     }
-    if (args.use_bed) {
-      uint64_t bed_sum = 0;
-      for (uint64_t k = 0; k < bed.n_regions; k++) {
-        bed_sum += bed.ends[k] - bed.starts[k];
-      }
-      fprintf(files.o,
-        "##MotifCount=%llu MotifSize=%llu BedCount=%llu BedSize=%llu SeqCount=%llu SeqSize=%llu GC=%.2f%% Ns=%llu\n",
-        motif_info.n, motif_size, bed.n_regions, bed_sum, seq_info.n,
-        seq_info.total_bases, seq_info.gc_pct, seq_info.unknowns);
-      fprintf(files.o, 
-        "##bed_range\tbed_name\tseq_name\tstart\tend\tstrand\tmotif\tpvalue\tscore\tscore_pct\tmatch\n");
-    } else {
-      fprintf(files.o,
-        "##MotifCount=%llu MotifSize=%llu SeqCount=%llu SeqSize=%llu GC=%.2f%% Ns=%llu MaxPossibleHits=%llu\n",
-        motif_info.n, motif_size, seq_info.n, seq_info.total_bases, seq_info.gc_pct,
-        seq_info.unknowns, max_possible_hits);
-      fprintf(files.o, 
-        "##seq_name\tstart\tend\tstrand\tmotif\tpvalue\tscore\tscore_pct\tmatch\n");
+    if (args.bb_prefix != NULL || args.bw_prefix != NULL || args.max_gap >= 0 || args.crm_size) {
+      rank_seq_names();
+    }
+    if (args.bb_prefix != NULL || args.max_gap >= 0 || args.crm_size) {
+      for (uint64_t i = 0; i < motif_info.n; i++) {
+        init_hits(motifs[i]);
+      }
+    }
+    if (args.affinity) {
+      const uint64_t n_rows = args.use_bed ? bed.n_regions : seq_info.n;
+      for (uint64_t i = 0; i < motif_info.n; i++) {
+        motifs[i]->affinity = calloc(MAX(1, n_rows), sizeof(double));
+        if (motifs[i]->affinity == NULL) {
+          badexit("Error: Failed to allocate memory for affinity scores.");
+        }
+      }
+    }
+    if (args.calib_pvalue > 0.0) {
+      for (uint64_t i = 0; i < motif_info.n; i++) {
+        motifs[i]->calib = calloc(1, sizeof(calib_t));
+        if (motifs[i]->calib == NULL) {
+          badexit("Error: Failed to allocate memory for window counts.");
+        }
+      }
+    }
+    if (args.fdr > 0.0) {
+      for (uint64_t i = 0; i < motif_info.n; i++) {
+        motifs[i]->fdr = calloc(1, sizeof(fdr_t));
+        if (motifs[i]->fdr == NULL) {
+          badexit("Error: Failed to allocate memory for FDR thresholds.");
+        }
+      }
+      time_t time1 = time(NULL);
+      if (args.v) fprintf(stderr, "Shuffling controls ...\n");
+      make_controls();
+      time_t time2 = time(NULL);
+      if (args.v) {
+        time_t time3 = difftime(time2, time1);
+        print_time((uint64_t) time3, "shuffle controls");
+      }
+    }
+    if (args.site_hist) {
+      uint64_t max_row_size = 0;
+      if (args.use_bed) {
+        for (uint64_t k = 0; k < bed.n_regions; k++) {
+          max_row_size = MAX(max_row_size, bed.ends[k] - bed.starts[k]);
+        }
+      } else {
+        for (uint64_t k = 0; k < seq_info.n; k++) {
+          max_row_size = MAX(max_row_size, seq_sizes[k]);
+        }
+      }
+      for (uint64_t i = 0; i < motif_info.n; i++) {
+        sites_t *sites = calloc(1, sizeof(sites_t));
+        if (sites == NULL) {
+          badexit("Error: Failed to allocate memory for site histograms.");
+        }
+        sites->mot_size = motifs[i]->size;
+        sites->n_bins = max_row_size >= sites->mot_size ? max_row_size - sites->mot_size + 1 : 0;
+        sites->hist = calloc(MAX(1, sites->n_bins), sizeof(double));
+        if (sites->hist == NULL) {
+          badexit("Error: Failed to allocate memory for site histograms.");
+        }
+        sites->row = UINT64_MAX;
+        motifs[i]->sites = sites;
+      }
     }
 
     if (args.v) fprintf(stderr, "Scanning ...\n");
     time_t time1 = time(NULL);
     if (alloc_cdf()) badexit("");
-    if (args.low_mem) {
+    if (args.use_reads || args.stream || args.crm_size) {
+      for (uint64_t i = 0; i < motif_info.n; i++) {
+        fill_cdf(motifs[i]);
+        set_threshold(motifs[i]);
+        keep_cdf_tail(motifs[i]);
+      }
+      if (args.crm_size) {
+        if (args.progress) print_pb(0.0);
+        scan_crms();
+        if (args.progress) fprintf(stderr, "\n");
+      } else {
+        if (args.use_reads) {
+          scan_reads(kseq);
+        } else {
+          stream_seqs(kseq);
+        }
+        kseq_destroy(kseq);
+        print_trailer();
+      }
+      for (uint64_t i = 0; i < motif_info.n; i++) {
+        free(motifs[i]->cdf);
+      }
+    } else if (args.use_vcf) {
       if (args.progress) print_pb(0.0);
       for (uint64_t i = 0; i < motif_info.n; i++) {
         if (args.w && !args.progress) {
-          fprintf(stderr, "    Scanning motif: %s\n", motifs[i]->name);
+          fprintf(stderr, "    Scoring variants for motif: %s\n", motifs[i]->name);
         }
         fill_cdf(motifs[i]);
         set_threshold(motifs[i]);
+        vcf_motif = motifs[i];
+        for (uint64_t t = 0; t < args.nthreads; t++) {
+          uint64_t *thread_i = malloc(sizeof(uint64_t));
+          if (thread_i == NULL) {
+            badexit("Error: Failed to allocate memory for thread index.");
+          }
+          *thread_i = t;
+          pthread_create(&threads[t], NULL,
+            args.use_haps ? score_haps_sub_process : score_variants_sub_process, thread_i);
+        }
+        for (uint64_t t = 0; t < args.nthreads; t++) {
+          pthread_join(threads[t], NULL);
+        }
+        if (args.progress) print_pb((i + 1.0) / motif_info.n);
+      }
+      if (args.progress) fprintf(stderr, "\n");
+    } else if (args.low_mem) {
+      if (args.progress) print_pb(0.0);
+      for (uint64_t i = 0; i < motif_info.n; i++) {
+        if (args.w && !args.progress) {
+          fprintf(stderr, "    Scanning motif: %s\n", motifs[i]->name);
+        }
+        if (args.affinity) {
+          fill_affinity_tab(motifs[i]);
+        } else if (args.bw_prefix != NULL) {
+          open_track(motifs[i]);
+        } else {
+          fill_cdf(motifs[i]);
+          set_threshold(motifs[i]);
+          if (motifs[i]->calib != NULL) set_calib_levels(motifs[i]);
+        }
+        open_motif_out(motifs[i]);
         for (uint64_t j = 0; j < seq_info.n; j++) {
           if (args.w && !args.progress) {
             fprintf(stderr, "        Scanning sequence: %s\n", seq_names[j]);
@@ -3328,7 +8122,7 @@ int main(int argc, char **argv) {
             seqs[0] = (unsigned char *) kseq->seq.s;
           }
           if (!args.use_bed) {
-            score_seq(motifs[i], j, 0);
+            score_seq(motifs[i], j, seqs[0], 0, 0, seq_sizes[j]);
           } else {
             for (uint64_t k = 0; k < bed.n_regions; k++) {
               if (bed.seq_indices[k] == j) {
@@ -3336,13 +8130,20 @@ int main(int argc, char **argv) {
                   fprintf(stderr, "          Scanning range: %llu-%llu\n",
                       bed.starts[i] + 1, bed.ends[i]);
                 }
-                score_seq_in_bed(motifs[i], 0, k);
+                score_seq_in_bed(motifs[i], seqs[0], 0, k, 0, UINT64_MAX);
               }
             }
           }
         }
         gzrewind(files.s);
         kseq_rewind(kseq);
+        close_motif_out(motifs[i]);
+        if (args.bb_prefix != NULL) write_bigbed(motifs[i]);
+        if (motifs[i]->track != NULL) close_track(motifs[i]);
+        if (motifs[i]->affinity_tab != NULL) {
+          free(motifs[i]->affinity_tab);
+          motifs[i]->affinity_tab = NULL;
+        }
         if (args.progress) print_pb((i + 1.0) / motif_info.n);
       }
       free(seqs[0]);
@@ -3363,6 +8164,17 @@ int main(int argc, char **argv) {
       if (args.progress) fprintf(stderr, "\n");
     }
     free_cdf();
+    if (args.fdr > 0.0) free_controls();
+    if (args.affinity) print_affinity();
+    if (args.site_hist) print_site_hists();
+    if (args.max_gap >= 0) print_spacing();
+    if (args.tabix_path != NULL) write_tabix_lines();
+    if (args.fdr > 0.0 && args.out_fmt == OUT_YAMSCAN && args.bb_prefix == NULL) {
+      print_fdr_thresholds();
+    }
+    if (args.calib_pvalue > 0.0) {
+      print_calibration(args.out_fmt == OUT_YAMSCAN && args.bb_prefix == NULL ? files.o : stderr);
+    }
     time_t time2 = time(NULL);
     time_t time3 = difftime(time2, time1);
     if (args.v) {
@@ -3374,10 +8186,13 @@ int main(int argc, char **argv) {
   }
 
   close_files();
+  if (args.tabix_path != NULL && has_seqs && has_motifs) write_tabix_index();
   free(threads);
   free_motifs();
   free_seqs();
   free_bed();
+  free_variants();
+  free_haps();
   free_ht();
 
   return EXIT_SUCCESS;
@@ -0,0 +1,1400 @@
+/*
+ *   yamseed: Seed DNA/RNA sequences with sampled motif sites
+ *   Copyright (C) 2026  Benjamin Jean-Marie Tremblay
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* yamseed is meant for generating benchmarking sets: background sequences are
+ * either shuffled from real sequences (using the same Euler/Fisher-Yates
+ * shuffling as yamshuf) or generated from a background model, then motif
+ * sites are sampled from the motif probability matrices and implanted at
+ * random positions. The location of every site is written to a BED file so
+ * that scanning sensitivity can be measured afterwards.
+ *
+ * Every sequence gets its own random number generator stream, seeded from
+ * the user seed and the sequence number. This means the output is identical
+ * regardless of how many threads are used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <locale.h>
+#include <getopt.h>
+#include <math.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <zlib.h>
+#include "kseq.h"
+
+KSEQ_INIT(gzFile, gzread)
+
+#define YAMSEED_VERSION             "1.0"
+#define YAMSEED_YEAR                 2026
+
+/* Max stored size of motif names. */
+#define MAX_NAME_SIZE           ((uint64_t) 256)
+
+/* Max motif width. */
+#define MAX_MOTIF_WIDTH         ((uint64_t) 50)
+
+/* Max size of PCM/PPM values in parsed motifs. */
+#define MOTIF_VALUE_MAX_CHAR    ((uint64_t) 256)
+
+/* Max size of the parsed -b char array. */
+#define USER_BKG_MAX_SIZE       ((uint64_t) 256)
+
+/* Chunk size for allocating additional memory for arrays of pointers. */
+#define ALLOC_CHUNK_SIZE        ((uint64_t) 256)
+
+/* Sequences are read, seeded and written in batches to keep memory usage
+ * bounded. A batch is closed once either limit is reached.
+ */
+#define BATCH_MAX_SEQS          ((uint64_t) 4096)
+#define BATCH_MAX_BASES     ((uint64_t) 67108864)
+
+/* Number of random positions tried before giving up on placing a site which
+ * doesn't overlap previous sites or non-standard letters.
+ */
+#define MAX_PLACEMENT_TRIES                  100
+
+/* HARD LIMIT FOR 64-BIT: 5^27 */
+#define MAX_K                                  9
+
+#define FASTA_LINE_LEN                        60
+
+/* These must be positive integers: */
+#define DEFAULT_K                              3
+#define DEFAULT_SEED                           4
+#define DEFAULT_SEQ_LEN                     1000
+
+#define DEFAULT_RATE                         0.5
+
+#define ERASE_ARRAY(ARR, LEN) memset(ARR, 0, sizeof(ARR[0]) * (LEN))
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+#define LIKELY(COND) __builtin_expect(COND, 1)
+#define UNLIKELY(COND) __builtin_expect(COND, 0)
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+static long peak_mem(void) {
+  return 0;
+}
+#else
+#include <sys/resource.h>
+static long peak_mem(void) {
+  struct rusage r_mem;
+  getrusage(RUSAGE_SELF, &r_mem);
+#ifdef __linux__
+  return r_mem.ru_maxrss * 1024;
+#else
+  return r_mem.ru_maxrss;
+#endif
+}
+#endif
+
+// Modified krng.h code from Heng Li to use xoroshiro128++ 1.0 instead
+
+typedef struct {
+  uint64_t s[2];
+} xrng_t;
+
+static inline uint64_t splitmix64(uint64_t x) {
+  uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+#define ROTL(X, K) (((X) << (K)) | ((X) >> (64 - (K))))
+
+static inline uint64_t xrand_r(xrng_t *r) {
+  const uint64_t s0 = r->s[0];
+  uint64_t s1 = r->s[1];
+  const uint64_t result = ROTL(s0 + s1, 17) + s0;
+  s1 ^= s0;
+  r->s[0] = ROTL(s0, 49) ^ s1 ^ (s1 << 21);
+  r->s[1] = ROTL(s1, 28);
+  return result;
+}
+
+static inline void sxrand_r(xrng_t *r, uint64_t seed) {
+  r->s[0] = splitmix64(seed);
+  r->s[1] = splitmix64(r->s[0]);
+}
+
+static inline double xrand_double(xrng_t *r) {
+  return (double) (xrand_r(r) >> 11) / 9007199254740992.0;
+}
+
+// rng code end
+
+static void print_peak_mb(void) {
+  long bytes = peak_mem();
+  if (bytes > (1 << 30)) {
+    fprintf(stderr, "Approx. peak memory usage: %'.2f GB.\n",
+      (((double) bytes / 1024.0) / 1024.0) / 1024.0);
+  } else if (bytes > (1 << 20)) {
+    fprintf(stderr, "Approx. peak memory usage: %'.2f MB.\n",
+      ((double) bytes / 1024.0) / 1024.0);
+  } else if (bytes) {
+    fprintf(stderr, "Approx. peak memory usage: %'.2f KB.\n",
+      (double) bytes / 1024.0);
+  }
+}
+
+static void print_time(const uint64_t s, const char *what) {
+  if (s > 7200) {
+    fprintf(stderr, "Needed %'.2f hours to %s.\n", ((double) s / 60.0) / 60.0, what);
+  } else if (s > 120) {
+    fprintf(stderr, "Needed %'.2f minutes to %s.\n", (double) s / 60.0, what);
+  } else if (s > 1) {
+    fprintf(stderr, "Needed %'llu seconds to %s.\n", s, what);
+  }
+}
+
+static void usage(void) {
+  printf(
+    "yamseed v%s  Copyright (C) %d  Benjamin Jean-Marie Tremblay                \n"
+    "                                                                              \n"
+    "Usage:  yamseed [options] -m motifs.txt [ -i sequences.fa | -n 1000 ]         \n"
+    "                                                                              \n"
+    " -m <str>   Filename of text file containing motifs. Acceptable formats: MEME,\n"
+    "            JASPAR, HOMER, HOCOMOCO (PCM). Must be 1-%llu bases wide. Sites are\n"
+    "            sampled from the motif probabilities (counts are normalized).    \n"
+    " -i <str>   Filename of fast(a|q)-formatted file containing DNA/RNA sequences \n"
+    "            to use as backgrounds. Can be gzipped. Use '-' for stdin. These   \n"
+    "            are shuffled before seeding (see -k).                             \n"
+    " -n <int>   Instead of -i, generate this many random background sequences   \n"
+    "            using the probabilities set with -b.                              \n"
+    " -L <int>   Size of the generated background sequences. Default: %d.       \n"
+    " -b <dbl,   Comma-separated background probabilities for A,C,G,T used with -n.\n"
+    "     dbl,   Default: a uniform background.                                    \n"
+    "     dbl,                                                                     \n"
+    "     dbl>                                                                     \n"
+    " -k <int>   Size of shuffled k-mers for -i backgrounds. Default: %d. When k = 1\n"
+    "            a Fisher-Yates shuffle is performed. Use 0 to seed the input      \n"
+    "            sequences without shuffling them. Max k: %d.                      \n"
+    " -r <dbl>   Number of sites to seed per motif per sequence. Fractional parts  \n"
+    "            are treated as a probability of seeding an extra site, e.g. 0.5   \n"
+    "            means half of the sequences get a site. Default: %g.             \n"
+    " -f         Only seed sites on the forward strand.                            \n"
+    " -o <str>   Filename to output sequences. By default output goes to stdout.   \n"
+    " -t <str>   Filename to output the locations of seeded sites as a BED file.   \n"
+    "            Columns: sequence, 0-based start, end, motif, score (always 0),   \n"
+    "            strand, and the seeded site (as found on the forward strand).     \n"
+    " -s <int>   Seed to initialize random number generators. Default: %d.          \n"
+    " -j <int>   Number of threads yamseed can use. Default: 1. Results do not     \n"
+    "            depend on the number of threads.                                  \n"
+    " -v         Verbose mode.                                                     \n"
+    " -w         Very verbose mode.                                                \n"
+    " -h         Print this help message.                                          \n"
+    , YAMSEED_VERSION, YAMSEED_YEAR, MAX_MOTIF_WIDTH, DEFAULT_SEQ_LEN, DEFAULT_K,
+      MAX_K, DEFAULT_RATE, DEFAULT_SEED
+  );
+}
+
+enum MOTIF_FMT {
+  FMT_MEME     = 1,
+  FMT_HOMER    = 2,
+  FMT_JASPAR   = 3,
+  FMT_HOCOMOCO = 4,
+  FMT_UNKNOWN  = 5
+};
+
+typedef struct args_t {
+  double   bkg[4];
+  double   rate;
+  int      k;
+  int      seed;
+  int      nthreads;
+  int      scan_rc : 1;
+  int      use_bkg_model : 1;
+  int      v : 1;
+  int      w : 1;
+  uint64_t n_gen;
+  uint64_t gen_len;
+} args_t;
+
+static args_t args = {
+  .bkg      = {0.25, 0.25, 0.25, 0.25},
+  .rate     = DEFAULT_RATE,
+  .k        = DEFAULT_K,
+  .seed     = DEFAULT_SEED,
+  .nthreads = 1,
+  .scan_rc  = 1,
+  .use_bkg_model = 0,
+  .v        = 0,
+  .w        = 0,
+  .n_gen    = 0,
+  .gen_len  = DEFAULT_SEQ_LEN
+};
+
+typedef struct files_t {
+  int       m_open : 1;
+  int       s_open : 1;
+  int       o_open : 1;
+  int       t_open : 1;
+  FILE     *m;
+  gzFile    s;
+  FILE     *o;
+  FILE     *t;
+} files_t;
+
+static files_t files = {
+  .m_open = 0,
+  .s_open = 0,
+  .o_open = 0,
+  .t_open = 0
+};
+
+static void close_files(void) {
+  if (files.m_open) fclose(files.m);
+  if (files.s_open) gzclose(files.s);
+  if (files.o_open) fclose(files.o);
+  if (files.t_open) fclose(files.t);
+}
+
+/* Each motif position gets its own alias table, allowing a letter to be
+ * sampled with a single random number.
+ */
+typedef struct motif_t {
+  double          probs[MAX_MOTIF_WIDTH * 4];
+  double          alias_prob[MAX_MOTIF_WIDTH * 4];
+  unsigned char   alias[MAX_MOTIF_WIDTH * 4];
+  uint64_t        size;
+  uint64_t        file_line_num;
+  char            name[MAX_NAME_SIZE];
+} motif_t;
+
+static motif_t **motifs;
+
+typedef struct motif_info_t {
+  uint64_t  n;
+  uint64_t  n_alloc;
+} motif_info_t;
+
+static motif_info_t motif_info = {
+  .n       = 0,
+  .n_alloc = 0
+};
+
+static double           bkg_alias_prob[4];
+static unsigned char    bkg_alias[4];
+
+typedef struct site_t {
+  uint64_t  start;
+  uint64_t  motif;
+  char      strand;
+} site_t;
+
+/* A batch of sequences, which are seeded in parallel and then written in
+ * their original order.
+ */
+typedef struct batch_t {
+  unsigned char  **seqs;
+  uint64_t        *sizes;
+  char           **names;
+  char           **comments;
+  site_t         **sites;
+  uint64_t        *n_sites;
+  uint64_t        *n_sites_alloc;
+  uint64_t         n;
+  uint64_t         n_alloc;
+  uint64_t         first_i;
+} batch_t;
+
+static batch_t batch = {
+  .n       = 0,
+  .n_alloc = 0,
+  .first_i = 0
+};
+
+static pthread_t         *threads;
+static uint64_t          *thread_failed;
+
+static void free_motifs(void) {
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    free(motifs[i]);
+  }
+  free(motifs);
+}
+
+static void clear_batch(void) {
+  for (uint64_t i = 0; i < batch.n; i++) {
+    free(batch.seqs[i]);
+    free(batch.names[i]);
+    free(batch.comments[i]);
+  }
+  batch.n = 0;
+}
+
+static void free_batch(void) {
+  clear_batch();
+  for (uint64_t i = 0; i < batch.n_alloc; i++) {
+    if (batch.n_sites_alloc[i]) free(batch.sites[i]);
+  }
+  free(batch.seqs);
+  free(batch.sizes);
+  free(batch.names);
+  free(batch.comments);
+  free(batch.sites);
+  free(batch.n_sites);
+  free(batch.n_sites_alloc);
+}
+
+static void badexit(const char *msg) {
+  fprintf(stderr, "%s\nRun yamseed -h to see usage.\n", msg);
+  free(threads);
+  free(thread_failed);
+  free_motifs();
+  free_batch();
+  close_files();
+  exit(EXIT_FAILURE);
+}
+
+/* aA = 0, cC = 1, gG = 2, tTuU = 3 */
+static const unsigned char char2index[256] = {
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 0, 4, 1, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 0, 4, 1, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4
+};
+
+static const char index2dna[6] = "ACGTN";
+
+static const uint64_t pow5[16] = {
+           1 ,           5 ,         25 ,         125
+,        625 ,        3125 ,      15625 ,       78125
+,     390625 ,     1953125 ,    9765625 ,    48828125
+,  244140625 ,  1220703125 , 6103515625 , 30517578125
+};
+
+static inline int str_to_double(char *str, double *res) {
+  char *tmp; errno = 0;
+  *res = strtod(str, &tmp);
+  if (str == tmp || errno != 0 || *tmp != '\0') {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+static inline int str_to_int(char *str, int *res) {
+  char *tmp; errno = 0;
+  long int res_long = strtol(str, &tmp, 10);
+  if (res_long > INT_MAX) return 1;
+  *res = (int) res_long;
+  if (str == tmp || errno != 0 || *tmp != '\0') {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+static inline int str_to_uint64_t(char *str, uint64_t *res) {
+  char *tmp; errno = 0;
+  *res = (uint64_t) strtoull(str, &tmp, 10);
+  if (str == tmp || errno != 0 || *tmp != '\0') {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+static void parse_user_bkg(const char *bkg_usr) {
+  uint64_t i = 0, j = 0, bi = 0;
+  char bc[USER_BKG_MAX_SIZE];
+  double b[] = {-1.0, -1.0, -1.0, -1.0};
+  ERASE_ARRAY(bc, USER_BKG_MAX_SIZE);
+  while (bkg_usr[i] != '\0') {
+    if (bkg_usr[i] != ',' && bkg_usr[i] != ' ') {
+      if (j == USER_BKG_MAX_SIZE - 1) {
+        badexit("Error: Background value is too long.");
+      }
+      bc[j] = bkg_usr[i];
+      j++;
+    } else if (bkg_usr[i] == ',') {
+      if (bi > 2) {
+        badexit("Error: Too many background values provided (need 4).");
+      }
+      if (str_to_double(bc, &b[bi])) {
+        fprintf(stderr, "Error: Failed to parse background value.\n");
+        fprintf(stderr, "  Input: %s\n  Bad value: %s", bkg_usr, bc);
+        badexit("");
+      }
+      ERASE_ARRAY(bc, USER_BKG_MAX_SIZE);
+      bi++;
+      j = 0;
+    }
+    i++;
+  }
+  if (bi != 3 || str_to_double(bc, &b[3])) {
+    fprintf(stderr, "Error: Failed to parse background values (need 4).\n");
+    fprintf(stderr, "  Input: %s", bkg_usr);
+    badexit("");
+  }
+  double sum = 0.0;
+  for (int k = 0; k < 4; k++) {
+    if (b[k] < 0.0) badexit("Error: Background values cannot be negative.");
+    sum += b[k];
+  }
+  if (sum <= 0.0) badexit("Error: Background values sum to zero.");
+  if (fabs(sum - 1.0) > 0.001 && args.v) {
+    fprintf(stderr,
+      "Warning: Background values don't add up to 1.0, adjusting (sum=%.3g).\n",
+      sum);
+  }
+  for (int k = 0; k < 4; k++) args.bkg[k] = b[k] / sum;
+}
+
+/* Vose's alias method for a four-letter alphabet. */
+static void fill_alias_table(const double *probs, double *alias_prob, unsigned char *alias) {
+  double scaled[4];
+  unsigned char small[4], large[4];
+  int n_small = 0, n_large = 0;
+  for (unsigned char i = 0; i < 4; i++) {
+    scaled[i] = probs[i] * 4.0;
+    if (scaled[i] < 1.0) {
+      small[n_small++] = i;
+    } else {
+      large[n_large++] = i;
+    }
+  }
+  while (n_small && n_large) {
+    const unsigned char s = small[--n_small];
+    const unsigned char l = large[--n_large];
+    alias_prob[s] = scaled[s];
+    alias[s] = l;
+    scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+    if (scaled[l] < 1.0) {
+      small[n_small++] = l;
+    } else {
+      large[n_large++] = l;
+    }
+  }
+  while (n_large) {
+    const unsigned char l = large[--n_large];
+    alias_prob[l] = 1.0;
+    alias[l] = l;
+  }
+  while (n_small) {
+    const unsigned char s = small[--n_small];
+    alias_prob[s] = 1.0;
+    alias[s] = s;
+  }
+}
+
+static inline unsigned char sample_alias(const double *alias_prob, const unsigned char *alias, xrng_t *r) {
+  /* Top two bits pick the column, the lower 53 bits decide on the alias. */
+  const uint64_t x = xrand_r(r);
+  const unsigned char i = x >> 62;
+  const double u = (double) (x & 0x1FFFFFFFFFFFFFULL) / 9007199254740992.0;
+  return u < alias_prob[i] ? i : alias[i];
+}
+
+static uint64_t count_nonempty_chars(const char *line) {
+  uint64_t total_chars = 0, i = 0;
+  for (;;) {
+    switch (line[i]) {
+      case ' ':
+      case '\t':
+      case '\r':
+      case '\v':
+      case '\f':
+      case '\n': break;
+      case '\0': return total_chars;
+      default: total_chars++;
+    }
+    i++;
+  }
+  return total_chars;
+}
+
+static int check_line_contains(const char *line, const char *substring) {
+  const uint64_t ss_len = strlen(substring);
+  if (strlen(line) < ss_len) return 0;
+  for (uint64_t i = 0; i < ss_len; i++) {
+    if (line[i] != substring[i]) return 0;
+  }
+  return 1;
+}
+
+static int check_char_is_one_of(const char c, const char *list) {
+  const uint64_t s_len = (uint64_t) strlen(list);
+  for (uint64_t i = 0; i < s_len; i++) {
+    if (list[i] == c) return 1;
+  }
+  return 0;
+}
+
+static int detect_motif_fmt(void) {
+  int jaspar_or_hocomoco = 0, file_fmt = 0, has_tabs = 0;
+  char *line = NULL;
+  size_t len = 0;
+  ssize_t read;
+  while ((read = getline(&line, &len, files.m)) != -1) {
+    if (!count_nonempty_chars(line)) continue;
+    if (check_line_contains(line, "MEME version \0")) {
+      if (args.w) fprintf(stderr, "Detected MEME format.\n");
+      file_fmt = FMT_MEME;
+      break;
+    }
+    if (jaspar_or_hocomoco) {
+      if (line[0] == 'A' &&
+          check_char_is_one_of('[', line) &&
+          check_char_is_one_of(']', line)) {
+        file_fmt = FMT_JASPAR;
+        if (args.w) fprintf(stderr, "Detected JASPAR format.\n");
+      } else if (has_tabs) {
+        file_fmt = FMT_HOMER;
+        if (args.w) fprintf(stderr, "Detected HOMER format.\n");
+      } else {
+        file_fmt = FMT_HOCOMOCO;
+        if (args.w) fprintf(stderr, "Detected HOCOMOCO format.\n");
+      }
+      break;
+    } else if (line[0] == '>') {
+      if (check_char_is_one_of('\t', line)) has_tabs = 1;
+      jaspar_or_hocomoco = 1;
+    }
+  }
+  rewind(files.m);
+  free(line);
+  if (!file_fmt) file_fmt = FMT_UNKNOWN;
+  return file_fmt;
+}
+
+static int add_motif(void) {
+  motif_info.n++;
+  const uint64_t last_i = motif_info.n - 1;
+  if (motif_info.n > motif_info.n_alloc) {
+    motif_t **tmp_ptr = realloc(motifs,
+      sizeof(*motifs) * motif_info.n_alloc + sizeof(*motifs) * ALLOC_CHUNK_SIZE);
+    if (tmp_ptr == NULL) {
+      fprintf(stderr, "Error: Failed to allocate memory for motifs.");
+      motif_info.n--;
+      return 1;
+    }
+    motifs = tmp_ptr;
+    motif_info.n_alloc += ALLOC_CHUNK_SIZE;
+  }
+  motifs[last_i] = malloc(sizeof(motif_t));
+  if (motifs[last_i] == NULL) {
+    fprintf(stderr, "Error: Failed to allocate memory for motif.");
+    motif_info.n--;
+    return 1;
+  }
+  ERASE_ARRAY(motifs[last_i]->name, MAX_NAME_SIZE);
+  strcpy(motifs[last_i]->name, "motif");
+  motifs[last_i]->size = 0;
+  motifs[last_i]->file_line_num = 0;
+  return 0;
+}
+
+/* Parse up to n whitespace-separated numbers, starting from line[i] and
+ * stopping at the end of the line or at the stop character (if not '\0').
+ * Returns the number of values found, or -1 on a parse failure.
+ */
+static int parse_values(const char *line, uint64_t i, const char stop, double *values, const int n) {
+  char value[MOTIF_VALUE_MAX_CHAR];
+  uint64_t j = 0;
+  int found = 0;
+  for (;; i++) {
+    const char c = line[i];
+    const int at_end = c == '\0' || c == '\r' || c == '\n' || (stop && c == stop);
+    if (at_end || c == ' ' || c == '\t') {
+      if (j) {
+        value[j] = '\0';
+        if (found == n || str_to_double(value, &values[found])) return -1;
+        found++;
+        j = 0;
+      }
+      if (at_end) break;
+    } else {
+      if (j == MOTIF_VALUE_MAX_CHAR - 1) return -1;
+      value[j++] = c;
+    }
+  }
+  return found;
+}
+
+static void add_motif_column(motif_t *motif, const char *line, const uint64_t line_num) {
+  double values[4];
+  if (motif->size == MAX_MOTIF_WIDTH) {
+    fprintf(stderr, "Error: Motif [%s] is too large (max=%llu).",
+      motif->name, MAX_MOTIF_WIDTH);
+    badexit("");
+  }
+  if (parse_values(line, 0, '\0', values, 4) != 4) {
+    fprintf(stderr, "Error: Failed to parse motif [%s] row (L%llu).",
+      motif->name, line_num);
+    badexit("");
+  }
+  for (int i = 0; i < 4; i++) {
+    motif->probs[motif->size * 4 + i] = values[i];
+  }
+  motif->size++;
+}
+
+static void parse_motif_name(motif_t *motif, const char *line, uint64_t i, const int stop_at_space) {
+  uint64_t j = 0;
+  while (line[i] == ' ' || line[i] == '\t') i++;
+  while (line[i] != '\0' && line[i] != '\r' && line[i] != '\n' && j < MAX_NAME_SIZE - 1) {
+    if (line[i] == '\t' || (stop_at_space && line[i] == ' ')) break;
+    motif->name[j++] = line[i++];
+  }
+  motif->name[j] = '\0';
+}
+
+static void read_meme(void) {
+  char *line = NULL;
+  size_t len = 0;
+  ssize_t read;
+  uint64_t line_num = 0;
+  int live_motif = 0;
+  while ((read = getline(&line, &len, files.m)) != -1) {
+    line_num++;
+    if (check_line_contains(line, "MOTIF\0")) {
+      if (add_motif()) {
+        free(line);
+        badexit("");
+      }
+      motifs[motif_info.n - 1]->file_line_num = line_num;
+      parse_motif_name(motifs[motif_info.n - 1], line, 5, 1);
+      live_motif = 0;
+    } else if (check_line_contains(line, "letter-probability matrix\0")) {
+      if (!motif_info.n) {
+        free(line);
+        fprintf(stderr, "Error: Possible malformed MEME motif (L%llu).", line_num);
+        badexit("");
+      }
+      live_motif = 1;
+    } else if (live_motif) {
+      if (!count_nonempty_chars(line) || check_char_is_one_of('-', line) ||
+          check_char_is_one_of('*', line) || check_char_is_one_of('M', line)) {
+        live_motif = 0;
+      } else {
+        add_motif_column(motifs[motif_info.n - 1], line, line_num);
+      }
+    }
+  }
+  free(line);
+}
+
+static void read_homer_or_hocomoco(const int is_homer) {
+  char *line = NULL;
+  size_t len = 0;
+  ssize_t read;
+  uint64_t line_num = 0;
+  while ((read = getline(&line, &len, files.m)) != -1) {
+    line_num++;
+    if (line[0] == '>') {
+      if (add_motif()) {
+        free(line);
+        badexit("");
+      }
+      motifs[motif_info.n - 1]->file_line_num = line_num;
+      if (is_homer) {
+        /* Second tab-separated field */
+        uint64_t i = 1;
+        while (line[i] != '\t' && line[i] != '\0' && line[i] != '\n') i++;
+        if (line[i] == '\t') parse_motif_name(motifs[motif_info.n - 1], line, i + 1, 0);
+      } else {
+        parse_motif_name(motifs[motif_info.n - 1], line, 1, 1);
+      }
+    } else if (count_nonempty_chars(line) && motif_info.n) {
+      add_motif_column(motifs[motif_info.n - 1], line, line_num);
+    }
+  }
+  free(line);
+}
+
+static void read_jaspar(void) {
+  char *line = NULL;
+  size_t len = 0;
+  ssize_t read;
+  uint64_t line_num = 0, row_i = 0;
+  double values[MAX_MOTIF_WIDTH + 1];
+  while ((read = getline(&line, &len, files.m)) != -1) {
+    line_num++;
+    if (line[0] == '>') {
+      if (motif_info.n && row_i != 4) {
+        free(line);
+        fprintf(stderr, "Error: Motif [%s] does not have four rows.",
+          motifs[motif_info.n - 1]->name);
+        badexit("");
+      }
+      if (add_motif()) {
+        free(line);
+        badexit("");
+      }
+      motifs[motif_info.n - 1]->file_line_num = line_num;
+      parse_motif_name(motifs[motif_info.n - 1], line, 1, 1);
+      row_i = 0;
+    } else if (count_nonempty_chars(line) && motif_info.n) {
+      motif_t *motif = motifs[motif_info.n - 1];
+      uint64_t left_bracket = 0;
+      int let = -1, n_values;
+      while (line[left_bracket] != '\0' && line[left_bracket] != '[') {
+        if (let == -1 && char2index[(unsigned char) line[left_bracket]] < 4) {
+          let = char2index[(unsigned char) line[left_bracket]];
+        }
+        left_bracket++;
+      }
+      if (let == -1 || line[left_bracket] != '[') {
+        free(line);
+        fprintf(stderr, "Error: Malformed JASPAR row for motif [%s] (L%llu).",
+          motif->name, line_num);
+        badexit("");
+      }
+      n_values = parse_values(line, left_bracket + 1, ']', values, MAX_MOTIF_WIDTH + 1);
+      if (n_values < 1 || n_values > MAX_MOTIF_WIDTH ||
+          (motif->size && n_values != motif->size)) {
+        free(line);
+        fprintf(stderr, "Error: Bad number of counts for motif [%s] (L%llu).",
+          motif->name, line_num);
+        badexit("");
+      }
+      motif->size = n_values;
+      for (int i = 0; i < n_values; i++) {
+        motif->probs[i * 4 + let] = values[i];
+      }
+      row_i++;
+    }
+  }
+  free(line);
+  if (motif_info.n && row_i != 4) {
+    fprintf(stderr, "Error: Motif [%s] does not have four rows.",
+      motifs[motif_info.n - 1]->name);
+    badexit("");
+  }
+}
+
+static void complete_motifs(void) {
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    motif_t *motif = motifs[i];
+    for (uint64_t pos = 0; pos < motif->size; pos++) {
+      double *col = motif->probs + pos * 4;
+      const double sum = col[0] + col[1] + col[2] + col[3];
+      if (col[0] < 0.0 || col[1] < 0.0 || col[2] < 0.0 || col[3] < 0.0 || sum <= 0.0) {
+        fprintf(stderr, "Error: Motif [%s] has an invalid position (#%llu).",
+          motif->name, pos + 1);
+        badexit("");
+      }
+      for (int let = 0; let < 4; let++) col[let] /= sum;
+      fill_alias_table(col, motif->alias_prob + pos * 4, motif->alias + pos * 4);
+    }
+  }
+}
+
+static void load_motifs(void) {
+  switch (detect_motif_fmt()) {
+    case FMT_MEME:     read_meme();                 break;
+    case FMT_HOMER:    read_homer_or_hocomoco(1);   break;
+    case FMT_JASPAR:   read_jaspar();               break;
+    case FMT_HOCOMOCO: read_homer_or_hocomoco(0);   break;
+    case FMT_UNKNOWN:
+      badexit("Error: Failed to detect motif format.");
+  }
+  if (!motif_info.n) badexit("Error: Failed to read any motifs.");
+  complete_motifs();
+  uint64_t empty_motifs = 0;
+  for (uint64_t i = 0; i < motif_info.n; i++) {
+    if (!motifs[i]->size) empty_motifs++;
+    if (args.w) {
+      fprintf(stderr, "    Found motif: %s (size=%llu)\n", motifs[i]->name, motifs[i]->size);
+    }
+  }
+  if (empty_motifs == motif_info.n) {
+    badexit("Error: All parsed motifs are empty.");
+  } else if (empty_motifs && args.v) {
+    fprintf(stderr, "Warning: Found %'llu empty motifs.\n", empty_motifs);
+  }
+  if (args.v) fprintf(stderr, "Found %'llu motif(s).\n", motif_info.n);
+}
+
+/* Shuffling code from yamshuf, modified to use a per-sequence generator. */
+
+typedef struct shuf_tabs_t {
+  uint64_t       *kmer_tab;
+  uint64_t       *euler_path;
+  uint64_t       *next_index;
+  unsigned char  *invalid_vertex;
+} shuf_tabs_t;
+
+static inline void swap(unsigned char *seq, const uint64_t i, const uint64_t j) {
+  const unsigned char tmp = seq[i]; seq[i] = seq[j]; seq[j] = tmp;
+}
+
+static void shuffle_fisher_yates(unsigned char *seq, const uint64_t len, xrng_t *xrng) {
+  for (uint64_t i = 0, l = len - 1; i < l; i++) {
+    swap(seq, i, i + xrand_r(xrng) % (l - i));
+  }
+}
+
+static inline uint64_t chars2kmer(const unsigned char *seq, const uint64_t k, const uint64_t offset) {
+  uint64_t kmer = 0;
+  for (uint64_t j = 0, i = k - 1; i < -1; j++, i--) {
+    kmer += pow5[i] * char2index[seq[offset + j]];
+  }
+  return kmer;
+}
+
+static inline void count_kmers(const unsigned char *seq, const uint64_t size, uint64_t *kmer_tab, const uint64_t k) {
+  for (uint64_t i = 0; i < size - k + 1; i++) {
+    kmer_tab[chars2kmer(seq, k, i)]++;
+  }
+}
+
+static inline uint64_t cumsum_and_pick_next_letter(const uint64_t *kmers, xrng_t *xrng) {
+  const uint64_t k0 = kmers[0];
+  const uint64_t k1 = kmers[0] + kmers[1];
+  const uint64_t k2 = kmers[0] + kmers[1] + kmers[2];
+  const uint64_t k3 = kmers[0] + kmers[1] + kmers[2] + kmers[3];
+  const uint64_t k4 = kmers[0] + kmers[1] + kmers[2] + kmers[3] + kmers[4];
+  const uint64_t r = xrand_r(xrng) % k4;
+  return 4 - ((r < k0) + (r < k1) + (r < k2) + (r < k3));
+}
+
+#define COUNT_EDGES(OFFSET, TABLE) (TABLE[OFFSET]+TABLE[OFFSET+1]+TABLE[OFFSET+2]+TABLE[OFFSET+3]+TABLE[OFFSET+4])
+
+static void shuffle_euler(unsigned char *seq, const uint64_t size, const uint64_t k, shuf_tabs_t *tabs, xrng_t *xrng) {
+
+  uint64_t *kmer_tab = tabs->kmer_tab;
+  uint64_t *euler_path = tabs->euler_path;
+  uint64_t *next_index = tabs->next_index;
+  unsigned char *invalid_vertex = tabs->invalid_vertex;
+
+  ERASE_ARRAY(invalid_vertex, pow5[k - 1]);
+  ERASE_ARRAY(euler_path, pow5[k - 1]);
+  ERASE_ARRAY(next_index, pow5[k - 1]);
+  ERASE_ARRAY(kmer_tab, pow5[k]);
+  count_kmers(seq, size, kmer_tab, k);
+
+  for (uint64_t i = 0; i < k - 1; i++) {
+    seq[i] = index2dna[char2index[seq[i]]];
+  }
+
+  for (uint64_t i = 0, j = 0; i < pow5[k - 1]; i++, j+= 5) {
+    if (!(COUNT_EDGES(j, kmer_tab))) invalid_vertex[i] = 1;
+  }
+
+  const uint64_t last_vertex = chars2kmer(seq, k - 1, size - k + 1);
+  invalid_vertex[last_vertex] = 1;
+
+  if (k > 2) {
+    for (uint64_t i = 0, j = 0, j_max = pow5[k - 2]; i < pow5[k - 1]; i++, j++) {
+      if (j == j_max) j = 0;
+      next_index[i] = j * 5;
+    }
+  }
+
+  for (uint64_t u, i = 0; i < pow5[k - 1]; i++) {
+    u = i;
+    while (!invalid_vertex[u]) {
+      euler_path[u] = cumsum_and_pick_next_letter(kmer_tab + u * 5, xrng);
+      u = euler_path[u] + next_index[u];
+    }
+    u = i;
+    while (!invalid_vertex[u]) {
+      invalid_vertex[u] = 1;
+      u = euler_path[u] + next_index[u];
+    }
+  }
+
+  for (uint64_t i = 0, j = 0; i < pow5[k - 1]; i++, j += 5) {
+    if (i != last_vertex && COUNT_EDGES(j, kmer_tab)) kmer_tab[j + euler_path[i]]--;
+  }
+
+  for (uint64_t current_vertex, next_edge, kmer_index, i = k - 2; i < size - 1; i++) {
+    current_vertex = chars2kmer(seq, k - 1, (i + 2) - k);
+    kmer_index = current_vertex * 5;
+    if (LIKELY(COUNT_EDGES(kmer_index, kmer_tab))) {
+      next_edge = cumsum_and_pick_next_letter(kmer_tab + kmer_index, xrng);
+      kmer_tab[next_edge + kmer_index]--;
+    } else {
+      next_edge = euler_path[current_vertex];
+    }
+    seq[i + 1] = index2dna[next_edge];
+  }
+
+}
+
+/* Shuffling code end */
+
+static int push_site(const uint64_t seq_i, const uint64_t start, const uint64_t motif, const char strand) {
+  if (batch.n_sites[seq_i] + 1 > batch.n_sites_alloc[seq_i]) {
+    site_t *tmp = realloc(batch.sites[seq_i],
+      sizeof(site_t) * (batch.n_sites_alloc[seq_i] + ALLOC_CHUNK_SIZE));
+    if (tmp == NULL) return 1;
+    batch.sites[seq_i] = tmp;
+    batch.n_sites_alloc[seq_i] += ALLOC_CHUNK_SIZE;
+  }
+  batch.sites[seq_i][batch.n_sites[seq_i]].start = start;
+  batch.sites[seq_i][batch.n_sites[seq_i]].motif = motif;
+  batch.sites[seq_i][batch.n_sites[seq_i]].strand = strand;
+  batch.n_sites[seq_i]++;
+  return 0;
+}
+
+static int window_is_free(const uint64_t seq_i, const uint64_t start, const uint64_t size) {
+  const unsigned char *seq = batch.seqs[seq_i];
+  for (uint64_t i = 0; i < batch.n_sites[seq_i]; i++) {
+    const site_t *site = &batch.sites[seq_i][i];
+    if (start < site->start + motifs[site->motif]->size && site->start < start + size) {
+      return 0;
+    }
+  }
+  for (uint64_t i = start; i < start + size; i++) {
+    if (char2index[seq[i]] == 4) return 0;
+  }
+  return 1;
+}
+
+static void implant_site(unsigned char *seq, const motif_t *motif, const uint64_t start, const char strand, xrng_t *xrng) {
+  for (uint64_t pos = 0; pos < motif->size; pos++) {
+    const unsigned char let =
+      sample_alias(motif->alias_prob + pos * 4, motif->alias + pos * 4, xrng);
+    if (strand == '+') {
+      seq[start + pos] = index2dna[let];
+    } else {
+      seq[start + motif->size - 1 - pos] = index2dna[3 - let];
+    }
+  }
+}
+
+/* Returns the number of sites which could not be placed, or -1 if memory
+ * allocation failed.
+ */
+static uint64_t seed_seq(const uint64_t seq_i, shuf_tabs_t *tabs) {
+  const uint64_t k = args.k;
+  unsigned char *seq = batch.seqs[seq_i];
+  const uint64_t size = batch.sizes[seq_i];
+  uint64_t failed = 0;
+  xrng_t xrng;
+  sxrand_r(&xrng, ((uint64_t) args.seed) ^ splitmix64(batch.first_i + seq_i));
+  batch.n_sites[seq_i] = 0;
+  if (args.use_bkg_model) {
+    for (uint64_t i = 0; i < size; i++) {
+      seq[i] = index2dna[sample_alias(bkg_alias_prob, bkg_alias, &xrng)];
+    }
+  } else if (k == 1 && size > 1) {
+    shuffle_fisher_yates(seq, size, &xrng);
+  } else if (k > 1 && size >= k * 2) {
+    shuffle_euler(seq, size, k, tabs, &xrng);
+  }
+  const uint64_t rate_int = (uint64_t) args.rate;
+  const double rate_frac = args.rate - (double) rate_int;
+  for (uint64_t m = 0; m < motif_info.n; m++) {
+    const motif_t *motif = motifs[m];
+    uint64_t n = rate_int;
+    if (rate_frac > 0.0 && xrand_double(&xrng) < rate_frac) n++;
+    if (!motif->size) continue;
+    for (uint64_t i = 0; i < n; i++) {
+      int placed = 0;
+      if (size >= motif->size) {
+        for (int tries = 0; tries < MAX_PLACEMENT_TRIES; tries++) {
+          const uint64_t start = xrand_r(&xrng) % (size - motif->size + 1);
+          const char strand = args.scan_rc && (xrand_r(&xrng) >> 63) ? '-' : '+';
+          if (window_is_free(seq_i, start, motif->size)) {
+            if (push_site(seq_i, start, m, strand)) return -1;
+            implant_site(seq, motif, start, strand, &xrng);
+            placed = 1;
+            break;
+          }
+        }
+      }
+      if (!placed) failed++;
+    }
+  }
+  return failed;
+}
+
+static void *seed_sub_process(void *thread_i) {
+  const uint64_t t = *((uint64_t *) thread_i);
+  const uint64_t k = args.k;
+  shuf_tabs_t tabs = { NULL, NULL, NULL, NULL };
+  if (k > 1 && !args.use_bkg_model) {
+    tabs.kmer_tab = malloc(sizeof(uint64_t) * pow5[k]);
+    tabs.euler_path = malloc(sizeof(uint64_t) * pow5[k - 1]);
+    tabs.next_index = malloc(sizeof(uint64_t) * pow5[k - 1]);
+    tabs.invalid_vertex = malloc(sizeof(unsigned char) * pow5[k - 1]);
+    if (tabs.kmer_tab == NULL || tabs.euler_path == NULL ||
+        tabs.next_index == NULL || tabs.invalid_vertex == NULL) {
+      thread_failed[t] = -1;
+    }
+  }
+  for (uint64_t i = t; i < batch.n && thread_failed[t] != -1; i += args.nthreads) {
+    const uint64_t failed = seed_seq(i, &tabs);
+    if (failed == -1) {
+      thread_failed[t] = -1;
+    } else {
+      thread_failed[t] += failed;
+    }
+  }
+  free(tabs.kmer_tab);
+  free(tabs.euler_path);
+  free(tabs.next_index);
+  free(tabs.invalid_vertex);
+  free(thread_i);
+  return NULL;
+}
+
+static int grow_batch(void) {
+  const uint64_t n_alloc = batch.n_alloc + ALLOC_CHUNK_SIZE;
+  unsigned char **tmp_seqs = realloc(batch.seqs, sizeof(*batch.seqs) * n_alloc);
+  if (tmp_seqs == NULL) return 1;
+  batch.seqs = tmp_seqs;
+  uint64_t *tmp_sizes = realloc(batch.sizes, sizeof(*batch.sizes) * n_alloc);
+  if (tmp_sizes == NULL) return 1;
+  batch.sizes = tmp_sizes;
+  char **tmp_names = realloc(batch.names, sizeof(*batch.names) * n_alloc);
+  if (tmp_names == NULL) return 1;
+  batch.names = tmp_names;
+  char **tmp_comments = realloc(batch.comments, sizeof(*batch.comments) * n_alloc);
+  if (tmp_comments == NULL) return 1;
+  batch.comments = tmp_comments;
+  site_t **tmp_sites = realloc(batch.sites, sizeof(*batch.sites) * n_alloc);
+  if (tmp_sites == NULL) return 1;
+  batch.sites = tmp_sites;
+  uint64_t *tmp_n_sites = realloc(batch.n_sites, sizeof(*batch.n_sites) * n_alloc);
+  if (tmp_n_sites == NULL) return 1;
+  batch.n_sites = tmp_n_sites;
+  uint64_t *tmp_n_sites_alloc = realloc(batch.n_sites_alloc,
+    sizeof(*batch.n_sites_alloc) * n_alloc);
+  if (tmp_n_sites_alloc == NULL) return 1;
+  batch.n_sites_alloc = tmp_n_sites_alloc;
+  for (uint64_t i = batch.n_alloc; i < n_alloc; i++) {
+    batch.sites[i] = NULL;
+    batch.n_sites[i] = 0;
+    batch.n_sites_alloc[i] = 0;
+  }
+  batch.n_alloc = n_alloc;
+  return 0;
+}
+
+/* Returns the number of sequences added to the batch. */
+static uint64_t fill_batch(kseq_t *kseq, uint64_t *n_generated) {
+  uint64_t n_bases = 0;
+  int ret_val;
+  clear_batch();
+  while (batch.n < BATCH_MAX_SEQS && n_bases < BATCH_MAX_BASES) {
+    if (batch.n + 1 > batch.n_alloc && grow_batch()) {
+      badexit("Error: Failed to allocate memory for sequences.");
+    }
+    const uint64_t i = batch.n;
+    if (args.use_bkg_model) {
+      if (*n_generated == args.n_gen) break;
+      batch.seqs[i] = malloc(args.gen_len + 1);
+      batch.names[i] = malloc(32);
+      batch.comments[i] = NULL;
+      if (batch.seqs[i] == NULL || batch.names[i] == NULL) {
+        badexit("Error: Failed to allocate memory for sequences.");
+      }
+      batch.seqs[i][args.gen_len] = '\0';
+      batch.sizes[i] = args.gen_len;
+      (*n_generated)++;
+      snprintf(batch.names[i], 32, "seq%llu", *n_generated);
+    } else {
+      if ((ret_val = kseq_read(kseq)) < 0) {
+        if (ret_val == -2) {
+          badexit("Error: Failed to parse FASTQ qualities.");
+        } else if (ret_val < -2) {
+          badexit("Error: Failed to read input.");
+        }
+        break;
+      }
+      batch.seqs[i] = (unsigned char *) kseq->seq.s;
+      kseq->seq.s = NULL;
+      batch.sizes[i] = kseq->seq.l;
+      batch.names[i] = strdup(kseq->name.s);
+      batch.comments[i] = kseq->comment.l ? strdup(kseq->comment.s) : NULL;
+      if (batch.names[i] == NULL || (kseq->comment.l && batch.comments[i] == NULL)) {
+        badexit("Error: Failed to allocate memory for sequence names.");
+      }
+    }
+    n_bases += batch.sizes[i];
+    batch.n++;
+  }
+  return batch.n;
+}
+
+static int compare_sites(const void *a, const void *b) {
+  const site_t *a_s = (const site_t *) a;
+  const site_t *b_s = (const site_t *) b;
+  if (a_s->start < b_s->start) {
+    return -1;
+  } else if (a_s->start > b_s->start) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+static void write_batch(void) {
+  for (uint64_t i = 0; i < batch.n; i++) {
+    if (batch.comments[i] != NULL) {
+      fprintf(files.o, ">%s %s\n", batch.names[i], batch.comments[i]);
+    } else {
+      fprintf(files.o, ">%s\n", batch.names[i]);
+    }
+    for (uint64_t j = 0; j < batch.sizes[i]; j += FASTA_LINE_LEN) {
+      fprintf(files.o, "%.*s\n", FASTA_LINE_LEN, batch.seqs[i] + j);
+    }
+    if (files.t_open && batch.n_sites[i]) {
+      qsort(batch.sites[i], batch.n_sites[i], sizeof(site_t), compare_sites);
+      for (uint64_t j = 0; j < batch.n_sites[i]; j++) {
+        const site_t *site = &batch.sites[i][j];
+        const motif_t *motif = motifs[site->motif];
+        fprintf(files.t, "%s\t%llu\t%llu\t%s\t0\t%c\t%.*s\n",
+          batch.names[i], site->start, site->start + motif->size, motif->name,
+          site->strand, (int) motif->size, batch.seqs[i] + site->start);
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+
+  kseq_t *kseq = NULL;
+  char *user_bkg = NULL;
+  int opt, use_stdout = 1, has_seqs = 0, has_motifs = 0, use_user_bkg = 0;
+
+  while ((opt = getopt(argc, argv, "m:i:n:L:b:k:r:fo:t:s:j:vwh")) != -1) {
+    switch (opt) {
+      case 'm':
+        has_motifs = 1;
+        files.m = fopen(optarg, "r");
+        if (files.m == NULL) {
+          fprintf(stderr, "Error: Failed to open motif file \"%s\" [%s]", optarg, strerror(errno));
+          badexit("");
+        }
+        files.m_open = 1;
+        break;
+      case 'i':
+        has_seqs = 1;
+        if (optarg[0] == '-' && optarg[1] == '\0') {
+          files.s = gzdopen(fileno(stdin), "r");
+        } else {
+          files.s = gzopen(optarg, "r");
+          if (files.s == NULL) {
+            fprintf(stderr, "Error: Failed to open sequence file \"%s\" [%s]", optarg, strerror(errno));
+            badexit("");
+          }
+        }
+        files.s_open = 1;
+        break;
+      case 'n':
+        if (str_to_uint64_t(optarg, &args.n_gen)) {
+          badexit("Error: Failed to parse -n value.");
+        }
+        if (!args.n_gen) {
+          badexit("Error: -n must be a positive integer.");
+        }
+        args.use_bkg_model = 1;
+        break;
+      case 'L':
+        if (str_to_uint64_t(optarg, &args.gen_len)) {
+          badexit("Error: Failed to parse -L value.");
+        }
+        if (!args.gen_len) {
+          badexit("Error: -L must be a positive integer.");
+        }
+        break;
+      case 'b':
+        use_user_bkg = 1;
+        user_bkg = optarg;
+        break;
+      case 'k':
+        if (str_to_int(optarg, &args.k)) {
+          badexit("Error: Failed to parse -k value.");
+        }
+        if (args.k < 0) {
+          badexit("Error: -k cannot be negative.");
+        }
+        if (args.k > MAX_K) {
+          fprintf(stderr, "Error: -k%d exceeds allowed max [MAX_K=%d]", args.k, MAX_K);
+          badexit("");
+        }
+        break;
+      case 'r':
+        if (str_to_double(optarg, &args.rate)) {
+          badexit("Error: Failed to parse -r value.");
+        }
+        if (args.rate < 0.0 || args.rate > 1000000.0) {
+          badexit("Error: -r must be between 0 and 1,000,000.");
+        }
+        break;
+      case 'f':
+        args.scan_rc = 0;
+        break;
+      case 'o':
+        use_stdout = 0;
+        files.o = fopen(optarg, "w");
+        if (files.o == NULL) {
+          fprintf(stderr, "Error: Failed to create output file \"%s\" [%s]", optarg, strerror(errno));
+          badexit("");
+        }
+        files.o_open = 1;
+        break;
+      case 't':
+        files.t = fopen(optarg, "w");
+        if (files.t == NULL) {
+          fprintf(stderr, "Error: Failed to create BED file \"%s\" [%s]", optarg, strerror(errno));
+          badexit("");
+        }
+        files.t_open = 1;
+        break;
+      case 's':
+        if (str_to_int(optarg, &args.seed)) {
+          badexit("Error: Failed to parse -s value.");
+        }
+        if (!args.seed) {
+          badexit("Error: -s must be a positive integer.");
+        }
+        break;
+      case 'j':
+        if (str_to_int(optarg, &args.nthreads)) {
+          badexit("Error: Failed to parse -j value.");
+        }
+        if (args.nthreads < 1) {
+          badexit("Error: -j must be a positive integer.");
+        }
+        break;
+      case 'w':
+        args.w = 1;
+      case 'v':
+        args.v = 1;
+        break;
+      case 'h':
+        usage();
+        return EXIT_SUCCESS;
+      default:
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (setlocale(LC_NUMERIC, "en_US") == NULL && args.v) {
+    fprintf(stderr, "Warning: setlocale(LC_NUMERIC, \"en_US\") failed.\n");
+  }
+
+  if (!has_motifs) {
+    badexit("Error: Missing -m arg.");
+  }
+  if (has_seqs && args.use_bkg_model) {
+    badexit("Error: Cannot use both -i and -n.");
+  } else if (!has_seqs && !args.use_bkg_model) {
+    badexit("Error: Missing one of -i, -n args.");
+  }
+  if (use_user_bkg && !args.use_bkg_model) {
+    badexit("Error: -b can only be used with -n.");
+  }
+
+  if (use_stdout) {
+    files.o = stdout;
+    files.o_open = 1;
+  }
+
+  load_motifs();
+
+  if (use_user_bkg) parse_user_bkg(user_bkg);
+  if (args.use_bkg_model) {
+    fill_alias_table(args.bkg, bkg_alias_prob, bkg_alias);
+  } else {
+    kseq = kseq_init(files.s);
+  }
+
+  threads = malloc(sizeof(pthread_t) * args.nthreads);
+  thread_failed = malloc(sizeof(uint64_t) * args.nthreads);
+  if (threads == NULL || thread_failed == NULL) {
+    kseq_destroy(kseq);
+    badexit("Error: Failed to allocate memory for threads.");
+  }
+  ERASE_ARRAY(thread_failed, args.nthreads);
+
+  if (args.v) fprintf(stderr, "Seeding ...\n");
+  time_t time1 = time(NULL);
+  uint64_t n_seqs = 0, n_generated = 0, n_sites = 0, n_failed = 0;
+  while (fill_batch(kseq, &n_generated)) {
+    if (args.w) {
+      fprintf(stderr, "    Seeding sequences #%'llu-%'llu\n", n_seqs + 1, n_seqs + batch.n);
+    }
+    batch.first_i = n_seqs;
+    for (uint64_t t = 0; t < args.nthreads; t++) {
+      uint64_t *thread_i = malloc(sizeof(uint64_t));
+      if (thread_i == NULL) {
+        kseq_destroy(kseq);
+        badexit("Error: Failed to allocate memory for thread index.");
+      }
+      *thread_i = t;
+      pthread_create(&threads[t], NULL, seed_sub_process, thread_i);
+    }
+    for (uint64_t t = 0; t < args.nthreads; t++) {
+      pthread_join(threads[t], NULL);
+      if (thread_failed[t] == -1) {
+        kseq_destroy(kseq);
+        badexit("Error: Failed to allocate memory while seeding sequences.");
+      }
+    }
+    write_batch();
+    for (uint64_t i = 0; i < batch.n; i++) n_sites += batch.n_sites[i];
+    n_seqs += batch.n;
+  }
+  for (uint64_t t = 0; t < args.nthreads; t++) n_failed += thread_failed[t];
+  kseq_destroy(kseq);
+
+  if (!n_seqs) {
+    badexit("Error: Failed to read any sequences from input.");
+  }
+
+  time_t time2 = time(NULL);
+  if (args.v) {
+    fprintf(stderr, "Seeded %'llu site(s) across %'llu sequence(s).\n", n_sites, n_seqs);
+    if (n_failed) {
+      fprintf(stderr, "Warning: Failed to find room for %'llu site(s).\n", n_failed);
+    }
+    time_t time3 = difftime(time2, time1);
+    print_time((uint64_t) time3, "seed sequences");
+    print_peak_mb();
+  }
+
+  free(threads);
+  free(thread_failed);
+  free_motifs();
+  free_batch();
+  close_files();
+
+  return EXIT_SUCCESS;
+
+}
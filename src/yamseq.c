@@ -0,0 +1,1508 @@
+/*
+ *   yamseq: Extract, mask and reformat DNA/RNA sequences
+ *   Copyright (C) 2026  Benjamin Jean-Marie Tremblay
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* yamseq reads sequences through one of three sources:
+ *
+ *   - SRC_MMAP: an uncompressed fasta file is mmap'd and ranges are read
+ *     directly from the mapping, using a .fai index (samtools faidx format)
+ *     to translate sequence coordinates to file offsets. If a range fits
+ *     within a single line of the file (always the case when the fasta is
+ *     unwrapped), it is written straight from the mapping without copying.
+ *   - SRC_BGZF: a BGZF-compressed fasta file (e.g. from bgzip) is read by
+ *     decompressing only the blocks needed for each range, again using a
+ *     .fai index. Block offsets come from the .gzi index if present, or
+ *     otherwise from a quick pass over the block headers.
+ *   - SRC_MEM: anything else (regular gzip, fastq, stdin, irregular line
+ *     lengths) is loaded into memory with kseq.
+ *
+ * Missing .fai indices are built on the fly (and can be saved with -I).
+ * Ranges are processed in batches: each thread fills a contiguous chunk of
+ * the batch, after which the main thread writes the batch in order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <locale.h>
+#include <getopt.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "kseq.h"
+#include "khash.h"
+
+KSEQ_INIT(gzFile, gzread)
+KHASH_MAP_INIT_STR(seq_str_h, uint64_t)
+
+#define YAMSEQ_VERSION              "1.0"
+#define YAMSEQ_YEAR                  2026
+
+/* Maximum number of characters allowed for individual BED fields */
+#define FIELD_MAX_CHAR          ((uint64_t) 512)
+/* Number of elements when calling malloc/realloc */
+#define ALLOC_CHUNK_SIZE        ((uint64_t) 256)
+/* Ranges are processed in batches; a batch is closed once either is hit */
+#define BATCH_MAX_RANGES      ((uint64_t) 16384)
+#define BATCH_MAX_BASES   ((uint64_t) 268435456)
+/* Chunk size when streaming through a file to build a .fai index */
+#define INDEX_CHUNK_SIZE      ((uint64_t) 1048576)
+/* Max size of BGZF blocks (both compressed and uncompressed) */
+#define BGZF_MAX_BLOCK_SIZE     ((uint64_t) 65536)
+#define BGZF_HEADER_SIZE                      18
+#define BGZF_FOOTER_SIZE                       8
+
+#define DEFAULT_LINE_LEN                      60
+
+#define ERASE_ARRAY(ARR, LEN) memset(ARR, 0, sizeof(ARR[0]) * (LEN))
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+#define LIKELY(COND) __builtin_expect(COND, 1)
+#define UNLIKELY(COND) __builtin_expect(COND, 0)
+
+#define MALLOC_OR_RET1(OBJ, SIZE)                    \
+  do {                                               \
+    OBJ = malloc(SIZE);                              \
+    if (OBJ == NULL)  return 1;                      \
+  } while (0)
+
+#define REALLOC_OR_RET1(OBJ, SIZE, TYPE)             \
+  do {                                               \
+    TYPE* TMP = realloc(OBJ, (SIZE) * sizeof(TYPE)); \
+    if (TMP == NULL) return 1;                       \
+    OBJ = TMP;                                       \
+  } while (0)
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+static long peak_mem(void) {
+  return 0;
+}
+#else
+#include <sys/resource.h>
+static long peak_mem(void) {
+  struct rusage r_mem;
+  getrusage(RUSAGE_SELF, &r_mem);
+#ifdef __linux__
+  return r_mem.ru_maxrss * 1024;
+#else
+  return r_mem.ru_maxrss;
+#endif
+}
+#endif
+
+static void print_peak_mb(void) {
+  long bytes = peak_mem();
+  if (bytes > (1 << 30)) {
+    fprintf(stderr, "Approx. peak memory usage: %'.2f GB.\n",
+      (((double) bytes / 1024.0) / 1024.0) / 1024.0);
+  } else if (bytes > (1 << 20)) {
+    fprintf(stderr, "Approx. peak memory usage: %'.2f MB.\n",
+      ((double) bytes / 1024.0) / 1024.0);
+  } else if (bytes) {
+    fprintf(stderr, "Approx. peak memory usage: %'.2f KB.\n",
+      (double) bytes / 1024.0);
+  }
+}
+
+static void print_time(const uint64_t s, const char *what) {
+  if (s > 7200) {
+    fprintf(stderr, "Needed %'.2f hours to %s.\n", ((double) s / 60.0) / 60.0, what);
+  } else if (s > 120) {
+    fprintf(stderr, "Needed %'.2f minutes to %s.\n", (double) s / 60.0, what);
+  } else if (s > 1) {
+    fprintf(stderr, "Needed %'llu seconds to %s.\n", s, what);
+  }
+}
+
+static void usage(void) {
+  printf(
+    "yamseq v%s  Copyright (C) %d  Benjamin Jean-Marie Tremblay                 \n"
+    "                                                                              \n"
+    "Usage:  yamseq [options] -i sequences.fa [ -b ranges.bed ] [ -x mask.bed ]    \n"
+    "                                                                              \n"
+    " -i <str>   Filename of fast(a|q)-formatted file containing DNA/RNA sequences.\n"
+    "            Can be gzipped. Use '-' for stdin. Uncompressed and bgzipped fasta\n"
+    "            files are read using random access (with a .fai index, built if \n"
+    "            missing); all other inputs are loaded into memory.                \n"
+    " -b <str>   Filename of a BED file of ranges to extract. Ranges on the minus  \n"
+    "            strand are reverse complemented. By default, all sequences are    \n"
+    "            output in full.                                                   \n"
+    " -x <str>   Filename of a BED file of ranges to mask. Masked ranges are       \n"
+    "            replaced with the letter N. Can be combined with -b.              \n"
+    " -S         Soft-mask ranges from -x by converting them to lowercase.          \n"
+    " -f         Ignore the strand column in -b and always extract the forward     \n"
+    "            strand.                                                           \n"
+    " -n         Use the BED name column (if present) to name extracted ranges. By \n"
+    "            default they are named as 'seq:start-end(strand)'.               \n"
+    " -l <int>   Number of letters per line in the output. Use 0 to print each   \n"
+    "            sequence on a single line. Default: %d.                           \n"
+    " -u         Convert all sequences to uppercase (before soft-masking).         \n"
+    " -I         Save the .fai index alongside the input if one had to be built. \n"
+    " -o <str>   Filename to output sequences. By default output goes to stdout.   \n"
+    " -j <int>   Number of threads yamseq can use. Default: 1.                     \n"
+    " -v         Verbose mode.                                                     \n"
+    " -w         Very verbose mode.                                                \n"
+    " -h         Print this help message.                                          \n"
+    , YAMSEQ_VERSION, YAMSEQ_YEAR, DEFAULT_LINE_LEN
+  );
+}
+
+enum SRC_TYPE {
+  SRC_MEM  = 1,
+  SRC_MMAP = 2,
+  SRC_BGZF = 3
+};
+
+typedef struct args_t {
+  uint64_t  line_len;
+  int       nthreads;
+  int       use_strand : 1;
+  int       use_names : 1;
+  int       soft_mask : 1;
+  int       uppercase : 1;
+  int       save_index : 1;
+  int       v : 1;
+  int       w : 1;
+} args_t;
+
+static args_t args = {
+  .line_len   = DEFAULT_LINE_LEN,
+  .nthreads   = 1,
+  .use_strand = 1,
+  .use_names  = 0,
+  .soft_mask  = 0,
+  .uppercase  = 0,
+  .save_index = 0,
+  .v          = 0,
+  .w          = 0
+};
+
+typedef struct files_t {
+  int       b_open : 1;
+  int       x_open : 1;
+  int       o_open : 1;
+  gzFile    b;
+  gzFile    x;
+  FILE     *o;
+} files_t;
+
+static files_t files = {
+  .b_open = 0,
+  .x_open = 0,
+  .o_open = 0
+};
+
+static void close_files(void) {
+  if (files.b_open) gzclose(files.b);
+  if (files.x_open) gzclose(files.x);
+  if (files.o_open) fclose(files.o);
+}
+
+/* For SRC_MMAP and SRC_BGZF the offset, line_bases and line_width fields
+ * mirror the .fai columns; for SRC_MEM the sequence itself is kept.
+ */
+typedef struct seq_t {
+  char           *name;
+  unsigned char  *seq;
+  uint64_t        size;
+  uint64_t        offset;
+  uint64_t        line_bases;
+  uint64_t        line_width;
+} seq_t;
+
+static seq_t *seqs;
+
+typedef struct seq_info_t {
+  uint64_t  n;
+  uint64_t  n_alloc;
+} seq_info_t;
+
+static seq_info_t seq_info = {
+  .n       = 0,
+  .n_alloc = 0
+};
+
+static khash_t(seq_str_h) *seq_hash_tab;
+
+typedef struct source_t {
+  int             type;
+  int             fd;
+  unsigned char  *map;
+  uint64_t        map_size;
+  uint64_t       *block_coffs;
+  uint64_t       *block_uoffs;
+  uint64_t        n_blocks;
+} source_t;
+
+static source_t src = {
+  .type     = 0,
+  .fd       = -1,
+  .map      = NULL,
+  .map_size = 0,
+  .n_blocks = 0
+};
+
+typedef struct ranges_t {
+  uint64_t  *seq_indices;
+  uint64_t  *starts;
+  uint64_t  *ends;
+  char      *strands;
+  char     **names;
+  uint64_t   n;
+  uint64_t   n_alloc;
+} ranges_t;
+
+static ranges_t ranges = {
+  .n       = 0,
+  .n_alloc = 0
+};
+
+/* Mask ranges are sorted and merged, then indexed per sequence. */
+static ranges_t masks = {
+  .n       = 0,
+  .n_alloc = 0
+};
+
+static uint64_t *mask_firsts;
+static uint64_t *mask_counts;
+
+/* Every slot of a batch points to its (contiguous) output sequence, which
+ * either lives in the source itself or in the slot buffer.
+ */
+typedef struct slot_t {
+  const unsigned char  *ptr;
+  uint64_t              size;
+  unsigned char        *buf;
+  uint64_t              buf_alloc;
+} slot_t;
+
+static slot_t *slots;
+static uint64_t slots_n_alloc;
+
+typedef struct batch_t {
+  uint64_t  first;
+  uint64_t  n;
+} batch_t;
+
+static batch_t batch;
+
+/* Per-thread scratch space for reading file bytes and BGZF blocks */
+typedef struct thread_buf_t {
+  unsigned char  *raw;
+  uint64_t        raw_alloc;
+  unsigned char  *cblock;
+  unsigned char  *ublock;
+  uint64_t        ublock_size;
+  uint64_t        ublock_i;
+  z_stream        zs;
+  int             zs_open;
+  int             failed;
+} thread_buf_t;
+
+static pthread_t      *threads;
+static thread_buf_t   *thread_bufs;
+
+static void free_ranges(ranges_t *r) {
+  if (r->n_alloc) {
+    if (r->names != NULL) {
+      for (uint64_t i = 0; i < r->n; i++) free(r->names[i]);
+      free(r->names);
+    }
+    free(r->seq_indices);
+    free(r->starts);
+    free(r->ends);
+    free(r->strands);
+  }
+  r->n = 0;
+  r->n_alloc = 0;
+}
+
+static void free_thread_bufs(void) {
+  if (thread_bufs == NULL) return;
+  for (int t = 0; t < args.nthreads; t++) {
+    free(thread_bufs[t].raw);
+    free(thread_bufs[t].cblock);
+    free(thread_bufs[t].ublock);
+    if (thread_bufs[t].zs_open) inflateEnd(&thread_bufs[t].zs);
+  }
+  free(thread_bufs);
+}
+
+static void free_seqs(void) {
+  for (uint64_t i = 0; i < seq_info.n; i++) {
+    free(seqs[i].name);
+    free(seqs[i].seq);
+  }
+  free(seqs);
+  if (seq_hash_tab != NULL) kh_destroy(seq_str_h, seq_hash_tab);
+}
+
+static void free_slots(void) {
+  for (uint64_t i = 0; i < slots_n_alloc; i++) free(slots[i].buf);
+  free(slots);
+}
+
+static void close_source(void) {
+  if (src.map != NULL) munmap(src.map, src.map_size);
+  if (src.fd != -1) close(src.fd);
+  if (src.n_blocks) {
+    free(src.block_coffs);
+    free(src.block_uoffs);
+  }
+}
+
+static void badexit(const char *msg) {
+  fprintf(stderr, "%s\nRun yamseq -h to see usage.\n", msg);
+  free(threads);
+  free_thread_bufs();
+  free_slots();
+  free_ranges(&ranges);
+  free_ranges(&masks);
+  free(mask_firsts);
+  free(mask_counts);
+  free_seqs();
+  close_source();
+  close_files();
+  exit(EXIT_FAILURE);
+}
+
+static const unsigned char char2comp[256] = {
+    0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,
+   16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,
+   32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,
+   48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,
+   64, 'T', 'V', 'G', 'H',  69,  70, 'C', 'D',  73,  74, 'M',  76, 'K', 'N',  79,
+   80,  81, 'Y', 'S', 'A', 'A', 'B', 'W',  88, 'R',  90,  91,  92,  93,  94,  95,
+   96, 't', 'v', 'g', 'h', 101, 102, 'c', 'd', 105, 106, 'm', 108, 'k', 'n', 111,
+  112, 113, 'y', 's', 'a', 'a', 'b', 'w', 120, 'r', 122, 123, 124, 125, 126, 127,
+  128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143,
+  144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+  160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+  176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+  192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
+  208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
+  224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
+  240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+};
+
+static inline int str_to_int(char *str, int *res) {
+  char *tmp; errno = 0;
+  long int res_long = strtol(str, &tmp, 10);
+  if (res_long > INT_MAX) return 1;
+  *res = (int) res_long;
+  if (str == tmp || errno != 0 || *tmp != '\0') {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+static inline int str_to_uint64_t(char *str, uint64_t *res) {
+  char *tmp; errno = 0;
+  *res = (uint64_t) strtoull(str, &tmp, 10);
+  if (str == tmp || errno != 0 || *tmp != '\0') {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+static inline uint64_t count_fields(const char *line) {
+  uint64_t res = 1;
+  for (uint64_t i = 0; line[i] != '\0'; i++) {
+    if (line[i] == '\t') res += 1;
+  }
+  return res;
+}
+
+static inline uint64_t extract_field(const char *line, const uint64_t k, char *field) {
+  uint64_t start = 0, end = 0, field_i = 1, size = 0;
+  ERASE_ARRAY(field, FIELD_MAX_CHAR);
+  for (uint64_t i = 0; ; i++) {
+    if (line[i] == '\0' || line[i] == '\r' || (line[i] == '\t' && field_i == k)) {
+      end = i - 1;
+      break;
+    } else if (line[i] == '\t') {
+      field_i += 1;
+    } else if (field_i == k) {
+      if (!size) start = i;
+      size += 1;
+    }
+  }
+  if (size > 0 && size < FIELD_MAX_CHAR) {
+    for (uint64_t i = start, j = 0; i <= end; i++, j++) {
+      field[j] = line[i];
+    }
+  }
+  return size;
+}
+
+static int add_seq(const char *name, const uint64_t name_size) {
+  if (seq_info.n == seq_info.n_alloc) {
+    REALLOC_OR_RET1(seqs, seq_info.n_alloc + ALLOC_CHUNK_SIZE, seq_t);
+    seq_info.n_alloc += ALLOC_CHUNK_SIZE;
+  }
+  seq_t *seq = &seqs[seq_info.n];
+  MALLOC_OR_RET1(seq->name, name_size + 1);
+  memcpy(seq->name, name, name_size);
+  seq->name[name_size] = '\0';
+  seq->seq = NULL;
+  seq->size = 0;
+  seq->offset = 0;
+  seq->line_bases = 0;
+  seq->line_width = 0;
+  seq_info.n++;
+  return 0;
+}
+
+static void reset_seqs(void) {
+  for (uint64_t i = 0; i < seq_info.n; i++) {
+    free(seqs[i].name);
+    free(seqs[i].seq);
+  }
+  seq_info.n = 0;
+}
+
+static void hash_seq_names(void) {
+  seq_hash_tab = kh_init(seq_str_h);
+  khint64_t k;
+  int absent;
+  for (uint64_t i = 0; i < seq_info.n; i++) {
+    k = kh_put(seq_str_h, seq_hash_tab, seqs[i].name, &absent);
+    if (absent == -1) {
+      badexit("Error: Failed to hash sequence names.");
+    } else if (absent == 0) {
+      fprintf(stderr, "Error: Encountered duplicate sequence name (%s).", seqs[i].name);
+      badexit("");
+    }
+    kh_val(seq_hash_tab, k) = i;
+  }
+}
+
+/* Builds a .fai index from a stream of file bytes fed in chunks. Anything
+ * samtools would refuse to index (differing line lengths within a sequence,
+ * blank lines, fastq) marks the index as irregular.
+ */
+typedef struct fai_builder_t {
+  uint64_t  pos;
+  uint64_t  line_size;
+  uint64_t  line_bytes;
+  char     *name;
+  uint64_t  name_size;
+  uint64_t  name_alloc;
+  int       in_header;
+  int       in_name;
+  int       in_seq;
+  int       short_line;
+  int       irregular;
+  int       failed;
+} fai_builder_t;
+
+static void fai_end_line(fai_builder_t *fb) {
+  seq_t *seq = &seqs[seq_info.n - 1];
+  if (!fb->line_size) {
+    if (fb->line_bytes) fb->short_line = 1;
+  } else if (fb->short_line) {
+    fb->irregular = 1;
+  } else if (!seq->line_bases) {
+    seq->line_bases = fb->line_size;
+    seq->line_width = fb->line_bytes;
+  } else if (fb->line_size > seq->line_bases ||
+      (fb->line_size == seq->line_bases && fb->line_bytes != seq->line_width)) {
+    fb->irregular = 1;
+  } else if (fb->line_size < seq->line_bases) {
+    fb->short_line = 1;
+  }
+  fb->line_size = 0;
+  fb->line_bytes = 0;
+}
+
+static void fai_feed(fai_builder_t *fb, const unsigned char *buf, const uint64_t size) {
+  for (uint64_t i = 0; i < size && !fb->irregular && !fb->failed; i++, fb->pos++) {
+    const unsigned char c = buf[i];
+    if (fb->in_header) {
+      if (c == '\n') {
+        if (!fb->name_size) {
+          fb->irregular = 1;
+        } else if (add_seq(fb->name, fb->name_size)) {
+          fb->failed = 1;
+        } else {
+          seqs[seq_info.n - 1].offset = fb->pos + 1;
+          fb->in_header = 0;
+          fb->in_seq = 1;
+          fb->short_line = 0;
+        }
+      } else if (fb->in_name) {
+        if (c == ' ' || c == '\t' || c == '\r') {
+          fb->in_name = 0;
+        } else {
+          if (fb->name_size + 1 >= fb->name_alloc) {
+            char *tmp = realloc(fb->name, fb->name_alloc + ALLOC_CHUNK_SIZE);
+            if (tmp == NULL) {
+              fb->failed = 1;
+              break;
+            }
+            fb->name = tmp;
+            fb->name_alloc += ALLOC_CHUNK_SIZE;
+          }
+          fb->name[fb->name_size++] = c;
+        }
+      }
+    } else if (c == '>' && !fb->line_bytes) {
+      fb->in_header = 1;
+      fb->in_name = 1;
+      fb->name_size = 0;
+      fb->in_seq = 0;
+    } else if (!fb->in_seq) {
+      if (c != '\n' && c != '\r') fb->irregular = 1;
+    } else if (c == '\n') {
+      fb->line_bytes++;
+      fai_end_line(fb);
+    } else if (c == '\r') {
+      fb->line_bytes++;
+    } else {
+      fb->line_size++;
+      fb->line_bytes++;
+      seqs[seq_info.n - 1].size++;
+    }
+  }
+}
+
+/* Returns 0 if an index was built, 1 if the input is irregular. */
+static int fai_finish(fai_builder_t *fb) {
+  if (fb->failed) {
+    free(fb->name);
+    badexit("Error: Failed to allocate memory while indexing sequences.");
+  }
+  if (fb->in_header) fb->irregular = 1;
+  if (!fb->irregular && fb->in_seq && fb->line_bytes) fai_end_line(fb);
+  free(fb->name);
+  if (!seq_info.n) fb->irregular = 1;
+  if (fb->irregular) reset_seqs();
+  return fb->irregular;
+}
+
+static void fai_init(fai_builder_t *fb) {
+  ERASE_ARRAY(fb, 1);
+  fb->name = NULL;
+}
+
+static int read_fai(const char *fai_path, const char *fa_path) {
+  struct stat fai_stat, fa_stat;
+  if (stat(fai_path, &fai_stat) || stat(fa_path, &fa_stat)) return 1;
+  if (fai_stat.st_mtime < fa_stat.st_mtime) {
+    if (args.v) {
+      fprintf(stderr, "Warning: Index \"%s\" is older than the input, ignoring it.\n",
+        fai_path);
+    }
+    return 1;
+  }
+  FILE *fai = fopen(fai_path, "r");
+  if (fai == NULL) return 1;
+  char *line = NULL;
+  size_t len = 0;
+  ssize_t read;
+  uint64_t line_num = 0, values[4];
+  char field[FIELD_MAX_CHAR];
+  int bad = 0;
+  while ((read = getline(&line, &len, fai)) != -1) {
+    line_num++;
+    if (line[read - 1] == '\n') line[read - 1] = '\0';
+    if (count_fields(line) < 5) {
+      bad = 1;
+      break;
+    }
+    for (uint64_t k = 0; k < 4; k++) {
+      if (!extract_field(line, k + 2, field) || str_to_uint64_t(field, &values[k])) {
+        bad = 1;
+        break;
+      }
+    }
+    const uint64_t name_size = extract_field(line, 1, field);
+    if (bad || !name_size || name_size >= FIELD_MAX_CHAR || add_seq(field, name_size)) {
+      bad = 1;
+      break;
+    }
+    seqs[seq_info.n - 1].size = values[0];
+    seqs[seq_info.n - 1].offset = values[1];
+    seqs[seq_info.n - 1].line_bases = values[2];
+    seqs[seq_info.n - 1].line_width = values[3];
+    if (values[0] && (!values[2] || values[3] < values[2])) {
+      bad = 1;
+      break;
+    }
+  }
+  free(line);
+  fclose(fai);
+  if (bad || !seq_info.n) {
+    if (args.v) {
+      fprintf(stderr, "Warning: Failed to parse index \"%s\" (L%llu), ignoring it.\n",
+        fai_path, line_num);
+    }
+    reset_seqs();
+    return 1;
+  }
+  if (args.v) fprintf(stderr, "Read index \"%s\".\n", fai_path);
+  return 0;
+}
+
+static void write_fai(const char *fai_path) {
+  FILE *fai = fopen(fai_path, "w");
+  if (fai == NULL) {
+    if (args.v) {
+      fprintf(stderr, "Warning: Failed to create index file \"%s\" [%s]\n",
+        fai_path, strerror(errno));
+    }
+    return;
+  }
+  for (uint64_t i = 0; i < seq_info.n; i++) {
+    fprintf(fai, "%s\t%llu\t%llu\t%llu\t%llu\n", seqs[i].name, seqs[i].size,
+      seqs[i].offset, seqs[i].line_bases, seqs[i].line_width);
+  }
+  fclose(fai);
+  if (args.v) fprintf(stderr, "Saved index to \"%s\".\n", fai_path);
+}
+
+static void load_seqs_into_mem(const char *fa_path) {
+  gzFile s;
+  if (fa_path[0] == '-' && fa_path[1] == '\0') {
+    s = gzdopen(fileno(stdin), "r");
+  } else {
+    s = gzopen(fa_path, "r");
+  }
+  if (s == NULL) {
+    fprintf(stderr, "Error: Failed to open sequence file \"%s\" [%s]", fa_path, strerror(errno));
+    badexit("");
+  }
+  kseq_t *kseq = kseq_init(s);
+  int ret_val;
+  while ((ret_val = kseq_read(kseq)) >= 0) {
+    if (add_seq(kseq->name.s, kseq->name.l)) {
+      kseq_destroy(kseq);
+      gzclose(s);
+      badexit("Error: Failed to allocate memory for sequence names.");
+    }
+    seqs[seq_info.n - 1].seq = (unsigned char *) kseq->seq.s;
+    seqs[seq_info.n - 1].size = kseq->seq.l;
+    kseq->seq.s = NULL;
+    kseq->seq.l = 0;
+    kseq->seq.m = 0;
+  }
+  kseq_destroy(kseq);
+  gzclose(s);
+  if (ret_val == -2) {
+    badexit("Error: Failed to parse FASTQ qualities.");
+  } else if (ret_val < -2) {
+    badexit("Error: Failed to read input.");
+  }
+  src.type = SRC_MEM;
+  if (args.v) fprintf(stderr, "Loaded sequences into memory.\n");
+}
+
+static inline uint64_t read_le(const unsigned char *buf, const int n_bytes) {
+  uint64_t x = 0;
+  for (int i = n_bytes - 1; i >= 0; i--) x = (x << 8) | buf[i];
+  return x;
+}
+
+static int is_bgzf_header(const unsigned char *h) {
+  return h[0] == 31 && h[1] == 139 && h[2] == 8 && (h[3] & 4) &&
+    read_le(h + 10, 2) == 6 && h[12] == 'B' && h[13] == 'C' && read_le(h + 14, 2) == 2;
+}
+
+static int add_block(const uint64_t coff, const uint64_t uoff) {
+  if (src.n_blocks % ALLOC_CHUNK_SIZE == 0) {
+    REALLOC_OR_RET1(src.block_coffs, src.n_blocks + ALLOC_CHUNK_SIZE, uint64_t);
+    REALLOC_OR_RET1(src.block_uoffs, src.n_blocks + ALLOC_CHUNK_SIZE, uint64_t);
+  }
+  src.block_coffs[src.n_blocks] = coff;
+  src.block_uoffs[src.n_blocks] = uoff;
+  src.n_blocks++;
+  return 0;
+}
+
+/* The .gzi index lists every block except the first. */
+static int read_gzi(const char *gzi_path) {
+  FILE *gzi = fopen(gzi_path, "rb");
+  if (gzi == NULL) return 1;
+  unsigned char buf[16];
+  int bad = 0;
+  if (fread(buf, 1, 8, gzi) != 8 || add_block(0, 0)) {
+    bad = 1;
+  } else {
+    const uint64_t n = read_le(buf, 8);
+    for (uint64_t i = 0; i < n; i++) {
+      if (fread(buf, 1, 16, gzi) != 16 || add_block(read_le(buf, 8), read_le(buf + 8, 8))) {
+        bad = 1;
+        break;
+      }
+    }
+  }
+  fclose(gzi);
+  if (bad) {
+    if (args.v) fprintf(stderr, "Warning: Failed to read \"%s\", ignoring it.\n", gzi_path);
+    src.n_blocks = 0;
+    return 1;
+  }
+  return 0;
+}
+
+static void scan_bgzf_blocks(void) {
+  unsigned char h[BGZF_HEADER_SIZE];
+  uint64_t coff = 0, uoff = 0;
+  for (;;) {
+    const ssize_t n = pread(src.fd, h, BGZF_HEADER_SIZE, coff);
+    if (n == 0) break;
+    if (n != BGZF_HEADER_SIZE || !is_bgzf_header(h)) {
+      badexit("Error: Failed to parse BGZF block header.");
+    }
+    const uint64_t block_size = read_le(h + 16, 2) + 1;
+    if (pread(src.fd, h, 4, coff + block_size - 4) != 4) {
+      badexit("Error: Failed to read BGZF block.");
+    }
+    if (add_block(coff, uoff)) {
+      badexit("Error: Failed to allocate memory for BGZF blocks.");
+    }
+    coff += block_size;
+    uoff += read_le(h, 4);
+  }
+}
+
+static void open_source(const char *fa_path) {
+  if (fa_path[0] == '-' && fa_path[1] == '\0') {
+    load_seqs_into_mem(fa_path);
+    return;
+  }
+  const uint64_t path_size = strlen(fa_path);
+  char *fai_path = malloc(path_size + 5);
+  if (fai_path == NULL) badexit("Error: Failed to allocate memory for index path.");
+  memcpy(fai_path, fa_path, path_size);
+  memcpy(fai_path + path_size, ".fai", 5);
+  src.fd = open(fa_path, O_RDONLY);
+  if (src.fd == -1) {
+    free(fai_path);
+    fprintf(stderr, "Error: Failed to open sequence file \"%s\" [%s]", fa_path, strerror(errno));
+    badexit("");
+  }
+  unsigned char h[BGZF_HEADER_SIZE];
+  const ssize_t h_size = pread(src.fd, h, BGZF_HEADER_SIZE, 0);
+  int built_index = 0;
+  fai_builder_t fb;
+  fai_init(&fb);
+  if (h_size >= 2 && h[0] == 31 && h[1] == 139) {
+    if (h_size != BGZF_HEADER_SIZE || !is_bgzf_header(h)) {
+      free(fai_path);
+      close(src.fd);
+      src.fd = -1;
+      load_seqs_into_mem(fa_path);
+      return;
+    }
+    if (read_fai(fai_path, fa_path)) {
+      /* Stream through the decompressed file to build the index. */
+      gzFile s = gzdopen(dup(src.fd), "r");
+      unsigned char *chunk = malloc(INDEX_CHUNK_SIZE);
+      if (s == NULL || chunk == NULL) {
+        free(fai_path);
+        if (s != NULL) gzclose(s);
+        free(chunk);
+        badexit("Error: Failed to allocate memory for indexing sequences.");
+      }
+      int n;
+      while ((n = gzread(s, chunk, INDEX_CHUNK_SIZE)) > 0) fai_feed(&fb, chunk, n);
+      free(chunk);
+      gzclose(s);
+      if (n < 0 || fai_finish(&fb)) {
+        free(fai_path);
+        close(src.fd);
+        src.fd = -1;
+        load_seqs_into_mem(fa_path);
+        return;
+      }
+      built_index = 1;
+    }
+    memcpy(fai_path + path_size, ".gzi", 5);
+    if (read_gzi(fai_path)) scan_bgzf_blocks();
+    src.type = SRC_BGZF;
+    if (args.v) fprintf(stderr, "Using BGZF random access (%'llu blocks).\n", src.n_blocks);
+  } else {
+    struct stat fa_stat;
+    if (fstat(src.fd, &fa_stat)) {
+      free(fai_path);
+      badexit("Error: Failed to stat sequence file.");
+    }
+    src.map_size = fa_stat.st_size;
+    if (src.map_size) {
+      src.map = mmap(NULL, src.map_size, PROT_READ, MAP_PRIVATE, src.fd, 0);
+      if (src.map == MAP_FAILED) {
+        src.map = NULL;
+      }
+    }
+    if (src.map == NULL) {
+      free(fai_path);
+      close(src.fd);
+      src.fd = -1;
+      load_seqs_into_mem(fa_path);
+      return;
+    }
+    if (read_fai(fai_path, fa_path)) {
+      fai_feed(&fb, src.map, src.map_size);
+      if (fai_finish(&fb)) {
+        munmap(src.map, src.map_size);
+        src.map = NULL;
+        free(fai_path);
+        close(src.fd);
+        src.fd = -1;
+        load_seqs_into_mem(fa_path);
+        return;
+      }
+      built_index = 1;
+    }
+    for (uint64_t i = 0; i < seq_info.n; i++) {
+      const seq_t *seq = &seqs[i];
+      if (seq->size && (seq->offset +
+            ((seq->size - 1) / seq->line_bases) * seq->line_width +
+            (seq->size - 1) % seq->line_bases) >= src.map_size) {
+        free(fai_path);
+        fprintf(stderr, "Error: Index does not match input (sequence %s).", seq->name);
+        badexit("");
+      }
+    }
+    madvise(src.map, src.map_size, MADV_RANDOM);
+    src.type = SRC_MMAP;
+    if (args.v) fprintf(stderr, "Using memory-mapped random access.\n");
+  }
+  if (built_index) {
+    if (args.v) fprintf(stderr, "Built index for %'llu sequence(s).\n", seq_info.n);
+    if (args.save_index) {
+      memcpy(fai_path + path_size, ".fai", 5);
+      write_fai(fai_path);
+    }
+  }
+  free(fai_path);
+}
+
+static int add_range(ranges_t *r, const uint64_t seq_i, const uint64_t start, const uint64_t end, const char strand, char *name) {
+  if (r->n == r->n_alloc) {
+    const uint64_t n_alloc = r->n_alloc + ALLOC_CHUNK_SIZE;
+    REALLOC_OR_RET1(r->seq_indices, n_alloc, uint64_t);
+    REALLOC_OR_RET1(r->starts, n_alloc, uint64_t);
+    REALLOC_OR_RET1(r->ends, n_alloc, uint64_t);
+    REALLOC_OR_RET1(r->strands, n_alloc, char);
+    REALLOC_OR_RET1(r->names, n_alloc, char *);
+    r->n_alloc = n_alloc;
+  }
+  r->seq_indices[r->n] = seq_i;
+  r->starts[r->n] = start;
+  r->ends[r->n] = end;
+  r->strands[r->n] = strand;
+  r->names[r->n] = name;
+  r->n++;
+  return 0;
+}
+
+static void read_bed(gzFile bed, ranges_t *r, const int keep_names, const char *what) {
+  kstream_t *kbed = ks_init(bed);
+  kstring_t line = { 0, 0, 0 };
+  char field[FIELD_MAX_CHAR];
+  uint64_t line_num = 0, start, end, trimmed = 0;
+  int ret_val;
+  khint64_t k;
+  while ((ret_val = ks_getuntil(kbed, '\n', &line, 0)) >= 0) {
+    line_num++;
+    if (!line.l || line.s[0] == '#' ||
+        (line.l >= 7 && !strncmp(line.s, "browser", 7)) ||
+        (line.l >= 5 && !strncmp(line.s, "track", 5))) {
+      continue;
+    }
+    const uint64_t n_fields = count_fields(line.s);
+    if (n_fields < 3) {
+      ks_destroy(kbed);
+      free(line.s);
+      fprintf(stderr, "Error: Line %'llu in %s has fewer than 3 tab-separated fields.",
+        line_num, what);
+      badexit("");
+    }
+    uint64_t field_size = extract_field(line.s, 1, field);
+    if (!field_size || field_size >= FIELD_MAX_CHAR) {
+      ks_destroy(kbed);
+      free(line.s);
+      fprintf(stderr, "Error: Line %'llu in %s has a bad sequence name.", line_num, what);
+      badexit("");
+    }
+    k = kh_get(seq_str_h, seq_hash_tab, field);
+    if (k == kh_end(seq_hash_tab)) {
+      ks_destroy(kbed);
+      free(line.s);
+      fprintf(stderr, "Error: Line %'llu in %s has a sequence name not in input sequences (%s).",
+        line_num, what, field);
+      badexit("");
+    }
+    const uint64_t seq_i = kh_val(seq_hash_tab, k);
+    if (!extract_field(line.s, 2, field) || str_to_uint64_t(field, &start) ||
+        !extract_field(line.s, 3, field) || str_to_uint64_t(field, &end)) {
+      ks_destroy(kbed);
+      free(line.s);
+      fprintf(stderr, "Error: Failed to parse start/end values on line %'llu in %s.",
+        line_num, what);
+      badexit("");
+    }
+    if (start >= end) {
+      ks_destroy(kbed);
+      free(line.s);
+      fprintf(stderr, "Error: Line %'llu in %s has a start >= end value.", line_num, what);
+      badexit("");
+    }
+    if (start >= seqs[seq_i].size) {
+      ks_destroy(kbed);
+      free(line.s);
+      fprintf(stderr, "Error: Line %'llu in %s is out of bounds on sequence %s.\n",
+        line_num, what, seqs[seq_i].name);
+      fprintf(stderr, "    Bed range = %'llu-%'llu\n", start + 1, end);
+      fprintf(stderr, "    Sequence size = %'llu", seqs[seq_i].size);
+      badexit("");
+    } else if (end > seqs[seq_i].size) {
+      if (args.w) {
+        fprintf(stderr, "Warning: Trimming line %'llu in %s on sequence %s.\n",
+          line_num, what, seqs[seq_i].name);
+      }
+      end = seqs[seq_i].size;
+      trimmed++;
+    }
+    char strand = '.';
+    if (n_fields >= 6) {
+      if (extract_field(line.s, 6, field) != 1 ||
+          (field[0] != '+' && field[0] != '-' && field[0] != '.')) {
+        ks_destroy(kbed);
+        free(line.s);
+        fprintf(stderr, "Error: Line %'llu in %s has an incorrect strand (need +/-/.).",
+          line_num, what);
+        badexit("");
+      }
+      strand = field[0];
+    }
+    char *name = NULL;
+    if (keep_names && n_fields >= 4 && (field_size = extract_field(line.s, 4, field)) &&
+        field_size < FIELD_MAX_CHAR) {
+      name = strdup(field);
+      if (name == NULL) {
+        ks_destroy(kbed);
+        free(line.s);
+        badexit("Error: Failed to allocate memory for range names.");
+      }
+    }
+    if (add_range(r, seq_i, start, end, strand, name)) {
+      ks_destroy(kbed);
+      free(line.s);
+      free(name);
+      badexit("Error: Failed to allocate memory for ranges.");
+    }
+  }
+  ks_destroy(kbed);
+  free(line.s);
+  if (ret_val == -3) {
+    fprintf(stderr, "Error: Failed to read %s.", what);
+    badexit("");
+  }
+  if (trimmed && args.v) {
+    fprintf(stderr, "Warning: Trimmed %'llu out of bounds range(s) in %s.\n", trimmed, what);
+  }
+  if (args.v) fprintf(stderr, "Read %'llu range(s) from %s.\n", r->n, what);
+}
+
+static uint64_t *mask_sort_order;
+
+static int compare_masks(const void *a, const void *b) {
+  const uint64_t a_i = *((const uint64_t *) a), b_i = *((const uint64_t *) b);
+  if (masks.seq_indices[a_i] != masks.seq_indices[b_i]) {
+    return masks.seq_indices[a_i] < masks.seq_indices[b_i] ? -1 : 1;
+  } else if (masks.starts[a_i] != masks.starts[b_i]) {
+    return masks.starts[a_i] < masks.starts[b_i] ? -1 : 1;
+  }
+  return 0;
+}
+
+/* Sort and merge mask ranges, then record where each sequence's masks are. */
+static void index_masks(void) {
+  mask_sort_order = malloc(sizeof(uint64_t) * masks.n);
+  uint64_t *seq_indices = malloc(sizeof(uint64_t) * masks.n);
+  uint64_t *starts = malloc(sizeof(uint64_t) * masks.n);
+  uint64_t *ends = malloc(sizeof(uint64_t) * masks.n);
+  mask_firsts = calloc(seq_info.n, sizeof(uint64_t));
+  mask_counts = calloc(seq_info.n, sizeof(uint64_t));
+  if (mask_sort_order == NULL || seq_indices == NULL || starts == NULL ||
+      ends == NULL || mask_firsts == NULL || mask_counts == NULL) {
+    free(mask_sort_order);
+    free(seq_indices);
+    free(starts);
+    free(ends);
+    badexit("Error: Failed to allocate memory for mask ranges.");
+  }
+  for (uint64_t i = 0; i < masks.n; i++) mask_sort_order[i] = i;
+  qsort(mask_sort_order, masks.n, sizeof(uint64_t), compare_masks);
+  uint64_t n = 0;
+  for (uint64_t j = 0; j < masks.n; j++) {
+    const uint64_t i = mask_sort_order[j];
+    if (n && seq_indices[n - 1] == masks.seq_indices[i] && masks.starts[i] <= ends[n - 1]) {
+      ends[n - 1] = MAX(ends[n - 1], masks.ends[i]);
+    } else {
+      seq_indices[n] = masks.seq_indices[i];
+      starts[n] = masks.starts[i];
+      ends[n] = masks.ends[i];
+      if (!mask_counts[seq_indices[n]]) mask_firsts[seq_indices[n]] = n;
+      mask_counts[seq_indices[n]]++;
+      n++;
+    }
+  }
+  free(mask_sort_order);
+  free(masks.seq_indices);
+  free(masks.starts);
+  free(masks.ends);
+  masks.seq_indices = seq_indices;
+  masks.starts = starts;
+  masks.ends = ends;
+  if (args.v && n != masks.n) {
+    fprintf(stderr, "Merged mask ranges into %'llu non-overlapping range(s).\n", n);
+  }
+  for (uint64_t i = n; i < masks.n; i++) {
+    free(masks.names[i]);
+    masks.names[i] = NULL;
+  }
+  masks.n = n;
+}
+
+static inline uint64_t file_offset(const seq_t *seq, const uint64_t pos) {
+  return seq->offset + (pos / seq->line_bases) * seq->line_width + pos % seq->line_bases;
+}
+
+static int ensure_buf(unsigned char **buf, uint64_t *buf_alloc, const uint64_t size) {
+  if (size > *buf_alloc) {
+    unsigned char *tmp = realloc(*buf, size);
+    if (tmp == NULL) return 1;
+    *buf = tmp;
+    *buf_alloc = size;
+  }
+  return 0;
+}
+
+static int load_bgzf_block(thread_buf_t *tb, const uint64_t block_i) {
+  if (tb->ublock_i == block_i) return 0;
+  const uint64_t coff = src.block_coffs[block_i];
+  if (pread(src.fd, tb->cblock, BGZF_HEADER_SIZE, coff) != BGZF_HEADER_SIZE ||
+      !is_bgzf_header(tb->cblock)) {
+    return 1;
+  }
+  const uint64_t block_size = read_le(tb->cblock + 16, 2) + 1;
+  if (block_size <= BGZF_HEADER_SIZE + BGZF_FOOTER_SIZE ||
+      pread(src.fd, tb->cblock, block_size, coff) != block_size) {
+    return 1;
+  }
+  if (inflateReset(&tb->zs) != Z_OK) return 1;
+  tb->zs.next_in = tb->cblock + BGZF_HEADER_SIZE;
+  tb->zs.avail_in = block_size - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE;
+  tb->zs.next_out = tb->ublock;
+  tb->zs.avail_out = BGZF_MAX_BLOCK_SIZE;
+  if (inflate(&tb->zs, Z_FINISH) != Z_STREAM_END) return 1;
+  tb->ublock_size = BGZF_MAX_BLOCK_SIZE - tb->zs.avail_out;
+  tb->ublock_i = block_i;
+  return 0;
+}
+
+/* Copy the decompressed bytes [start, end) into tb->raw. */
+static int read_bgzf_bytes(thread_buf_t *tb, const uint64_t start, const uint64_t end) {
+  if (ensure_buf(&tb->raw, &tb->raw_alloc, end - start)) return 1;
+  uint64_t lo = 0, hi = src.n_blocks - 1;
+  while (lo < hi) {
+    const uint64_t mid = lo + (hi - lo + 1) / 2;
+    if (src.block_uoffs[mid] <= start) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  uint64_t pos = start;
+  for (uint64_t block_i = lo; pos < end && block_i < src.n_blocks; block_i++) {
+    if (load_bgzf_block(tb, block_i)) return 1;
+    const uint64_t uoff = src.block_uoffs[block_i];
+    if (pos >= uoff + tb->ublock_size) continue;
+    const uint64_t n = MIN(end, uoff + tb->ublock_size) - pos;
+    memcpy(tb->raw + (pos - start), tb->ublock + (pos - uoff), n);
+    pos += n;
+  }
+  return pos != end;
+}
+
+static inline uint64_t copy_without_newlines(unsigned char *dst, const unsigned char *raw, const uint64_t raw_size) {
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < raw_size; i++) {
+    if (raw[i] != '\n' && raw[i] != '\r') dst[n++] = raw[i];
+  }
+  return n;
+}
+
+static inline void apply_masks(unsigned char *seq, const uint64_t seq_i, const uint64_t start, const uint64_t end) {
+  const uint64_t first = mask_firsts[seq_i], last = first + mask_counts[seq_i];
+  uint64_t lo = first, hi = last;
+  while (lo < hi) {
+    const uint64_t mid = lo + (hi - lo) / 2;
+    if (masks.ends[mid] <= start) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  for (uint64_t i = lo; i < last && masks.starts[i] < end; i++) {
+    const uint64_t m_start = MAX(masks.starts[i], start) - start;
+    const uint64_t m_end = MIN(masks.ends[i], end) - start;
+    if (args.soft_mask) {
+      for (uint64_t j = m_start; j < m_end; j++) {
+        if (seq[j] >= 'A' && seq[j] <= 'Z') seq[j] += 32;
+      }
+    } else {
+      memset(seq + m_start, 'N', m_end - m_start);
+    }
+  }
+}
+
+static inline int overlaps_mask(const uint64_t seq_i, const uint64_t start, const uint64_t end) {
+  const uint64_t first = mask_firsts[seq_i], last = first + mask_counts[seq_i];
+  uint64_t lo = first, hi = last;
+  while (lo < hi) {
+    const uint64_t mid = lo + (hi - lo) / 2;
+    if (masks.ends[mid] <= start) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo < last && masks.starts[lo] < end;
+}
+
+static int fill_slot(const uint64_t range_i, slot_t *slot, thread_buf_t *tb) {
+  const uint64_t seq_i = ranges.seq_indices[range_i];
+  const uint64_t start = ranges.starts[range_i], end = ranges.ends[range_i];
+  const uint64_t size = end - start;
+  const seq_t *seq = &seqs[seq_i];
+  const int do_rc = args.use_strand && ranges.strands[range_i] == '-';
+  const int do_mask = masks.n && mask_counts[seq_i] && overlaps_mask(seq_i, start, end);
+  const int must_copy = do_rc || do_mask || args.uppercase;
+  slot->size = size;
+  if (!size) {
+    slot->ptr = (const unsigned char *) "";
+    return 0;
+  }
+  switch (src.type) {
+    case SRC_MEM:
+      slot->ptr = seq->seq + start;
+      break;
+    case SRC_MMAP:
+      if (start / seq->line_bases == (end - 1) / seq->line_bases) {
+        slot->ptr = src.map + file_offset(seq, start);
+      } else {
+        const uint64_t raw_start = file_offset(seq, start);
+        const uint64_t raw_end = file_offset(seq, end - 1) + 1;
+        if (ensure_buf(&slot->buf, &slot->buf_alloc, raw_end - raw_start)) return 1;
+        if (copy_without_newlines(slot->buf, src.map + raw_start, raw_end - raw_start) != size) {
+          return 1;
+        }
+        slot->ptr = slot->buf;
+      }
+      break;
+    case SRC_BGZF: {
+      const uint64_t raw_start = file_offset(seq, start);
+      const uint64_t raw_end = file_offset(seq, end - 1) + 1;
+      if (read_bgzf_bytes(tb, raw_start, raw_end)) return 1;
+      if (ensure_buf(&slot->buf, &slot->buf_alloc, raw_end - raw_start)) return 1;
+      if (copy_without_newlines(slot->buf, tb->raw, raw_end - raw_start) != size) return 1;
+      slot->ptr = slot->buf;
+      break;
+    }
+  }
+  if (!must_copy) return 0;
+  if (slot->ptr != slot->buf) {
+    if (ensure_buf(&slot->buf, &slot->buf_alloc, size)) return 1;
+    memcpy(slot->buf, slot->ptr, size);
+    slot->ptr = slot->buf;
+  }
+  unsigned char *buf = slot->buf;
+  if (args.uppercase) {
+    for (uint64_t i = 0; i < size; i++) {
+      if (buf[i] >= 'a' && buf[i] <= 'z') buf[i] -= 32;
+    }
+  }
+  if (do_mask) apply_masks(buf, seq_i, start, end);
+  if (do_rc) {
+    for (uint64_t i = 0, j = size - 1; i < j; i++, j--) {
+      const unsigned char tmp = char2comp[buf[i]];
+      buf[i] = char2comp[buf[j]];
+      buf[j] = tmp;
+    }
+    if (size % 2) buf[size / 2] = char2comp[buf[size / 2]];
+  }
+  return 0;
+}
+
+static void *fill_sub_process(void *thread_i) {
+  const uint64_t t = *((uint64_t *) thread_i);
+  const uint64_t chunk = (batch.n + args.nthreads - 1) / args.nthreads;
+  const uint64_t first = t * chunk, last = MIN(batch.n, first + chunk);
+  thread_buf_t *tb = &thread_bufs[t];
+  for (uint64_t i = first; i < last; i++) {
+    if (fill_slot(batch.first + i, &slots[i], tb)) {
+      tb->failed = 1;
+      break;
+    }
+  }
+  free(thread_i);
+  return NULL;
+}
+
+static void write_slot(const uint64_t range_i, const slot_t *slot) {
+  const uint64_t seq_i = ranges.seq_indices[range_i];
+  if (ranges.names[range_i] != NULL) {
+    fprintf(files.o, ">%s\n", ranges.names[range_i]);
+  } else if (args.use_strand && ranges.strands[range_i] != '.') {
+    fprintf(files.o, ">%s:%llu-%llu(%c)\n", seqs[seq_i].name,
+      ranges.starts[range_i], ranges.ends[range_i], ranges.strands[range_i]);
+  } else {
+    fprintf(files.o, ">%s:%llu-%llu\n", seqs[seq_i].name,
+      ranges.starts[range_i], ranges.ends[range_i]);
+  }
+  if (!args.line_len) {
+    fwrite(slot->ptr, 1, slot->size, files.o);
+    fputc('\n', files.o);
+  } else {
+    for (uint64_t i = 0; i < slot->size; i += args.line_len) {
+      fwrite(slot->ptr + i, 1, MIN(args.line_len, slot->size - i), files.o);
+      fputc('\n', files.o);
+    }
+  }
+}
+
+static void init_thread_bufs(void) {
+  threads = malloc(sizeof(pthread_t) * args.nthreads);
+  thread_bufs = calloc(args.nthreads, sizeof(thread_buf_t));
+  if (threads == NULL || thread_bufs == NULL) {
+    badexit("Error: Failed to allocate memory for threads.");
+  }
+  for (int t = 0; t < args.nthreads; t++) {
+    thread_bufs[t].ublock_i = -1;
+    if (src.type == SRC_BGZF) {
+      thread_bufs[t].cblock = malloc(BGZF_MAX_BLOCK_SIZE);
+      thread_bufs[t].ublock = malloc(BGZF_MAX_BLOCK_SIZE);
+      if (thread_bufs[t].cblock == NULL || thread_bufs[t].ublock == NULL ||
+          inflateInit2(&thread_bufs[t].zs, -15) != Z_OK) {
+        badexit("Error: Failed to allocate memory for BGZF decompression.");
+      }
+      thread_bufs[t].zs_open = 1;
+    }
+  }
+}
+
+static uint64_t process_ranges(void) {
+  uint64_t n_bases = 0;
+  slots = calloc(MIN(BATCH_MAX_RANGES, ranges.n), sizeof(slot_t));
+  if (slots == NULL) badexit("Error: Failed to allocate memory for output.");
+  slots_n_alloc = MIN(BATCH_MAX_RANGES, ranges.n);
+  batch.first = 0;
+  while (batch.first < ranges.n) {
+    uint64_t batch_bases = 0;
+    batch.n = 0;
+    while (batch.first + batch.n < ranges.n && batch.n < BATCH_MAX_RANGES &&
+        (!batch.n || batch_bases < BATCH_MAX_BASES)) {
+      const uint64_t i = batch.first + batch.n;
+      batch_bases += ranges.ends[i] - ranges.starts[i];
+      batch.n++;
+    }
+    if (args.w) {
+      fprintf(stderr, "    Processing ranges #%'llu-%'llu\n",
+        batch.first + 1, batch.first + batch.n);
+    }
+    for (uint64_t t = 0; t < args.nthreads; t++) {
+      uint64_t *thread_i = malloc(sizeof(uint64_t));
+      if (thread_i == NULL) badexit("Error: Failed to allocate memory for thread index.");
+      *thread_i = t;
+      pthread_create(&threads[t], NULL, fill_sub_process, thread_i);
+    }
+    for (uint64_t t = 0; t < args.nthreads; t++) {
+      pthread_join(threads[t], NULL);
+    }
+    for (uint64_t t = 0; t < args.nthreads; t++) {
+      if (thread_bufs[t].failed) badexit("Error: Failed to read sequence ranges.");
+    }
+    for (uint64_t i = 0; i < batch.n; i++) {
+      write_slot(batch.first + i, &slots[i]);
+    }
+    batch.first += batch.n;
+    n_bases += batch_bases;
+  }
+  return n_bases;
+}
+
+int main(int argc, char **argv) {
+
+  int opt, use_stdout = 1, has_seqs = 0;
+  char *fa_path = NULL;
+
+  while ((opt = getopt(argc, argv, "i:b:x:Sfnl:uIo:j:vwh")) != -1) {
+    switch (opt) {
+      case 'i':
+        has_seqs = 1;
+        fa_path = optarg;
+        break;
+      case 'b':
+        files.b = gzopen(optarg, "r");
+        if (files.b == NULL) {
+          fprintf(stderr, "Error: Failed to open bed file \"%s\" [%s]", optarg, strerror(errno));
+          badexit("");
+        }
+        files.b_open = 1;
+        break;
+      case 'x':
+        files.x = gzopen(optarg, "r");
+        if (files.x == NULL) {
+          fprintf(stderr, "Error: Failed to open mask file \"%s\" [%s]", optarg, strerror(errno));
+          badexit("");
+        }
+        files.x_open = 1;
+        break;
+      case 'S':
+        args.soft_mask = 1;
+        break;
+      case 'f':
+        args.use_strand = 0;
+        break;
+      case 'n':
+        args.use_names = 1;
+        break;
+      case 'l':
+        if (str_to_uint64_t(optarg, &args.line_len)) {
+          badexit("Error: Failed to parse -l value.");
+        }
+        break;
+      case 'u':
+        args.uppercase = 1;
+        break;
+      case 'I':
+        args.save_index = 1;
+        break;
+      case 'o':
+        use_stdout = 0;
+        files.o = fopen(optarg, "w");
+        if (files.o == NULL) {
+          fprintf(stderr, "Error: Failed to create output file \"%s\" [%s]", optarg, strerror(errno));
+          badexit("");
+        }
+        files.o_open = 1;
+        break;
+      case 'j':
+        if (str_to_int(optarg, &args.nthreads)) {
+          badexit("Error: Failed to parse -j value.");
+        }
+        if (args.nthreads < 1) {
+          badexit("Error: -j must be a positive integer.");
+        }
+        break;
+      case 'w':
+        args.w = 1;
+      case 'v':
+        args.v = 1;
+        break;
+      case 'h':
+        usage();
+        return EXIT_SUCCESS;
+      default:
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (setlocale(LC_NUMERIC, "en_US") == NULL && args.v) {
+    fprintf(stderr, "Warning: setlocale(LC_NUMERIC, \"en_US\") failed.\n");
+  }
+
+  if (!has_seqs) {
+    badexit("Error: Missing -i arg.");
+  }
+  if (args.soft_mask && !files.x_open) {
+    badexit("Error: -S requires -x.");
+  }
+
+  if (use_stdout) {
+    files.o = stdout;
+    files.o_open = 1;
+  }
+
+  time_t time1 = time(NULL);
+  open_source(fa_path);
+  if (!seq_info.n) {
+    badexit("Error: Failed to read any sequences from input.");
+  }
+  hash_seq_names();
+  if (args.v) fprintf(stderr, "Found %'llu sequence(s).\n", seq_info.n);
+
+  if (files.b_open) {
+    read_bed(files.b, &ranges, args.use_names, "bed file");
+  } else {
+    for (uint64_t i = 0; i < seq_info.n; i++) {
+      char *name = strdup(seqs[i].name);
+      if (name == NULL || add_range(&ranges, i, 0, seqs[i].size, '.', name)) {
+        free(name);
+        badexit("Error: Failed to allocate memory for ranges.");
+      }
+    }
+  }
+  if (files.x_open) {
+    read_bed(files.x, &masks, 0, "mask file");
+    if (masks.n) index_masks();
+  }
+
+  init_thread_bufs();
+
+  if (args.v) fprintf(stderr, "Writing sequences ...\n");
+  const uint64_t n_bases = process_ranges();
+
+  time_t time2 = time(NULL);
+  if (args.v) {
+    fprintf(stderr, "Wrote %'llu sequence(s) (%'llu bases).\n", ranges.n, n_bases);
+    time_t time3 = difftime(time2, time1);
+    print_time((uint64_t) time3, "process sequences");
+    print_peak_mb();
+  }
+
+  free(threads);
+  free_thread_bufs();
+  free_slots();
+  free_ranges(&ranges);
+  free_ranges(&masks);
+  free(mask_firsts);
+  free(mask_counts);
+  free_seqs();
+  close_source();
+  close_files();
+
+  return EXIT_SUCCESS;
+
+}
@@ -57,6 +57,7 @@
  * - this would lead to an incorrect number of each k-mer afterwards though..
  */
 
+#define _GNU_SOURCE  /* fopencookie(), see zout.h */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -69,13 +70,21 @@
 #include <stdint.h>
 #include <zlib.h>
 #include "kseq.h"
+#include "twobit.h"
+#include "zout.h"
 
 KSEQ_INIT(gzFile, gzread)
 
-#define YAMSHUF_VERSION             "1.3"
-#define YAMSHUF_YEAR                 2023
+#define YAMSHUF_VERSION             "1.4"
+#define YAMSHUF_YEAR                 2026
 
 /* ChangeLog
+ *
+ * v1.4 (October 2026)
+ * - Read .2bit files directly via -i
+ * - Fix Euler shuffling never finishing for some sequences; this changes the
+ *   output of Euler shuffling for a given seed (-s)
+ * - Compress the output as BGZF (-z) or zstd (-Z) on dedicated threads (-T)
  *
  * v1.3 (20 Nov 2023)
  * - Reduce branching for Euler/Markov shuffling, slight speed ups
@@ -196,10 +205,18 @@ static void usage(void) {
     "            to scan. Can be gzipped. Use '-' for stdin.  Non-standard         \n"
     "            characters (i.e. other than ACGTU) will be read but are treated as\n"
     "            the letter N during shuffling (exceptions: when -l is used or when\n"
-    "            -k is set to 1). Fastq files will be output as fasta.             \n"
+    "            -k is set to 1). Fastq files will be output as fasta. Files ending\n"
+    "            in .2bit are read directly.                                       \n"
     " -k <int>   Size of shuffled k-mers. Default: %d. When k = 1 a Fisher-Yates    \n"
     "            shuffle is performed. Max k for Euler/Markov methods: %d.        \n"
     " -o <str>   Filename to output results. By default output goes to stdout.     \n"
+    " -z <int>   Compress the output as BGZF at this level (1-9), using dedicated  \n"
+    "            threads (see -T). The output can be read like any gzip file, and  \n"
+    "            is compatible with bgzip and tabix.                               \n"
+    " -Z <int>   Compress the output with zstd at this level (1-19). Only available\n"
+    "            if yamshuf was built with make ZSTD=1.                            \n"
+    " -T <int>   Number of threads used to compress the output with -z or -Z.      \n"
+    "            Default: 1.                                                       \n"
     " -s <int>   Seed to initialize random number generator. Default: %d.           \n"
     " -m         Use Markov shuffling instead of performing a random Eulerian walk.\n"
     "            Essentially generates random sequences with similar k-mer         \n"
@@ -238,7 +255,11 @@ typedef struct args_t {
   int      v : 1;
   int      w : 1;
   int      print_kmers : 1;
+  int      use_twobit : 1;
   int      shuf_repeats;
+  int      compress;
+  int      compress_level;
+  int      compress_threads;
   uint64_t window_step;
   uint64_t window_overlap;
 } args_t;
@@ -254,7 +275,11 @@ static args_t args = {
   .v              = 0,
   .w              = 0,
   .print_kmers    = 0,
+  .use_twobit     = 0,
   .shuf_repeats   = 0,
+  .compress       = 0,
+  .compress_level = 0,
+  .compress_threads = 1,
   .window_step    = 0,
   .window_overlap = 0
 };
@@ -271,8 +296,11 @@ static files_t files = {
   .o_open = 0
 };
 
+static twobit_t twobit;
+
 void close_files(void) {
   if (files.s_open) gzclose(files.s);
+  if (args.use_twobit) twobit_close(&twobit);
   if (files.o_open) fclose(files.o);
 }
 
@@ -431,17 +459,11 @@ static int shuffle_euler(unsigned char *seq, const uint64_t size, const uint64_t
 
   const char *index2xna = is_dna ? index2dna : index2rna;
 
-  // Initialize new sequence with starting vertex and final edge.
+  // Initialize new sequence with starting vertex.
 
   for (uint64_t i = 0; i < k - 1; i++) {
     seq[i] = index2xna[char2index[seq[i]]];
   }
-  seq[size - 1] = index2xna[char2index[seq[size - 1]]];
-
-  // Remove the final edge from the edge pool.
-
-  uint64_t last_edge = chars2kmer(seq, k, size - k);
-  kmer_tab[last_edge]--;
 
   // Initialize unavailable vertices.
 
@@ -449,9 +471,11 @@ static int shuffle_euler(unsigned char *seq, const uint64_t size, const uint64_t
     if (!(COUNT_EDGES(j, kmer_tab))) invalid_vertex[i] = 1;
   }
 
-  // Reserve the final vertex.
+  // Reserve the final vertex, where the path has to end. It is the root of
+  // the tree of last exits, and every other vertex can reach it.
 
-  invalid_vertex[chars2kmer(seq, k - 1, size - k + 1)] = 1;
+  const uint64_t last_vertex = chars2kmer(seq, k - 1, size - k + 1);
+  invalid_vertex[last_vertex] = 1;
 
   // For k > 2, prefill an array containing the indices to the next vertex from an edge.
   // (For k = 2, it is just 0 as the edge is already the correct index.)
@@ -480,14 +504,13 @@ static int shuffle_euler(unsigned char *seq, const uint64_t size, const uint64_t
 
   // Remove reserved edges from pool.
 
-  for (uint64_t i = 0, edge; i < pow5[k - 1]; i++) {
-    edge = i * 5 + euler_path[i];
-    if (edge != last_edge && kmer_tab[edge]) kmer_tab[edge]--;
+  for (uint64_t i = 0, j = 0; i < pow5[k - 1]; i++, j += 5) {
+    if (i != last_vertex && COUNT_EDGES(j, kmer_tab)) kmer_tab[j + euler_path[i]]--;
   }
 
   // Walk through Eulerian path, using up all available edges.
 
-  for (uint64_t current_vertex, next_edge, kmer_index, i = k - 2; i < size - 2; i++) {
+  for (uint64_t current_vertex, next_edge, kmer_index, i = k - 2; i < size - 1; i++) {
     current_vertex = chars2kmer(seq, k - 1, (i + 2) - k);
     kmer_index = current_vertex * 5;
     if (LIKELY(COUNT_EDGES(kmer_index, kmer_tab))) {
@@ -548,17 +571,60 @@ static void print_kmer_table_header(const uint64_t k, const int is_dna) {
   fputc('\n', files.o);
 }
 
+/* Decode the next .2bit record into kseq, so it can be used in place of
+ * kseq_read. Returns -1 once all records have been read.
+ */
+static int read_twobit_seq(kseq_t *kseq) {
+  static uint64_t seq_i = 0;
+  if (seq_i == twobit.n) return -1;
+  const uint64_t size = twobit.seqs[seq_i].size;
+  const uint64_t name_size = strlen(twobit.seqs[seq_i].name);
+  if (kseq->seq.m < size + 1) {
+    char *tmp_ptr = realloc(kseq->seq.s, size + 1);
+    if (tmp_ptr == NULL) {
+      badexit("Error: Failed to allocate memory for sequence.");
+    }
+    kseq->seq.s = tmp_ptr;
+    kseq->seq.m = size + 1;
+  }
+  if (kseq->name.m < name_size + 1) {
+    char *tmp_ptr = realloc(kseq->name.s, name_size + 1);
+    if (tmp_ptr == NULL) {
+      badexit("Error: Failed to allocate memory for sequence name.");
+    }
+    kseq->name.s = tmp_ptr;
+    kseq->name.m = name_size + 1;
+  }
+  twobit_decode(&twobit, seq_i, 0, size, (unsigned char *) kseq->seq.s);
+  kseq->seq.s[size] = '\0';
+  kseq->seq.l = size;
+  memcpy(kseq->name.s, twobit.seqs[seq_i].name, name_size + 1);
+  kseq->name.l = name_size;
+  kseq->comment.l = 0;
+  seq_i++;
+  return size > INT_MAX ? INT_MAX : (int) size;
+}
+
 int main(int argc, char **argv) {
 
   kseq_t *kseq;
   int opt;
   int use_stdout = 1;
 
-  while ((opt = getopt(argc, argv, "i:k:o:s:mlr:Rnpvwh")) != -1) {
+  while ((opt = getopt(argc, argv, "i:k:o:z:Z:T:s:mlr:Rnpvwh")) != -1) {
     switch (opt) {
       case 'i':
         if (optarg[0] == '-' && optarg[1] == '\0') {
           files.s = gzdopen(fileno(stdin), "r");
+        } else if (twobit_is_path(optarg)) {
+          errno = 0;
+          if (twobit_open(&twobit, optarg)) {
+            fprintf(stderr, "Error: Failed to open sequence file \"%s\" [%s]",
+              optarg, errno ? strerror(errno) : twobit.err);
+            badexit("");
+          }
+          args.use_twobit = 1;
+          break;
         } else {
           files.s = gzopen(optarg, "r");
           if (files.s == NULL) {
@@ -579,6 +645,27 @@ int main(int argc, char **argv) {
         }
         files.o_open = 1;
         break;
+      case 'z':
+      case 'Z':
+        args.compress = opt == 'z' ? ZOUT_BGZF : ZOUT_ZSTD;
+        if (str_to_int(optarg, &args.compress_level)) {
+          fprintf(stderr, "Error: Failed to parse -%c value.", opt);
+          badexit("");
+        }
+        if (args.compress_level < 1 || args.compress_level > (opt == 'z' ? 9 : 19)) {
+          fprintf(stderr, "Error: -%c must be between 1 and %d.", opt, opt == 'z' ? 9 : 19);
+          badexit("");
+        }
+        break;
+      case 'T':
+        if (str_to_int(optarg, &args.compress_threads)) {
+          badexit("Error: Failed to parse -T value.");
+        }
+        if (args.compress_threads < 1 || args.compress_threads > ZOUT_MAX_THREADS) {
+          fprintf(stderr, "Error: -T must be between 1 and %d.", ZOUT_MAX_THREADS);
+          badexit("");
+        }
+        break;
       case 'k':
         if (str_to_int(optarg, &args.k)) {
           badexit("Error: Failed to parse -k value.");
@@ -681,6 +768,17 @@ int main(int argc, char **argv) {
     files.o_open = 1;
   }
 
+  if (args.compress) {
+    const char *zout_err = NULL;
+    FILE *zout = zout_open(files.o, args.compress, args.compress_level,
+      args.compress_threads, files.o != stdout, NULL, &zout_err);
+    if (zout == NULL) {
+      fprintf(stderr, "Error: Failed to set up output compression [%s].", zout_err);
+      badexit("");
+    }
+    files.o = zout;
+  }
+
   if (args.window_step && !args.window_overlap && !args.print_kmers) {
     args.window_overlap = args.window_step;
   }
@@ -737,7 +835,7 @@ int main(int argc, char **argv) {
 
   int markov_warning_has_been_emitted = 0;
 
-  while ((ret_val = kseq_read(kseq)) >= 0) {
+  while ((ret_val = args.use_twobit ? read_twobit_seq(kseq) : kseq_read(kseq)) >= 0) {
 
     n_seqs++;
     rep_counter = total_reps;
@@ -0,0 +1,365 @@
+/*
+ *   zout.h: Multithreaded BGZF (and zstd) compression of an output stream
+ *   Copyright (C) 2026  Benjamin Jean-Marie Tremblay
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* zout_open() returns a new FILE which can be written to with the usual
+ * stdio functions, and which compresses everything written to it into
+ * another FILE. The text is cut into blocks, which are compressed by a pool
+ * of dedicated threads and written out in order by whichever thread writes
+ * to the FILE. Closing it with fclose() compresses and writes the remaining
+ * text (plus the BGZF EOF marker) and stops the threads.
+ *
+ * BGZF output is a regular gzip file, which can also be read by tabix and
+ * bgzip. zstd output is a series of zstd frames, one per block, and is only
+ * available when compiled with -DYAM_ZSTD (and linked with -lzstd).
+ *
+ * For BGZF, the compressed offset of every block can also be recorded, which
+ * is what tabix indexes need (see tabix.h). Since every block but the last
+ * holds exactly ZOUT_BGZF_BLOCK_SIZE bytes of text, the block of any position
+ * in the text is known without looking at the compressed data.
+ *
+ * The FILE is created with fopencookie() (glibc, so _GNU_SOURCE must be
+ * defined before stdio.h is included) or funopen() (macOS and the BSDs).
+ */
+
+#ifndef ZOUT_H
+#define ZOUT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <zlib.h>
+#ifdef YAM_ZSTD
+#include <zstd.h>
+#endif
+
+#define ZOUT_BGZF                      1
+#define ZOUT_ZSTD                      2
+
+#define ZOUT_MAX_THREADS              64
+
+/* Text per block. BGZF blocks must be at most 64 KiB once compressed. */
+#define ZOUT_BGZF_BLOCK_SIZE     0xff00
+#define ZOUT_BGZF_MAX_BLOCK     0x10000
+#define ZOUT_ZSTD_BLOCK_SIZE   0x100000
+
+/* Blocks in flight per compression thread */
+#define ZOUT_JOBS_PER_THREAD           4
+
+static const unsigned char zout_bgzf_eof[28] = {
+  0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00,
+  0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+typedef struct zout_job_t {
+  unsigned char        *in;
+  size_t                in_size;
+  unsigned char        *out;
+  size_t                out_size;
+  int                   done;
+  int                   failed;
+} zout_job_t;
+
+/* Filled in by the FILE: offsets[i] is where block i starts in the compressed
+ * output. One more offset (the size of the compressed output, without the EOF
+ * marker) is added when closing. in_bytes counts the text written so far,
+ * which is exact after an fflush().
+ */
+typedef struct zout_blocks_t {
+  uint64_t             *offsets;
+  uint64_t              n;
+  uint64_t              n_alloc;
+  uint64_t              in_bytes;
+  uint64_t              out_bytes;
+} zout_blocks_t;
+
+typedef struct zout_t {
+  FILE                 *dest;
+  zout_blocks_t        *blocks;
+  int                   close_dest;
+  int                   fmt;
+  int                   level;
+  size_t                block_size;
+  size_t                out_alloc;
+  uint64_t              n_jobs;
+  zout_job_t           *jobs;
+  uint64_t              head;              /* Oldest block not yet written */
+  uint64_t              tail;              /* Block being filled           */
+  uint64_t              next;              /* Next block for the threads   */
+  int                   quit;
+  int                   failed;
+  int                   n_threads;
+  pthread_t            *threads;
+  pthread_mutex_t       lock;
+  pthread_cond_t        work;
+  pthread_cond_t        done;
+} zout_t;
+
+static inline void zout_put_u16(unsigned char *p, const uint32_t x) {
+  p[0] = x & 0xff; p[1] = (x >> 8) & 0xff;
+}
+
+static inline void zout_put_u32(unsigned char *p, const uint32_t x) {
+  p[0] = x & 0xff; p[1] = (x >> 8) & 0xff; p[2] = (x >> 16) & 0xff; p[3] = (x >> 24) & 0xff;
+}
+
+/* Raw deflate into a block with the BGZF header and footer. Returns the
+ * block size, or 0 if the compressed data does not fit.
+ */
+static inline size_t zout_deflate(unsigned char *in, const size_t in_size, unsigned char *out, const int level) {
+  z_stream zs;
+  memset(&zs, 0, sizeof(z_stream));
+  if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return 0;
+  zs.next_in = in;
+  zs.avail_in = in_size;
+  zs.next_out = out + 18;
+  zs.avail_out = ZOUT_BGZF_MAX_BLOCK - 18 - 8;
+  const int ret = deflate(&zs, Z_FINISH);
+  const size_t size = zs.total_out + 18 + 8;
+  deflateEnd(&zs);
+  if (ret != Z_STREAM_END) return 0;
+  static const unsigned char header[16] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00,
+    0x42, 0x43, 0x02, 0x00
+  };
+  memcpy(out, header, 16);
+  zout_put_u16(out + 16, size - 1);
+  zout_put_u32(out + size - 8, crc32(crc32(0L, Z_NULL, 0), in, in_size));
+  zout_put_u32(out + size - 4, in_size);
+  return size;
+}
+
+static inline void zout_compress(const zout_t *z, zout_job_t *job) {
+  job->out_size = 0;
+  if (z->fmt == ZOUT_BGZF) {
+    job->out_size = zout_deflate(job->in, job->in_size, job->out, z->level);
+    /* Only for incompressible text, which stored blocks always fit */
+    if (!job->out_size) job->out_size = zout_deflate(job->in, job->in_size, job->out, 0);
+  }
+#ifdef YAM_ZSTD
+  if (z->fmt == ZOUT_ZSTD) {
+    const size_t size = ZSTD_compress(job->out, z->out_alloc, job->in, job->in_size, z->level);
+    if (!ZSTD_isError(size)) job->out_size = size;
+  }
+#endif
+  job->failed = !job->out_size;
+}
+
+static void *zout_thread(void *arg) {
+  zout_t *z = (zout_t *) arg;
+  pthread_mutex_lock(&z->lock);
+  for (;;) {
+    while (z->next == z->tail && !z->quit) pthread_cond_wait(&z->work, &z->lock);
+    if (z->next == z->tail) break;
+    zout_job_t *job = &z->jobs[z->next % z->n_jobs];
+    z->next++;
+    pthread_mutex_unlock(&z->lock);
+    zout_compress(z, job);
+    pthread_mutex_lock(&z->lock);
+    job->done = 1;
+    pthread_cond_broadcast(&z->done);
+  }
+  pthread_mutex_unlock(&z->lock);
+  return NULL;
+}
+
+static inline void zout_push_block(zout_t *z, const uint64_t size) {
+  zout_blocks_t *b = z->blocks;
+  if (b->n == b->n_alloc) {
+    uint64_t *offsets = realloc(b->offsets, sizeof(uint64_t) * (b->n_alloc + 1024));
+    if (offsets == NULL) {
+      z->failed = 1;
+      return;
+    }
+    b->offsets = offsets;
+    b->n_alloc += 1024;
+  }
+  b->offsets[b->n++] = b->out_bytes;
+  b->out_bytes += size;
+}
+
+/* Wait for the oldest block to be compressed and write it out */
+static inline void zout_write_head(zout_t *z) {
+  zout_job_t *job = &z->jobs[z->head % z->n_jobs];
+  pthread_mutex_lock(&z->lock);
+  while (!job->done) pthread_cond_wait(&z->done, &z->lock);
+  pthread_mutex_unlock(&z->lock);
+  if (job->failed || fwrite(job->out, 1, job->out_size, z->dest) != job->out_size) {
+    z->failed = 1;
+  }
+  if (z->blocks != NULL) zout_push_block(z, job->out_size);
+  job->done = 0;
+  job->in_size = 0;
+  z->head++;
+}
+
+static inline void zout_submit(zout_t *z) {
+  pthread_mutex_lock(&z->lock);
+  z->tail++;
+  pthread_cond_signal(&z->work);
+  pthread_mutex_unlock(&z->lock);
+  if (z->tail - z->head == z->n_jobs) zout_write_head(z);
+}
+
+static inline size_t zout_write(zout_t *z, const char *buf, const size_t size) {
+  size_t written = 0;
+  if (z->failed) return 0;
+  if (z->blocks != NULL) z->blocks->in_bytes += size;
+  while (written < size) {
+    zout_job_t *job = &z->jobs[z->tail % z->n_jobs];
+    const size_t n = size - written < z->block_size - job->in_size ?
+      size - written : z->block_size - job->in_size;
+    memcpy(job->in + job->in_size, buf + written, n);
+    job->in_size += n;
+    written += n;
+    if (job->in_size == z->block_size) zout_submit(z);
+  }
+  return written;
+}
+
+static inline void zout_free(zout_t *z) {
+  if (z->jobs != NULL) {
+    for (uint64_t i = 0; i < z->n_jobs; i++) {
+      free(z->jobs[i].in);
+      free(z->jobs[i].out);
+    }
+    free(z->jobs);
+  }
+  free(z->threads);
+  pthread_mutex_destroy(&z->lock);
+  pthread_cond_destroy(&z->work);
+  pthread_cond_destroy(&z->done);
+  free(z);
+}
+
+static inline int zout_close(zout_t *z) {
+  if (z->jobs[z->tail % z->n_jobs].in_size) zout_submit(z);
+  while (z->head < z->tail) zout_write_head(z);
+  pthread_mutex_lock(&z->lock);
+  z->quit = 1;
+  pthread_cond_broadcast(&z->work);
+  pthread_mutex_unlock(&z->lock);
+  for (int i = 0; i < z->n_threads; i++) pthread_join(z->threads[i], NULL);
+  if (z->blocks != NULL) zout_push_block(z, 0);
+  if (z->fmt == ZOUT_BGZF && !z->failed &&
+      fwrite(zout_bgzf_eof, 1, sizeof(zout_bgzf_eof), z->dest) != sizeof(zout_bgzf_eof)) {
+    z->failed = 1;
+  }
+  if (fflush(z->dest)) z->failed = 1;
+  if (z->close_dest && fclose(z->dest)) z->failed = 1;
+  const int failed = z->failed;
+  zout_free(z);
+  return failed ? EOF : 0;
+}
+
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+static int zout_cookie_write(void *cookie, const char *buf, int size) {
+  const size_t written = zout_write((zout_t *) cookie, buf, size);
+  return written == size ? (int) written : -1;
+}
+static int zout_cookie_close(void *cookie) {
+  return zout_close((zout_t *) cookie);
+}
+#else
+static ssize_t zout_cookie_write(void *cookie, const char *buf, size_t size) {
+  return zout_write((zout_t *) cookie, buf, size);
+}
+static int zout_cookie_close(void *cookie) {
+  return zout_close((zout_t *) cookie);
+}
+#endif
+
+/* Returns NULL (with *err set) if the format is not available or if memory
+ * or threads could not be allocated. If close_dest is set, dest is closed
+ * along with the returned FILE. blocks can be NULL, and is otherwise filled
+ * in until the FILE is closed (the caller frees blocks->offsets).
+ */
+static inline FILE *zout_open(FILE *dest, const int fmt, const int level, const int n_threads, const int close_dest, zout_blocks_t *blocks, const char **err) {
+#ifndef YAM_ZSTD
+  if (fmt == ZOUT_ZSTD) {
+    *err = "zstd compression is not available (build with make ZSTD=1)";
+    return NULL;
+  }
+#endif
+  zout_t *z = calloc(1, sizeof(zout_t));
+  if (z == NULL) {
+    *err = "failed to allocate memory for output compression";
+    return NULL;
+  }
+  pthread_mutex_init(&z->lock, NULL);
+  pthread_cond_init(&z->work, NULL);
+  pthread_cond_init(&z->done, NULL);
+  z->dest = dest;
+  z->blocks = blocks;
+  z->close_dest = close_dest;
+  z->fmt = fmt;
+  z->level = level;
+  z->n_threads = n_threads;
+  z->n_jobs = ZOUT_JOBS_PER_THREAD * n_threads;
+  if (fmt == ZOUT_BGZF) {
+    z->block_size = ZOUT_BGZF_BLOCK_SIZE;
+    z->out_alloc = ZOUT_BGZF_MAX_BLOCK;
+  }
+#ifdef YAM_ZSTD
+  if (fmt == ZOUT_ZSTD) {
+    z->block_size = ZOUT_ZSTD_BLOCK_SIZE;
+    z->out_alloc = ZSTD_compressBound(ZOUT_ZSTD_BLOCK_SIZE);
+  }
+#endif
+  z->jobs = calloc(z->n_jobs, sizeof(zout_job_t));
+  z->threads = calloc(n_threads, sizeof(pthread_t));
+  if (z->jobs == NULL || z->threads == NULL) goto error_mem;
+  for (uint64_t i = 0; i < z->n_jobs; i++) {
+    z->jobs[i].in = malloc(z->block_size);
+    z->jobs[i].out = malloc(z->out_alloc);
+    if (z->jobs[i].in == NULL || z->jobs[i].out == NULL) goto error_mem;
+  }
+  for (int i = 0; i < n_threads; i++) {
+    if (pthread_create(&z->threads[i], NULL, zout_thread, z)) {
+      z->n_threads = i;
+      z->failed = 1;
+      z->close_dest = 0;
+      zout_close(z);
+      *err = "failed to create output compression threads";
+      return NULL;
+    }
+  }
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+  FILE *f = funopen(z, NULL, zout_cookie_write, NULL, zout_cookie_close);
+#else
+  cookie_io_functions_t io = { NULL, zout_cookie_write, NULL, zout_cookie_close };
+  FILE *f = fopencookie(z, "w", io);
+#endif
+  if (f == NULL) {
+    z->failed = 1;
+    z->close_dest = 0;
+    zout_close(z);
+    *err = "failed to create compressed output stream";
+    return NULL;
+  }
+  return f;
+error_mem:
+  zout_free(z);
+  *err = "failed to allocate memory for output compression";
+  return NULL;
+}
+
+#endif